@@ -0,0 +1,170 @@
+#include "../Engine/Common/JobSystem.h"
+#include "../Engine/Common/Logger.h"
+#include "../Engine/Common/Mesh.h"
+#include "../Engine/Common/SceneAssets.h"
+#include "../Engine/Common/Texture.h"
+#include "../Engine/RHI/Shader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+// Builds the binary caches the engine otherwise writes on its first launch: imported and optimized meshes,
+// decoded textures and SPIR-V. Every cache is keyed by the hash of its sources, shader includes included,
+// so only changed assets are cooked again. Run from the engine directory, like the viewer:
+//
+//     AssetCooker [asset directory]
+
+enum class AssetType
+{
+	Mesh,
+	Texture,
+	Shader,
+};
+
+struct CookJob
+{
+	AssetType type;
+	std::string path;
+	MeshImportOptions options;
+	std::vector<std::string> defines; // shader variant
+};
+
+static const char* typeNames[] = { "mesh", "texture", "shader" };
+
+static bool hasExtension(const std::filesystem::path& path, std::initializer_list<const char*> extensions)
+{
+	std::string extension = path.extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+	for (const char* candidate : extensions)
+		if (extension == candidate)
+			return true;
+
+	return false;
+}
+
+// Scene assets keep the options the scene loads them with, everything else in the asset directories gets the defaults.
+// Paths are made relative to the working directory, like the scene's, so each file is cooked by exactly one job
+static std::vector<CookJob> gatherJobs(const std::filesystem::path& root)
+{
+	std::vector<CookJob> jobs;
+	std::set<std::string> paths;
+
+	auto add = [&jobs, &paths](AssetType type, const std::string& path, const MeshImportOptions& options, const std::vector<std::string>& defines = {})
+	{
+		std::error_code error;
+		std::filesystem::path relativePath = std::filesystem::proximate(path, error);
+		if (error)
+			relativePath = path;
+
+		std::string normalizedPath = relativePath.lexically_normal().generic_string();
+
+		// Only shaders cook several variants of one file
+		std::string key = normalizedPath;
+		if (type == AssetType::Shader)
+			key += "?" + RHI::Shader::getVariantName(defines);
+
+		if (paths.insert(key).second)
+			jobs.push_back({ type, normalizedPath, options, defines });
+	};
+
+	for (size_t i = 0; i < RHI::config::meshes.size(); i++)
+		add(AssetType::Mesh, RHI::config::meshes[i], RHI::config::meshImportOptions[i]);
+
+	for (const char* path : RHI::config::textures)
+		add(AssetType::Texture, path, MeshImportOptions());
+
+	for (const char* path : RHI::config::hdrTextures)
+		add(AssetType::Texture, path, MeshImportOptions());
+
+	for (const RHI::config::ShaderAsset& asset : RHI::config::shaders)
+		add(AssetType::Shader, asset.path, MeshImportOptions(), asset.defines);
+
+	auto scan = [&root, &add](const char* directory, AssetType type, std::initializer_list<const char*> extensions)
+	{
+		std::error_code error;
+		for (const auto& entry : std::filesystem::recursive_directory_iterator(root / directory, error))
+			if (entry.is_regular_file() && hasExtension(entry.path(), extensions))
+				add(type, entry.path().generic_string(), MeshImportOptions());
+	};
+
+	// Shader includes are cooked as part of the shaders using them
+	scan("Model", AssetType::Mesh, { ".fbx", ".obj", ".gltf", ".glb", ".dae" });
+	scan("Texture", AssetType::Texture, { ".jpg", ".jpeg", ".png", ".tga", ".bmp", ".hdr" });
+	scan("Shader", AssetType::Shader, { ".vert", ".frag", ".comp", ".geom", ".tesc", ".tese" });
+
+	return jobs;
+}
+
+static CookResult cook(const CookJob& job)
+{
+	switch (job.type)
+	{
+		case AssetType::Mesh:
+		{
+			Mesh mesh(nullptr);
+			return mesh.cookFromFile(job.path, job.options);
+		}
+
+		case AssetType::Texture:
+		{
+			Texture texture(nullptr);
+			return texture.cookFromFile(job.path);
+		}
+
+		case AssetType::Shader:
+			return RHI::Shader::cookFromFile(job.path.c_str(), job.defines);
+	}
+
+	return CookResult::Failed;
+}
+
+int main(int argc, char** argv)
+{
+	Log::Init();
+
+	std::filesystem::path root = (argc > 1) ? argv[1] : "Assert";
+	if (!std::filesystem::is_directory(root))
+	{
+		std::cerr << "AssetCooker: can't find the asset directory \"" << root.string() << "\"" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::vector<CookJob> jobs = gatherJobs(root);
+
+	std::atomic<uint32_t> numCooked{ 0 };
+	std::atomic<uint32_t> numFailed{ 0 };
+	std::mutex outputMutex;
+
+	// One asset per job, importers and compilers are created per asset so they don't share state
+	JobSystem jobSystem;
+	jobSystem.parallelFor(static_cast<uint32_t>(jobs.size()), [&](uint32_t index, uint32_t /*thread*/)
+	{
+		const CookJob& job = jobs[index];
+		CookResult result = cook(job);
+
+		if (result == CookResult::UpToDate)
+			return;
+
+		std::atomic<uint32_t>& counter = (result == CookResult::Cooked) ? numCooked : numFailed;
+		counter++;
+
+		std::lock_guard<std::mutex> lock(outputMutex);
+		std::cout << ((result == CookResult::Cooked) ? "cooked " : "FAILED ") << typeNames[static_cast<int>(job.type)] << " \"" << job.path << "\"";
+		if (!job.defines.empty())
+			std::cout << " [" << RHI::Shader::getVariantName(job.defines) << "]";
+		std::cout << std::endl;
+	});
+
+	uint32_t numUpToDate = static_cast<uint32_t>(jobs.size()) - numCooked - numFailed;
+	std::cout << numCooked << " cooked, " << numUpToDate << " up to date, " << numFailed << " failed" << std::endl;
+
+	return (numFailed > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -6,6 +6,11 @@
 #include "RHI/VulkanContext.h"
 
 #include "Common/RenderScene.h"
+#include "Common/FrustumCuller.h"
+#include "Common/OcclusionRasterizer.h"
+#include "Common/FileSystem.h"
+#include "Common/FileWatcher.h"
+#include "Common/JobSystem.h"
 
 #include "Vendor/imgui/imgui.h"
 #include "Vendor/imgui/imgui_impl_glfw.h"
@@ -32,6 +37,7 @@ bool Application::firstMouse = true;
 
 void Application::run()
 {
+	initJobSystem();
 	initWindow();
 	initImGui();
 	initVulkan();
@@ -45,10 +51,24 @@ void Application::run()
 	shutdownVulkan();
 	shutdownImGui();
 	shutdownWindow();
+	shutdownJobSystem();
 }
 
 void Application::update()
 {
+	scene->update();
+
+	// Only the shaders depending on the edited files compile again, and only the pipelines built with them
+	std::vector<std::string> changedFiles;
+	shaderWatcher->poll(changedFiles);
+
+	if (!changedFiles.empty())
+	{
+		std::vector<const Shader*> reloadedShaders;
+		scene->reloadShaders(changedFiles, reloadedShaders);
+		renderer->reloadShaders(scene, reloadedShaders);
+	}
+
 	float currentFrame = glfwGetTime();
 	deltaTime = currentFrame - lastFrame;
 	lastFrame = currentFrame;
@@ -96,9 +116,9 @@ void Application::update()
 
 	if (ImGui::Button("Reload Shaders"))
 	{
-		scene->reloadShaders();
-		renderer->reload(scene);
-		renderer->setEnvironment(scene->getHDRTexture(ubo.currentEnvironment));
+		std::vector<const Shader*> reloadedShaders;
+		scene->reloadShaders(reloadedShaders);
+		renderer->reloadShaders(scene, reloadedShaders);
 	}
 
 	int oldCurrentEnvironment = ubo.currentEnvironment;
@@ -108,22 +128,157 @@ void Application::update()
 		{
 			bool selected = (i == ubo.currentEnvironment);
 			if (ImGui::Selectable(scene->getHDRTexturePath(i), &selected))
-			{
 				ubo.currentEnvironment = i;
-				renderer->setEnvironment(scene->getHDRTexture(ubo.currentEnvironment));
-			}
 			if (selected)
 				ImGui::SetItemDefaultFocus();
 		}
 		ImGui::EndCombo();
 	}
 
+	// Bakes again when the selection changed or its texture finished loading
+	const Texture* environment = scene->getHDRTexture(ubo.currentEnvironment);
+	if (environment != environmentTexture)
+	{
+		renderer->setEnvironment(environment);
+		environmentTexture = environment;
+	}
+
+	if (scene->isLoading())
+		ImGui::Text("Loading %u resources", scene->getNumPendingLoads());
+
 	ImGui::Checkbox("Demo Window", &show_demo_window);
 
+	// Quality tiers keep the specular variant picked below
+	static const char* tierNames[] = { "Low", "Medium", "High" };
+	int tier = static_cast<int>(shadingQualityTier);
+	if (ImGui::Combo("Shading Quality", &tier, tierNames, IM_ARRAYSIZE(tierNames)))
+	{
+		shadingQualityTier = static_cast<ShadingQualityTier>(tier);
+
+		ShadingQuality quality = ShadingQuality::fromTier(shadingQualityTier);
+		quality.specularIBL = renderer->getShadingQuality().specularIBL;
+		renderer->setShadingQuality(scene, quality);
+	}
+
+	static const char* specularIBLNames[] = { "Split Sum", "Prefiltered", "Reference" };
+	int specularIBL = static_cast<int>(renderer->getShadingQuality().specularIBL);
+	if (ImGui::Combo("Specular IBL", &specularIBL, specularIBLNames, IM_ARRAYSIZE(specularIBLNames)))
+	{
+		ShadingQuality quality = renderer->getShadingQuality();
+		quality.specularIBL = static_cast<SpecularIBL>(specularIBL);
+		renderer->setShadingQuality(scene, quality);
+	}
+
 	ImGui::SliderFloat("Lerp User Material", &ubo.lerpUserValues, 0.0f, 1.0f);
 	ImGui::SliderFloat("Metalness", &ubo.userMetalness, 0.0f, 1.0f);
 	ImGui::SliderFloat("Roughness", &ubo.userRoughness, 0.0f, 1.0f);
 
+	bool clusterCulling = renderer->getClusterCulling();
+	if (ImGui::Checkbox("Cluster Culling", &clusterCulling))
+		renderer->setClusterCulling(clusterCulling);
+
+	ImGui::Text("Visible meshlets %u / %u", renderer->getNumVisibleMeshlets(), renderer->getNumMeshlets());
+
+	float lodErrorThreshold = renderer->getLodErrorThreshold();
+	if (ImGui::SliderFloat("LOD Error (px)", &lodErrorThreshold, 0.0f, 16.0f))
+		renderer->setLodErrorThreshold(lodErrorThreshold);
+
+	ImGui::Text("Triangles %u", renderer->getNumTriangles());
+
+	bool instancing = renderer->getInstancing();
+	if (ImGui::Checkbox("Instancing", &instancing))
+		renderer->setInstancing(instancing);
+
+	ImGui::Text("Draw calls %u, instance batches %u", renderer->getNumDrawCalls(), renderer->getNumInstanceBatches());
+
+	bool parallelRecording = renderer->getParallelRecording();
+	if (ImGui::Checkbox("Parallel Recording", &parallelRecording))
+		renderer->setParallelRecording(parallelRecording);
+
+	ImGui::Text("Draw lists %u on %u threads", renderer->getNumDrawLists(), parallelRecording ? renderer->getNumRecordingThreads() : 1);
+
+	// Extra helmets to measure the draw throughput
+	static int numStressObjects = 1000;
+	if (ImGui::InputInt("Stress Objects", &numStressObjects, 100, 1000))
+		numStressObjects = std::max(numStressObjects, 0);
+
+	if (ImGui::Button("Spawn Stress Scene"))
+		scene->spawnStressObjects(static_cast<uint32_t>(numStressObjects));
+
+	ImGui::SameLine();
+	if (ImGui::Button("Clear Stress Scene"))
+		scene->clearStressObjects();
+
+	bool occlusionCulling = renderer->getOcclusionCulling();
+	if (ImGui::Checkbox("Occlusion Culling", &occlusionCulling))
+		renderer->setOcclusionCulling(occlusionCulling);
+
+	ImGui::Text("Visible objects %u / %u", renderer->getNumVisibleObjects(), scene->getBVH().getNumObjects());
+	ImGui::Text("Occluded objects %u", renderer->getNumOccludedObjects());
+
+	bool softwareOcclusionCulling = renderer->getSoftwareOcclusionCulling();
+	if (ImGui::Checkbox("Software Occlusion Culling", &softwareOcclusionCulling))
+		renderer->setSoftwareOcclusionCulling(softwareOcclusionCulling);
+
+	ImGui::Text("Occluder triangles %u on %u threads", renderer->getOcclusionRasterizer().getNumTriangles(), renderer->getOcclusionRasterizer().getNumThreads());
+	ImGui::Text("Software occluded objects %u", renderer->getNumSoftwareOccludedObjects());
+
+	if (renderer->isGPUDrivenSupported())
+	{
+		bool gpuDriven = renderer->getGPUDriven();
+		if (ImGui::Checkbox("GPU Driven", &gpuDriven))
+			renderer->setGPUDriven(gpuDriven);
+
+		if (gpuDriven)
+			ImGui::Text("Culled on the GPU: %u draws, %u command slots", renderer->getIndirectRenderer().getNumDraws(), renderer->getIndirectRenderer().getNumCommands());
+	}
+	else
+		ImGui::Text("GPU Driven: drawIndirectFirstInstance not supported");
+
+	// Cursor ray against the scene BVH, Vulkan NDC has y pointing down like the window
+	{
+		double mouseX = 0.0, mouseY = 0.0;
+		int windowWidth = 0, windowHeight = 0;
+		glfwGetCursorPos(window, &mouseX, &mouseY);
+		glfwGetWindowSize(window, &windowWidth, &windowHeight);
+
+		glm::vec2 ndc(2.0f * mouseX / std::max(windowWidth, 1) - 1.0f, 2.0f * mouseY / std::max(windowHeight, 1) - 1.0f);
+		glm::mat4 inverseViewProjection = glm::inverse(ubo.proj * ubo.view);
+
+		glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndc, 0.0f, 1.0f);
+		glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndc, 1.0f, 1.0f);
+
+		glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+		glm::vec3 direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+
+		uint32_t pickedObject = 0;
+		float pickedDistance = 0.0f;
+
+		if (scene->getBVH().raycast(origin, direction, zFar, pickedObject, pickedDistance))
+			ImGui::Text("Object under cursor %u at %.2f", pickedObject, pickedDistance);
+		else
+			ImGui::Text("Object under cursor: none");
+	}
+
+	// Culls 100k random boxes against the current camera with the scalar, SSE and AVX paths
+	static FrustumCuller::BenchmarkResult cullingBenchmark;
+	if (ImGui::Button("Culling Benchmark"))
+		cullingBenchmark = FrustumCuller::runBenchmark(Frustum(ubo.proj * ubo.view));
+
+	if (cullingBenchmark.numObjects > 0)
+		ImGui::Text("%u boxes, %u visible: scalar %.3f ms, SSE %.3f ms, AVX %.3f ms", cullingBenchmark.numObjects, cullingBenchmark.numVisible, cullingBenchmark.scalarMs, cullingBenchmark.sseMs, cullingBenchmark.avxMs);
+
+	// Rasterizes random box walls with the scalar and AVX2 paths, then on every thread
+	static OcclusionRasterizer::BenchmarkResult rasterizerBenchmark;
+	if (ImGui::Button("Occlusion Rasterizer Benchmark"))
+		rasterizerBenchmark = OcclusionRasterizer::runBenchmark();
+
+	if (rasterizerBenchmark.numTriangles > 0)
+	{
+		ImGui::Text("%u triangles: scalar %.3f ms, AVX2 %.3f ms, AVX2 threaded %.3f ms", rasterizerBenchmark.numTriangles, rasterizerBenchmark.scalarMs, rasterizerBenchmark.avx2Ms, rasterizerBenchmark.avx2ThreadedMs);
+		ImGui::Text("%u / %u boxes occluded, tested in %.3f ms", rasterizerBenchmark.numOccluded, rasterizerBenchmark.numObjects, rasterizerBenchmark.testMs);
+	}
+
 	ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
 	ImGui::End();
 }
@@ -138,7 +293,7 @@ void Application::render()
 		return;
 	}
 
-	renderer->render(scene, frame);
+	renderer->render(scene, frame, ubo);
 	imguiRenderer->render(frame);
 
 	if (!swapChain->present(frame) || windowResized)
@@ -250,12 +405,18 @@ void Application::recreateVulkanSwapChain()
 
 void Application::initRenderScene()
 {
-	scene = new RenderScene(context);
+	scene = new RenderScene(context, jobSystem);
 	scene->init();
+
+	shaderWatcher = new FileWatcher();
+	shaderWatcher->watchDirectory("Assert/Shader");
 }
 
 void Application::shutdownRenderScene()
 {
+	delete shaderWatcher;
+	shaderWatcher = nullptr;
+
 	scene->shutdown();
 
 	delete scene;
@@ -264,9 +425,15 @@ void Application::shutdownRenderScene()
 
 void Application::initRenderers()
 {
-	renderer = new Renderer(context, swapChain->getExtent(), swapChain->getDescriptorSetLayout(), swapChain->getRenderPass());
+	renderer = new Renderer(context, jobSystem, swapChain->getExtent(), swapChain->getDescriptorSetLayout(), swapChain->getRenderPass());
+
+	// Cheaper image based lighting on integrated and software devices
+	shadingQualityTier = ShadingQuality::getDeviceTier(context->getPhysicalDevice());
+	renderer->setShadingQuality(scene, ShadingQuality::fromTier(shadingQualityTier));
 	renderer->init(scene);
+	renderer->resize(swapChain);
 	renderer->setEnvironment(scene->getHDRTexture(ubo.currentEnvironment));
+	environmentTexture = scene->getHDRTexture(ubo.currentEnvironment);
 
 	imguiRenderer = new ImGuiRenderer(context, ImGui::GetCurrentContext(), swapChain->getExtent(), swapChain->getNoClearRenderPass());
 	imguiRenderer->init(swapChain);
@@ -281,6 +448,20 @@ void Application::shutdownRenderers()
 	imguiRenderer = nullptr;
 }
 
+void Application::initJobSystem()
+{
+	// The main thread is job system thread 0, every other hardware thread gets a worker
+	jobSystem = new JobSystem();
+	FileSystem::get().setJobSystem(jobSystem);
+}
+
+void Application::shutdownJobSystem()
+{
+	FileSystem::get().setJobSystem(nullptr);
+	delete jobSystem;
+	jobSystem = nullptr;
+}
+
 void Application::initImGui()
 {
 	IMGUI_CHECKVERSION();
@@ -13,12 +13,16 @@
 
 // Forward declaration
 struct GLFWwindow;
+class FileWatcher;
 class ImGuiRenderer;
+class JobSystem;
+class Texture;
 
 namespace RHI
 {
 	class Renderer;
 	class RenderScene;
+	enum class ShadingQualityTier;
 	class SwapChain;
 	class VulkanContext;
 
@@ -76,6 +80,9 @@ private:
 	void initRenderers();
 	void shutdownRenderers();
 
+	void initJobSystem();
+	void shutdownJobSystem();
+
 	void initImGui();
 	void shutdownImGui();
 
@@ -97,13 +104,18 @@ private:
 
 	RHI::RenderScene* scene{ nullptr };
 	RHI::UniformBufferObject ubo;
+	const Texture* environmentTexture{ nullptr }; // baked into the environment cubemaps
+	FileWatcher* shaderWatcher{ nullptr }; // edited shaders are compiled again while running
 
 	RHI::Renderer* renderer{ nullptr };
+	RHI::ShadingQualityTier shadingQualityTier{}; // picked for the device at startup
 	ImGuiRenderer* imguiRenderer{ nullptr };
 
 	RHI::SwapChain* swapChain{ nullptr };
 	RHI::VulkanContext* context{ nullptr };
 
+	JobSystem* jobSystem{ nullptr };
+
 	// Input 
 	CameraState camera;
 	InputState input;
@@ -14,6 +14,14 @@ layout(location = 5) in vec3 fragPositionWS;
 
 layout(location = 0) out vec4 outColor;
 
+// Importance samples of the environment per pixel, a specialization constant so quality tiers pick it per pipeline
+layout(constant_id = 0) const uint SAMPLE_COUNT = 124u;
+
+// Specular IBL variants, compiled with one of the keywords or none:
+//   SPECULAR_IBL_REFERENCE    brute force importance sampling of the environment
+//   SPECULAR_IBL_PREFILTERED  prefiltered environment only, no BRDF term
+//   (none)                    split sum, prefiltered environment and the baked BRDF
+
 // ---------- PBR ---------------------
 
 struct MicrofacetMaterial
@@ -49,8 +57,6 @@ vec3 PrefilterSpecularEnvMap(vec3 V, vec3 N,float roughness)
 	vec3 prefilteredColor = vec3(0.0);
 	float totalWeight = 0.0f;
 
-	const uint SAMPLE_COUNT = 124u;
-
 	for(uint i = 0u; i < SAMPLE_COUNT; ++i)
 	{
 		// generates a sample vector that's biased towards the preferred alignment direction (importance sampling).
@@ -84,7 +90,6 @@ vec3 PrefilterSpecularEnvMap(vec3 V, vec3 N,float roughness)
 vec3 SpecularIBL(Surface surface, MicrofacetMaterial material)
 {
 	vec3 result = vec3(0.0);
-	 const uint SAMPLE_COUNT = 124u;
 
 	Surface sample_surface;
 	sample_surface.view = surface.view;
@@ -158,7 +163,7 @@ void main() {
 	ibl.dotHV = max(0.0f, dot(ibl.halfVector, ibl.view));
 
 	MicrofacetMaterial microfacet_material;
-	microfacet_material.albedo = texture(albedoSampler, fragTexCoord).rgb;
+	microfacet_material.albedo = texture(albedoSampler, fragTexCoord).rgb * fragColor;
 	microfacet_material.roughness = texture(shadingSampler, fragTexCoord).g;
 	microfacet_material.metalness = texture(shadingSampler, fragTexCoord).b;
 	microfacet_material.f0 = lerp(vec3(0.04f), microfacet_material.albedo, microfacet_material.metalness);
@@ -176,9 +181,13 @@ void main() {
 	vec3 ibl_diffuse  = texture(diffuseIrradianceSampler, ibl.normal).rgb * microfacet_material.albedo;
 	ibl_diffuse  *= (1.0f - F_Shlick(ibl.dotNV, microfacet_material.f0, microfacet_material.roughness));
 
-	//vec3 ibl_specular = SpecularIBL(ibl, microfacet_material);
-	//vec3 ibl_specular = PrefilterSpecularEnvMap(ibl.view, ibl.normal, microfacet_material.roughness);
+#if defined(SPECULAR_IBL_REFERENCE)
+	vec3 ibl_specular = SpecularIBL(ibl, microfacet_material);
+#elif defined(SPECULAR_IBL_PREFILTERED)
+	vec3 ibl_specular = PrefilterSpecularEnvMap(ibl.view, ibl.normal, microfacet_material.roughness);
+#else
 	vec3 ibl_specular = ApproximateSpecularIBL(microfacet_material.f0, ibl.view, ibl.normal, microfacet_material.roughness);
+#endif
 
 	vec3 ambient = ibl_diffuse * iPI + ibl_specular;
 
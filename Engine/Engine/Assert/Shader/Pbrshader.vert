@@ -3,6 +3,7 @@
 
 // Uniforms
 #include "Common/Uniform.inc"
+#include "Common/Object.inc"
 
 // Input
 layout(location = 0) in vec3 inPosition;
@@ -21,13 +22,13 @@ layout(location = 4) out vec3 fragNormalWS;
 layout(location = 5) out vec3 fragPositionWS;
 
 void main() {
-	gl_Position = ubo.proj * ubo.view * ubo.world * vec4(inPosition, 1.0f);
+	gl_Position = ubo.proj * ubo.view * object.world * vec4(inPosition, 1.0f);
 
-	fragColor = inColor;
+	fragColor = inColor * object.albedoTint.rgb;
 	fragTexCoord = inTexCoord;
 
-	fragTangentWS = vec3(ubo.world * vec4(inTangent, 0.0f));
-	fragBinormalWS = vec3(ubo.world * vec4(inBinormal, 0.0f));
-	fragNormalWS = vec3(ubo.world * vec4(inNormal, 0.0f));
-	fragPositionWS = vec3(ubo.world * vec4(inPosition, 1.0f));
+	fragTangentWS = vec3(object.world * vec4(inTangent, 0.0f));
+	fragBinormalWS = vec3(object.world * vec4(inBinormal, 0.0f));
+	fragNormalWS = vec3(object.world * vec4(inNormal, 0.0f));
+	fragPositionWS = vec3(object.world * vec4(inPosition, 1.0f));
 }
\ No newline at end of file
@@ -0,0 +1,38 @@
+#version 450
+#pragma shader_stage(vertex)
+
+// Uniforms
+#include "Common/Uniform.inc"
+#include "Common/VertexCompact.inc"
+
+// Input
+layout(location = 0) in vec4 inPosition;
+layout(location = 1) in vec2 inTangent;
+layout(location = 3) in vec2 inNormal;
+layout(location = 4) in vec4 inColor;
+layout(location = 5) in vec2 inTexCoord;
+
+// Output
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out vec3 fragTangentWS;
+layout(location = 3) out vec3 fragBinormalWS;
+layout(location = 4) out vec3 fragNormalWS;
+layout(location = 5) out vec3 fragPositionWS;
+
+void main() {
+	vec3 position = decodePosition(inPosition);
+	vec3 normal = decodeOctahedral(inNormal);
+	vec3 tangent = decodeOctahedral(inTangent);
+	vec3 binormal = decodeBinormal(normal, tangent, inPosition);
+
+	gl_Position = ubo.proj * ubo.view * object.world * vec4(position, 1.0f);
+
+	fragColor = inColor.rgb * object.albedoTint.rgb;
+	fragTexCoord = inTexCoord;
+
+	fragTangentWS = vec3(object.world * vec4(tangent, 0.0f));
+	fragBinormalWS = vec3(object.world * vec4(binormal, 0.0f));
+	fragNormalWS = vec3(object.world * vec4(normal, 0.0f));
+	fragPositionWS = vec3(object.world * vec4(position, 1.0f));
+}
\ No newline at end of file
@@ -7,6 +7,9 @@ layout(location = 0) in vec2 fragTexCoord;
 
 layout(location = 0) out vec4 outColor;
 
+// Importance samples per texel of the lookup table, set when the bake pipeline is built
+layout(constant_id = 0) const uint SAMPLE_COUNT = 1024u;
+
 vec2 IntegrateBRDF(float roughness, float dotNV)
 {
 	vec3 view;
@@ -19,16 +22,14 @@ vec2 IntegrateBRDF(float roughness, float dotNV)
 	float A = 0;
 	float B = 0;
 
-	const uint samples = 1024u;
-
 	Surface sample_surface;
 	sample_surface.view = view;
 	sample_surface.normal = normal;
 	sample_surface.dotNV = max(0.0f, dot(sample_surface.normal, sample_surface.view));
 
-	for (uint i = 0; i < samples; ++i)
+	for (uint i = 0; i < SAMPLE_COUNT; ++i)
 	{
-		vec2 Xi = Hammersley(i, samples);
+		vec2 Xi = Hammersley(i, SAMPLE_COUNT);
 
 		vec3 halfVector = ImportanceSamplingGGX(Xi, normal, roughness);
 		vec3 light = normalize(2.0 * dot(view, halfVector) * halfVector - view);
@@ -48,7 +49,7 @@ vec2 IntegrateBRDF(float roughness, float dotNV)
 		}
 	}
 
-	return vec2(A,B) / float(samples);
+	return vec2(A,B) / float(SAMPLE_COUNT);
 }
 
 void main()
@@ -17,6 +17,9 @@ layout(location = 3) out vec4 outColor3;
 layout(location = 4) out vec4 outColor4;
 layout(location = 5) out vec4 outColor5;
 
+// Step of the hemisphere walk in radians, set when the bake pipeline is built. Samples grow with the inverse square
+layout(constant_id = 0) const float ANGLE_STEP = 0.025f;
+
 const float PI = 3.141592653589798979f;
 const float iPI = 0.31830988618379f;
 
@@ -31,12 +34,11 @@ vec4 fillFace(int index)
 
 	vec3 irradiance = vec3(0.0f);
 
-	float angleStep = 0.025f;
 	float numSamples = 0.0f;
 
-	for (float phi = 0.0f; phi < 2.0f * PI; phi += angleStep)
+	for (float phi = 0.0f; phi < 2.0f * PI; phi += ANGLE_STEP)
 	{
-		for (float theta = 0.0f; theta < 0.5f * PI; theta += angleStep)
+		for (float theta = 0.0f; theta < 0.5f * PI; theta += ANGLE_STEP)
 		{
 			// spherical to cartesian (in tangent space)
 			vec3 tangent = vec3(sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta));
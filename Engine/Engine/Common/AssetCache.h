@@ -0,0 +1,26 @@
+#pragma once
+
+#include "FileSystem.h"
+#include "Hash.h"
+
+#include <string>
+
+// Meshes, textures and shaders keep a binary cache next to their source file, keyed by the hash of the source content.
+// The runtime writes it on a miss, the AssetCooker builds every cache ahead of time
+enum class CookResult
+{
+	UpToDate,
+	Cooked,
+	Failed,
+};
+
+// Through the file system, so the read stays in its cache for the load right after
+inline bool hashFile(const std::string& path, uint64_t& hash)
+{
+	FileData file;
+	if (!FileSystem::get().read(path, file))
+		return false;
+
+	hash = hashFNV1a(file.getData(), file.getSize(), hash);
+	return true;
+}
\ No newline at end of file
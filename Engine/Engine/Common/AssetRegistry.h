@@ -0,0 +1,66 @@
+#pragma once
+
+#include "HandlePool.h"
+
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+
+// Handles of the files loaded so far, by key. Loading a known key again shares the existing resource.
+// Only touched at load and release time, lookups while rendering go through the handle pools
+template<typename T>
+class AssetRegistry
+{
+public:
+	// Spellings of the same file end up with the same key
+	static std::string makeKey(const char* path)
+	{
+		return std::filesystem::path(path).lexically_normal().generic_string();
+	}
+
+	inline Handle<T> find(const std::string& key) const
+	{
+		auto it = handles.find(key);
+		return (it != handles.end()) ? it->second : Handle<T>();
+	}
+
+	void add(const std::string& key, Handle<T> handle, bool loading)
+	{
+		handles[key] = handle;
+		entries[handle.getValue()] = { key, loading };
+	}
+
+	void remove(Handle<T> handle)
+	{
+		auto it = entries.find(handle.getValue());
+		if (it == entries.end())
+			return;
+
+		handles.erase(it->second.key);
+		entries.erase(it);
+	}
+
+	// An asynchronous load of the file is still in flight
+	inline bool isLoading(Handle<T> handle) const
+	{
+		auto it = entries.find(handle.getValue());
+		return it != entries.end() && it->second.loading;
+	}
+
+	void setLoaded(Handle<T> handle)
+	{
+		auto it = entries.find(handle.getValue());
+		if (it != entries.end())
+			it->second.loading = false;
+	}
+
+private:
+	struct Entry
+	{
+		std::string key;
+		bool loading{ false };
+	};
+
+	std::unordered_map<std::string, Handle<T>> handles;
+	std::unordered_map<uint32_t, Entry> entries;
+};
\ No newline at end of file
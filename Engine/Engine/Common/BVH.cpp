@@ -0,0 +1,604 @@
+#include "BVH.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+// Binned SAH, split candidates are the bin borders along the largest centroid axis
+static const uint32_t SAH_NUM_BINS = 12;
+
+static float surfaceArea(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	glm::vec3 extent = glm::max(boundsMax - boundsMin, glm::vec3(0.0f));
+	return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+static bool overlaps(const glm::vec3& minA, const glm::vec3& maxA, const glm::vec3& minB, const glm::vec3& maxB)
+{
+	return minA.x <= maxB.x && maxA.x >= minB.x && minA.y <= maxB.y && maxA.y >= minB.y && minA.z <= maxB.z && maxA.z >= minB.z;
+}
+
+static bool contains(const glm::vec3& outerMin, const glm::vec3& outerMax, const glm::vec3& innerMin, const glm::vec3& innerMax)
+{
+	return outerMin.x <= innerMin.x && outerMin.y <= innerMin.y && outerMin.z <= innerMin.z
+		&& outerMax.x >= innerMax.x && outerMax.y >= innerMax.y && outerMax.z >= innerMax.z;
+}
+
+// Slab test, returns the entry distance or infinity when the box is missed
+static float intersectRay(const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	glm::vec3 t0 = (boundsMin - origin) * inverseDirection;
+	glm::vec3 t1 = (boundsMax - origin) * inverseDirection;
+
+	glm::vec3 tNear = glm::min(t0, t1);
+	glm::vec3 tFar = glm::max(t0, t1);
+
+	float entry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+	float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+
+	return (entry <= exit) ? entry : std::numeric_limits<float>::infinity();
+}
+
+uint32_t BVH::allocateNode()
+{
+	if (!freeNodes.empty())
+	{
+		uint32_t node = freeNodes.back();
+		freeNodes.pop_back();
+
+		nodes[node] = Node();
+		parents[node] = INVALID_INDEX;
+		return node;
+	}
+
+	nodes.push_back(Node());
+	parents.push_back(INVALID_INDEX);
+	return static_cast<uint32_t>(nodes.size() - 1);
+}
+
+void BVH::freeNode(uint32_t node)
+{
+	freeNodes.push_back(node);
+}
+
+void BVH::setLeafBounds(uint32_t leaf, const Object& object)
+{
+	glm::vec3 margin = (object.boundsMax - object.boundsMin) * fatMargin;
+
+	nodes[leaf].boundsMin = object.boundsMin - margin;
+	nodes[leaf].boundsMax = object.boundsMax + margin;
+}
+
+uint32_t BVH::addObject(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	uint32_t object = 0;
+	if (!freeObjects.empty())
+	{
+		object = freeObjects.back();
+		freeObjects.pop_back();
+	}
+	else
+	{
+		object = static_cast<uint32_t>(objects.size());
+		objects.push_back(Object());
+	}
+
+	objects[object].boundsMin = boundsMin;
+	objects[object].boundsMax = boundsMax;
+
+	uint32_t leaf = allocateNode();
+	nodes[leaf].left = object;
+	setLeafBounds(leaf, objects[object]);
+
+	objects[object].leaf = leaf;
+	insertLeaf(leaf);
+
+	numObjects++;
+	return object;
+}
+
+void BVH::removeObject(uint32_t object)
+{
+	assert(object < objects.size() && objects[object].leaf != INVALID_INDEX);
+
+	removeLeaf(objects[object].leaf);
+	freeNode(objects[object].leaf);
+
+	objects[object].leaf = INVALID_INDEX;
+	freeObjects.push_back(object);
+	numObjects--;
+}
+
+void BVH::moveObject(uint32_t object, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	assert(object < objects.size() && objects[object].leaf != INVALID_INDEX);
+
+	Object& data = objects[object];
+	data.boundsMin = boundsMin;
+	data.boundsMax = boundsMax;
+
+	uint32_t leaf = data.leaf;
+	if (contains(nodes[leaf].boundsMin, nodes[leaf].boundsMax, boundsMin, boundsMax))
+		return;
+
+	removeLeaf(leaf);
+	setLeafBounds(leaf, data);
+	insertLeaf(leaf);
+}
+
+void BVH::insertLeaf(uint32_t leaf)
+{
+	if (root == INVALID_INDEX)
+	{
+		root = leaf;
+		parents[leaf] = INVALID_INDEX;
+		return;
+	}
+
+	glm::vec3 leafMin = nodes[leaf].boundsMin;
+	glm::vec3 leafMax = nodes[leaf].boundsMax;
+
+	// Descend towards the sibling with the smallest area increase, every ancestor pays for its growth
+	uint32_t sibling = root;
+	while (!isLeaf(sibling))
+	{
+		const Node& node = nodes[sibling];
+
+		float area = surfaceArea(node.boundsMin, node.boundsMax);
+		float combinedArea = surfaceArea(glm::min(node.boundsMin, leafMin), glm::max(node.boundsMax, leafMax));
+
+		// Cost of pairing the leaf with this node, and the growth pushed onto every node below
+		float cost = 2.0f * combinedArea;
+		float inheritedCost = 2.0f * (combinedArea - area);
+
+		float childCosts[2];
+		uint32_t children[2] = { node.left, node.right };
+
+		for (int k = 0; k < 2; k++)
+		{
+			const Node& child = nodes[children[k]];
+			float childArea = surfaceArea(glm::min(child.boundsMin, leafMin), glm::max(child.boundsMax, leafMax));
+
+			if (!isLeaf(children[k]))
+				childArea -= surfaceArea(child.boundsMin, child.boundsMax);
+
+			childCosts[k] = childArea + inheritedCost;
+		}
+
+		if (cost < childCosts[0] && cost < childCosts[1])
+			break;
+
+		sibling = (childCosts[0] < childCosts[1]) ? children[0] : children[1];
+	}
+
+	uint32_t oldParent = parents[sibling];
+	uint32_t newParent = allocateNode();
+
+	nodes[newParent].boundsMin = glm::min(nodes[sibling].boundsMin, leafMin);
+	nodes[newParent].boundsMax = glm::max(nodes[sibling].boundsMax, leafMax);
+	nodes[newParent].left = sibling;
+	nodes[newParent].right = leaf;
+
+	parents[newParent] = oldParent;
+	parents[sibling] = newParent;
+	parents[leaf] = newParent;
+
+	if (oldParent == INVALID_INDEX)
+	{
+		root = newParent;
+		return;
+	}
+
+	if (nodes[oldParent].left == sibling)
+		nodes[oldParent].left = newParent;
+	else
+		nodes[oldParent].right = newParent;
+
+	refitAncestors(oldParent);
+}
+
+void BVH::removeLeaf(uint32_t leaf)
+{
+	if (leaf == root)
+	{
+		root = INVALID_INDEX;
+		return;
+	}
+
+	// The sibling takes the place of the parent
+	uint32_t parent = parents[leaf];
+	uint32_t grandParent = parents[parent];
+	uint32_t sibling = (nodes[parent].left == leaf) ? nodes[parent].right : nodes[parent].left;
+
+	freeNode(parent);
+	parents[sibling] = grandParent;
+	parents[leaf] = INVALID_INDEX;
+
+	if (grandParent == INVALID_INDEX)
+	{
+		root = sibling;
+		return;
+	}
+
+	if (nodes[grandParent].left == parent)
+		nodes[grandParent].left = sibling;
+	else
+		nodes[grandParent].right = sibling;
+
+	refitAncestors(grandParent);
+}
+
+void BVH::refitAncestors(uint32_t node)
+{
+	for (; node != INVALID_INDEX; node = parents[node])
+	{
+		const Node& left = nodes[nodes[node].left];
+		const Node& right = nodes[nodes[node].right];
+
+		nodes[node].boundsMin = glm::min(left.boundsMin, right.boundsMin);
+		nodes[node].boundsMax = glm::max(left.boundsMax, right.boundsMax);
+	}
+}
+
+void BVH::refit()
+{
+	if (root == INVALID_INDEX)
+		return;
+
+	// Post order walk, children are refitted before their parent
+	std::vector<uint32_t> stack;
+	std::vector<bool> expanded(nodes.size(), false);
+	stack.push_back(root);
+
+	while (!stack.empty())
+	{
+		uint32_t index = stack.back();
+		Node& node = nodes[index];
+
+		if (isLeaf(index))
+		{
+			setLeafBounds(index, objects[node.left]);
+			stack.pop_back();
+			continue;
+		}
+
+		if (!expanded[index])
+		{
+			expanded[index] = true;
+			stack.push_back(node.left);
+			stack.push_back(node.right);
+			continue;
+		}
+
+		node.boundsMin = glm::min(nodes[node.left].boundsMin, nodes[node.right].boundsMin);
+		node.boundsMax = glm::max(nodes[node.left].boundsMax, nodes[node.right].boundsMax);
+		stack.pop_back();
+	}
+}
+
+void BVH::build()
+{
+	std::vector<uint32_t> objectIndices;
+	objectIndices.reserve(numObjects);
+
+	for (uint32_t i = 0; i < objects.size(); i++)
+		if (objects[i].leaf != INVALID_INDEX)
+			objectIndices.push_back(i);
+
+	nodes.clear();
+	parents.clear();
+	freeNodes.clear();
+	root = INVALID_INDEX;
+
+	if (objectIndices.empty())
+		return;
+
+	nodes.reserve(objectIndices.size() * 2 - 1);
+	parents.reserve(objectIndices.size() * 2 - 1);
+
+	root = buildNode(objectIndices, 0, objectIndices.size(), INVALID_INDEX);
+}
+
+uint32_t BVH::buildNode(std::vector<uint32_t>& objectIndices, size_t begin, size_t end, uint32_t parent)
+{
+	uint32_t index = allocateNode();
+	parents[index] = parent;
+
+	if (end - begin == 1)
+	{
+		Object& object = objects[objectIndices[begin]];
+		nodes[index].left = objectIndices[begin];
+		setLeafBounds(index, object);
+		object.leaf = index;
+		return index;
+	}
+
+	// Node bounds cover the fattened leaves, centroids decide the split
+	glm::vec3 boundsMin(std::numeric_limits<float>::max());
+	glm::vec3 boundsMax(-std::numeric_limits<float>::max());
+	glm::vec3 centroidMin(std::numeric_limits<float>::max());
+	glm::vec3 centroidMax(-std::numeric_limits<float>::max());
+
+	for (size_t i = begin; i < end; i++)
+	{
+		const Object& object = objects[objectIndices[i]];
+		glm::vec3 margin = (object.boundsMax - object.boundsMin) * fatMargin;
+		glm::vec3 centroid = (object.boundsMin + object.boundsMax) * 0.5f;
+
+		boundsMin = glm::min(boundsMin, object.boundsMin - margin);
+		boundsMax = glm::max(boundsMax, object.boundsMax + margin);
+		centroidMin = glm::min(centroidMin, centroid);
+		centroidMax = glm::max(centroidMax, centroid);
+	}
+
+	nodes[index].boundsMin = boundsMin;
+	nodes[index].boundsMax = boundsMax;
+
+	glm::vec3 centroidExtent = centroidMax - centroidMin;
+	int axis = (centroidExtent.x > centroidExtent.y && centroidExtent.x > centroidExtent.z) ? 0 : (centroidExtent.y > centroidExtent.z ? 1 : 2);
+
+	size_t middle = begin + (end - begin) / 2;
+
+	if (centroidExtent[axis] > 0.0f)
+	{
+		struct Bin
+		{
+			glm::vec3 boundsMin{ std::numeric_limits<float>::max() };
+			glm::vec3 boundsMax{ -std::numeric_limits<float>::max() };
+			uint32_t count{ 0 };
+		};
+
+		Bin bins[SAH_NUM_BINS];
+		float binScale = SAH_NUM_BINS / centroidExtent[axis];
+
+		auto binOf = [&](uint32_t objectIndex)
+		{
+			const Object& object = objects[objectIndex];
+			float centroid = (object.boundsMin[axis] + object.boundsMax[axis]) * 0.5f;
+			return std::min(static_cast<uint32_t>((centroid - centroidMin[axis]) * binScale), SAH_NUM_BINS - 1);
+		};
+
+		for (size_t i = begin; i < end; i++)
+		{
+			const Object& object = objects[objectIndices[i]];
+			Bin& bin = bins[binOf(objectIndices[i])];
+
+			bin.boundsMin = glm::min(bin.boundsMin, object.boundsMin);
+			bin.boundsMax = glm::max(bin.boundsMax, object.boundsMax);
+			bin.count++;
+		}
+
+		// Sweep from the right to get the area and count on the right of every split
+		float rightAreas[SAH_NUM_BINS];
+		uint32_t rightCounts[SAH_NUM_BINS];
+		{
+			Bin accumulated;
+			for (uint32_t i = SAH_NUM_BINS - 1; i > 0; i--)
+			{
+				accumulated.boundsMin = glm::min(accumulated.boundsMin, bins[i].boundsMin);
+				accumulated.boundsMax = glm::max(accumulated.boundsMax, bins[i].boundsMax);
+				accumulated.count += bins[i].count;
+
+				rightAreas[i] = accumulated.count ? surfaceArea(accumulated.boundsMin, accumulated.boundsMax) : 0.0f;
+				rightCounts[i] = accumulated.count;
+			}
+		}
+
+		float bestCost = std::numeric_limits<float>::max();
+		uint32_t bestSplit = 0;
+		{
+			Bin accumulated;
+			for (uint32_t i = 0; i < SAH_NUM_BINS - 1; i++)
+			{
+				accumulated.boundsMin = glm::min(accumulated.boundsMin, bins[i].boundsMin);
+				accumulated.boundsMax = glm::max(accumulated.boundsMax, bins[i].boundsMax);
+				accumulated.count += bins[i].count;
+
+				if (accumulated.count == 0 || rightCounts[i + 1] == 0)
+					continue;
+
+				float cost = surfaceArea(accumulated.boundsMin, accumulated.boundsMax) * accumulated.count + rightAreas[i + 1] * rightCounts[i + 1];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestSplit = i + 1;
+				}
+			}
+		}
+
+		if (bestSplit > 0)
+		{
+			auto split = std::partition(objectIndices.begin() + begin, objectIndices.begin() + end, [&](uint32_t objectIndex) { return binOf(objectIndex) < bestSplit; });
+			middle = static_cast<size_t>(split - objectIndices.begin());
+		}
+	}
+
+	// Coincident centroids or a degenerate split, fall back to halving the list
+	if (middle == begin || middle == end)
+		middle = begin + (end - begin) / 2;
+
+	// Depth first, the left subtree is emitted right after this node
+	uint32_t left = buildNode(objectIndices, begin, middle, index);
+	uint32_t right = buildNode(objectIndices, middle, end, index);
+
+	nodes[index].left = left;
+	nodes[index].right = right;
+
+	return index;
+}
+
+void BVH::clear()
+{
+	nodes.clear();
+	parents.clear();
+	freeNodes.clear();
+	objects.clear();
+	freeObjects.clear();
+
+	root = INVALID_INDEX;
+	numObjects = 0;
+}
+
+void BVH::queryFrustum(const Frustum& frustum, std::vector<uint32_t>& result) const
+{
+	if (root == INVALID_INDEX)
+		return;
+
+	// Second element is set once an ancestor is fully inside and the planes can be skipped
+	std::vector<std::pair<uint32_t, bool>> stack;
+	stack.push_back({ root, false });
+
+	while (!stack.empty())
+	{
+		uint32_t index = stack.back().first;
+		bool inside = stack.back().second;
+		stack.pop_back();
+
+		const Node& node = nodes[index];
+
+		if (!inside)
+		{
+			Frustum::Containment containment = frustum.classifyBox(node.boundsMin, node.boundsMax);
+			if (containment == Frustum::Containment::Outside)
+				continue;
+
+			inside = (containment == Frustum::Containment::Inside);
+		}
+
+		if (isLeaf(index))
+		{
+			const Object& object = objects[node.left];
+			if (inside || frustum.intersectsBox(object.boundsMin, object.boundsMax))
+				result.push_back(node.left);
+
+			continue;
+		}
+
+		stack.push_back({ node.right, inside });
+		stack.push_back({ node.left, inside });
+	}
+}
+
+void BVH::queryBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, std::vector<uint32_t>& result) const
+{
+	if (root == INVALID_INDEX)
+		return;
+
+	std::vector<uint32_t> stack;
+	stack.push_back(root);
+
+	while (!stack.empty())
+	{
+		uint32_t index = stack.back();
+		stack.pop_back();
+
+		const Node& node = nodes[index];
+		if (!overlaps(node.boundsMin, node.boundsMax, boundsMin, boundsMax))
+			continue;
+
+		if (isLeaf(index))
+		{
+			const Object& object = objects[node.left];
+			if (overlaps(object.boundsMin, object.boundsMax, boundsMin, boundsMax))
+				result.push_back(node.left);
+
+			continue;
+		}
+
+		stack.push_back(node.right);
+		stack.push_back(node.left);
+	}
+}
+
+bool BVH::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, uint32_t& object, float& distance) const
+{
+	object = INVALID_INDEX;
+	distance = maxDistance;
+
+	if (root == INVALID_INDEX)
+		return false;
+
+	// Division by zero gives infinities that the slab test handles
+	glm::vec3 inverseDirection = 1.0f / direction;
+
+	std::vector<std::pair<uint32_t, float>> stack;
+	float rootEntry = intersectRay(origin, inverseDirection, distance, nodes[root].boundsMin, nodes[root].boundsMax);
+	if (rootEntry <= distance)
+		stack.push_back({ root, rootEntry });
+
+	while (!stack.empty())
+	{
+		uint32_t index = stack.back().first;
+		float entry = stack.back().second;
+		stack.pop_back();
+
+		if (entry > distance)
+			continue;
+
+		const Node& node = nodes[index];
+
+		if (isLeaf(index))
+		{
+			const Object& data = objects[node.left];
+			float hit = intersectRay(origin, inverseDirection, distance, data.boundsMin, data.boundsMax);
+
+			if (hit < distance)
+			{
+				distance = hit;
+				object = node.left;
+			}
+
+			continue;
+		}
+
+		float leftEntry = intersectRay(origin, inverseDirection, distance, nodes[node.left].boundsMin, nodes[node.left].boundsMax);
+		float rightEntry = intersectRay(origin, inverseDirection, distance, nodes[node.right].boundsMin, nodes[node.right].boundsMax);
+
+		// The nearer child goes on top of the stack
+		if (leftEntry <= rightEntry)
+		{
+			if (rightEntry <= distance)
+				stack.push_back({ node.right, rightEntry });
+			if (leftEntry <= distance)
+				stack.push_back({ node.left, leftEntry });
+		}
+		else
+		{
+			if (leftEntry <= distance)
+				stack.push_back({ node.left, leftEntry });
+			if (rightEntry <= distance)
+				stack.push_back({ node.right, rightEntry });
+		}
+	}
+
+	return object != INVALID_INDEX;
+}
+
+float BVH::getCost() const
+{
+	if (root == INVALID_INDEX)
+		return 0.0f;
+
+	float rootArea = surfaceArea(nodes[root].boundsMin, nodes[root].boundsMax);
+	if (rootArea <= 0.0f)
+		return 0.0f;
+
+	float area = 0.0f;
+	std::vector<uint32_t> stack;
+	stack.push_back(root);
+
+	while (!stack.empty())
+	{
+		uint32_t index = stack.back();
+		stack.pop_back();
+
+		if (isLeaf(index))
+			continue;
+
+		area += surfaceArea(nodes[index].boundsMin, nodes[index].boundsMax);
+		stack.push_back(nodes[index].left);
+		stack.push_back(nodes[index].right);
+	}
+
+	return area / rootArea;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "Frustum.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Bounding volume hierarchy over object boxes, one object per leaf.
+// build() makes a binned SAH tree laid out depth first, a left child always follows its parent.
+// Leaves keep a fattened box so small moves cost nothing, objects leaving it are reinserted along the cheapest SAH path.
+class BVH
+{
+public:
+	// 32 bytes, two nodes per cache line
+	struct Node
+	{
+		glm::vec3 boundsMin{ 0.0f };
+		uint32_t left{ INVALID_INDEX };		// first child, or the object of a leaf
+		glm::vec3 boundsMax{ 0.0f };
+		uint32_t right{ INVALID_INDEX };	// second child, INVALID_INDEX for leaves
+	};
+
+	// Returns the object index, it is inserted right away and can be queried before the next build()
+	uint32_t addObject(const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+	void removeObject(uint32_t object);
+
+	// Reinserts the object once it leaves its fattened leaf box
+	void moveObject(uint32_t object, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+	// Full SAH rebuild, restores the depth first layout and the tree quality after many reinsertions
+	void build();
+
+	// Shrinks every node around the current object boxes without changing the topology,
+	// cheaper than moveObject when most objects move a little every frame
+	void refit();
+
+	void clear();
+
+	// Appends the objects whose box intersects the frustum or the query box
+	void queryFrustum(const Frustum& frustum, std::vector<uint32_t>& result) const;
+	void queryBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, std::vector<uint32_t>& result) const;
+
+	// Closest object box hit by the ray, children are visited front to back and pruned past the best hit
+	bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, uint32_t& object, float& distance) const;
+
+	inline const std::vector<Node>& getNodes() const { return nodes; }
+	inline uint32_t getRoot() const { return root; }
+	inline uint32_t getNumObjects() const { return numObjects; }
+	inline uint32_t getObjectCapacity() const { return static_cast<uint32_t>(objects.size()); }
+	inline bool hasObject(uint32_t object) const { return object < objects.size() && objects[object].leaf != INVALID_INDEX; }
+	inline bool isLeaf(uint32_t node) const { return nodes[node].right == INVALID_INDEX; }
+
+	// Sum of the internal node areas relative to the root area, grows as reinsertions degrade the tree
+	float getCost() const;
+
+	// Leaf boxes grow by this share of the object size on each side
+	float fatMargin{ 0.1f };
+
+	static constexpr uint32_t INVALID_INDEX = ~0u;
+
+private:
+	struct Object
+	{
+		glm::vec3 boundsMin{ 0.0f };
+		glm::vec3 boundsMax{ 0.0f };
+		uint32_t leaf{ INVALID_INDEX };
+	};
+
+	uint32_t allocateNode();
+	void freeNode(uint32_t node);
+
+	void insertLeaf(uint32_t leaf);
+	void removeLeaf(uint32_t leaf);
+	void refitAncestors(uint32_t node);
+	void setLeafBounds(uint32_t leaf, const Object& object);
+
+	uint32_t buildNode(std::vector<uint32_t>& objectIndices, size_t begin, size_t end, uint32_t parent);
+
+private:
+	std::vector<Node> nodes;
+	std::vector<uint32_t> parents;
+	std::vector<uint32_t> freeNodes;
+
+	std::vector<Object> objects;
+	std::vector<uint32_t> freeObjects;
+
+	uint32_t root{ INVALID_INDEX };
+	uint32_t numObjects{ 0 };
+};
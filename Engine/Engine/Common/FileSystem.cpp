@@ -0,0 +1,336 @@
+#include "FileSystem.h"
+#include "JobSystem.h"
+#include "PackFile.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+// Files above this share of the budget are read every time instead of pushing everything else out
+static const size_t MAX_CACHED_SHARE = 4;
+
+FileData FileData::fromBuffer(std::vector<uint8_t> buffer)
+{
+	auto owner = std::make_shared<const std::vector<uint8_t>>(std::move(buffer));
+	return FileData(owner, owner->data(), owner->size());
+}
+
+DirectorySource::DirectorySource(const std::string& directory)
+	: directory(directory)
+{
+}
+
+bool DirectorySource::exists(const std::string& path) const
+{
+	std::error_code error;
+	return std::filesystem::is_regular_file(std::filesystem::path(directory) / path, error);
+}
+
+bool DirectorySource::read(const std::string& path, FileData& data) const
+{
+	std::ifstream file(std::filesystem::path(directory) / path, std::ios::ate | std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	size_t fileSize = static_cast<size_t>(file.tellg());
+	std::vector<uint8_t> buffer(fileSize);
+
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(buffer.data()), fileSize);
+
+	if (!file.good())
+	{
+		std::cerr << "DirectorySource::read(): can't read \"" << path << "\"" << std::endl;
+		return false;
+	}
+
+	data = FileData::fromBuffer(std::move(buffer));
+	return true;
+}
+
+PackSource::PackSource(std::shared_ptr<PackFile> pack, JobSystem* jobSystem)
+	: pack(std::move(pack)), jobSystem(jobSystem)
+{
+}
+
+bool PackSource::exists(const std::string& path) const
+{
+	return pack->find(path) != nullptr;
+}
+
+bool PackSource::read(const std::string& path, FileData& data) const
+{
+	const PackEntry* entry = pack->find(path);
+	if (!entry)
+		return false;
+
+	if (const uint8_t* mapped = pack->getMappedData(*entry))
+	{
+		data = FileData(pack, mapped, entry->size);
+		return true;
+	}
+
+	std::vector<uint8_t> buffer(entry->size);
+	if (!pack->read(*entry, buffer.data(), jobSystem))
+		return false;
+
+	data = FileData::fromBuffer(std::move(buffer));
+	return true;
+}
+
+void MemorySource::addFile(const std::string& path, std::vector<uint8_t> data)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	files[FileSystem::normalizePath(path)] = FileData::fromBuffer(std::move(data));
+}
+
+bool MemorySource::exists(const std::string& path) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return files.find(path) != files.end();
+}
+
+bool MemorySource::read(const std::string& path, FileData& data) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto it = files.find(path);
+	if (it == files.end())
+		return false;
+
+	data = it->second;
+	return true;
+}
+
+FileSystem& FileSystem::get()
+{
+	static FileSystem fileSystem;
+	return fileSystem;
+}
+
+FileSystem::FileSystem()
+{
+	mountDirectory("", ".");
+}
+
+void FileSystem::mount(const std::string& mountPoint, std::shared_ptr<FileSource> source)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	std::string point = normalizePath(mountPoint);
+	if (point == ".")
+		point.clear();
+
+	mounts.push_back({ point, std::move(source) });
+
+	// Cached files may come from a mount the new one hides
+	cache.clear();
+	cacheOrder.clear();
+	cacheSize = 0;
+	cacheGeneration++;
+}
+
+void FileSystem::mountDirectory(const std::string& mountPoint, const std::string& directory)
+{
+	mount(mountPoint, std::make_shared<DirectorySource>(directory));
+}
+
+bool FileSystem::mountPack(const std::string& mountPoint, const std::string& path)
+{
+	auto pack = std::make_shared<PackFile>();
+	if (!pack->open(path))
+		return false;
+
+	mount(mountPoint, std::make_shared<PackSource>(pack, jobSystem));
+	return true;
+}
+
+void FileSystem::unmountAll()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	mounts.clear();
+	cache.clear();
+	cacheOrder.clear();
+	cacheSize = 0;
+	cacheGeneration++;
+}
+
+bool FileSystem::exists(const std::string& path) const
+{
+	std::string normalized = normalizePath(path);
+
+	std::vector<Mount> currentMounts;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (cache.find(normalized) != cache.end())
+			return true;
+
+		currentMounts = mounts;
+	}
+
+	std::string relativePath;
+	for (auto it = currentMounts.rbegin(); it != currentMounts.rend(); ++it)
+		if (getRelativePath(*it, normalized, relativePath) && it->source->exists(relativePath))
+			return true;
+
+	return false;
+}
+
+bool FileSystem::read(const std::string& path, FileData& data)
+{
+	std::string normalized = normalizePath(path);
+	if (findInCache(normalized, data))
+		return true;
+
+	// Sources are read without the lock, other threads keep hitting the cache meanwhile
+	std::vector<Mount> currentMounts;
+	uint64_t generation = 0;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		currentMounts = mounts;
+		generation = getGeneration(normalized);
+	}
+
+	std::string relativePath;
+	for (auto it = currentMounts.rbegin(); it != currentMounts.rend(); ++it)
+	{
+		if (!getRelativePath(*it, normalized, relativePath) || !it->source->read(relativePath, data))
+			continue;
+
+		addToCache(normalized, data, generation);
+		return true;
+	}
+
+	return false;
+}
+
+void FileSystem::readAsync(const std::string& path, std::function<void(const std::string&, FileData)> callback, JobCounter* counter)
+{
+	auto job = [this, path, callback = std::move(callback)]()
+	{
+		FileData data;
+		read(path, data);
+		callback(path, std::move(data));
+	};
+
+	if (!jobSystem)
+	{
+		job();
+		return;
+	}
+
+	jobSystem->run(std::move(job), counter);
+}
+
+void FileSystem::invalidate(const std::string& path)
+{
+	std::string normalized = normalizePath(path);
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// Even when nothing is cached yet, a read in flight may be about to cache the old bytes
+	pathGenerations[normalized]++;
+
+	auto it = cache.find(normalized);
+	if (it == cache.end())
+		return;
+
+	cacheSize -= it->second.data.getSize();
+	cacheOrder.erase(it->second.order);
+	cache.erase(it);
+}
+
+void FileSystem::clearCache()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	cache.clear();
+	cacheOrder.clear();
+	cacheSize = 0;
+	cacheGeneration++;
+}
+
+void FileSystem::setCacheBudget(size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	cacheBudget = bytes;
+	trimCache();
+}
+
+std::string FileSystem::normalizePath(const std::string& path)
+{
+	std::string normalized = std::filesystem::path(path).lexically_normal().generic_string();
+
+	if (normalized.compare(0, 2, "./") == 0)
+		normalized.erase(0, 2);
+
+	return normalized;
+}
+
+bool FileSystem::findInCache(const std::string& path, FileData& data)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto it = cache.find(path);
+	if (it == cache.end())
+		return false;
+
+	cacheOrder.splice(cacheOrder.begin(), cacheOrder, it->second.order);
+	data = it->second.data;
+
+	return true;
+}
+
+void FileSystem::addToCache(const std::string& path, const FileData& data, uint64_t generation)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// Invalidated while it was read, the data may predate the change
+	if (getGeneration(path) != generation)
+		return;
+
+	if (data.getSize() > cacheBudget / MAX_CACHED_SHARE || cache.find(path) != cache.end())
+		return;
+
+	cacheOrder.push_front(path);
+	cache[path] = { data, cacheOrder.begin() };
+	cacheSize += data.getSize();
+
+	trimCache();
+}
+
+uint64_t FileSystem::getGeneration(const std::string& path) const
+{
+	// Both counters only grow, so their sum changes whenever either does
+	auto it = pathGenerations.find(path);
+	return cacheGeneration + ((it != pathGenerations.end()) ? it->second : 0);
+}
+
+void FileSystem::trimCache()
+{
+	while (cacheSize > cacheBudget && !cacheOrder.empty())
+	{
+		auto it = cache.find(cacheOrder.back());
+		cacheSize -= it->second.data.getSize();
+
+		cache.erase(it);
+		cacheOrder.pop_back();
+	}
+}
+
+bool FileSystem::getRelativePath(const Mount& mount, const std::string& path, std::string& relativePath)
+{
+	if (mount.point.empty())
+	{
+		relativePath = path;
+		return true;
+	}
+
+	if (path.size() <= mount.point.size() || path.compare(0, mount.point.size(), mount.point) != 0 || path[mount.point.size()] != '/')
+		return false;
+
+	relativePath = path.substr(mount.point.size() + 1);
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class JobCounter;
+class JobSystem;
+class PackFile;
+
+// Read-only bytes of a file, keeping whatever owns them alive: a buffer, or the pack they are mapped from
+class FileData
+{
+public:
+	FileData() = default;
+	FileData(std::shared_ptr<const void> owner, const uint8_t* data, size_t size)
+		: owner(std::move(owner)), data(data), size(size) { }
+
+	static FileData fromBuffer(std::vector<uint8_t> buffer);
+
+	inline bool isValid() const { return owner != nullptr; }
+	inline const uint8_t* getData() const { return data; }
+	inline size_t getSize() const { return size; }
+
+private:
+	std::shared_ptr<const void> owner;
+	const uint8_t* data{ nullptr };
+	size_t size{ 0 };
+};
+
+// Where the files of a mount point come from, paths are relative to the mount point. Read from any thread
+class FileSource
+{
+public:
+	virtual ~FileSource() = default;
+
+	virtual bool exists(const std::string& path) const = 0;
+	virtual bool read(const std::string& path, FileData& data) const = 0;
+};
+
+class DirectorySource : public FileSource
+{
+public:
+	explicit DirectorySource(const std::string& directory);
+
+	bool exists(const std::string& path) const override;
+	bool read(const std::string& path, FileData& data) const override;
+
+private:
+	std::string directory;
+};
+
+// Stored entries are handed out straight from the mapping, compressed ones are decompressed on the job system if any
+class PackSource : public FileSource
+{
+public:
+	PackSource(std::shared_ptr<PackFile> pack, JobSystem* jobSystem);
+
+	bool exists(const std::string& path) const override;
+	bool read(const std::string& path, FileData& data) const override;
+
+private:
+	std::shared_ptr<PackFile> pack;
+	JobSystem* jobSystem{ nullptr };
+};
+
+// Files generated at runtime or embedded in the executable
+class MemorySource : public FileSource
+{
+public:
+	void addFile(const std::string& path, std::vector<uint8_t> data);
+
+	bool exists(const std::string& path) const override;
+	bool read(const std::string& path, FileData& data) const override;
+
+private:
+	mutable std::mutex mutex;
+	std::unordered_map<std::string, FileData> files;
+};
+
+// Virtual file system every loader reads through. Paths are relative with forward slashes, like "Assert/Shader/skyBox.vert".
+// Mounts map a path prefix to a source and are searched from the last one to the first, so later mounts override earlier ones.
+// Recently read files stay in a cache up to a byte budget, files written on disk have to be invalidated
+class FileSystem
+{
+public:
+	// Engine wide instance, the working directory is mounted at the root until mounts are changed
+	static FileSystem& get();
+
+	FileSystem();
+
+	void mount(const std::string& mountPoint, std::shared_ptr<FileSource> source);
+	void mountDirectory(const std::string& mountPoint, const std::string& directory);
+	bool mountPack(const std::string& mountPoint, const std::string& path);
+	void unmountAll();
+
+	bool exists(const std::string& path) const;
+	bool read(const std::string& path, FileData& data);
+
+	// Reads on a job system worker and calls back there, the counter tells when it's done.
+	// Without a job system the read and the callback run right away
+	void readAsync(const std::string& path, std::function<void(const std::string&, FileData)> callback, JobCounter* counter = nullptr);
+
+	// Used by async reads and to decompress pack entries in parallel
+	inline void setJobSystem(JobSystem* system) { jobSystem = system; }
+	inline JobSystem* getJobSystem() const { return jobSystem; }
+
+	void invalidate(const std::string& path);
+	void clearCache();
+	void setCacheBudget(size_t bytes);
+
+	static std::string normalizePath(const std::string& path);
+
+private:
+	struct Mount
+	{
+		std::string point; // normalized, empty for the root
+		std::shared_ptr<FileSource> source;
+	};
+
+	struct CacheEntry
+	{
+		FileData data;
+		std::list<std::string>::iterator order;
+	};
+
+	bool findInCache(const std::string& path, FileData& data);
+	void addToCache(const std::string& path, const FileData& data, uint64_t generation);
+	uint64_t getGeneration(const std::string& path) const; // under the lock
+	void trimCache();
+
+	static bool getRelativePath(const Mount& mount, const std::string& path, std::string& relativePath);
+
+private:
+	mutable std::mutex mutex;
+	std::vector<Mount> mounts;
+
+	// Least recently used files are dropped first
+	std::list<std::string> cacheOrder; // most recent first
+	std::unordered_map<std::string, CacheEntry> cache;
+	size_t cacheSize{ 0 };
+	size_t cacheBudget{ 64 * 1024 * 1024 };
+
+	// Bumped when cached files go stale, a read overlapping an invalidation doesn't cache what it read
+	std::unordered_map<std::string, uint64_t> pathGenerations;
+	uint64_t cacheGeneration{ 0 };
+
+	JobSystem* jobSystem{ nullptr };
+};
\ No newline at end of file
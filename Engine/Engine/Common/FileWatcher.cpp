@@ -0,0 +1,198 @@
+#include "FileWatcher.h"
+#include "FileSystem.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+
+FileWatcher::~FileWatcher()
+{
+	clear();
+}
+
+#ifdef _WIN32
+
+bool FileWatcher::watchDirectory(const std::string& directory)
+{
+	HANDLE handle = FindFirstChangeNotificationA(directory.c_str(), TRUE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+	if (handle == INVALID_HANDLE_VALUE)
+	{
+		std::cerr << "FileWatcher::watchDirectory(): can't watch \"" << directory << "\"" << std::endl;
+		return false;
+	}
+
+	WatchedDirectory watched;
+	watched.path = FileSystem::normalizePath(directory);
+	watched.handle = handle;
+
+	// Write times the first notification is compared against
+	scan(watched.path, watched.writeTimes);
+
+	directories.push_back(std::move(watched));
+	return true;
+}
+
+void FileWatcher::clear()
+{
+	for (WatchedDirectory& directory : directories)
+		FindCloseChangeNotification(directory.handle);
+
+	directories.clear();
+}
+
+void FileWatcher::poll(std::vector<std::string>& changedFiles)
+{
+	size_t first = changedFiles.size();
+
+	for (WatchedDirectory& directory : directories)
+	{
+		if (WaitForSingleObject(directory.handle, 0) != WAIT_OBJECT_0)
+			continue;
+
+		// The notification only says something changed, the write times tell what
+		std::unordered_map<std::string, std::filesystem::file_time_type> writeTimes;
+		scan(directory.path, writeTimes);
+
+		for (const auto& [path, writeTime] : writeTimes)
+		{
+			auto it = directory.writeTimes.find(path);
+			if (it == directory.writeTimes.end() || it->second != writeTime)
+				changedFiles.push_back(path);
+		}
+
+		directory.writeTimes = std::move(writeTimes);
+		FindNextChangeNotification(directory.handle);
+	}
+
+	std::sort(changedFiles.begin() + first, changedFiles.end());
+	changedFiles.erase(std::unique(changedFiles.begin() + first, changedFiles.end()), changedFiles.end());
+}
+
+void FileWatcher::scan(const std::string& directory, std::unordered_map<std::string, std::filesystem::file_time_type>& writeTimes)
+{
+	std::error_code error;
+	for (auto it = std::filesystem::recursive_directory_iterator(directory, error); !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error))
+	{
+		if (!it->is_regular_file(error))
+			continue;
+
+		std::filesystem::file_time_type writeTime = it->last_write_time(error);
+		if (!error)
+			writeTimes[FileSystem::normalizePath(it->path().string())] = writeTime;
+	}
+}
+
+#else
+
+bool FileWatcher::watchDirectory(const std::string& directory)
+{
+	if (fileDescriptor < 0)
+	{
+		// Non blocking, poll() drains whatever queued up and returns
+		fileDescriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (fileDescriptor < 0)
+		{
+			std::cerr << "FileWatcher::watchDirectory(): can't initialize inotify" << std::endl;
+			return false;
+		}
+	}
+
+	std::string path = FileSystem::normalizePath(directory);
+	if (!addWatch(path))
+		return false;
+
+	// inotify isn't recursive, every subdirectory gets its own watch
+	std::error_code error;
+	for (auto it = std::filesystem::recursive_directory_iterator(path, error); !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error))
+		if (it->is_directory(error))
+			addWatch(FileSystem::normalizePath(it->path().string()));
+
+	return true;
+}
+
+void FileWatcher::clear()
+{
+	if (fileDescriptor >= 0)
+		close(fileDescriptor);
+
+	fileDescriptor = -1;
+	directories.clear();
+}
+
+void FileWatcher::poll(std::vector<std::string>& changedFiles)
+{
+	if (fileDescriptor < 0)
+		return;
+
+	size_t first = changedFiles.size();
+
+	alignas(inotify_event) char buffer[4096];
+
+	for (;;)
+	{
+		ssize_t size = read(fileDescriptor, buffer, sizeof(buffer));
+		if (size <= 0)
+			break;
+
+		for (ssize_t offset = 0; offset < size; )
+		{
+			const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+			offset += sizeof(inotify_event) + event->len;
+
+			auto it = directories.find(event->wd);
+			if (it == directories.end())
+				continue;
+
+			if (event->mask & IN_IGNORED)
+			{
+				directories.erase(it);
+				continue;
+			}
+
+			if (event->len == 0)
+				continue;
+
+			std::string path = it->second + "/" + event->name;
+
+			if (event->mask & IN_ISDIR)
+			{
+				if (event->mask & (IN_CREATE | IN_MOVED_TO))
+					addWatch(path);
+
+				continue;
+			}
+
+			// Created files are reported once the write closes them
+			if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+				changedFiles.push_back(path);
+		}
+	}
+
+	std::sort(changedFiles.begin() + first, changedFiles.end());
+	changedFiles.erase(std::unique(changedFiles.begin() + first, changedFiles.end()), changedFiles.end());
+}
+
+bool FileWatcher::addWatch(const std::string& directory)
+{
+	// Files closed after a write, files renamed in place the way most editors save, and new subdirectories
+	int watch = inotify_add_watch(fileDescriptor, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR);
+	if (watch < 0)
+	{
+		std::cerr << "FileWatcher::addWatch(): can't watch \"" << directory << "\"" << std::endl;
+		return false;
+	}
+
+	directories[watch] = directory;
+	return true;
+}
+
+#endif
\ No newline at end of file
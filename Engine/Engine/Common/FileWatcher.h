@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <filesystem>
+#endif
+
+// Reports the files written under watched directories, subdirectories included.
+// inotify on Linux, change notifications and a scan of the write times of the changed directory tree on Windows.
+// Nothing runs in the background, changes queue up in the system until poll()
+class FileWatcher
+{
+public:
+	FileWatcher() = default;
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+
+	~FileWatcher();
+
+	bool watchDirectory(const std::string& directory);
+	void clear();
+
+	// Main thread, once per frame. Appends the files written since the last call, once each,
+	// as the watched directory joined with the path below it like "Assert/Shader/Common/Brdf.inc"
+	void poll(std::vector<std::string>& changedFiles);
+
+private:
+#ifdef _WIN32
+	struct WatchedDirectory
+	{
+		std::string path;
+		void* handle{ nullptr };
+		std::unordered_map<std::string, std::filesystem::file_time_type> writeTimes;
+	};
+
+	static void scan(const std::string& directory, std::unordered_map<std::string, std::filesystem::file_time_type>& writeTimes);
+
+	std::vector<WatchedDirectory> directories;
+#else
+	bool addWatch(const std::string& directory);
+
+	int fileDescriptor{ -1 };
+	std::unordered_map<int, std::string> directories; // by watch descriptor
+#endif
+};
\ No newline at end of file
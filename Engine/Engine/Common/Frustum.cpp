@@ -0,0 +1,76 @@
+#include "Frustum.h"
+
+Frustum::Frustum(const glm::mat4& clipFromSpace)
+{
+	// Gribb-Hartmann extraction, GLM matrices are column major
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+		rows[i] = glm::vec4(clipFromSpace[0][i], clipFromSpace[1][i], clipFromSpace[2][i], clipFromSpace[3][i]);
+
+	planes[0] = rows[3] + rows[0];	// left
+	planes[1] = rows[3] - rows[0];	// right
+	planes[2] = rows[3] + rows[1];	// bottom
+	planes[3] = rows[3] - rows[1];	// top
+	planes[4] = rows[3] + rows[2];	// near, conservative for both [0, 1] and [-1, 1] depth ranges
+	planes[5] = rows[3] - rows[2];	// far
+
+	for (glm::vec4& plane : planes)
+	{
+		float length = glm::length(glm::vec3(plane));
+		if (length > 0.0f)
+			plane /= length;
+	}
+}
+
+bool Frustum::intersectsSphere(const glm::vec3& center, float radius) const
+{
+	for (const glm::vec4& plane : planes)
+		if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+			return false;
+
+	return true;
+}
+
+bool Frustum::intersectsBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const
+{
+	for (const glm::vec4& plane : planes)
+	{
+		// Corner furthest along the plane normal
+		glm::vec3 corner(
+			plane.x >= 0.0f ? boundsMax.x : boundsMin.x,
+			plane.y >= 0.0f ? boundsMax.y : boundsMin.y,
+			plane.z >= 0.0f ? boundsMax.z : boundsMin.z);
+
+		if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+			return false;
+	}
+
+	return true;
+}
+
+Frustum::Containment Frustum::classifyBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const
+{
+	Containment result = Containment::Inside;
+
+	for (const glm::vec4& plane : planes)
+	{
+		// Corners furthest along and against the plane normal
+		glm::vec3 positive(
+			plane.x >= 0.0f ? boundsMax.x : boundsMin.x,
+			plane.y >= 0.0f ? boundsMax.y : boundsMin.y,
+			plane.z >= 0.0f ? boundsMax.z : boundsMin.z);
+
+		glm::vec3 negative(
+			plane.x >= 0.0f ? boundsMin.x : boundsMax.x,
+			plane.y >= 0.0f ? boundsMin.y : boundsMax.y,
+			plane.z >= 0.0f ? boundsMin.z : boundsMax.z);
+
+		if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f)
+			return Containment::Outside;
+
+		if (glm::dot(glm::vec3(plane), negative) + plane.w < 0.0f)
+			result = Containment::Intersects;
+	}
+
+	return result;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <array>
+
+// Six inward facing planes, a point p is inside when dot(plane.xyz, p) + plane.w >= 0 for all of them
+class Frustum
+{
+public:
+	enum class Containment
+	{
+		Outside = 0,
+		Intersects,
+		Inside,
+	};
+
+	Frustum() = default;
+
+	// Planes end up in the space the matrix transforms from, pass proj * view * world to get model space planes
+	explicit Frustum(const glm::mat4& clipFromSpace);
+
+	bool intersectsSphere(const glm::vec3& center, float radius) const;
+	bool intersectsBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const;
+
+	// Inside means every corner is inside, hierarchies can accept a whole subtree without further tests
+	Containment classifyBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const;
+
+	inline const std::array<glm::vec4, 6>& getPlanes() const { return planes; }
+
+private:
+	std::array<glm::vec4, 6> planes;
+};
@@ -0,0 +1,285 @@
+#include "FrustumCuller.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+#include <immintrin.h>
+
+#if defined(_MSC_VER)
+	#include <intrin.h>
+	#define AVX_TARGET
+#else
+	#include <cpuid.h>
+	#define AVX_TARGET __attribute__((target("avx")))
+#endif
+
+static const uint32_t SIMD_WIDTH = 8;
+
+uint32_t FrustumCuller::addObject(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	uint32_t index = numObjects++;
+
+	// Padding entries are culled by the lane mask of the last batch
+	size_t capacity = (numObjects + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+	for (std::vector<float>* values : { &centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ })
+		values->resize(capacity, 0.0f);
+
+	setObject(index, boundsMin, boundsMax);
+	return index;
+}
+
+void FrustumCuller::setObject(uint32_t index, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+	glm::vec3 extent = (boundsMax - boundsMin) * 0.5f;
+
+	centerX[index] = center.x;
+	centerY[index] = center.y;
+	centerZ[index] = center.z;
+	extentX[index] = extent.x;
+	extentY[index] = extent.y;
+	extentZ[index] = extent.z;
+}
+
+void FrustumCuller::clear()
+{
+	for (std::vector<float>* values : { &centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ })
+		values->clear();
+
+	numObjects = 0;
+}
+
+uint32_t FrustumCuller::cull(const Frustum& frustum, std::vector<uint32_t>& visible, Path path) const
+{
+	// Compaction writes whole batches before the count is known
+	visible.resize(centerX.size());
+
+	if (path == Path::Auto)
+		path = isAVXSupported() ? Path::AVX : Path::SSE;
+
+	uint32_t numVisible = 0;
+	switch (path)
+	{
+		case Path::Scalar: numVisible = cullScalar(frustum, visible.data()); break;
+		case Path::SSE: numVisible = cullSSE(frustum, visible.data()); break;
+		case Path::AVX: numVisible = cullAVX(frustum, visible.data()); break;
+		case Path::Auto: assert(false && "Path::Auto is resolved above"); break;
+	}
+
+	visible.resize(numVisible);
+	return numVisible;
+}
+
+bool FrustumCuller::isAVXSupported()
+{
+	static const bool supported = []()
+	{
+		// CPUID.1:ECX bit 27 OSXSAVE and bit 28 AVX, then XCR0 must enable the XMM and YMM states
+		unsigned int ecx = 0;
+#if defined(_MSC_VER)
+		int info[4] = {};
+		__cpuid(info, 1);
+		ecx = static_cast<unsigned int>(info[2]);
+#else
+		unsigned int eax = 0, ebx = 0, edx = 0;
+		if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+			return false;
+#endif
+		if ((ecx & (1u << 27)) == 0 || (ecx & (1u << 28)) == 0)
+			return false;
+
+#if defined(_MSC_VER)
+		unsigned long long xcr0 = _xgetbv(0);
+#else
+		unsigned int xcr0Low = 0, xcr0High = 0;
+		__asm__("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+		unsigned long long xcr0 = xcr0Low;
+#endif
+		return (xcr0 & 0x6) == 0x6;
+	}();
+
+	return supported;
+}
+
+uint32_t FrustumCuller::cullScalar(const Frustum& frustum, uint32_t* visible) const
+{
+	const std::array<glm::vec4, 6>& planes = frustum.getPlanes();
+	uint32_t numVisible = 0;
+
+	for (uint32_t i = 0; i < numObjects; i++)
+	{
+		bool inside = true;
+		for (const glm::vec4& plane : planes)
+		{
+			// Signed distance of the center against the projected half extent
+			float distance = plane.x * centerX[i] + plane.y * centerY[i] + plane.z * centerZ[i] + plane.w;
+			float radius = fabs(plane.x) * extentX[i] + fabs(plane.y) * extentY[i] + fabs(plane.z) * extentZ[i];
+
+			if (distance + radius < 0.0f)
+			{
+				inside = false;
+				break;
+			}
+		}
+
+		if (inside)
+			visible[numVisible++] = i;
+	}
+
+	return numVisible;
+}
+
+uint32_t FrustumCuller::cullSSE(const Frustum& frustum, uint32_t* visible) const
+{
+	const std::array<glm::vec4, 6>& planes = frustum.getPlanes();
+
+	__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+	__m128 absPlaneX[6], absPlaneY[6], absPlaneZ[6];
+
+	for (int k = 0; k < 6; k++)
+	{
+		planeX[k] = _mm_set1_ps(planes[k].x);
+		planeY[k] = _mm_set1_ps(planes[k].y);
+		planeZ[k] = _mm_set1_ps(planes[k].z);
+		planeW[k] = _mm_set1_ps(planes[k].w);
+		absPlaneX[k] = _mm_set1_ps(fabs(planes[k].x));
+		absPlaneY[k] = _mm_set1_ps(fabs(planes[k].y));
+		absPlaneZ[k] = _mm_set1_ps(fabs(planes[k].z));
+	}
+
+	const __m128 zero = _mm_setzero_ps();
+	uint32_t numVisible = 0;
+
+	for (uint32_t i = 0; i < numObjects; i += 4)
+	{
+		__m128 cx = _mm_loadu_ps(&centerX[i]);
+		__m128 cy = _mm_loadu_ps(&centerY[i]);
+		__m128 cz = _mm_loadu_ps(&centerZ[i]);
+		__m128 ex = _mm_loadu_ps(&extentX[i]);
+		__m128 ey = _mm_loadu_ps(&extentY[i]);
+		__m128 ez = _mm_loadu_ps(&extentZ[i]);
+
+		// A lane is culled as soon as one plane has the whole box behind it
+		__m128 outside = zero;
+		for (int k = 0; k < 6; k++)
+		{
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[k], cx), _mm_mul_ps(planeY[k], cy)), _mm_add_ps(_mm_mul_ps(planeZ[k], cz), planeW[k]));
+			__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absPlaneX[k], ex), _mm_mul_ps(absPlaneY[k], ey)), _mm_mul_ps(absPlaneZ[k], ez));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+		}
+
+		uint32_t mask = ~static_cast<uint32_t>(_mm_movemask_ps(outside)) & 0xF;
+		if (numObjects - i < 4)
+			mask &= (1u << (numObjects - i)) - 1;
+
+		// Branchless compaction, every lane is written and only visible ones advance the cursor
+		for (uint32_t lane = 0; lane < 4; lane++)
+		{
+			visible[numVisible] = i + lane;
+			numVisible += (mask >> lane) & 1;
+		}
+	}
+
+	return numVisible;
+}
+
+AVX_TARGET uint32_t FrustumCuller::cullAVX(const Frustum& frustum, uint32_t* visible) const
+{
+	if (!isAVXSupported())
+		return cullSSE(frustum, visible);
+
+	const std::array<glm::vec4, 6>& planes = frustum.getPlanes();
+
+	__m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+	__m256 absPlaneX[6], absPlaneY[6], absPlaneZ[6];
+
+	for (int k = 0; k < 6; k++)
+	{
+		planeX[k] = _mm256_set1_ps(planes[k].x);
+		planeY[k] = _mm256_set1_ps(planes[k].y);
+		planeZ[k] = _mm256_set1_ps(planes[k].z);
+		planeW[k] = _mm256_set1_ps(planes[k].w);
+		absPlaneX[k] = _mm256_set1_ps(fabs(planes[k].x));
+		absPlaneY[k] = _mm256_set1_ps(fabs(planes[k].y));
+		absPlaneZ[k] = _mm256_set1_ps(fabs(planes[k].z));
+	}
+
+	const __m256 zero = _mm256_setzero_ps();
+	uint32_t numVisible = 0;
+
+	for (uint32_t i = 0; i < numObjects; i += 8)
+	{
+		__m256 cx = _mm256_loadu_ps(&centerX[i]);
+		__m256 cy = _mm256_loadu_ps(&centerY[i]);
+		__m256 cz = _mm256_loadu_ps(&centerZ[i]);
+		__m256 ex = _mm256_loadu_ps(&extentX[i]);
+		__m256 ey = _mm256_loadu_ps(&extentY[i]);
+		__m256 ez = _mm256_loadu_ps(&extentZ[i]);
+
+		__m256 outside = zero;
+		for (int k = 0; k < 6; k++)
+		{
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[k], cx), _mm256_mul_ps(planeY[k], cy)), _mm256_add_ps(_mm256_mul_ps(planeZ[k], cz), planeW[k]));
+			__m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(absPlaneX[k], ex), _mm256_mul_ps(absPlaneY[k], ey)), _mm256_mul_ps(absPlaneZ[k], ez));
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), zero, _CMP_LT_OQ));
+		}
+
+		uint32_t mask = ~static_cast<uint32_t>(_mm256_movemask_ps(outside)) & 0xFF;
+		if (numObjects - i < 8)
+			mask &= (1u << (numObjects - i)) - 1;
+
+		for (uint32_t lane = 0; lane < 8; lane++)
+		{
+			visible[numVisible] = i + lane;
+			numVisible += (mask >> lane) & 1;
+		}
+	}
+
+	// Avoid the AVX to SSE transition penalty in the caller
+	_mm256_zeroupper();
+
+	return numVisible;
+}
+
+FrustumCuller::BenchmarkResult FrustumCuller::runBenchmark(const Frustum& frustum, uint32_t numObjects, uint32_t numIterations)
+{
+	// Fixed seed so runs are comparable, boxes fill a cube around the origin where the scene lives
+	std::mt19937 generator(1234);
+	std::uniform_real_distribution<float> position(-50.0f, 50.0f);
+	std::uniform_real_distribution<float> size(0.1f, 2.0f);
+
+	FrustumCuller culler;
+	for (uint32_t i = 0; i < numObjects; i++)
+	{
+		glm::vec3 center(position(generator), position(generator), position(generator));
+		glm::vec3 extent(size(generator), size(generator), size(generator));
+		culler.addObject(center - extent, center + extent);
+	}
+
+	BenchmarkResult result;
+	result.numObjects = numObjects;
+
+	std::vector<uint32_t> visible;
+	visible.reserve(culler.centerX.size());
+
+	auto measure = [&](Path path)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < numIterations; i++)
+			result.numVisible = culler.cull(frustum, visible, path);
+		auto end = std::chrono::high_resolution_clock::now();
+
+		return std::chrono::duration<double, std::milli>(end - start).count() / std::max(numIterations, 1u);
+	};
+
+	result.scalarMs = measure(Path::Scalar);
+	result.sseMs = measure(Path::SSE);
+
+	if (isAVXSupported())
+		result.avxMs = measure(Path::AVX);
+
+	return result;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Frustum.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Axis aligned boxes stored as structure of arrays, culled 4 (SSE) or 8 (AVX) at a time
+class FrustumCuller
+{
+public:
+	enum class Path
+	{
+		Auto = 0,	// AVX when the CPU and the OS support it, SSE otherwise
+		Scalar,
+		SSE,
+		AVX,
+	};
+
+	struct BenchmarkResult
+	{
+		uint32_t numObjects{ 0 };
+		uint32_t numVisible{ 0 };
+		double scalarMs{ 0.0 };	// average time of one cull call
+		double sseMs{ 0.0 };
+		double avxMs{ 0.0 };	// 0.0 when AVX is not supported
+	};
+
+	// Returns the object index
+	uint32_t addObject(const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+	void setObject(uint32_t index, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+	void clear();
+
+	inline uint32_t getNumObjects() const { return numObjects; }
+
+	// Writes the indices of the objects intersecting the frustum in ascending order, returns their number
+	uint32_t cull(const Frustum& frustum, std::vector<uint32_t>& visible, Path path = Path::Auto) const;
+
+	static bool isAVXSupported();
+
+	// Culls numObjects random boxes spread around the frustum with every path
+	static BenchmarkResult runBenchmark(const Frustum& frustum, uint32_t numObjects = 100000, uint32_t numIterations = 100);
+
+private:
+	uint32_t cullScalar(const Frustum& frustum, uint32_t* visible) const;
+	uint32_t cullSSE(const Frustum& frustum, uint32_t* visible) const;
+	uint32_t cullAVX(const Frustum& frustum, uint32_t* visible) const;
+
+private:
+	// Center and half extent, padded to a multiple of 8 entries
+	std::vector<float> centerX;
+	std::vector<float> centerY;
+	std::vector<float> centerZ;
+	std::vector<float> extentX;
+	std::vector<float> extentY;
+	std::vector<float> extentZ;
+
+	uint32_t numObjects{ 0 };
+};
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+template<typename T>
+class HandlePool;
+
+// 32-bit reference to a pool slot, the index in the low bits and the generation of the slot in the high bits.
+// Freeing a slot bumps its generation, so handles to a freed resource stop resolving instead of aliasing the next one
+template<typename T>
+class Handle
+{
+public:
+	Handle() = default;
+
+	inline bool isValid() const { return value != 0; }
+	inline uint32_t getIndex() const { return value & INDEX_MASK; }
+	inline uint32_t getGeneration() const { return value >> INDEX_BITS; }
+	inline uint32_t getValue() const { return value; }
+
+	inline bool operator==(const Handle& other) const { return value == other.value; }
+	inline bool operator!=(const Handle& other) const { return value != other.value; }
+	inline bool operator<(const Handle& other) const { return value < other.value; }
+
+	enum
+	{
+		INDEX_BITS = 20,
+		INDEX_MASK = (1u << INDEX_BITS) - 1,
+		MAX_GENERATION = (1u << (32 - INDEX_BITS)) - 1,
+	};
+
+private:
+	friend class HandlePool<T>;
+
+	Handle(uint32_t index, uint32_t generation)
+		: value(index | (generation << INDEX_BITS)) { }
+
+	uint32_t value{ 0 }; // generations start at 1, 0 is never a live handle
+};
+
+// Sparse slots pointing into dense arrays: lookups are two array reads with no hashing, removal swaps
+// the last resource into the hole so live resources always sit next to each other.
+// Slots count their users, add() hands out the first reference
+template<typename T>
+class HandlePool
+{
+public:
+	Handle<T> add(T* resource)
+	{
+		uint32_t index = 0;
+		if (!freeSlots.empty())
+		{
+			index = freeSlots.back();
+			freeSlots.pop_back();
+		}
+		else
+		{
+			index = static_cast<uint32_t>(slots.size());
+			assert(index <= Handle<T>::INDEX_MASK);
+			slots.push_back(Slot());
+		}
+
+		Slot& slot = slots[index];
+		slot.dense = static_cast<uint32_t>(resources.size());
+		slot.references = 1;
+
+		resources.push_back(resource);
+		denseSlots.push_back(index);
+
+		return Handle<T>(index, slot.generation);
+	}
+
+	// Removes the resource whatever its reference count, returns it for the caller to release. nullptr for stale handles
+	T* remove(Handle<T> handle)
+	{
+		if (!contains(handle))
+			return nullptr;
+
+		Slot& slot = slots[handle.getIndex()];
+		T* resource = resources[slot.dense];
+
+		// The last resource fills the hole
+		uint32_t last = static_cast<uint32_t>(resources.size()) - 1;
+		resources[slot.dense] = resources[last];
+		denseSlots[slot.dense] = denseSlots[last];
+		slots[denseSlots[slot.dense]].dense = slot.dense;
+
+		resources.pop_back();
+		denseSlots.pop_back();
+
+		slot.dense = INVALID_DENSE;
+		slot.references = 0;
+		slot.generation = (slot.generation == Handle<T>::MAX_GENERATION) ? 1 : slot.generation + 1;
+		freeSlots.push_back(handle.getIndex());
+
+		return resource;
+	}
+
+	inline void addReference(Handle<T> handle)
+	{
+		assert(contains(handle));
+		slots[handle.getIndex()].references++;
+	}
+
+	// Drops one reference. True once the last one is gone, the resource is removed and handed back for the caller to release
+	bool release(Handle<T> handle, T*& resource)
+	{
+		if (!contains(handle) || --slots[handle.getIndex()].references > 0)
+			return false;
+
+		resource = remove(handle);
+		return true;
+	}
+
+	inline uint32_t getReferences(Handle<T> handle) const { return contains(handle) ? slots[handle.getIndex()].references : 0; }
+
+	// Swaps the resource behind a live handle, returns the previous one
+	T* replace(Handle<T> handle, T* resource)
+	{
+		assert(contains(handle));
+
+		T*& current = resources[slots[handle.getIndex()].dense];
+		T* previous = current;
+		current = resource;
+
+		return previous;
+	}
+
+	inline bool contains(Handle<T> handle) const
+	{
+		uint32_t index = handle.getIndex();
+		return handle.isValid() && index < slots.size() && slots[index].generation == handle.getGeneration() && slots[index].dense != INVALID_DENSE;
+	}
+
+	// nullptr for stale handles
+	inline T* get(Handle<T> handle) const { return contains(handle) ? resources[slots[handle.getIndex()].dense] : nullptr; }
+
+	// Live resources in no particular order, getHandle() maps a position back to its handle
+	inline const std::vector<T*>& getResources() const { return resources; }
+	inline Handle<T> getHandle(uint32_t position) const { return Handle<T>(denseSlots[position], slots[denseSlots[position]].generation); }
+	inline uint32_t getSize() const { return static_cast<uint32_t>(resources.size()); }
+
+private:
+	enum
+	{
+		INVALID_DENSE = 0xFFFFFFFF,
+	};
+
+	struct Slot
+	{
+		uint32_t generation{ 1 };
+		uint32_t dense{ INVALID_DENSE };
+		uint32_t references{ 0 };
+	};
+
+	std::vector<Slot> slots;
+	std::vector<uint32_t> freeSlots;
+
+	std::vector<T*> resources;
+	std::vector<uint32_t> denseSlots; // slot of every resource
+};
\ No newline at end of file
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// 64-bit FNV-1a, pass the previous result as seed to hash several blocks
+static const uint64_t FNV1A_OFFSET_BASIS = 14695981039346656037ull;
+static const uint64_t FNV1A_PRIME = 1099511628211ull;
+
+inline uint64_t hashFNV1a(const void* data, size_t size, uint64_t seed = FNV1A_OFFSET_BASIS)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+	uint64_t hash = seed;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= FNV1A_PRIME;
+	}
+
+	return hash;
+}
\ No newline at end of file
@@ -0,0 +1,325 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cassert>
+
+static thread_local uint32_t currentThreadIndex = JobSystem::INVALID_THREAD;
+
+bool JobSystem::WorkQueue::push(Job* job)
+{
+	int64_t b = bottom.load(std::memory_order_relaxed);
+	int64_t t = top.load(std::memory_order_acquire);
+
+	if (b - t >= CAPACITY)
+		return false;
+
+	jobs[b & MASK].store(job, std::memory_order_relaxed);
+	bottom.store(b + 1, std::memory_order_release);
+
+	return true;
+}
+
+Job* JobSystem::WorkQueue::pop()
+{
+	int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+	bottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t t = top.load(std::memory_order_relaxed);
+
+	if (t > b)
+	{
+		// Empty
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Job* job = jobs[b & MASK].load(std::memory_order_relaxed);
+
+	// The last job can be stolen at the same time, whoever moves top first takes it
+	if (t == b)
+	{
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			job = nullptr;
+
+		bottom.store(b + 1, std::memory_order_relaxed);
+	}
+
+	return job;
+}
+
+Job* JobSystem::WorkQueue::steal()
+{
+	int64_t t = top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t b = bottom.load(std::memory_order_acquire);
+
+	if (t >= b)
+		return nullptr;
+
+	Job* job = jobs[t & MASK].load(std::memory_order_relaxed);
+
+	if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		return nullptr;
+
+	return job;
+}
+
+JobSystem::JobSystem(uint32_t numThreads)
+{
+	if (numThreads == 0)
+		numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+	for (uint32_t thread = 0; thread < numThreads; thread++)
+		queues.push_back(std::make_unique<WorkQueue>());
+
+	assert(currentThreadIndex == INVALID_THREAD && "One job system per thread");
+	currentThreadIndex = 0;
+
+	for (uint32_t thread = 1; thread < numThreads; thread++)
+		workers.emplace_back(&JobSystem::workerLoop, this, thread);
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopping = true;
+	}
+	wakeCondition.notify_all();
+
+	for (std::thread& worker : workers)
+		worker.join();
+
+	currentThreadIndex = INVALID_THREAD;
+}
+
+uint32_t JobSystem::getThreadIndex()
+{
+	return currentThreadIndex;
+}
+
+void JobSystem::run(std::function<void()> function, JobCounter* counter, JobCounter* dependency)
+{
+	Job* job = new Job();
+	job->function = std::move(function);
+	job->counter = counter;
+
+	if (counter)
+		counter->count++;
+
+	if (dependency)
+	{
+		// Checked under the lock, the thread finishing the dependency takes the lock before scheduling
+		std::lock_guard<std::mutex> lock(dependency->mutex);
+		if (!dependency->isDone())
+		{
+			dependency->continuations.push_back(job);
+			return;
+		}
+	}
+
+	schedule(job);
+}
+
+void JobSystem::runBackground(std::function<void()> function, JobCounter* counter)
+{
+	Job* job = new Job();
+	job->function = std::move(function);
+	job->counter = counter;
+
+	if (counter)
+		counter->count++;
+
+	{
+		std::lock_guard<std::mutex> lock(backgroundMutex);
+		backgroundJobs.push_back(job);
+	}
+
+	numQueuedJobs++;
+	wakeWorker();
+}
+
+void JobSystem::schedule(Job* job)
+{
+	uint32_t thread = currentThreadIndex;
+
+	if (thread < queues.size())
+	{
+		// A full queue runs the job right away, which keeps the order a deque would have given
+		if (!queues[thread]->push(job))
+		{
+			execute(job);
+			return;
+		}
+	}
+	else
+	{
+		std::lock_guard<std::mutex> lock(externalMutex);
+		externalJobs.push_back(job);
+	}
+
+	numQueuedJobs++;
+	wakeWorker();
+}
+
+void JobSystem::wakeWorker()
+{
+	if (numSleeping.load() > 0)
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		wakeCondition.notify_one();
+	}
+}
+
+void JobSystem::execute(Job* job)
+{
+	job->function();
+
+	JobCounter* counter = job->counter;
+	delete job;
+
+	if (counter == nullptr)
+		return;
+
+	// Jobs that can't be the last one never touch the lock
+	uint32_t count = counter->count.load();
+	while (count > 1 && !counter->count.compare_exchange_weak(count, count - 1));
+
+	if (count > 1)
+		return;
+
+	// The last decrement happens under the lock, a waiter takes it before letting the counter go
+	std::vector<Job*> continuations;
+	{
+		std::lock_guard<std::mutex> lock(counter->mutex);
+		if (--counter->count > 0)
+			return;
+
+		continuations.swap(counter->continuations);
+	}
+
+	for (Job* continuation : continuations)
+		schedule(continuation);
+}
+
+Job* JobSystem::findJob(uint32_t thread)
+{
+	Job* job = nullptr;
+
+	// Threads without a queue have no index to hand to parallelFor batches, they leave the queues alone
+	if (thread < queues.size())
+	{
+		job = queues[thread]->pop();
+
+		// Victims in a different order on every thread
+		for (uint32_t i = 1; job == nullptr && i < queues.size(); i++)
+			job = queues[(thread + i) % queues.size()]->steal();
+	}
+
+	if (job == nullptr)
+	{
+		std::lock_guard<std::mutex> lock(externalMutex);
+		if (!externalJobs.empty())
+		{
+			job = externalJobs.front();
+			externalJobs.pop_front();
+		}
+	}
+
+	if (job)
+		numQueuedJobs--;
+
+	return job;
+}
+
+Job* JobSystem::findBackgroundJob()
+{
+	std::lock_guard<std::mutex> lock(backgroundMutex);
+	if (backgroundJobs.empty())
+		return nullptr;
+
+	Job* job = backgroundJobs.front();
+	backgroundJobs.pop_front();
+
+	numQueuedJobs--;
+	return job;
+}
+
+void JobSystem::wait(JobCounter& counter)
+{
+	uint32_t thread = currentThreadIndex;
+
+	while (!counter.isDone())
+	{
+		Job* job = findJob(thread);
+
+		// Nobody else would ever run them
+		if (job == nullptr && workers.empty())
+			job = findBackgroundJob();
+
+		if (job)
+			execute(job);
+		else
+			std::this_thread::yield();
+	}
+
+	// The thread finishing the last job may still hold the lock
+	std::lock_guard<std::mutex> lock(counter.mutex);
+}
+
+void JobSystem::parallelFor(uint32_t count, const std::function<void(uint32_t, uint32_t)>& function, uint32_t batchSize)
+{
+	parallelForRange(count, batchSize, [&function](uint32_t begin, uint32_t end, uint32_t thread)
+	{
+		for (uint32_t i = begin; i < end; i++)
+			function(i, thread);
+	});
+}
+
+void JobSystem::parallelForRange(uint32_t count, uint32_t batchSize, const std::function<void(uint32_t, uint32_t, uint32_t)>& function)
+{
+	// Another thread would have to borrow the index of a job system thread, and its scratch with it
+	assert(currentThreadIndex < queues.size() && "parallelFor from a thread the job system doesn't own");
+
+	batchSize = std::max(batchSize, 1u);
+
+	if (count <= batchSize || queues.size() == 1)
+	{
+		function(0, count, currentThreadIndex);
+		return;
+	}
+
+	// The function outlives the jobs, wait() returns once all of them ran
+	JobCounter counter;
+	for (uint32_t begin = 0; begin < count; begin += batchSize)
+	{
+		uint32_t end = std::min(begin + batchSize, count);
+		run([&function, begin, end]() { function(begin, end, currentThreadIndex); }, &counter);
+	}
+
+	wait(counter);
+}
+
+void JobSystem::workerLoop(uint32_t thread)
+{
+	currentThreadIndex = thread;
+
+	while (!stopping)
+	{
+		// Frame jobs first, background jobs only when there is nothing else
+		Job* job = findJob(thread);
+		if (job == nullptr)
+			job = findBackgroundJob();
+
+		if (job)
+		{
+			execute(job);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		numSleeping++;
+		wakeCondition.wait(lock, [this]() { return stopping || numQueuedJobs.load() > 0; });
+		numSleeping--;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem;
+struct Job;
+
+// Number of unfinished jobs of a group. Jobs can wait on a counter before they start,
+// threads waiting on one execute other jobs in the meantime
+class JobCounter
+{
+public:
+	JobCounter() = default;
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator=(const JobCounter&) = delete;
+
+	inline bool isDone() const { return count.load() == 0; }
+
+private:
+	friend class JobSystem;
+
+	std::atomic<uint32_t> count{ 0 };
+
+	// Jobs depending on the counter, scheduled by the thread finishing its last job
+	std::mutex mutex;
+	std::vector<Job*> continuations;
+};
+
+struct Job
+{
+	std::function<void()> function;
+	JobCounter* counter{ nullptr };
+};
+
+// Fixed pool of workers, each owning a lock-free deque it pushes and pops at the bottom while idle threads steal
+// at the top. The thread creating the job system is thread 0, the workers follow. Other threads can submit jobs,
+// they go through a locked queue. Workers sleep when there is nothing to run or steal
+class JobSystem
+{
+public:
+	// 0 threads uses every hardware thread, the creating thread counts as one
+	explicit JobSystem(uint32_t numThreads = 0);
+	~JobSystem();
+
+	// The counter is incremented right away and decremented once the job finished,
+	// the job starts once the dependency counter reached zero
+	void run(std::function<void()> function, JobCounter* counter = nullptr, JobCounter* dependency = nullptr);
+
+	// Long jobs like reading and decoding files, which must not hold up a frame. They go to a queue only the
+	// workers take from between jobs, never thread 0 and never a thread inside wait(). Without workers
+	// wait() runs them once nothing else is left
+	void runBackground(std::function<void()> function, JobCounter* counter = nullptr);
+
+	// Runs jobs until the counter reaches zero. Threads the job system doesn't own only run jobs submitted
+	// by such threads, never the ones of the thread queues, which may expect a thread index
+	void wait(JobCounter& counter);
+
+	// Runs function(index, thread) for index in [0, count), batches of indices form one job.
+	// Thread is the job system thread index in [0, getNumThreads()), stable while the job runs and never shared,
+	// so callers can index per thread scratch with it. Only the job system threads can call it, which is asserted.
+	// Returns once every index ran
+	void parallelFor(uint32_t count, const std::function<void(uint32_t, uint32_t)>& function, uint32_t batchSize = 1);
+
+	// Same but hands whole [begin, end) ranges to the function
+	void parallelForRange(uint32_t count, uint32_t batchSize, const std::function<void(uint32_t, uint32_t, uint32_t)>& function);
+
+	inline uint32_t getNumThreads() const { return static_cast<uint32_t>(queues.size()); }
+
+	// Index of the calling thread in this job system, INVALID_THREAD for threads it doesn't own
+	static uint32_t getThreadIndex();
+
+	enum
+	{
+		INVALID_THREAD = 0xFFFFFFFF,
+	};
+
+private:
+	// Chase-Lev work stealing deque of fixed capacity
+	class WorkQueue
+	{
+	public:
+		// Owner thread only, returns false when full
+		bool push(Job* job);
+		Job* pop();
+
+		// Any thread
+		Job* steal();
+
+		enum
+		{
+			CAPACITY = 4096,
+			MASK = CAPACITY - 1,
+		};
+
+	private:
+		std::atomic<int64_t> top{ 0 };
+		std::atomic<int64_t> bottom{ 0 };
+		std::atomic<Job*> jobs[CAPACITY];
+	};
+
+	void schedule(Job* job);
+	void execute(Job* job);
+	Job* findJob(uint32_t thread);
+	Job* findBackgroundJob();
+	void wakeWorker();
+
+	void workerLoop(uint32_t thread);
+
+private:
+	std::vector<std::unique_ptr<WorkQueue>> queues; // one per thread
+	std::vector<std::thread> workers;
+
+	// Jobs submitted by threads without a queue
+	std::mutex externalMutex;
+	std::deque<Job*> externalJobs;
+
+	std::mutex backgroundMutex;
+	std::deque<Job*> backgroundJobs;
+
+	std::atomic<int32_t> numQueuedJobs{ 0 };
+	std::atomic<uint32_t> numSleeping{ 0 };
+	std::mutex sleepMutex;
+	std::condition_variable wakeCondition;
+	std::atomic<bool> stopping{ false };
+};
\ No newline at end of file
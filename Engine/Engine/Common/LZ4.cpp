@@ -0,0 +1,191 @@
+#include "LZ4.h"
+
+#include <cassert>
+#include <cstring>
+
+static const size_t MIN_MATCH = 4;
+static const size_t LAST_LITERALS = 5; // the block ends with at least this many literals
+static const size_t MATCH_LIMIT = 12; // no match starts in the last bytes of the block
+static const size_t MAX_OFFSET = 0xFFFF;
+static const uint32_t HASH_BITS = 12;
+
+static inline uint32_t read32(const uint8_t* data)
+{
+	uint32_t value;
+	memcpy(&value, data, sizeof(uint32_t));
+	return value;
+}
+
+static inline uint32_t hashSequence(uint32_t sequence)
+{
+	return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static uint8_t* writeLength(uint8_t* out, size_t length)
+{
+	while (length >= 255)
+	{
+		*out++ = 255;
+		length -= 255;
+	}
+
+	*out++ = static_cast<uint8_t>(length);
+	return out;
+}
+
+static bool readLength(const uint8_t*& in, const uint8_t* end, size_t& length)
+{
+	uint8_t byte = 0;
+	do
+	{
+		if (in == end)
+			return false;
+
+		byte = *in++;
+		length += byte;
+	} while (byte == 255);
+
+	return true;
+}
+
+// Literals followed by a match, or only literals for the last sequence of the block (matchLength 0)
+static uint8_t* writeSequence(uint8_t* out, uint8_t* end, const uint8_t* literals, size_t numLiterals, size_t offset, size_t matchLength)
+{
+	size_t worstCase = 1 + numLiterals / 255 + 1 + numLiterals + 2 + matchLength / 255 + 1;
+	if (static_cast<size_t>(end - out) < worstCase)
+		return nullptr;
+
+	size_t matchCode = (matchLength > 0) ? matchLength - MIN_MATCH : 0;
+
+	uint8_t* token = out++;
+	*token = static_cast<uint8_t>(((numLiterals < 15) ? numLiterals : 15) << 4);
+
+	if (numLiterals >= 15)
+		out = writeLength(out, numLiterals - 15);
+
+	memcpy(out, literals, numLiterals);
+	out += numLiterals;
+
+	if (matchLength == 0)
+		return out;
+
+	*out++ = static_cast<uint8_t>(offset & 0xFF);
+	*out++ = static_cast<uint8_t>(offset >> 8);
+
+	*token |= static_cast<uint8_t>((matchCode < 15) ? matchCode : 15);
+	if (matchCode >= 15)
+		out = writeLength(out, matchCode - 15);
+
+	return out;
+}
+
+size_t compressLZ4(const uint8_t* source, size_t size, uint8_t* destination, size_t capacity)
+{
+	assert(size <= LZ4_MAX_BLOCK_SIZE);
+
+	// Last position + 1 of every hashed 4 byte sequence, 0 when none was seen
+	uint32_t table[1 << HASH_BITS] = {};
+
+	uint8_t* out = destination;
+	uint8_t* end = destination + capacity;
+
+	size_t anchor = 0;
+	size_t position = 0;
+
+	while (position + MATCH_LIMIT < size)
+	{
+		uint32_t sequence = read32(source + position);
+		uint32_t hash = hashSequence(sequence);
+
+		size_t candidate = table[hash];
+		table[hash] = static_cast<uint32_t>(position + 1);
+
+		if (candidate == 0 || position - (candidate - 1) > MAX_OFFSET || read32(source + candidate - 1) != sequence)
+		{
+			position++;
+			continue;
+		}
+
+		size_t match = candidate - 1;
+		size_t length = MIN_MATCH;
+
+		while (position + length < size - LAST_LITERALS && source[match + length] == source[position + length])
+			length++;
+
+		// Literals right before the match may belong to it as well
+		while (position > anchor && match > 0 && source[position - 1] == source[match - 1])
+		{
+			position--;
+			match--;
+			length++;
+		}
+
+		out = writeSequence(out, end, source + anchor, position - anchor, position - match, length);
+		if (!out)
+			return 0;
+
+		position += length;
+		anchor = position;
+	}
+
+	out = writeSequence(out, end, source + anchor, size - anchor, 0, 0);
+	if (!out)
+		return 0;
+
+	return static_cast<size_t>(out - destination);
+}
+
+bool decompressLZ4(const uint8_t* source, size_t sourceSize, uint8_t* destination, size_t size)
+{
+	const uint8_t* in = source;
+	const uint8_t* inEnd = source + sourceSize;
+
+	uint8_t* out = destination;
+	uint8_t* outEnd = destination + size;
+
+	while (in < inEnd)
+	{
+		uint8_t token = *in++;
+
+		size_t numLiterals = token >> 4;
+		if (numLiterals == 15 && !readLength(in, inEnd, numLiterals))
+			return false;
+
+		if (numLiterals > static_cast<size_t>(inEnd - in) || numLiterals > static_cast<size_t>(outEnd - out))
+			return false;
+
+		memcpy(out, in, numLiterals);
+		in += numLiterals;
+		out += numLiterals;
+
+		// The last sequence has no match
+		if (in == inEnd)
+			break;
+
+		if (inEnd - in < 2)
+			return false;
+
+		size_t offset = in[0] | (in[1] << 8);
+		in += 2;
+
+		if (offset == 0 || offset > static_cast<size_t>(out - destination))
+			return false;
+
+		size_t length = token & 15;
+		if (length == 15 && !readLength(in, inEnd, length))
+			return false;
+
+		length += MIN_MATCH;
+		if (length > static_cast<size_t>(outEnd - out))
+			return false;
+
+		// Byte by byte, overlapping matches repeat the last offset bytes
+		const uint8_t* match = out - offset;
+		for (size_t i = 0; i < length; i++)
+			out[i] = match[i];
+
+		out += length;
+	}
+
+	return out == outEnd;
+}
\ No newline at end of file
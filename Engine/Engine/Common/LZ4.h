@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// LZ4 block format, without the frame around it. Blocks are at most 64 KB so match offsets always fit
+
+static const size_t LZ4_MAX_BLOCK_SIZE = 64 * 1024;
+
+// Worst case compressed size of a block, incompressible data grows a little
+inline size_t getLZ4Bound(size_t size)
+{
+	return size + size / 255 + 16;
+}
+
+// Returns the compressed size, 0 when it doesn't fit in the capacity
+size_t compressLZ4(const uint8_t* source, size_t size, uint8_t* destination, size_t capacity);
+
+// False for corrupt blocks or blocks that don't decompress to exactly size bytes
+bool decompressLZ4(const uint8_t* source, size_t sourceSize, uint8_t* destination, size_t size);
\ No newline at end of file
@@ -0,0 +1,112 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <iostream>
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const std::string& path)
+{
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize))
+	{
+		std::cerr << "MappedFile::open(): can't get the size of \"" << path << "\"" << std::endl;
+		CloseHandle(file);
+		return false;
+	}
+
+	fileHandle = file;
+	size = static_cast<size_t>(fileSize.QuadPart);
+	opened = true;
+
+	// Empty files can't be mapped
+	if (size == 0)
+		return true;
+
+	mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mappingHandle)
+		data = static_cast<const uint8_t*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+#else
+	fileDescriptor = ::open(path.c_str(), O_RDONLY);
+	if (fileDescriptor < 0)
+		return false;
+
+	struct stat fileStat;
+	if (fstat(fileDescriptor, &fileStat) != 0)
+	{
+		std::cerr << "MappedFile::open(): can't get the size of \"" << path << "\"" << std::endl;
+		::close(fileDescriptor);
+		fileDescriptor = -1;
+		return false;
+	}
+
+	size = static_cast<size_t>(fileStat.st_size);
+	opened = true;
+
+	// Empty files can't be mapped
+	if (size == 0)
+		return true;
+
+	void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+	if (mapping != MAP_FAILED)
+		data = static_cast<const uint8_t*>(mapping);
+#endif
+
+	if (!data)
+	{
+		std::cerr << "MappedFile::open(): can't map \"" << path << "\"" << std::endl;
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if (data)
+		UnmapViewOfFile(data);
+
+	if (mappingHandle)
+		CloseHandle(mappingHandle);
+
+	if (fileHandle)
+		CloseHandle(fileHandle);
+
+	mappingHandle = nullptr;
+	fileHandle = nullptr;
+#else
+	if (data)
+		munmap(const_cast<uint8_t*>(data), size);
+
+	if (fileDescriptor >= 0)
+		::close(fileDescriptor);
+
+	fileDescriptor = -1;
+#endif
+
+	data = nullptr;
+	size = 0;
+	opened = false;
+}
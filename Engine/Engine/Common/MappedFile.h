@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	~MappedFile();
+
+	bool open(const std::string& path);
+	void close();
+
+	inline const uint8_t* getData() const { return data; }
+	inline size_t getSize() const { return size; }
+	inline bool isOpen() const { return opened; }
+
+private:
+	const uint8_t* data{ nullptr };
+	size_t size{ 0 };
+	bool opened{ false };
+
+#ifdef _WIN32
+	void* fileHandle{ nullptr };
+	void* mappingHandle{ nullptr };
+#else
+	int fileDescriptor{ -1 };
+#endif
+};
\ No newline at end of file
@@ -1,12 +1,136 @@
 #include "Mesh.h"
+#include "MeshOptimizer.h"
+#include "AssetCache.h"
+#include "Logger.h"
 #include "../RHI/VulkanUtils.h"
 #include "../RHI/VulkanContext.h"
 
 #include <assimp/Importer.hpp>
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <fstream>
 #include <iostream>
+#include <limits>
+
+static const unsigned int IMPORT_FLAGS = aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace | aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_SortByPType;
+
+// Binary cache stored next to the source file, bump the version whenever the layout or the import changes
+static const char* MESH_CACHE_EXTENSION = ".meshcache";
+static const uint32_t MESH_CACHE_MAGIC = 0x4853454D; // "MESH"
+static const uint32_t MESH_CACHE_VERSION = 6;
+static const uint64_t MESH_CACHE_ALIGNMENT = 16;
+
+struct MeshCacheSection
+{
+	uint64_t offset;
+	uint64_t size;
+};
+
+struct MeshCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t sourceHash;
+	uint64_t importHash;
+	uint32_t vertexFormat;
+	uint32_t indexType;
+	uint32_t numIndices;
+	float positionDecodeScale[3];
+	float positionDecodeOffset[3];
+	MeshCacheSection submeshes;
+	MeshCacheSection drawRanges;
+	MeshCacheSection meshlets;
+	MeshCacheSection lods;
+	MeshCacheSection occluderPositions;
+	MeshCacheSection occluderIndices;
+	MeshCacheSection vertices;
+	MeshCacheSection indices;
+};
+
+// Read-only Assimp streams over files of the virtual file system
+class FileSystemIOStream : public Assimp::IOStream
+{
+public:
+	explicit FileSystemIOStream(FileData data)
+		: data(std::move(data)) { }
+
+	size_t Read(void* buffer, size_t size, size_t count) override
+	{
+		if (size == 0)
+			return 0;
+
+		size_t numElements = std::min(count, (data.getSize() - position) / size);
+		memcpy(buffer, data.getData() + position, numElements * size);
+		position += numElements * size;
+
+		return numElements;
+	}
+
+	size_t Write(const void* buffer, size_t size, size_t count) override { return 0; }
+
+	aiReturn Seek(size_t offset, aiOrigin origin) override
+	{
+		size_t base = (origin == aiOrigin_SET) ? 0 : (origin == aiOrigin_CUR) ? position : data.getSize();
+		if (offset > data.getSize() - base)
+			return aiReturn_FAILURE;
+
+		position = base + offset;
+		return aiReturn_SUCCESS;
+	}
+
+	size_t Tell() const override { return position; }
+	size_t FileSize() const override { return data.getSize(); }
+	void Flush() override { }
+
+private:
+	FileData data;
+	size_t position{ 0 };
+};
+
+class FileSystemIOSystem : public Assimp::IOSystem
+{
+public:
+	bool Exists(const char* path) const override { return FileSystem::get().exists(path); }
+	char getOsSeparator() const override { return '/'; }
+
+	Assimp::IOStream* Open(const char* path, const char* mode) override
+	{
+		// The importer only reads
+		if (strchr(mode, 'w') || strchr(mode, 'a'))
+			return nullptr;
+
+		FileData data;
+		if (!FileSystem::get().read(path, data))
+			return nullptr;
+
+		return new FileSystemIOStream(std::move(data));
+	}
+
+	void Close(Assimp::IOStream* stream) override { delete stream; }
+};
+
+// Levels of detail per submesh including the full detail one, each level aims at half the triangles of the previous one
+static const size_t MAX_LODS = 4;
+static const float LOD_REDUCTION = 0.5f;
+
+// The chain stops once the simplifier can't remove at least this share of the triangles, locked seams usually cause it
+static const float LOD_MIN_REDUCTION = 0.1f;
+
+// The occluder uses the finest level of detail whose triangles fit this budget, the coarsest one otherwise
+static const size_t OCCLUDER_MAX_TRIANGLES = 8192;
+
+// Largest vertex span a 16-bit draw range can address
+static const uint32_t MAX_INDEX16_VERTICES = std::numeric_limits<uint16_t>::max();
+
+// Above this number of ranges the extra draw calls are not worth the memory savings
+static const size_t MAX_INDEX16_DRAW_RANGES = 64;
 
 using namespace RHI;
 
@@ -16,17 +140,42 @@ Mesh::~Mesh()
 	clearCPUData();
 }
 
-VkVertexInputBindingDescription Mesh::getVertexInputBindingDescription()
+// Octahedral mapping of a unit vector to [-1, 1]^2
+static glm::vec2 octEncode(const glm::vec3& v)
+{
+	float length = fabs(v.x) + fabs(v.y) + fabs(v.z);
+	if (length <= 0.0f)
+		return glm::vec2(0.0f, 0.0f);
+
+	glm::vec3 n = v / length;
+	glm::vec2 result(n.x, n.y);
+
+	if (n.z < 0.0f)
+	{
+		result.x = (1.0f - fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+		result.y = (1.0f - fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+	}
+
+	return result;
+}
+
+static glm::vec3 safeNormalize(const glm::vec3& v)
+{
+	float length = glm::length(v);
+	return (length > 0.0f) ? v / length : v;
+}
+
+VkVertexInputBindingDescription Mesh::getVertexInputBindingDescription(VertexFormat format)
 {
 	VkVertexInputBindingDescription bindingDescription;
 	bindingDescription.binding = 0;
-	bindingDescription.stride = sizeof(Vertex);
+	bindingDescription.stride = getVertexStride(format);
 	bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
 	return bindingDescription;
 }
 
-std::vector<VkVertexInputAttributeDescription> Mesh::getAttributeDescriptions()
+std::vector<VkVertexInputAttributeDescription> Mesh::getAttributeDescriptions(VertexFormat format)
 {
 	static std::vector<VkVertexInputAttributeDescription> attributes = {
 	{ 0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, position) },
@@ -37,15 +186,127 @@ std::vector<VkVertexInputAttributeDescription> Mesh::getAttributeDescriptions()
 	{ 5, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, uv) }
 	};
 
+	// Binormal is rebuilt in the shader, locations are kept so both layouts share semantics
+	static std::vector<VkVertexInputAttributeDescription> compactAttributes = {
+	{ 0, 0, VK_FORMAT_R16G16B16A16_UNORM, offsetof(CompactVertex, position) },
+	{ 1, 0, VK_FORMAT_R16G16_SNORM, offsetof(CompactVertex, tangent) },
+	{ 3, 0, VK_FORMAT_R16G16_SNORM, offsetof(CompactVertex, normal) },
+	{ 5, 0, VK_FORMAT_R16G16_SFLOAT, offsetof(CompactVertex, uv) }
+	};
+
+	static std::vector<VkVertexInputAttributeDescription> compactColorAttributes = {
+	{ 0, 0, VK_FORMAT_R16G16B16A16_UNORM, offsetof(CompactVertex, position) },
+	{ 1, 0, VK_FORMAT_R16G16_SNORM, offsetof(CompactVertex, tangent) },
+	{ 3, 0, VK_FORMAT_R16G16_SNORM, offsetof(CompactVertex, normal) },
+	{ 4, 0, VK_FORMAT_R8G8B8A8_UNORM, offsetof(CompactVertex, color) },
+	{ 5, 0, VK_FORMAT_R16G16_SFLOAT, offsetof(CompactVertex, uv) }
+	};
+
+	switch (format)
+	{
+		case VertexFormat::Default: return attributes;
+		case VertexFormat::Compact: return compactAttributes;
+		case VertexFormat::CompactColor: return compactColorAttributes;
+	}
+
 	return attributes;
 }
 
-bool Mesh::loadFromFile(const std::string& path)
+uint32_t Mesh::getVertexStride(VertexFormat format)
+{
+	switch (format)
+	{
+		case VertexFormat::Default: return static_cast<uint32_t>(sizeof(Vertex));
+		case VertexFormat::Compact: return static_cast<uint32_t>(offsetof(CompactVertex, color));
+		case VertexFormat::CompactColor: return static_cast<uint32_t>(sizeof(CompactVertex));
+	}
+
+	return static_cast<uint32_t>(sizeof(Vertex));
+}
+
+bool Mesh::loadFromFile(const std::string& path, const MeshImportOptions& options)
+{
+	clearGPUData();
+	if (!decodeFromFile(path, options))
+		return false;
+
+	// Upload CPU data to GPU
+	uploadToGPU();
+
+	// TODO: should we clear CPU data after uploading it to the GPU?
+
+	return true;
+}
+
+bool Mesh::decodeFromFile(const std::string& path, const MeshImportOptions& options)
+{
+	uint64_t sourceHash = 0;
+	uint64_t importHash = 0;
+	if (!getCacheKeys(path, options, sourceHash, importHash))
+		return false;
+
+	std::string cachePath = path + MESH_CACHE_EXTENSION;
+	if (options.useCache && loadFromCache(cachePath, sourceHash, importHash))
+		return true;
+
+	if (!importFromFile(path, options))
+		return false;
+
+	packGPUData();
+
+	if (options.useCache)
+		saveToCache(cachePath, sourceHash, importHash);
+
+	return true;
+}
+
+CookResult Mesh::cookFromFile(const std::string& path, const MeshImportOptions& options)
 {
+	uint64_t sourceHash = 0;
+	uint64_t importHash = 0;
+	if (!getCacheKeys(path, options, sourceHash, importHash))
+		return CookResult::Failed;
+
+	std::string cachePath = path + MESH_CACHE_EXTENSION;
+	if (loadFromCache(cachePath, sourceHash, importHash))
+	{
+		clearCPUData();
+		return CookResult::UpToDate;
+	}
+
+	if (!importFromFile(path, options))
+		return CookResult::Failed;
+
+	packGPUData();
+	bool saved = saveToCache(cachePath, sourceHash, importHash);
+	clearCPUData();
+
+	return saved ? CookResult::Cooked : CookResult::Failed;
+}
+
+bool Mesh::getCacheKeys(const std::string& path, const MeshImportOptions& options, uint64_t& sourceHash, uint64_t& importHash) const
+{
+	// Cache key: source content plus everything that changes the imported data
+	sourceHash = FNV1A_OFFSET_BASIS;
+	if (!hashFile(path, sourceHash))
+	{
+		std::cerr << "Mesh::loadFromFile(): can't open \"" << path << "\"" << std::endl;
+		return false;
+	}
+
+	uint32_t importKey[] = { IMPORT_FLAGS, static_cast<uint32_t>(options.vertexFormat), options.optimize ? 1u : 0u, options.flattenTransforms ? 1u : 0u, options.buildMeshlets ? 1u : 0u, options.generateLods ? 1u : 0u, options.buildOccluder ? 1u : 0u };
+	importHash = hashFNV1a(importKey, sizeof(importKey));
+
+	return true;
+}
+
+bool Mesh::importFromFile(const std::string& path, const MeshImportOptions& options)
+{
+	// Files the model references, like material libraries or buffers, go through the file system too
 	Assimp::Importer importer;
+	importer.SetIOHandler(new FileSystemIOSystem());
 
-	unsigned int flags = aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace | aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_SortByPType;
-	const aiScene* scene = importer.ReadFile(path, flags);
+	const aiScene* scene = importer.ReadFile(path, IMPORT_FLAGS);
 
 	if (!scene)
 	{
@@ -59,76 +320,309 @@ bool Mesh::loadFromFile(const std::string& path)
 		return false;
 	}
 
-	aiMesh* mesh = scene->mMeshes[0];
+	// Fill CPU data, every mesh instance of the node hierarchy becomes a submesh
+	clearCPUData();
+	importNode(scene, scene->mRootNode, glm::mat4(1.0f), options.flattenTransforms);
+
+	if (submeshes.empty())
+	{
+		std::cerr << "Mesh::loadFromFile(): model has no triangle meshes" << std::endl;
+		return false;
+	}
+
+	if (options.optimize)
+	{
+		MeshOptimizer::VertexCacheStatistics before = MeshOptimizer::analyzeVertexCache(indices, vertices.size());
+		optimize();
+		MeshOptimizer::VertexCacheStatistics after = MeshOptimizer::analyzeVertexCache(indices, vertices.size());
+
+		K_INFO("Mesh::loadFromFile(): {0} ACMR {1:.3f} -> {2:.3f}, ATVR {3:.3f} -> {4:.3f}", path, before.acmr, after.acmr, before.atvr, after.atvr);
+	}
+
+	if (options.buildMeshlets)
+		buildMeshlets();
+
+	if (options.generateLods)
+		buildLods(options.optimize);
+
+	occluderPositions.clear();
+	occluderIndices.clear();
+
+	if (options.buildOccluder)
+		buildOccluder();
+
+	vertexFormat = options.vertexFormat;
+
+	return true;
+}
+
+void Mesh::importNode(const aiScene* scene, const aiNode* node, const glm::mat4& parentTransform, bool flattenTransforms)
+{
+	glm::mat4 transform = parentTransform;
+
+	// Assimp matrices are row major
+	if (flattenTransforms)
+		transform = parentTransform * glm::transpose(glm::make_mat4(&node->mTransformation.a1));
+
+	for (unsigned int i = 0; i < node->mNumMeshes; i++)
+		importSubmesh(scene->mMeshes[node->mMeshes[i]], transform);
+
+	for (unsigned int i = 0; i < node->mNumChildren; i++)
+		importNode(scene, node->mChildren[i], transform, flattenTransforms);
+}
+
+void Mesh::importSubmesh(const aiMesh* mesh, const glm::mat4& transform)
+{
 	assert(mesh != nullptr);
 
-	// Fill CPU data
-	vertices.resize(mesh->mNumVertices);
-	indices.resize(mesh->mNumFaces * 3);
+	// Points and lines are split out by aiProcess_SortByPType
+	if ((mesh->mPrimitiveTypes & aiPrimitiveType_TRIANGLE) == 0)
+		return;
+
+	Submesh submesh;
+	submesh.firstIndex = static_cast<uint32_t>(indices.size());
+	submesh.baseVertex = static_cast<int32_t>(vertices.size());
+	submesh.numVertices = mesh->mNumVertices;
+	submesh.materialIndex = mesh->mMaterialIndex;
+
+	// Directions in the tangent plane follow the node transform, normals its inverse transpose
+	glm::mat3 tangentTransform = glm::mat3(transform);
+	glm::mat3 normalTransform = glm::transpose(glm::inverse(tangentTransform));
+
+	// Mirroring transforms flip the triangle winding
+	bool flipWinding = glm::determinant(tangentTransform) < 0.0f;
+
+	vertices.resize(submesh.baseVertex + mesh->mNumVertices);
+	Vertex* meshVertices = vertices.data() + submesh.baseVertex;
 
-	// Vertices
-	aiVector3D* meshVertices = mesh->mVertices;
 	for (unsigned int i = 0; i < mesh->mNumVertices; i++)
-		vertices[i].position = glm::vec3(meshVertices[i].x, meshVertices[i].y, meshVertices[i].z);
-
-	// Tangents
-	aiVector3D* meshTangents = mesh->mTangents;
-	if (meshTangents)
-		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
-			vertices[i].tangent = glm::vec3(meshTangents[i].x, meshTangents[i].y, meshTangents[i].z);
-	else
-		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
-			vertices[i].tangent = glm::vec3(0.0f, 0.0f, 0.0f);
-
-	// Bitangents
-	aiVector3D* meshBinormals = mesh->mBitangents;
-	if (meshBinormals)
-		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
-			vertices[i].binormal = glm::vec3(meshBinormals[i].x, meshBinormals[i].y, meshBinormals[i].z);
-	else
-		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
-			vertices[i].binormal = glm::vec3(0.0f, 0.0f, 0.0f);
-
-	// Normal
-	aiVector3D* meshNormals = mesh->mNormals;
-	if (meshNormals)
-		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
-			vertices[i].normal = glm::vec3(meshNormals[i].x, meshNormals[i].y, meshNormals[i].z);
-	else
-		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
-			vertices[i].normal = glm::vec3(0.0f, 0.0f, 0.0f);
-
-	// UV
-	aiVector3D* meshUVs = mesh->mTextureCoords[0];
-	if (meshUVs)
-		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
-			vertices[i].uv = glm::vec2(meshUVs[i].x, 1.0f - meshUVs[i].y);
-	else
-		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
-			vertices[i].uv = glm::vec2(0.0f, 0.0f);
-
-	// Color
-	aiColor4D* meshColors = mesh->mColors[0];
-	if (meshColors)
-		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
-			vertices[i].color = glm::vec3(meshColors[i].r, meshColors[i].g, meshColors[i].b);
-	else
-		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
-			vertices[i].color = glm::vec3(1.0f, 1.0f, 1.0f);
+	{
+		Vertex& vertex = meshVertices[i];
+
+		const aiVector3D& position = mesh->mVertices[i];
+		vertex.position = glm::vec3(transform * glm::vec4(position.x, position.y, position.z, 1.0f));
+
+		// Tangents
+		vertex.tangent = glm::vec3(0.0f, 0.0f, 0.0f);
+		if (mesh->mTangents)
+			vertex.tangent = safeNormalize(tangentTransform * glm::vec3(mesh->mTangents[i].x, mesh->mTangents[i].y, mesh->mTangents[i].z));
+
+		// Bitangents
+		vertex.binormal = glm::vec3(0.0f, 0.0f, 0.0f);
+		if (mesh->mBitangents)
+			vertex.binormal = safeNormalize(tangentTransform * glm::vec3(mesh->mBitangents[i].x, mesh->mBitangents[i].y, mesh->mBitangents[i].z));
+
+		// Normal
+		vertex.normal = glm::vec3(0.0f, 0.0f, 0.0f);
+		if (mesh->mNormals)
+			vertex.normal = safeNormalize(normalTransform * glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z));
+
+		// UV
+		vertex.uv = glm::vec2(0.0f, 0.0f);
+		if (mesh->mTextureCoords[0])
+			vertex.uv = glm::vec2(mesh->mTextureCoords[0][i].x, 1.0f - mesh->mTextureCoords[0][i].y);
+
+		// Color
+		vertex.color = glm::vec3(1.0f, 1.0f, 1.0f);
+		if (mesh->mColors[0])
+			vertex.color = glm::vec3(mesh->mColors[0][i].r, mesh->mColors[0][i].g, mesh->mColors[0][i].b);
+	}
 
 	// Indices
-	aiFace* meshFaces = mesh->mFaces;
-	unsigned int index = 0;
 	for (unsigned int i = 0; i < mesh->mNumFaces; i++)
-		for (unsigned int faceIndex = 0; faceIndex < meshFaces[i].mNumIndices; faceIndex++)
-			indices[index++] = meshFaces[i].mIndices[faceIndex];
+	{
+		const aiFace& face = mesh->mFaces[i];
+		if (face.mNumIndices != 3)
+			continue;
 
-	// Upload CPU data to GPU
-	clearGPUData();
-	uploadToGPU();
+		indices.push_back(submesh.baseVertex + face.mIndices[0]);
+		indices.push_back(submesh.baseVertex + face.mIndices[flipWinding ? 2 : 1]);
+		indices.push_back(submesh.baseVertex + face.mIndices[flipWinding ? 1 : 2]);
+	}
 
-	// TODO: should we clear CPU data after uploading it to the GPU?
+	submesh.numIndices = static_cast<uint32_t>(indices.size()) - submesh.firstIndex;
+	computeSubmeshBounds(submesh);
+
+	submeshes.push_back(submesh);
+}
+
+void Mesh::computeSubmeshBounds(Submesh& submesh) const
+{
+	submesh.boundsMin = glm::vec3(0.0f);
+	submesh.boundsMax = glm::vec3(0.0f);
+	submesh.sphereCenter = glm::vec3(0.0f);
+	submesh.sphereRadius = 0.0f;
+
+	if (submesh.numVertices == 0)
+		return;
+
+	submesh.boundsMin = vertices[submesh.baseVertex].position;
+	submesh.boundsMax = vertices[submesh.baseVertex].position;
+
+	for (uint32_t i = 0; i < submesh.numVertices; i++)
+	{
+		submesh.boundsMin = glm::min(submesh.boundsMin, vertices[submesh.baseVertex + i].position);
+		submesh.boundsMax = glm::max(submesh.boundsMax, vertices[submesh.baseVertex + i].position);
+	}
+
+	// Sphere around the box center, usually tighter than the box diagonal
+	submesh.sphereCenter = (submesh.boundsMin + submesh.boundsMax) * 0.5f;
+
+	for (uint32_t i = 0; i < submesh.numVertices; i++)
+		submesh.sphereRadius = std::max(submesh.sphereRadius, glm::length(vertices[submesh.baseVertex + i].position - submesh.sphereCenter));
+}
+
+void Mesh::computeBounds()
+{
+	boundsMin = glm::vec3(0.0f);
+	boundsMax = glm::vec3(0.0f);
+	sphereCenter = glm::vec3(0.0f);
+	sphereRadius = 0.0f;
+
+	if (submeshes.empty())
+		return;
+
+	boundsMin = submeshes[0].boundsMin;
+	boundsMax = submeshes[0].boundsMax;
+
+	for (const Submesh& submesh : submeshes)
+	{
+		boundsMin = glm::min(boundsMin, submesh.boundsMin);
+		boundsMax = glm::max(boundsMax, submesh.boundsMax);
+	}
+
+	// Enclose the submesh spheres, or the box if that is smaller
+	sphereCenter = (boundsMin + boundsMax) * 0.5f;
+
+	for (const Submesh& submesh : submeshes)
+		sphereRadius = std::max(sphereRadius, glm::length(submesh.sphereCenter - sphereCenter) + submesh.sphereRadius);
+
+	sphereRadius = std::min(sphereRadius, glm::length(boundsMax - boundsMin) * 0.5f);
+}
+
+bool Mesh::loadFromCache(const std::string& path, uint64_t sourceHash, uint64_t importHash)
+{
+	FileData file;
+	if (!FileSystem::get().read(path, file) || file.getSize() < sizeof(MeshCacheHeader))
+		return false;
+
+	MeshCacheHeader header;
+	memcpy(&header, file.getData(), sizeof(MeshCacheHeader));
+
+	if (header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION)
+		return false;
+
+	// Stale cache, the source or the import options changed
+	if (header.sourceHash != sourceHash || header.importHash != importHash)
+		return false;
+
+	for (const MeshCacheSection& section : { header.submeshes, header.drawRanges, header.meshlets, header.lods, header.occluderPositions, header.occluderIndices, header.vertices, header.indices })
+		if (section.offset > file.getSize() || section.size > file.getSize() - section.offset)
+		{
+			std::cerr << "Mesh::loadFromCache(): \"" << path << "\" is truncated" << std::endl;
+			return false;
+		}
+
+	if (header.submeshes.size % sizeof(Submesh) != 0 || header.drawRanges.size % sizeof(DrawRange) != 0 || header.meshlets.size % sizeof(Meshlet) != 0 || header.lods.size % sizeof(Lod) != 0)
+		return false;
+
+	if (header.occluderPositions.size % sizeof(glm::vec3) != 0 || header.occluderIndices.size % sizeof(uint32_t) != 0)
+		return false;
+
+	clearCPUData();
+
+	vertexFormat = static_cast<VertexFormat>(header.vertexFormat);
+	indexType = static_cast<VkIndexType>(header.indexType);
+	positionDecodeScale = glm::vec3(header.positionDecodeScale[0], header.positionDecodeScale[1], header.positionDecodeScale[2]);
+	positionDecodeOffset = glm::vec3(header.positionDecodeOffset[0], header.positionDecodeOffset[1], header.positionDecodeOffset[2]);
+
+	submeshes.resize(header.submeshes.size / sizeof(Submesh));
+	memcpy(submeshes.data(), file.getData() + header.submeshes.offset, header.submeshes.size);
 
+	drawRanges.resize(header.drawRanges.size / sizeof(DrawRange));
+	memcpy(drawRanges.data(), file.getData() + header.drawRanges.offset, header.drawRanges.size);
+
+	meshlets.resize(header.meshlets.size / sizeof(Meshlet));
+	memcpy(meshlets.data(), file.getData() + header.meshlets.offset, header.meshlets.size);
+
+	lods.resize(header.lods.size / sizeof(Lod));
+	memcpy(lods.data(), file.getData() + header.lods.offset, header.lods.size);
+
+	occluderPositions.resize(header.occluderPositions.size / sizeof(glm::vec3));
+	memcpy(occluderPositions.data(), file.getData() + header.occluderPositions.offset, header.occluderPositions.size);
+
+	occluderIndices.resize(header.occluderIndices.size / sizeof(uint32_t));
+	memcpy(occluderIndices.data(), file.getData() + header.occluderIndices.offset, header.occluderIndices.size);
+
+	computeBounds();
+
+	// Blobs are already in GPU layout and wait for the upload as they are
+	packedVertices.assign(file.getData() + header.vertices.offset, file.getData() + header.vertices.offset + header.vertices.size);
+	packedIndices.assign(file.getData() + header.indices.offset, file.getData() + header.indices.offset + header.indices.size);
+	numIndices = header.numIndices;
+
+	return true;
+}
+
+bool Mesh::saveToCache(const std::string& path, uint64_t sourceHash, uint64_t importHash) const
+{
+	MeshCacheHeader header = {};
+	header.magic = MESH_CACHE_MAGIC;
+	header.version = MESH_CACHE_VERSION;
+	header.sourceHash = sourceHash;
+	header.importHash = importHash;
+	header.vertexFormat = static_cast<uint32_t>(vertexFormat);
+	header.indexType = static_cast<uint32_t>(indexType);
+	header.numIndices = numIndices;
+
+	for (int i = 0; i < 3; i++)
+	{
+		header.positionDecodeScale[i] = positionDecodeScale[i];
+		header.positionDecodeOffset[i] = positionDecodeOffset[i];
+	}
+
+	auto align = [](uint64_t offset) { return (offset + MESH_CACHE_ALIGNMENT - 1) & ~(MESH_CACHE_ALIGNMENT - 1); };
+
+	header.submeshes = { align(sizeof(MeshCacheHeader)), sizeof(Submesh) * submeshes.size() };
+	header.drawRanges = { align(header.submeshes.offset + header.submeshes.size), sizeof(DrawRange) * drawRanges.size() };
+	header.meshlets = { align(header.drawRanges.offset + header.drawRanges.size), sizeof(Meshlet) * meshlets.size() };
+	header.lods = { align(header.meshlets.offset + header.meshlets.size), sizeof(Lod) * lods.size() };
+	header.occluderPositions = { align(header.lods.offset + header.lods.size), sizeof(glm::vec3) * occluderPositions.size() };
+	header.occluderIndices = { align(header.occluderPositions.offset + header.occluderPositions.size), sizeof(uint32_t) * occluderIndices.size() };
+	header.vertices = { align(header.occluderIndices.offset + header.occluderIndices.size), packedVertices.size() };
+	header.indices = { align(header.vertices.offset + header.vertices.size), packedIndices.size() };
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cerr << "Mesh::saveToCache(): can't open \"" << path << "\"" << std::endl;
+		return false;
+	}
+
+	auto writeSection = [&file](const MeshCacheSection& section, const void* data)
+	{
+		static const char padding[MESH_CACHE_ALIGNMENT] = {};
+		file.write(padding, static_cast<std::streamsize>(section.offset - static_cast<uint64_t>(file.tellp())));
+		file.write(static_cast<const char*>(data), static_cast<std::streamsize>(section.size));
+	};
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(MeshCacheHeader));
+	writeSection(header.submeshes, submeshes.data());
+	writeSection(header.drawRanges, drawRanges.data());
+	writeSection(header.meshlets, meshlets.data());
+	writeSection(header.lods, lods.data());
+	writeSection(header.occluderPositions, occluderPositions.data());
+	writeSection(header.occluderIndices, occluderIndices.data());
+	writeSection(header.vertices, packedVertices.data());
+	writeSection(header.indices, packedIndices.data());
+
+	if (!file.good())
+	{
+		std::cerr << "Mesh::saveToCache(): can't write \"" << path << "\"" << std::endl;
+		return false;
+	}
+
+	FileSystem::get().invalidate(path);
 	return true;
 }
 
@@ -137,6 +631,8 @@ void Mesh::createSkybox(float size)
 	clearCPUData();
 	clearGPUData();
 
+	vertexFormat = VertexFormat::Default;
+
 	vertices.resize(8);
 	indices.resize(36);
 
@@ -168,6 +664,8 @@ void Mesh::createQuad(float size)
 	clearCPUData();
 	clearGPUData();
 
+	vertexFormat = VertexFormat::Default;
+
 	vertices.resize(4);
 	indices.resize(6);
 
@@ -190,10 +688,286 @@ void Mesh::createQuad(float size)
 	uploadToGPU();
 }
 
-void Mesh::createVertexBuffer()
+void Mesh::createBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, VertexFormat format)
+{
+	clearCPUData();
+	clearGPUData();
+
+	vertexFormat = format;
+
+	glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+	glm::vec3 halfSize = (boundsMax - boundsMin) * 0.5f;
+
+	// Four vertices per face so every face gets its own normal, corners go counter clockwise seen from outside
+	const glm::vec3 normals[] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+	const glm::vec3 tangents[] = { { 0, 1, 0 }, { 0, -1, 0 }, { -1, 0, 0 }, { 1, 0, 0 }, { 1, 0, 0 }, { -1, 0, 0 } };
+	const glm::vec2 corners[] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 } };
+
+	for (int face = 0; face < 6; face++)
+	{
+		glm::vec3 binormal = glm::cross(normals[face], tangents[face]);
+		uint32_t base = static_cast<uint32_t>(vertices.size());
+
+		for (const glm::vec2& corner : corners)
+		{
+			Vertex vertex;
+			vertex.position = center + (normals[face] + tangents[face] * corner.x + binormal * corner.y) * halfSize;
+			vertex.tangent = tangents[face];
+			vertex.binormal = binormal;
+			vertex.normal = normals[face];
+			vertex.color = glm::vec3(1.0f);
+			vertex.uv = corner * 0.5f + 0.5f;
+
+			vertices.push_back(vertex);
+		}
+
+		indices.insert(indices.end(), { base, base + 1, base + 2, base + 2, base + 3, base });
+	}
+
+	uploadToGPU();
+}
+
+void Mesh::getSubmeshGeometry(const Submesh& submesh, std::vector<uint32_t>& submeshIndices, std::vector<glm::vec3>& positions) const
+{
+	submeshIndices.assign(indices.begin() + submesh.firstIndex, indices.begin() + submesh.firstIndex + submesh.numIndices);
+	for (uint32_t& index : submeshIndices)
+		index -= submesh.baseVertex;
+
+	positions.resize(submesh.numVertices);
+	for (uint32_t i = 0; i < submesh.numVertices; i++)
+		positions[i] = vertices[submesh.baseVertex + i].position;
+}
+
+void Mesh::optimize()
+{
+	std::vector<Vertex> optimizedVertices;
+	optimizedVertices.reserve(vertices.size());
+
+	// Submeshes are drawn separately, so each one is optimized on its own
+	for (Submesh& submesh : submeshes)
+	{
+		std::vector<uint32_t> submeshIndices;
+		std::vector<glm::vec3> positions;
+		getSubmeshGeometry(submesh, submeshIndices, positions);
+
+		// Triangle order for the post-transform cache, then clusters sorted against overdraw
+		std::vector<uint32_t> clusters;
+		MeshOptimizer::optimizeVertexCache(submeshIndices, submesh.numVertices, 16, &clusters);
+		MeshOptimizer::optimizeOverdraw(submeshIndices, positions, clusters);
+
+		// Vertex order for fetch locality, unreferenced vertices are dropped
+		std::vector<uint32_t> remap;
+		size_t numVertices = MeshOptimizer::optimizeVertexFetch(submeshIndices, submesh.numVertices, remap);
+
+		uint32_t baseVertex = static_cast<uint32_t>(optimizedVertices.size());
+		optimizedVertices.resize(baseVertex + numVertices);
+
+		for (uint32_t i = 0; i < submesh.numVertices; i++)
+			if (remap[i] != MeshOptimizer::INVALID_INDEX)
+				optimizedVertices[baseVertex + remap[i]] = vertices[submesh.baseVertex + i];
+
+		for (uint32_t i = 0; i < submesh.numIndices; i++)
+			indices[submesh.firstIndex + i] = baseVertex + submeshIndices[i];
+
+		submesh.baseVertex = static_cast<int32_t>(baseVertex);
+		submesh.numVertices = static_cast<uint32_t>(numVertices);
+	}
+
+	vertices.swap(optimizedVertices);
+}
+
+void Mesh::buildMeshlets()
+{
+	meshlets.clear();
+
+	for (uint32_t submeshIndex = 0; submeshIndex < submeshes.size(); submeshIndex++)
+	{
+		Submesh& submesh = submeshes[submeshIndex];
+
+		std::vector<uint32_t> submeshIndices;
+		std::vector<glm::vec3> positions;
+		getSubmeshGeometry(submesh, submeshIndices, positions);
+
+		std::vector<Meshlet> submeshMeshlets;
+		MeshOptimizer::buildMeshlets(submeshIndices, positions, submeshMeshlets);
+
+		submesh.firstMeshlet = static_cast<uint32_t>(meshlets.size());
+		submesh.numMeshlets = static_cast<uint32_t>(submeshMeshlets.size());
+
+		for (Meshlet& meshlet : submeshMeshlets)
+		{
+			meshlet.firstIndex += submesh.firstIndex;
+			meshlet.submesh = submeshIndex;
+			meshlets.push_back(meshlet);
+		}
+	}
+}
+
+void Mesh::buildLods(bool optimizeLods)
 {
-	VkDeviceSize bufferSize = sizeof(Vertex) * vertices.size();
+	lods.clear();
+
+	// Coarser levels go after every full detail submesh, level 0 ranges and meshlets keep their place
+	for (Submesh& submesh : submeshes)
+	{
+		submesh.firstLod = static_cast<uint32_t>(lods.size());
+
+		Lod lod;
+		lod.firstIndex = submesh.firstIndex;
+		lod.numIndices = submesh.numIndices;
+		lods.push_back(lod);
+
+		std::vector<uint32_t> submeshIndices;
+		std::vector<glm::vec3> positions;
+		getSubmeshGeometry(submesh, submeshIndices, positions);
+
+		// Every level is simplified from level 0 so its error is measured against the full detail surface
+		size_t targetIndexCount = submeshIndices.size();
+		while (lods.size() - submesh.firstLod < MAX_LODS)
+		{
+			targetIndexCount = static_cast<size_t>(targetIndexCount * LOD_REDUCTION) / 3 * 3;
+
+			std::vector<uint32_t> lodIndices;
+			float error = MeshOptimizer::simplify(submeshIndices, positions, targetIndexCount, lodIndices);
+
+			if (lodIndices.empty() || lodIndices.size() > lods.back().numIndices * (1.0f - LOD_MIN_REDUCTION))
+				break;
+
+			if (optimizeLods)
+				MeshOptimizer::optimizeVertexCache(lodIndices, submesh.numVertices);
+
+			lod.firstIndex = static_cast<uint32_t>(indices.size());
+			lod.numIndices = static_cast<uint32_t>(lodIndices.size());
+			lod.error = std::max(error, lods.back().error);
+
+			for (uint32_t index : lodIndices)
+				indices.push_back(submesh.baseVertex + index);
+
+			lods.push_back(lod);
+		}
+
+		submesh.numLods = static_cast<uint32_t>(lods.size()) - submesh.firstLod;
+	}
+}
+
+void Mesh::buildOccluder()
+{
+	// Finest level shared by every submesh that fits the budget, submeshes with fewer levels use their last one
+	uint32_t maxLods = 1;
+	for (const Submesh& submesh : submeshes)
+		maxLods = std::max(maxLods, submesh.numLods);
+
+	auto getLod = [this](const Submesh& submesh, uint32_t level)
+	{
+		if (submesh.numLods == 0)
+		{
+			Lod lod;
+			lod.firstIndex = submesh.firstIndex;
+			lod.numIndices = submesh.numIndices;
+			return lod;
+		}
 
+		return lods[submesh.firstLod + std::min(level, submesh.numLods - 1)];
+	};
+
+	uint32_t level = 0;
+	for (; level + 1 < maxLods; level++)
+	{
+		size_t numTriangles = 0;
+		for (const Submesh& submesh : submeshes)
+			numTriangles += getLod(submesh, level).numIndices / 3;
+
+		if (numTriangles <= OCCLUDER_MAX_TRIANGLES)
+			break;
+	}
+
+	// Only the referenced positions are kept
+	std::vector<uint32_t> remap(vertices.size(), MeshOptimizer::INVALID_INDEX);
+
+	for (const Submesh& submesh : submeshes)
+	{
+		Lod lod = getLod(submesh, level);
+
+		for (uint32_t i = lod.firstIndex; i < lod.firstIndex + lod.numIndices; i++)
+		{
+			uint32_t vertex = indices[i];
+
+			if (remap[vertex] == MeshOptimizer::INVALID_INDEX)
+			{
+				remap[vertex] = static_cast<uint32_t>(occluderPositions.size());
+				occluderPositions.push_back(vertices[vertex].position);
+			}
+
+			occluderIndices.push_back(remap[vertex]);
+		}
+	}
+}
+
+void Mesh::computePositionQuantization()
+{
+	positionDecodeScale = glm::vec3(1.0f);
+	positionDecodeOffset = glm::vec3(0.0f);
+
+	if (vertexFormat == VertexFormat::Default || vertices.empty())
+		return;
+
+	glm::vec3 boundsMin = vertices[0].position;
+	glm::vec3 boundsMax = vertices[0].position;
+
+	for (const Vertex& vertex : vertices)
+	{
+		boundsMin = glm::min(boundsMin, vertex.position);
+		boundsMax = glm::max(boundsMax, vertex.position);
+	}
+
+	// Flat axes still need a non-zero scale to stay invertible
+	glm::vec3 extent = boundsMax - boundsMin;
+	for (int i = 0; i < 3; i++)
+		if (extent[i] <= 0.0f)
+			extent[i] = 1.0f;
+
+	positionDecodeScale = extent;
+	positionDecodeOffset = boundsMin;
+}
+
+void Mesh::packVertexData(std::vector<uint8_t>& data) const
+{
+	if (vertexFormat == VertexFormat::Default)
+	{
+		data.resize(sizeof(Vertex) * vertices.size());
+		memcpy(data.data(), vertices.data(), data.size());
+		return;
+	}
+
+	uint32_t stride = getVertexStride(vertexFormat);
+	data.resize(static_cast<size_t>(stride) * vertices.size());
+
+	glm::vec3 invScale = 1.0f / positionDecodeScale;
+
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		const Vertex& vertex = vertices[i];
+		CompactVertex packed = {};
+
+		glm::vec3 position = glm::clamp((vertex.position - positionDecodeOffset) * invScale, 0.0f, 1.0f);
+		for (int k = 0; k < 3; k++)
+			packed.position[k] = static_cast<uint16_t>(position[k] * 65535.0f + 0.5f);
+
+		// Only the handedness of the binormal is kept, the shader rebuilds it from normal and tangent
+		float binormalSign = glm::dot(glm::cross(vertex.normal, vertex.tangent), vertex.binormal) < 0.0f ? -1.0f : 1.0f;
+		packed.position[3] = binormalSign < 0.0f ? 0 : 65535;
+
+		packed.tangent = glm::packSnorm2x16(octEncode(vertex.tangent));
+		packed.normal = glm::packSnorm2x16(octEncode(vertex.normal));
+		packed.uv = glm::packHalf2x16(vertex.uv);
+		packed.color = glm::packUnorm4x8(glm::vec4(vertex.color, 1.0f));
+
+		memcpy(data.data() + i * stride, &packed, stride);
+	}
+}
+
+void Mesh::createVertexBuffer(const void* vertexData, VkDeviceSize bufferSize)
+{
 	// StagingBuffer definition
 	VkBuffer stagingBuffer = VK_NULL_HANDLE;
 	VkDeviceMemory stagingBufferMemory = VK_NULL_HANDLE;
@@ -218,7 +992,7 @@ void Mesh::createVertexBuffer()
 	// Fill staging buffer
 	void* data = nullptr;
 	vkMapMemory(context->getDevice(), stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, vertices.data(), static_cast<size_t>(bufferSize));
+	memcpy(data, vertexData, static_cast<size_t>(bufferSize));
 	vkUnmapMemory(context->getDevice(), stagingBufferMemory);
 
 	// Transfer to GPU local memory
@@ -229,10 +1003,129 @@ void Mesh::createVertexBuffer()
 	vkFreeMemory(context->getDevice(), stagingBufferMemory, nullptr);
 }
 
-void Mesh::createIndexBuffer()
+void Mesh::buildDrawRanges()
 {
-	VkDeviceSize bufferSize = sizeof(uint32_t) * indices.size();
+	drawRanges.clear();
+	indexType = VK_INDEX_TYPE_UINT16;
+
+	// One index run per level of detail of every submesh
+	std::vector<DrawRange> runs;
+	for (uint32_t submeshIndex = 0; submeshIndex < submeshes.size(); submeshIndex++)
+	{
+		const Submesh& submesh = submeshes[submeshIndex];
 
+		for (uint32_t lod = 0; lod < std::max(submesh.numLods, 1u); lod++)
+		{
+			DrawRange run;
+			run.firstIndex = (submesh.numLods > 0) ? lods[submesh.firstLod + lod].firstIndex : submesh.firstIndex;
+			run.numIndices = (submesh.numLods > 0) ? lods[submesh.firstLod + lod].numIndices : submesh.numIndices;
+			run.baseVertex = submesh.baseVertex;
+			run.submesh = submeshIndex;
+			run.lod = lod;
+
+			runs.push_back(run);
+		}
+	}
+
+	// A triangle spanning more than a 16-bit window cannot be rebased by any split
+	bool fitsIndex16 = true;
+
+	for (const DrawRange& run : runs)
+	{
+		if (!fitsIndex16)
+			break;
+
+		if (submeshes[run.submesh].numVertices <= MAX_INDEX16_VERTICES)
+		{
+			drawRanges.push_back(run);
+			continue;
+		}
+
+		// Split the triangle list into runs whose vertices fit in a 16-bit window
+		DrawRange range = run;
+		uint32_t rangeMin = std::numeric_limits<uint32_t>::max();
+		uint32_t rangeMax = 0;
+		range.numIndices = 0;
+
+		for (uint32_t i = run.firstIndex; i < run.firstIndex + run.numIndices; i += 3)
+		{
+			uint32_t triangleMin = std::min(indices[i], std::min(indices[i + 1], indices[i + 2]));
+			uint32_t triangleMax = std::max(indices[i], std::max(indices[i + 1], indices[i + 2]));
+
+			if (triangleMax - triangleMin >= MAX_INDEX16_VERTICES)
+			{
+				fitsIndex16 = false;
+				break;
+			}
+
+			uint32_t newMin = std::min(rangeMin, triangleMin);
+			uint32_t newMax = std::max(rangeMax, triangleMax);
+
+			if (range.numIndices > 0 && newMax - newMin >= MAX_INDEX16_VERTICES)
+			{
+				drawRanges.push_back(range);
+
+				range.firstIndex = i;
+				range.numIndices = 0;
+				newMin = triangleMin;
+				newMax = triangleMax;
+			}
+
+			rangeMin = newMin;
+			rangeMax = newMax;
+			range.baseVertex = static_cast<int32_t>(rangeMin);
+			range.numIndices += 3;
+		}
+
+		if (range.numIndices > 0)
+			drawRanges.push_back(range);
+	}
+
+	if (!fitsIndex16 || drawRanges.size() > runs.size() + MAX_INDEX16_DRAW_RANGES)
+	{
+		// Too many splits or a triangle too wide to split, keep absolute 32-bit indices with one range per run
+		indexType = VK_INDEX_TYPE_UINT32;
+		drawRanges.clear();
+
+		for (DrawRange run : runs)
+		{
+			run.baseVertex = 0;
+			drawRanges.push_back(run);
+		}
+	}
+
+	// Ranges come out submesh by submesh
+	for (Submesh& submesh : submeshes)
+		submesh.numDrawRanges = 0;
+
+	for (uint32_t i = static_cast<uint32_t>(drawRanges.size()); i-- > 0;)
+	{
+		Submesh& submesh = submeshes[drawRanges[i].submesh];
+		submesh.firstDrawRange = i;
+		submesh.numDrawRanges++;
+	}
+}
+
+void Mesh::packIndexData(std::vector<uint8_t>& data) const
+{
+	if (indexType == VK_INDEX_TYPE_UINT32)
+	{
+		data.resize(sizeof(uint32_t) * indices.size());
+		memcpy(data.data(), indices.data(), data.size());
+		return;
+	}
+
+	data.resize(sizeof(uint16_t) * indices.size());
+	uint16_t* indices16 = reinterpret_cast<uint16_t*>(data.data());
+
+	// Rebase every range on its base vertex
+	for (const DrawRange& range : drawRanges)
+		for (uint32_t i = range.firstIndex; i < range.firstIndex + range.numIndices; i++)
+			indices16[i] = static_cast<uint16_t>(indices[i] - range.baseVertex);
+}
+
+void Mesh::createIndexBuffer(const void* indexData, VkDeviceSize bufferSize)
+{
 	VkBuffer stagingBuffer = VK_NULL_HANDLE;
 	VkDeviceMemory stagingBufferMemory = VK_NULL_HANDLE;
 
@@ -256,7 +1149,7 @@ void Mesh::createIndexBuffer()
 	// Fill staging buffer
 	void* data = nullptr;
 	vkMapMemory(context->getDevice(), stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, indices.data(), static_cast<size_t>(bufferSize));
+	memcpy(data, indexData, static_cast<size_t>(bufferSize));
 	vkUnmapMemory(context->getDevice(), stagingBufferMemory);
 
 	// Transfer to GPU local memory
@@ -267,29 +1160,69 @@ void Mesh::createIndexBuffer()
 	vkFreeMemory(context->getDevice(), stagingBufferMemory, nullptr);
 }
 
+void Mesh::packGPUData()
+{
+	// Procedural meshes are a single submesh
+	if (submeshes.empty())
+	{
+		Submesh submesh;
+		submesh.numIndices = static_cast<uint32_t>(indices.size());
+		submesh.numVertices = static_cast<uint32_t>(vertices.size());
+		computeSubmeshBounds(submesh);
+
+		submeshes.push_back(submesh);
+	}
+
+	computeBounds();
+	computePositionQuantization();
+	buildDrawRanges();
+
+	packVertexData(packedVertices);
+	packIndexData(packedIndices);
+	numIndices = static_cast<uint32_t>(indices.size());
+}
+
 void Mesh::uploadToGPU()
 {
-	createVertexBuffer();
-	createIndexBuffer();
+	// Procedural meshes come straight here, loaded ones were packed by decodeFromFile()
+	if (packedVertices.empty())
+		packGPUData();
+
+	createVertexBuffer(packedVertices.data(), packedVertices.size());
+	createIndexBuffer(packedIndices.data(), packedIndices.size());
+
+	packedVertices = std::vector<uint8_t>();
+	packedIndices = std::vector<uint8_t>();
 }
 
 void Mesh::clearGPUData()
 {
-	vkDestroyBuffer(context->getDevice(), vertexBuffer, nullptr);
-	vertexBuffer = VK_NULL_HANDLE;
+	// Offline tools decode meshes without a device
+	if (context)
+	{
+		vkDestroyBuffer(context->getDevice(), vertexBuffer, nullptr);
+		vkFreeMemory(context->getDevice(), vertexBufferMemory, nullptr);
+		vkDestroyBuffer(context->getDevice(), indexBuffer, nullptr);
+		vkFreeMemory(context->getDevice(), indexBufferMemory, nullptr);
+	}
 
-	vkFreeMemory(context->getDevice(), vertexBufferMemory, nullptr);
+	vertexBuffer = VK_NULL_HANDLE;
 	vertexBufferMemory = VK_NULL_HANDLE;
-
-	vkDestroyBuffer(context->getDevice(), indexBuffer, nullptr);
 	indexBuffer = VK_NULL_HANDLE;
-
-	vkFreeMemory(context->getDevice(), indexBufferMemory, nullptr);
 	indexBufferMemory = VK_NULL_HANDLE;
+
+	// Draw metadata describes the GPU buffers
+	submeshes.clear();
+	drawRanges.clear();
+	meshlets.clear();
+	lods.clear();
+	numIndices = 0;
 }
 
 void Mesh::clearCPUData()
 {
 	vertices.clear();
 	indices.clear();
+	packedVertices.clear();
+	packedIndices.clear();
 }
\ No newline at end of file
@@ -3,6 +3,9 @@
 #include <vulkan/vulkan.h>
 #include <glm/glm.hpp>
 
+#include "AssetCache.h"
+#include "MeshOptimizer.h"
+
 #include <array>
 #include <vector>
 #include <string>
@@ -12,35 +15,151 @@ namespace RHI
 	class VulkanContext;
 }
 
+// GPU vertex layout, chosen at import time
+enum class VertexFormat
+{
+	Default = 0,	// 68 bytes: full precision position, tangent frame, color and uv
+	Compact,		// 20 bytes: quantized position, octahedral tangent frame, half uv
+	CompactColor,	// 24 bytes: Compact + rgba8 color
+};
+
+struct MeshImportOptions
+{
+	VertexFormat vertexFormat{ VertexFormat::Default };
+	bool optimize{ true }; // vertex cache, overdraw and vertex fetch reordering
+	bool useCache{ true }; // read and write the binary cache next to the source file
+	bool flattenTransforms{ true }; // bake node transforms into the vertices
+	bool buildMeshlets{ true }; // split submeshes into small clusters culled one by one
+	bool generateLods{ true }; // append simplified levels of detail to the index buffer
+	bool buildOccluder{ true }; // keep a low detail copy of the geometry for CPU occlusion culling
+};
+
+struct aiScene;
+struct aiNode;
+struct aiMesh;
+
 class Mesh
 {
 public:
+	// Indices of a range are relative to baseVertex, so 16-bit storage can address meshes above 65535 vertices
+	struct DrawRange
+	{
+		uint32_t firstIndex{ 0 };
+		uint32_t numIndices{ 0 };
+		int32_t baseVertex{ 0 };
+		uint32_t submesh{ 0 };
+		uint32_t lod{ 0 };
+	};
+
+	// Level of detail of a submesh, it indexes the submesh vertices like level 0 does
+	struct Lod
+	{
+		uint32_t firstIndex{ 0 };
+		uint32_t numIndices{ 0 };
+		float error{ 0.0f }; // geometric deviation from level 0 in mesh units
+	};
+
+	// One imported mesh instance, all submeshes share the vertex and index buffers
+	struct Submesh
+	{
+		uint32_t firstIndex{ 0 };
+		uint32_t numIndices{ 0 };
+		int32_t baseVertex{ 0 };
+		uint32_t numVertices{ 0 };
+		uint32_t materialIndex{ 0 };
+		uint32_t firstMeshlet{ 0 };
+		uint32_t numMeshlets{ 0 };
+		uint32_t firstLod{ 0 };
+		uint32_t numLods{ 0 };
+		uint32_t firstDrawRange{ 0 };
+		uint32_t numDrawRanges{ 0 };
+		glm::vec3 boundsMin{ 0.0f };
+		glm::vec3 boundsMax{ 0.0f };
+		glm::vec3 sphereCenter{ 0.0f };
+		float sphereRadius{ 0.0f };
+	};
+
+	using Meshlet = MeshOptimizer::Meshlet;
+
 	Mesh(const RHI::VulkanContext* context)
 		: context(context) { }
 
 	~Mesh();
 
 	// Passing model data format to vertex shader
-	static VkVertexInputBindingDescription getVertexInputBindingDescription();
-	static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions();
+	static VkVertexInputBindingDescription getVertexInputBindingDescription(VertexFormat format = VertexFormat::Default);
+	static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions(VertexFormat format = VertexFormat::Default);
+	static uint32_t getVertexStride(VertexFormat format);
 
 	// Getters
 	inline VkBuffer getVertexBuffer() const { return vertexBuffer; }
 	inline VkBuffer getIndexBuffer() const { return indexBuffer; }
-	inline uint32_t getNumIndices() const { return static_cast<uint32_t>(indices.size()); }
+	inline uint32_t getNumIndices() const { return numIndices; }
+	inline VkIndexType getIndexType() const { return indexType; }
+	inline const std::vector<DrawRange>& getDrawRanges() const { return drawRanges; }
+	inline const std::vector<Submesh>& getSubmeshes() const { return submeshes; }
+	inline const std::vector<Meshlet>& getMeshlets() const { return meshlets; }
+	inline const std::vector<Lod>& getLods() const { return lods; }
+	inline VertexFormat getVertexFormat() const { return vertexFormat; }
 
-	bool loadFromFile(const std::string& filename);
+	// Low detail triangles in mesh space, they stay on the CPU after the upload
+	inline const std::vector<glm::vec3>& getOccluderPositions() const { return occluderPositions; }
+	inline const std::vector<uint32_t>& getOccluderIndices() const { return occluderIndices; }
+
+	// Bounds of every submesh together, in mesh space
+	inline const glm::vec3& getBoundsMin() const { return boundsMin; }
+	inline const glm::vec3& getBoundsMax() const { return boundsMax; }
+	inline const glm::vec3& getSphereCenter() const { return sphereCenter; }
+	inline float getSphereRadius() const { return sphereRadius; }
+
+	// Compact formats store positions relative to the mesh bounds: position = offset + quantized * scale
+	inline const glm::vec3& getPositionDecodeScale() const { return positionDecodeScale; }
+	inline const glm::vec3& getPositionDecodeOffset() const { return positionDecodeOffset; }
+
+	bool loadFromFile(const std::string& filename, const MeshImportOptions& options = MeshImportOptions());
+
+	// CPU half of loadFromFile(), safe on any thread as long as the mesh isn't on the GPU yet.
+	// Leaves the packed buffers for uploadToGPU()
+	bool decodeFromFile(const std::string& filename, const MeshImportOptions& options = MeshImportOptions());
+
+	// Imports the file into its cache unless the cache is up to date, leaves no CPU data behind
+	CookResult cookFromFile(const std::string& path, const MeshImportOptions& options = MeshImportOptions());
 
 	void createSkybox(float size);
 	void createQuad(float size);
 
+	// Flat shaded box, used as a stand-in while the real mesh loads
+	void createBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, VertexFormat format = VertexFormat::Default);
+
 	void uploadToGPU();
 	void clearGPUData();
 	void clearCPUData();
 
 private:
-	void createVertexBuffer();
-	void createIndexBuffer();
+	bool importFromFile(const std::string& path, const MeshImportOptions& options);
+	void importNode(const aiScene* scene, const aiNode* node, const glm::mat4& parentTransform, bool flattenTransforms);
+	void importSubmesh(const aiMesh* mesh, const glm::mat4& transform);
+	void computeSubmeshBounds(Submesh& submesh) const;
+	void computeBounds();
+	bool getCacheKeys(const std::string& path, const MeshImportOptions& options, uint64_t& sourceHash, uint64_t& importHash) const;
+	bool loadFromCache(const std::string& path, uint64_t sourceHash, uint64_t importHash);
+	bool saveToCache(const std::string& path, uint64_t sourceHash, uint64_t importHash) const;
+
+	void createVertexBuffer(const void* data, VkDeviceSize size);
+	void createIndexBuffer(const void* data, VkDeviceSize size);
+
+	void getSubmeshGeometry(const Submesh& submesh, std::vector<uint32_t>& submeshIndices, std::vector<glm::vec3>& positions) const;
+
+	void optimize();
+	void buildMeshlets();
+	void buildLods(bool optimizeLods);
+	void buildOccluder();
+	void buildDrawRanges();
+
+	void computePositionQuantization();
+	void packVertexData(std::vector<uint8_t>& data) const;
+	void packIndexData(std::vector<uint8_t>& data) const;
+	void packGPUData();
 
 private:
 	const RHI::VulkanContext* context{ nullptr };
@@ -56,9 +175,42 @@ private:
 		glm::vec2 uv;
 	};
 
+	// Packed vertex used by the compact formats, Compact stops before color
+	struct CompactVertex
+	{
+		uint16_t position[4];	// xyz unorm16 inside the mesh bounds, w is the binormal sign
+		uint32_t tangent;		// octahedral, 2 x snorm16
+		uint32_t normal;		// octahedral, 2 x snorm16
+		uint32_t uv;			// 2 x half
+		uint32_t color;			// rgba8 unorm
+	};
+
 	std::vector<Vertex> vertices; 
 	std::vector<uint32_t> indices;
 
+	VkIndexType indexType{ VK_INDEX_TYPE_UINT32 };
+	std::vector<Submesh> submeshes;
+	std::vector<DrawRange> drawRanges;
+	std::vector<Meshlet> meshlets;
+	std::vector<Lod> lods;
+	uint32_t numIndices{ 0 };
+
+	// GPU layout of the vertices and indices, waiting for the upload
+	std::vector<uint8_t> packedVertices;
+	std::vector<uint8_t> packedIndices;
+
+	std::vector<glm::vec3> occluderPositions;
+	std::vector<uint32_t> occluderIndices;
+
+	glm::vec3 boundsMin{ 0.0f };
+	glm::vec3 boundsMax{ 0.0f };
+	glm::vec3 sphereCenter{ 0.0f };
+	float sphereRadius{ 0.0f };
+
+	VertexFormat vertexFormat{ VertexFormat::Default };
+	glm::vec3 positionDecodeScale{ 1.0f };
+	glm::vec3 positionDecodeOffset{ 0.0f };
+
 	// Vertex buffer
 	VkBuffer vertexBuffer{ VK_NULL_HANDLE };
 	VkDeviceMemory vertexBufferMemory{ VK_NULL_HANDLE };
@@ -0,0 +1,690 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <unordered_set>
+
+// Soft cluster boundaries are placed once the cluster ACMR drops below this value
+static const float CLUSTER_ACMR_THRESHOLD = 0.75f;
+
+// Normal cones wider than this almost never cull, the backface test is disabled for them
+static const float MESHLET_CONE_MIN_DOT = 0.1f;
+
+// Collapses rotating a triangle normal by more than ~75 degrees are rejected
+static const float SIMPLIFY_MAX_NORMAL_ROTATION = 0.25f;
+
+// Symmetric 4x4 plane quadric, error(p) = sum of squared distances to the accumulated planes
+struct Quadric
+{
+	double a00{ 0.0 }, a01{ 0.0 }, a02{ 0.0 }, a03{ 0.0 };
+	double a11{ 0.0 }, a12{ 0.0 }, a13{ 0.0 };
+	double a22{ 0.0 }, a23{ 0.0 };
+	double a33{ 0.0 };
+
+	void addPlane(const glm::vec3& normal, float distance)
+	{
+		double a = normal.x, b = normal.y, c = normal.z, d = distance;
+		a00 += a * a; a01 += a * b; a02 += a * c; a03 += a * d;
+		a11 += b * b; a12 += b * c; a13 += b * d;
+		a22 += c * c; a23 += c * d;
+		a33 += d * d;
+	}
+
+	void add(const Quadric& q)
+	{
+		a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+		a11 += q.a11; a12 += q.a12; a13 += q.a13;
+		a22 += q.a22; a23 += q.a23;
+		a33 += q.a33;
+	}
+
+	double evaluate(const glm::vec3& p) const
+	{
+		double x = p.x, y = p.y, z = p.z;
+		double result = a00 * x * x + a11 * y * y + a22 * z * z + a33
+			+ 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z + a03 * x + a13 * y + a23 * z);
+
+		return std::max(result, 0.0);
+	}
+};
+
+MeshOptimizer::VertexCacheStatistics MeshOptimizer::analyzeVertexCache(const std::vector<uint32_t>& indices, size_t numVertices, uint32_t cacheSize)
+{
+	VertexCacheStatistics statistics;
+
+	size_t numTriangles = indices.size() / 3;
+	if (numTriangles == 0)
+		return statistics;
+
+	std::vector<uint32_t> cacheTime(numVertices, 0);
+	std::vector<bool> referenced(numVertices, false);
+
+	uint32_t time = cacheSize + 1;
+	uint32_t misses = 0;
+	uint32_t numReferenced = 0;
+
+	for (uint32_t index : indices)
+	{
+		assert(index < numVertices);
+
+		if (!referenced[index])
+		{
+			referenced[index] = true;
+			numReferenced++;
+		}
+
+		if (time - cacheTime[index] > cacheSize)
+		{
+			cacheTime[index] = time++;
+			misses++;
+		}
+	}
+
+	statistics.acmr = static_cast<float>(misses) / numTriangles;
+	statistics.atvr = static_cast<float>(misses) / numReferenced;
+
+	return statistics;
+}
+
+void MeshOptimizer::optimizeVertexCache(std::vector<uint32_t>& indices, size_t numVertices, uint32_t cacheSize, std::vector<uint32_t>* clusters)
+{
+	size_t numTriangles = indices.size() / 3;
+	if (numTriangles == 0)
+		return;
+
+	// Vertex to triangle adjacency
+	std::vector<uint32_t> liveTriangles(numVertices, 0);
+	for (uint32_t index : indices)
+		liveTriangles[index]++;
+
+	std::vector<uint32_t> offsets(numVertices + 1, 0);
+	for (size_t i = 0; i < numVertices; i++)
+		offsets[i + 1] = offsets[i] + liveTriangles[i];
+
+	std::vector<uint32_t> adjacency(indices.size());
+	{
+		std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < indices.size(); i++)
+			adjacency[cursor[indices[i]]++] = static_cast<uint32_t>(i / 3);
+	}
+
+	std::vector<uint32_t> cacheTime(numVertices, 0);
+	std::vector<bool> emitted(numTriangles, false);
+	std::vector<uint32_t> deadEnd;
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+
+	std::vector<uint32_t> hardBoundaries;
+	hardBoundaries.push_back(0);
+
+	uint32_t time = cacheSize + 1;
+	uint32_t cursor = 0;
+
+	auto skipDeadEnd = [&]() -> int64_t
+	{
+		while (!deadEnd.empty())
+		{
+			uint32_t vertex = deadEnd.back();
+			deadEnd.pop_back();
+
+			if (liveTriangles[vertex] > 0)
+				return vertex;
+		}
+
+		for (; cursor < numVertices; cursor++)
+			if (liveTriangles[cursor] > 0)
+				return cursor;
+
+		return -1;
+	};
+
+	int64_t fanning = skipDeadEnd();
+	while (fanning >= 0)
+	{
+		candidates.clear();
+
+		// Emit every live triangle around the fanning vertex
+		for (uint32_t k = offsets[fanning]; k < offsets[fanning + 1]; k++)
+		{
+			uint32_t triangle = adjacency[k];
+			if (emitted[triangle])
+				continue;
+
+			for (int j = 0; j < 3; j++)
+			{
+				uint32_t vertex = indices[triangle * 3 + j];
+
+				result.push_back(vertex);
+				deadEnd.push_back(vertex);
+				candidates.push_back(vertex);
+				liveTriangles[vertex]--;
+
+				if (time - cacheTime[vertex] > cacheSize)
+					cacheTime[vertex] = time++;
+			}
+
+			emitted[triangle] = true;
+		}
+
+		// Pick the candidate that is still in cache and has the fewest live triangles left
+		int64_t next = -1;
+		int64_t bestPriority = -1;
+
+		for (uint32_t vertex : candidates)
+		{
+			if (liveTriangles[vertex] == 0)
+				continue;
+
+			int64_t priority = 0;
+			if (time - cacheTime[vertex] + 2 * liveTriangles[vertex] <= cacheSize)
+				priority = time - cacheTime[vertex];
+
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				next = vertex;
+			}
+		}
+
+		if (next < 0)
+		{
+			next = skipDeadEnd();
+			if (next >= 0)
+				hardBoundaries.push_back(static_cast<uint32_t>(result.size() / 3));
+		}
+
+		fanning = next;
+	}
+
+	assert(result.size() == indices.size());
+	indices.swap(result);
+
+	if (clusters)
+	{
+		*clusters = hardBoundaries;
+		splitClusters(indices, numVertices, cacheSize, *clusters);
+	}
+}
+
+void MeshOptimizer::splitClusters(const std::vector<uint32_t>& indices, size_t numVertices, uint32_t cacheSize, std::vector<uint32_t>& clusters)
+{
+	uint32_t numTriangles = static_cast<uint32_t>(indices.size() / 3);
+
+	std::vector<uint32_t> result;
+	std::vector<uint32_t> cacheTime(numVertices, 0);
+	uint32_t time = cacheSize + 1;
+
+	for (size_t i = 0; i < clusters.size(); i++)
+	{
+		uint32_t begin = clusters[i];
+		uint32_t end = (i + 1 < clusters.size()) ? clusters[i + 1] : numTriangles;
+
+		// Each cluster is measured with a cold cache, as it can be drawn after any other one
+		uint32_t clusterStart = time;
+		uint32_t misses = 0;
+		uint32_t triangles = 0;
+
+		result.push_back(begin);
+
+		for (uint32_t triangle = begin; triangle < end; triangle++)
+		{
+			for (int j = 0; j < 3; j++)
+			{
+				uint32_t vertex = indices[triangle * 3 + j];
+				if (cacheTime[vertex] < clusterStart || time - cacheTime[vertex] > cacheSize)
+				{
+					cacheTime[vertex] = time++;
+					misses++;
+				}
+			}
+
+			triangles++;
+
+			if (misses <= CLUSTER_ACMR_THRESHOLD * triangles && triangle + 1 < end)
+			{
+				result.push_back(triangle + 1);
+
+				clusterStart = time;
+				misses = 0;
+				triangles = 0;
+			}
+		}
+	}
+
+	clusters.swap(result);
+}
+
+void MeshOptimizer::optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& clusters)
+{
+	uint32_t numTriangles = static_cast<uint32_t>(indices.size() / 3);
+	if (numTriangles == 0 || clusters.size() < 2)
+		return;
+
+	struct ClusterInfo
+	{
+		uint32_t begin;
+		uint32_t end;
+		glm::vec3 centroid;
+		glm::vec3 normal;
+		float area;
+		float sortKey;
+	};
+
+	std::vector<ClusterInfo> infos(clusters.size());
+
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+
+	for (size_t i = 0; i < clusters.size(); i++)
+	{
+		ClusterInfo& info = infos[i];
+		info.begin = clusters[i];
+		info.end = (i + 1 < clusters.size()) ? clusters[i + 1] : numTriangles;
+		info.centroid = glm::vec3(0.0f);
+		info.normal = glm::vec3(0.0f);
+		info.area = 0.0f;
+
+		// Area weighted centroid and normal
+		for (uint32_t triangle = info.begin; triangle < info.end; triangle++)
+		{
+			const glm::vec3& p0 = positions[indices[triangle * 3 + 0]];
+			const glm::vec3& p1 = positions[indices[triangle * 3 + 1]];
+			const glm::vec3& p2 = positions[indices[triangle * 3 + 2]];
+
+			glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			float area = glm::length(normal);
+
+			info.centroid += (p0 + p1 + p2) * (area / 3.0f);
+			info.normal += normal;
+			info.area += area;
+		}
+
+		meshCentroid += info.centroid;
+		meshArea += info.area;
+
+		if (info.area > 0.0f)
+			info.centroid /= info.area;
+	}
+
+	if (meshArea > 0.0f)
+		meshCentroid /= meshArea;
+
+	for (ClusterInfo& info : infos)
+	{
+		float length = glm::length(info.normal);
+		info.sortKey = (length > 0.0f) ? glm::dot(info.centroid - meshCentroid, info.normal / length) : 0.0f;
+	}
+
+	std::stable_sort(infos.begin(), infos.end(), [](const ClusterInfo& a, const ClusterInfo& b) { return a.sortKey > b.sortKey; });
+
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+
+	for (const ClusterInfo& info : infos)
+		result.insert(result.end(), indices.begin() + info.begin * 3, indices.begin() + info.end * 3);
+
+	indices.swap(result);
+}
+
+size_t MeshOptimizer::optimizeVertexFetch(std::vector<uint32_t>& indices, size_t numVertices, std::vector<uint32_t>& remap)
+{
+	remap.assign(numVertices, INVALID_INDEX);
+
+	uint32_t numReferenced = 0;
+	for (uint32_t& index : indices)
+	{
+		if (remap[index] == INVALID_INDEX)
+			remap[index] = numReferenced++;
+
+		index = remap[index];
+	}
+
+	return numReferenced;
+}
+
+void MeshOptimizer::buildMeshlets(const std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions, std::vector<Meshlet>& meshlets, uint32_t maxVertices, uint32_t maxTriangles)
+{
+	assert(maxVertices >= 3 && maxTriangles > 0);
+
+	meshlets.clear();
+
+	// Triangles keep their order, after optimizeVertexCache consecutive triangles are already spatially coherent
+	// and the meshlets can be drawn straight from the index buffer
+	std::vector<uint32_t> lastMeshlet(positions.size(), INVALID_INDEX);
+
+	Meshlet meshlet;
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		uint32_t meshletIndex = static_cast<uint32_t>(meshlets.size());
+
+		uint32_t newVertices = 0;
+		for (size_t k = 0; k < 3; k++)
+			if (lastMeshlet[indices[i + k]] != meshletIndex)
+				newVertices++;
+
+		if (meshlet.numIndices > 0 && (meshlet.numVertices + newVertices > maxVertices || meshlet.numIndices / 3 >= maxTriangles))
+		{
+			meshlets.push_back(meshlet);
+			meshletIndex++;
+
+			meshlet = Meshlet();
+			meshlet.firstIndex = static_cast<uint32_t>(i);
+		}
+
+		for (size_t k = 0; k < 3; k++)
+		{
+			uint32_t index = indices[i + k];
+			assert(index < positions.size());
+
+			if (lastMeshlet[index] != meshletIndex)
+			{
+				lastMeshlet[index] = meshletIndex;
+				meshlet.numVertices++;
+			}
+		}
+
+		meshlet.numIndices += 3;
+	}
+
+	if (meshlet.numIndices > 0)
+		meshlets.push_back(meshlet);
+
+	for (Meshlet& result : meshlets)
+		computeMeshletBounds(indices, positions, result);
+}
+
+void MeshOptimizer::computeMeshletBounds(const std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions, Meshlet& meshlet)
+{
+	uint32_t begin = meshlet.firstIndex;
+	uint32_t end = meshlet.firstIndex + meshlet.numIndices;
+
+	// Bounding sphere around the box center
+	glm::vec3 boundsMin = positions[indices[begin]];
+	glm::vec3 boundsMax = positions[indices[begin]];
+
+	for (uint32_t i = begin; i < end; i++)
+	{
+		boundsMin = glm::min(boundsMin, positions[indices[i]]);
+		boundsMax = glm::max(boundsMax, positions[indices[i]]);
+	}
+
+	meshlet.center = (boundsMin + boundsMax) * 0.5f;
+	meshlet.radius = 0.0f;
+
+	for (uint32_t i = begin; i < end; i++)
+		meshlet.radius = std::max(meshlet.radius, glm::length(positions[indices[i]] - meshlet.center));
+
+	// Normal cone around the area weighted average normal
+	glm::vec3 axis(0.0f);
+	for (uint32_t i = begin; i < end; i += 3)
+		axis += glm::cross(positions[indices[i + 1]] - positions[indices[i]], positions[indices[i + 2]] - positions[indices[i]]);
+
+	meshlet.coneApex = meshlet.center;
+	meshlet.coneAxis = glm::vec3(0.0f);
+	meshlet.coneCutoff = 1.0f;
+
+	float axisLength = glm::length(axis);
+	if (axisLength <= 0.0f)
+		return;
+
+	axis /= axisLength;
+	meshlet.coneAxis = axis;
+
+	float minDot = 1.0f;
+	for (uint32_t i = begin; i < end; i += 3)
+	{
+		glm::vec3 normal = glm::cross(positions[indices[i + 1]] - positions[indices[i]], positions[indices[i + 2]] - positions[indices[i]]);
+		float length = glm::length(normal);
+
+		if (length > 0.0f)
+			minDot = std::min(minDot, glm::dot(normal / length, axis));
+	}
+
+	if (minDot <= MESHLET_CONE_MIN_DOT)
+		return;
+
+	// Move the apex back until every triangle plane passes in front of it
+	float maxDistance = 0.0f;
+	for (uint32_t i = begin; i < end; i += 3)
+	{
+		const glm::vec3& p0 = positions[indices[i]];
+
+		glm::vec3 normal = glm::cross(positions[indices[i + 1]] - p0, positions[indices[i + 2]] - p0);
+		float length = glm::length(normal);
+
+		if (length <= 0.0f)
+			continue;
+
+		normal /= length;
+		maxDistance = std::max(maxDistance, glm::dot(meshlet.center - p0, normal) / glm::dot(axis, normal));
+	}
+
+	meshlet.coneApex = meshlet.center - axis * maxDistance;
+	meshlet.coneCutoff = sqrtf(1.0f - minDot * minDot);
+}
+
+float MeshOptimizer::simplify(const std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions, size_t targetIndexCount, std::vector<uint32_t>& result)
+{
+	result = indices;
+
+	size_t numVertices = positions.size();
+	if (result.size() <= targetIndexCount || numVertices == 0)
+		return 0.0f;
+
+	// Weld vertices sharing a position, seams are split vertices on top of each other
+	std::vector<uint32_t> sorted(numVertices);
+	for (uint32_t i = 0; i < numVertices; i++)
+		sorted[i] = i;
+
+	auto lessPosition = [&positions](uint32_t a, uint32_t b)
+	{
+		const glm::vec3& pa = positions[a];
+		const glm::vec3& pb = positions[b];
+		return (pa.x != pb.x) ? pa.x < pb.x : (pa.y != pb.y) ? pa.y < pb.y : pa.z < pb.z;
+	};
+
+	std::stable_sort(sorted.begin(), sorted.end(), lessPosition);
+
+	std::vector<uint32_t> weld(numVertices);
+	std::vector<bool> locked(numVertices, false);
+
+	for (size_t i = 0; i < numVertices;)
+	{
+		size_t end = i + 1;
+		while (end < numVertices && positions[sorted[end]] == positions[sorted[i]])
+			end++;
+
+		for (size_t k = i; k < end; k++)
+		{
+			weld[sorted[k]] = sorted[i];
+			locked[sorted[k]] = (end - i > 1);
+		}
+
+		i = end;
+	}
+
+	// Edges of the welded topology without an opposite half edge are open borders
+	{
+		std::unordered_set<uint64_t> halfEdges;
+		halfEdges.reserve(result.size());
+
+		for (size_t i = 0; i < result.size(); i += 3)
+			for (size_t k = 0; k < 3; k++)
+			{
+				uint64_t a = weld[result[i + k]];
+				uint64_t b = weld[result[i + (k + 1) % 3]];
+				halfEdges.insert((a << 32) | b);
+			}
+
+		for (size_t i = 0; i < result.size(); i += 3)
+			for (size_t k = 0; k < 3; k++)
+			{
+				uint32_t a = result[i + k];
+				uint32_t b = result[i + (k + 1) % 3];
+
+				if (halfEdges.find((static_cast<uint64_t>(weld[b]) << 32) | weld[a]) == halfEdges.end())
+				{
+					locked[a] = true;
+					locked[b] = true;
+				}
+			}
+	}
+
+	// Plane quadrics accumulate on the welded vertex so both sides of a seam see the same surface
+	std::vector<Quadric> quadrics(numVertices);
+
+	for (size_t i = 0; i < result.size(); i += 3)
+	{
+		const glm::vec3& p0 = positions[result[i + 0]];
+		const glm::vec3& p1 = positions[result[i + 1]];
+		const glm::vec3& p2 = positions[result[i + 2]];
+
+		glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+		float length = glm::length(normal);
+
+		if (length <= 0.0f)
+			continue;
+
+		normal /= length;
+
+		Quadric quadric;
+		quadric.addPlane(normal, -glm::dot(normal, p0));
+
+		for (size_t k = 0; k < 3; k++)
+			quadrics[weld[result[i + k]]].add(quadric);
+	}
+
+	struct Collapse
+	{
+		uint32_t source;
+		uint32_t target;
+		double error;
+	};
+
+	std::vector<Collapse> collapses;
+	std::vector<uint32_t> remap(numVertices);
+	std::vector<bool> passLocked(numVertices);
+	std::vector<uint32_t> offsets(numVertices + 1);
+	std::vector<uint32_t> adjacency;
+
+	double maxError = 0.0;
+
+	while (result.size() > targetIndexCount)
+	{
+		// Vertex to triangle adjacency of the current triangles
+		std::fill(offsets.begin(), offsets.end(), 0);
+		for (uint32_t index : result)
+			offsets[index + 1]++;
+
+		for (size_t i = 0; i < numVertices; i++)
+			offsets[i + 1] += offsets[i];
+
+		adjacency.resize(result.size());
+		{
+			std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < result.size(); i++)
+				adjacency[cursor[result[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+
+		// Candidate collapses along every edge, sources must be free interior vertices
+		collapses.clear();
+		for (size_t i = 0; i < result.size(); i += 3)
+			for (size_t k = 0; k < 3; k++)
+			{
+				uint32_t a = result[i + k];
+				uint32_t b = result[i + (k + 1) % 3];
+
+				Quadric quadric = quadrics[weld[a]];
+				quadric.add(quadrics[weld[b]]);
+
+				if (!locked[a])
+					collapses.push_back({ a, b, quadric.evaluate(positions[b]) });
+
+				if (!locked[b])
+					collapses.push_back({ b, a, quadric.evaluate(positions[a]) });
+			}
+
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+		// An interior collapse removes two triangles
+		size_t collapseGoal = (result.size() - targetIndexCount) / 6 + 1;
+		size_t numCollapses = 0;
+
+		for (uint32_t i = 0; i < numVertices; i++)
+			remap[i] = i;
+
+		std::fill(passLocked.begin(), passLocked.end(), false);
+
+		for (const Collapse& collapse : collapses)
+		{
+			if (numCollapses >= collapseGoal)
+				break;
+
+			uint32_t source = collapse.source;
+			uint32_t target = collapse.target;
+
+			if (passLocked[source] || passLocked[target])
+				continue;
+
+			// Reject collapses that flip or fold a triangle around the source
+			bool valid = true;
+			for (uint32_t k = offsets[source]; k < offsets[source + 1] && valid; k++)
+			{
+				const uint32_t* triangle = &result[adjacency[k] * 3];
+				if (triangle[0] == target || triangle[1] == target || triangle[2] == target)
+					continue;
+
+				glm::vec3 p[3];
+				glm::vec3 q[3];
+				for (size_t v = 0; v < 3; v++)
+				{
+					p[v] = positions[triangle[v]];
+					q[v] = (triangle[v] == source) ? positions[target] : p[v];
+				}
+
+				glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+				glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+
+				valid = glm::dot(before, after) > SIMPLIFY_MAX_NORMAL_ROTATION * glm::length(before) * glm::length(after);
+			}
+
+			if (!valid)
+				continue;
+
+			remap[source] = target;
+			quadrics[weld[target]].add(quadrics[weld[source]]);
+			maxError = std::max(maxError, collapse.error);
+			numCollapses++;
+
+			// Triangles around the source change shape, their vertices wait for the next pass
+			for (uint32_t k = offsets[source]; k < offsets[source + 1]; k++)
+				for (size_t v = 0; v < 3; v++)
+					passLocked[result[adjacency[k] * 3 + v]] = true;
+		}
+
+		if (numCollapses == 0)
+			break;
+
+		// Apply the collapses and drop the degenerate triangles
+		size_t numIndices = 0;
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			uint32_t a = remap[result[i + 0]];
+			uint32_t b = remap[result[i + 1]];
+			uint32_t c = remap[result[i + 2]];
+
+			if (a == b || b == c || c == a)
+				continue;
+
+			result[numIndices++] = a;
+			result[numIndices++] = b;
+			result[numIndices++] = c;
+		}
+
+		result.resize(numIndices);
+	}
+
+	return static_cast<float>(sqrt(maxError));
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Import time index/vertex reordering, all passes are deterministic
+class MeshOptimizer
+{
+public:
+	// Triangle cluster with culling bounds, its indices are a contiguous run of the index buffer
+	struct Meshlet
+	{
+		uint32_t firstIndex{ 0 };
+		uint32_t numIndices{ 0 };
+		uint32_t numVertices{ 0 };
+		uint32_t submesh{ 0 };
+		glm::vec3 center{ 0.0f };	// bounding sphere
+		float radius{ 0.0f };
+		glm::vec3 coneApex{ 0.0f };	// normal cone, every triangle is backfacing for viewers inside the cone behind the apex
+		float coneCutoff{ 1.0f };	// sine of the cone half angle, 1.0 never culls
+		glm::vec3 coneAxis{ 0.0f };
+	};
+
+	struct VertexCacheStatistics
+	{
+		float acmr{ 0.0f }; // average cache miss ratio, transformed vertices per triangle
+		float atvr{ 0.0f }; // average transform to vertex ratio, 1.0 is optimal
+	};
+
+	// Simulates a FIFO post-transform cache
+	static VertexCacheStatistics analyzeVertexCache(const std::vector<uint32_t>& indices, size_t numVertices, uint32_t cacheSize = 16);
+
+	// Tipsify triangle ordering, optionally returns the first triangle of each cluster for optimizeOverdraw
+	static void optimizeVertexCache(std::vector<uint32_t>& indices, size_t numVertices, uint32_t cacheSize = 16, std::vector<uint32_t>* clusters = nullptr);
+
+	// Sorts the clusters so the ones facing outward from the mesh center are drawn first
+	static void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& clusters);
+
+	// Builds a vertex remap table in first use order and rewrites the indices, returns the number of referenced vertices
+	static size_t optimizeVertexFetch(std::vector<uint32_t>& indices, size_t numVertices, std::vector<uint32_t>& remap);
+
+	// Splits the triangle list in index order into clusters of at most maxVertices unique vertices and maxTriangles triangles
+	static void buildMeshlets(const std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions, std::vector<Meshlet>& meshlets, uint32_t maxVertices = 64, uint32_t maxTriangles = 124);
+
+	// Quadric error edge collapse towards targetIndexCount, vertices are never moved so the result indexes the same vertex buffer.
+	// Vertices on open borders or sharing their position with another vertex (uv, normal seams) are locked.
+	// Returns the largest collapse error as a distance in mesh units
+	static float simplify(const std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions, size_t targetIndexCount, std::vector<uint32_t>& result);
+
+	static constexpr uint32_t INVALID_INDEX = ~0u;
+
+private:
+	static void splitClusters(const std::vector<uint32_t>& indices, size_t numVertices, uint32_t cacheSize, std::vector<uint32_t>& clusters);
+	static void computeMeshletBounds(const std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions, Meshlet& meshlet);
+};
@@ -0,0 +1,510 @@
+#include "OcclusionRasterizer.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+#include <immintrin.h>
+
+#if defined(_MSC_VER)
+	#include <intrin.h>
+	#define AVX2_TARGET
+#else
+	#include <cpuid.h>
+	#define AVX2_TARGET __attribute__((target("avx2,fma")))
+#endif
+
+// Triangles set up by one task, chunks keep the setup output free of locks
+static const uint32_t SETUP_CHUNK_SIZE = 1024;
+
+// Bands per thread, more than one evens out bands covering different amounts of geometry
+static const uint32_t BANDS_PER_THREAD = 2;
+
+// Screen space area under which a triangle covers no pixel center worth rasterizing
+static const float MIN_TRIANGLE_AREA = 1e-8f;
+
+OcclusionRasterizer::OcclusionRasterizer(uint32_t width, uint32_t height, uint32_t numThreads)
+	: threadPool(numThreads)
+{
+	resize(width, height);
+}
+
+void OcclusionRasterizer::resize(uint32_t newWidth, uint32_t newHeight)
+{
+	numTilesX = std::max((newWidth + TILE_WIDTH - 1) / TILE_WIDTH, 1u);
+	numTilesY = std::max((newHeight + TILE_HEIGHT - 1) / TILE_HEIGHT, 1u);
+	width = numTilesX * TILE_WIDTH;
+	height = numTilesY * TILE_HEIGHT;
+
+	depth.resize(width * height);
+	tileDepth.resize(numTilesX * numTilesY);
+	clear();
+}
+
+void OcclusionRasterizer::clear()
+{
+	std::fill(depth.begin(), depth.end(), 1.0f);
+	std::fill(tileDepth.begin(), tileDepth.end(), 1.0f);
+
+	occluders.clear();
+	numTriangles = 0;
+}
+
+void OcclusionRasterizer::addOccluder(const glm::mat4& clipFromSpace, const glm::vec3* positions, const uint32_t* indices, uint32_t numIndices)
+{
+	if (numIndices >= 3)
+		occluders.push_back({ clipFromSpace, positions, indices, numIndices });
+}
+
+void OcclusionRasterizer::rasterize(Path path)
+{
+	if (path == Path::Auto || (path == Path::AVX2 && !isAVX2Supported()))
+		path = isAVX2Supported() ? Path::AVX2 : Path::Scalar;
+
+	// Setup, every chunk of triangles lands in its own list
+	struct Chunk
+	{
+		uint32_t occluder;
+		uint32_t firstTriangle;
+		uint32_t lastTriangle;
+	};
+
+	std::vector<Chunk> chunks;
+	for (uint32_t i = 0; i < occluders.size(); i++)
+	{
+		uint32_t numOccluderTriangles = occluders[i].numIndices / 3;
+		for (uint32_t first = 0; first < numOccluderTriangles; first += SETUP_CHUNK_SIZE)
+			chunks.push_back({ i, first, std::min(first + SETUP_CHUNK_SIZE, numOccluderTriangles) });
+	}
+
+	threadTriangles.resize(chunks.size());
+	threadPool.parallelFor(static_cast<uint32_t>(chunks.size()), [&](uint32_t index, uint32_t)
+	{
+		const Chunk& chunk = chunks[index];
+		threadTriangles[index].clear();
+		setupTriangles(occluders[chunk.occluder], chunk.firstTriangle, chunk.lastTriangle, threadTriangles[index]);
+	});
+
+	numTriangles = 0;
+	for (size_t i = 0; i < chunks.size(); i++)
+		numTriangles += static_cast<uint32_t>(threadTriangles[i].size());
+
+	// Rasterization, bands of tile rows never share a pixel
+	uint32_t numBands = std::min(getNumThreads() * BANDS_PER_THREAD, numTilesY);
+	uint32_t numChunks = static_cast<uint32_t>(chunks.size());
+
+	threadPool.parallelFor(numBands, [&](uint32_t band, uint32_t)
+	{
+		uint32_t firstTileRow = band * numTilesY / numBands;
+		uint32_t lastTileRow = (band + 1) * numTilesY / numBands;
+
+		int minY = static_cast<int>(firstTileRow * TILE_HEIGHT);
+		int maxY = static_cast<int>(lastTileRow * TILE_HEIGHT) - 1;
+
+		for (uint32_t chunk = 0; chunk < numChunks; chunk++)
+			for (const Triangle& triangle : threadTriangles[chunk])
+			{
+				if (triangle.maxY < minY || triangle.minY > maxY)
+					continue;
+
+				if (path == Path::AVX2)
+					rasterizeTriangleAVX2(triangle, minY, maxY);
+				else
+					rasterizeTriangleScalar(triangle, minY, maxY);
+			}
+
+		updateTileDepth(firstTileRow, lastTileRow);
+	});
+}
+
+bool OcclusionRasterizer::isOccluded(const glm::mat4& clipFromSpace, const glm::vec3& boundsMin, const glm::vec3& boundsMax) const
+{
+	glm::vec2 screenMin(FLT_MAX);
+	glm::vec2 screenMax(-FLT_MAX);
+	float nearestDepth = FLT_MAX;
+
+	for (int i = 0; i < 8; i++)
+	{
+		glm::vec3 corner(
+			(i & 1) ? boundsMax.x : boundsMin.x,
+			(i & 2) ? boundsMax.y : boundsMin.y,
+			(i & 4) ? boundsMax.z : boundsMin.z);
+
+		glm::vec4 clip = clipFromSpace * glm::vec4(corner, 1.0f);
+
+		// In front of the near plane, the box surrounds the camera
+		if (clip.z < 0.0f || clip.w <= 0.0f)
+			return false;
+
+		glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		glm::vec2 screen((ndc.x * 0.5f + 0.5f) * width, (ndc.y * 0.5f + 0.5f) * height);
+
+		screenMin = glm::min(screenMin, screen);
+		screenMax = glm::max(screenMax, screen);
+		nearestDepth = std::min(nearestDepth, ndc.z);
+	}
+
+	// Every pixel the box touches, clamped to the screen
+	int minX = std::max(static_cast<int>(floorf(screenMin.x)), 0);
+	int minY = std::max(static_cast<int>(floorf(screenMin.y)), 0);
+	int maxX = std::min(static_cast<int>(floorf(screenMax.x)), static_cast<int>(width) - 1);
+	int maxY = std::min(static_cast<int>(floorf(screenMax.y)), static_cast<int>(height) - 1);
+
+	if (minX > maxX || minY > maxY)
+		return false;
+
+	for (int tileY = minY / TILE_HEIGHT; tileY <= maxY / TILE_HEIGHT; tileY++)
+		for (int tileX = minX / TILE_WIDTH; tileX <= maxX / TILE_WIDTH; tileX++)
+		{
+			// The whole tile is nearer than the box
+			if (tileDepth[tileY * numTilesX + tileX] < nearestDepth)
+				continue;
+
+			int x0 = std::max(minX, tileX * TILE_WIDTH);
+			int y0 = std::max(minY, tileY * TILE_HEIGHT);
+			int x1 = std::min(maxX, tileX * TILE_WIDTH + TILE_WIDTH - 1);
+			int y1 = std::min(maxY, tileY * TILE_HEIGHT + TILE_HEIGHT - 1);
+
+			for (int y = y0; y <= y1; y++)
+				for (int x = x0; x <= x1; x++)
+					if (depth[y * width + x] >= nearestDepth)
+						return false;
+		}
+
+	return true;
+}
+
+bool OcclusionRasterizer::isAVX2Supported()
+{
+	static const bool supported = []()
+	{
+		// CPUID.1:ECX bit 12 FMA, bit 27 OSXSAVE and bit 28 AVX, CPUID.7:EBX bit 5 AVX2,
+		// then XCR0 must enable the XMM and YMM states
+		unsigned int ecx = 0;
+		unsigned int ebx7 = 0;
+#if defined(_MSC_VER)
+		int info[4] = {};
+		__cpuid(info, 1);
+		ecx = static_cast<unsigned int>(info[2]);
+
+		__cpuidex(info, 7, 0);
+		ebx7 = static_cast<unsigned int>(info[1]);
+#else
+		unsigned int eax = 0, ebx = 0, edx = 0;
+		if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+			return false;
+
+		unsigned int ecx7 = 0;
+		if (!__get_cpuid_count(7, 0, &eax, &ebx7, &ecx7, &edx))
+			return false;
+#endif
+		if ((ecx & (1u << 12)) == 0 || (ecx & (1u << 27)) == 0 || (ecx & (1u << 28)) == 0 || (ebx7 & (1u << 5)) == 0)
+			return false;
+
+#if defined(_MSC_VER)
+		unsigned long long xcr0 = _xgetbv(0);
+#else
+		unsigned int xcr0Low = 0, xcr0High = 0;
+		__asm__("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+		unsigned long long xcr0 = xcr0Low;
+#endif
+		return (xcr0 & 0x6) == 0x6;
+	}();
+
+	return supported;
+}
+
+void OcclusionRasterizer::setupTriangles(const Occluder& occluder, uint32_t firstTriangle, uint32_t lastTriangle, std::vector<Triangle>& triangles) const
+{
+	for (uint32_t i = firstTriangle; i < lastTriangle; i++)
+	{
+		const uint32_t* index = occluder.indices + i * 3;
+
+		std::array<glm::vec4, 3> vertices =
+		{
+			occluder.clipFromSpace * glm::vec4(occluder.positions[index[0]], 1.0f),
+			occluder.clipFromSpace * glm::vec4(occluder.positions[index[1]], 1.0f),
+			occluder.clipFromSpace * glm::vec4(occluder.positions[index[2]], 1.0f),
+		};
+
+		if (vertices[0].z >= 0.0f && vertices[1].z >= 0.0f && vertices[2].z >= 0.0f)
+		{
+			setupTriangle(vertices[0], vertices[1], vertices[2], triangles);
+			continue;
+		}
+
+		// Clip against the Vulkan near plane z = 0, one triangle becomes a polygon of up to 4 vertices
+		std::array<glm::vec4, 4> polygon;
+		uint32_t numVertices = 0;
+
+		for (uint32_t j = 0; j < 3; j++)
+		{
+			const glm::vec4& current = vertices[j];
+			const glm::vec4& next = vertices[(j + 1) % 3];
+
+			if (current.z >= 0.0f)
+				polygon[numVertices++] = current;
+
+			if ((current.z >= 0.0f) != (next.z >= 0.0f))
+				polygon[numVertices++] = glm::mix(current, next, current.z / (current.z - next.z));
+		}
+
+		for (uint32_t j = 2; j < numVertices; j++)
+			setupTriangle(polygon[0], polygon[j - 1], polygon[j], triangles);
+	}
+}
+
+void OcclusionRasterizer::setupTriangle(const glm::vec4& v0, const glm::vec4& v1, const glm::vec4& v2, std::vector<Triangle>& triangles) const
+{
+	if (v0.w <= 0.0f || v1.w <= 0.0f || v2.w <= 0.0f)
+		return;
+
+	glm::vec3 p[3];
+	const glm::vec4* clip[3] = { &v0, &v1, &v2 };
+
+	for (int i = 0; i < 3; i++)
+	{
+		glm::vec3 ndc = glm::vec3(*clip[i]) / clip[i]->w;
+		p[i] = glm::vec3((ndc.x * 0.5f + 0.5f) * width, (ndc.y * 0.5f + 0.5f) * height, ndc.z);
+	}
+
+	// Occluders are two sided, clockwise triangles are flipped
+	float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+
+	if (fabs(area) < MIN_TRIANGLE_AREA)
+		return;
+
+	if (area < 0.0f)
+	{
+		std::swap(p[1], p[2]);
+		area = -area;
+	}
+
+	Triangle triangle;
+
+	float minX = std::min({ p[0].x, p[1].x, p[2].x });
+	float minY = std::min({ p[0].y, p[1].y, p[2].y });
+	float maxX = std::max({ p[0].x, p[1].x, p[2].x });
+	float maxY = std::max({ p[0].y, p[1].y, p[2].y });
+
+	triangle.minX = std::max(static_cast<int>(floorf(minX)), 0);
+	triangle.minY = std::max(static_cast<int>(floorf(minY)), 0);
+	triangle.maxX = std::min(static_cast<int>(floorf(maxX)), static_cast<int>(width) - 1);
+	triangle.maxY = std::min(static_cast<int>(floorf(maxY)), static_cast<int>(height) - 1);
+
+	if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+		return;
+
+	// Edge p -> q is positive on the inside, evaluated at pixel centers
+	for (int i = 0; i < 3; i++)
+	{
+		const glm::vec3& from = p[i];
+		const glm::vec3& to = p[(i + 1) % 3];
+
+		float a = from.y - to.y;
+		float b = to.x - from.x;
+
+		triangle.edgeA[i] = a;
+		triangle.edgeB[i] = b;
+		triangle.edgeC[i] = -(a * from.x + b * from.y) + 0.5f * (a + b);
+	}
+
+	// Depth plane through the three vertices. It is pushed back by its slope over half a pixel
+	// and capped by the farthest vertex, so a pixel never gets nearer than the surface it samples
+	float depthA = ((p[1].z - p[0].z) * (p[2].y - p[0].y) - (p[2].z - p[0].z) * (p[1].y - p[0].y)) / area;
+	float depthB = ((p[2].z - p[0].z) * (p[1].x - p[0].x) - (p[1].z - p[0].z) * (p[2].x - p[0].x)) / area;
+
+	triangle.depthA = depthA;
+	triangle.depthB = depthB;
+	triangle.depthC = p[0].z - depthA * p[0].x - depthB * p[0].y + 0.5f * (depthA + depthB) + 0.5f * (fabs(depthA) + fabs(depthB));
+	triangle.depthMax = std::max({ p[0].z, p[1].z, p[2].z });
+
+	triangles.push_back(triangle);
+}
+
+void OcclusionRasterizer::rasterizeTriangleScalar(const Triangle& triangle, int minY, int maxY)
+{
+	int y0 = std::max(triangle.minY, minY);
+	int y1 = std::min(triangle.maxY, maxY);
+
+	for (int y = y0; y <= y1; y++)
+	{
+		float* row = depth.data() + y * width;
+
+		for (int x = triangle.minX; x <= triangle.maxX; x++)
+		{
+			float e0 = triangle.edgeA[0] * x + triangle.edgeB[0] * y + triangle.edgeC[0];
+			float e1 = triangle.edgeA[1] * x + triangle.edgeB[1] * y + triangle.edgeC[1];
+			float e2 = triangle.edgeA[2] * x + triangle.edgeB[2] * y + triangle.edgeC[2];
+
+			if (e0 < 0.0f || e1 < 0.0f || e2 < 0.0f)
+				continue;
+
+			float z = std::min(triangle.depthA * x + triangle.depthB * y + triangle.depthC, triangle.depthMax);
+			row[x] = std::min(row[x], z);
+		}
+	}
+}
+
+AVX2_TARGET void OcclusionRasterizer::rasterizeTriangleAVX2(const Triangle& triangle, int minY, int maxY)
+{
+	int y0 = std::max(triangle.minY, minY);
+	int y1 = std::min(triangle.maxY, maxY);
+
+	// Rows are walked in aligned groups of 8 pixels, lanes left of the triangle fail the edge test
+	int x0 = triangle.minX & ~(TILE_WIDTH - 1);
+
+	__m256 laneOffsets = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+
+	__m256 edgeA0 = _mm256_set1_ps(triangle.edgeA[0]);
+	__m256 edgeA1 = _mm256_set1_ps(triangle.edgeA[1]);
+	__m256 edgeA2 = _mm256_set1_ps(triangle.edgeA[2]);
+	__m256 depthA = _mm256_set1_ps(triangle.depthA);
+	__m256 depthMax = _mm256_set1_ps(triangle.depthMax);
+
+	for (int y = y0; y <= y1; y++)
+	{
+		float* row = depth.data() + y * width;
+
+		float fy = static_cast<float>(y);
+		__m256 rowEdge0 = _mm256_set1_ps(triangle.edgeB[0] * fy + triangle.edgeC[0]);
+		__m256 rowEdge1 = _mm256_set1_ps(triangle.edgeB[1] * fy + triangle.edgeC[1]);
+		__m256 rowEdge2 = _mm256_set1_ps(triangle.edgeB[2] * fy + triangle.edgeC[2]);
+		__m256 rowDepth = _mm256_set1_ps(triangle.depthB * fy + triangle.depthC);
+
+		for (int x = x0; x <= triangle.maxX; x += TILE_WIDTH)
+		{
+			__m256 px = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), laneOffsets);
+
+			__m256 e0 = _mm256_fmadd_ps(edgeA0, px, rowEdge0);
+			__m256 e1 = _mm256_fmadd_ps(edgeA1, px, rowEdge1);
+			__m256 e2 = _mm256_fmadd_ps(edgeA2, px, rowEdge2);
+
+			// A lane is inside when no edge value has its sign bit set
+			__m256i outside = _mm256_or_si256(_mm256_or_si256(_mm256_castps_si256(e0), _mm256_castps_si256(e1)), _mm256_castps_si256(e2));
+			__m256i inside = _mm256_cmpgt_epi32(_mm256_setzero_si256(), outside);
+			inside = _mm256_xor_si256(inside, _mm256_set1_epi32(-1));
+
+			if (_mm256_testz_si256(inside, inside))
+				continue;
+
+			__m256 z = _mm256_min_ps(_mm256_fmadd_ps(depthA, px, rowDepth), depthMax);
+			__m256 current = _mm256_loadu_ps(row + x);
+			__m256 nearest = _mm256_min_ps(current, z);
+
+			_mm256_storeu_ps(row + x, _mm256_blendv_ps(current, nearest, _mm256_castsi256_ps(inside)));
+		}
+	}
+}
+
+void OcclusionRasterizer::updateTileDepth(uint32_t firstTileRow, uint32_t lastTileRow)
+{
+	for (uint32_t tileY = firstTileRow; tileY < lastTileRow; tileY++)
+		for (uint32_t tileX = 0; tileX < numTilesX; tileX++)
+		{
+			float farthest = 0.0f;
+
+			for (uint32_t y = tileY * TILE_HEIGHT; y < (tileY + 1) * TILE_HEIGHT; y++)
+			{
+				const float* row = depth.data() + y * width + tileX * TILE_WIDTH;
+				for (uint32_t x = 0; x < TILE_WIDTH; x++)
+					farthest = std::max(farthest, row[x]);
+			}
+
+			tileDepth[tileY * numTilesX + tileX] = farthest;
+		}
+}
+
+OcclusionRasterizer::BenchmarkResult OcclusionRasterizer::runBenchmark(uint32_t numOccluders, uint32_t numObjects, uint32_t numIterations)
+{
+	// Fixed seed so runs are comparable, the camera sits at the origin looking down -z
+	std::mt19937 generator(1234);
+	std::uniform_real_distribution<float> spread(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> occluderDistance(5.0f, 10.0f);
+	std::uniform_real_distribution<float> objectDistance(15.0f, 40.0f);
+	std::uniform_real_distribution<float> occluderSize(0.25f, 0.75f);
+	std::uniform_real_distribution<float> objectSize(0.1f, 0.5f);
+
+	const uint32_t width = 320;
+	const uint32_t height = 192;
+	glm::mat4 clipFromWorld = glm::perspectiveRH_ZO(glm::radians(60.0f), static_cast<float>(width) / height, 0.1f, 100.0f);
+
+	// Every occluder is a box of 12 triangles
+	static const uint32_t boxIndices[] =
+	{
+		0, 1, 3, 0, 3, 2,	4, 6, 7, 4, 7, 5,
+		0, 4, 5, 0, 5, 1,	2, 3, 7, 2, 7, 6,
+		0, 2, 6, 0, 6, 4,	1, 5, 7, 1, 7, 3,
+	};
+
+	std::vector<glm::vec3> occluderPositions(numOccluders * 8);
+	for (uint32_t i = 0; i < numOccluders; i++)
+	{
+		float distance = occluderDistance(generator);
+		glm::vec3 center(spread(generator) * distance * 0.9f, spread(generator) * distance * 0.55f, -distance);
+		glm::vec3 extent(occluderSize(generator), occluderSize(generator), occluderSize(generator));
+
+		for (int corner = 0; corner < 8; corner++)
+			occluderPositions[i * 8 + corner] = center + extent * glm::vec3((corner & 4) ? 1.0f : -1.0f, (corner & 2) ? 1.0f : -1.0f, (corner & 1) ? 1.0f : -1.0f);
+	}
+
+	std::vector<glm::vec3> objectBounds(numObjects * 2);
+	for (uint32_t i = 0; i < numObjects; i++)
+	{
+		float distance = objectDistance(generator);
+		glm::vec3 center(spread(generator) * distance * 0.9f, spread(generator) * distance * 0.55f, -distance);
+		glm::vec3 extent(objectSize(generator));
+
+		objectBounds[i * 2] = center - extent;
+		objectBounds[i * 2 + 1] = center + extent;
+	}
+
+	auto measure = [&](OcclusionRasterizer& rasterizer, Path path)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < numIterations; i++)
+		{
+			rasterizer.clear();
+			for (uint32_t j = 0; j < numOccluders; j++)
+				rasterizer.addOccluder(clipFromWorld, occluderPositions.data() + j * 8, boxIndices, 36);
+
+			rasterizer.rasterize(path);
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+
+		return std::chrono::duration<double, std::milli>(end - start).count() / std::max(numIterations, 1u);
+	};
+
+	BenchmarkResult result;
+	result.numObjects = numObjects;
+
+	OcclusionRasterizer singleThreaded(width, height, 1);
+	result.scalarMs = measure(singleThreaded, Path::Scalar);
+
+	OcclusionRasterizer threaded(width, height);
+
+	if (isAVX2Supported())
+	{
+		result.avx2Ms = measure(singleThreaded, Path::AVX2);
+		result.avx2ThreadedMs = measure(threaded, Path::AVX2);
+	}
+	else
+		measure(threaded, Path::Scalar);
+
+	result.numTriangles = threaded.getNumTriangles();
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < numObjects; i++)
+		if (threaded.isOccluded(clipFromWorld, objectBounds[i * 2], objectBounds[i * 2 + 1]))
+			result.numOccluded++;
+	auto end = std::chrono::high_resolution_clock::now();
+
+	result.testMs = std::chrono::duration<double, std::milli>(end - start).count();
+
+	return result;
+}
\ No newline at end of file
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "ThreadPool.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Software depth buffer of a few occluder meshes, rasterized on the CPU at low resolution.
+// Pixels are grouped in 8x8 tiles processed one 8 pixel row per AVX2 instruction, every tile
+// also keeps its farthest depth so boxes behind whole tiles are rejected without touching pixels.
+// Triangles are set up in parallel, then every thread rasterizes its own band of tile rows
+class OcclusionRasterizer
+{
+public:
+	enum class Path
+	{
+		Auto = 0,	// AVX2 when the CPU and the OS support it, scalar otherwise
+		Scalar,
+		AVX2,
+	};
+
+	struct BenchmarkResult
+	{
+		uint32_t numTriangles{ 0 };
+		uint32_t numObjects{ 0 };
+		uint32_t numOccluded{ 0 };
+		double scalarMs{ 0.0 };			// average time of one rasterize call on one thread
+		double avx2Ms{ 0.0 };			// 0.0 when AVX2 is not supported
+		double avx2ThreadedMs{ 0.0 };	// AVX2 on every thread
+		double testMs{ 0.0 };			// testing every object once
+	};
+
+	enum
+	{
+		TILE_WIDTH = 8,
+		TILE_HEIGHT = 8,
+	};
+
+	// Width and height are rounded up to whole tiles, 0 threads uses every hardware thread
+	OcclusionRasterizer(uint32_t width = 320, uint32_t height = 192, uint32_t numThreads = 0);
+
+	void resize(uint32_t width, uint32_t height);
+
+	// Resets the depth to the far plane and forgets the occluders
+	void clear();
+
+	// Positions and indices are referenced until rasterize() returns, clipFromSpace takes them to Vulkan clip space
+	void addOccluder(const glm::mat4& clipFromSpace, const glm::vec3* positions, const uint32_t* indices, uint32_t numIndices);
+
+	void rasterize(Path path = Path::Auto);
+
+	// Conservative, a box crossing the near plane is visible. Safe to call from several threads once rasterized
+	bool isOccluded(const glm::mat4& clipFromSpace, const glm::vec3& boundsMin, const glm::vec3& boundsMax) const;
+
+	inline uint32_t getWidth() const { return width; }
+	inline uint32_t getHeight() const { return height; }
+	inline uint32_t getNumThreads() const { return threadPool.getNumThreads(); }
+	inline uint32_t getNumTriangles() const { return numTriangles; }
+	inline const std::vector<float>& getDepth() const { return depth; }
+
+	static bool isAVX2Supported();
+
+	// Rasterizes walls of random boxes in front of the camera and tests many small boxes behind them
+	static BenchmarkResult runBenchmark(uint32_t numOccluders = 256, uint32_t numObjects = 10000, uint32_t numIterations = 20);
+
+private:
+	struct Occluder
+	{
+		glm::mat4 clipFromSpace;
+		const glm::vec3* positions;
+		const uint32_t* indices;
+		uint32_t numIndices;
+	};
+
+	// Edge functions are positive inside, depth is a plane in screen space
+	struct Triangle
+	{
+		float edgeA[3];
+		float edgeB[3];
+		float edgeC[3];
+		float depthA;
+		float depthB;
+		float depthC;
+		float depthMax;
+		int minX, minY, maxX, maxY;
+	};
+
+	void setupTriangles(const Occluder& occluder, uint32_t firstTriangle, uint32_t lastTriangle, std::vector<Triangle>& triangles) const;
+	void setupTriangle(const glm::vec4& v0, const glm::vec4& v1, const glm::vec4& v2, std::vector<Triangle>& triangles) const;
+
+	void rasterizeBand(uint32_t firstTileRow, uint32_t lastTileRow, Path path);
+	void rasterizeTriangleScalar(const Triangle& triangle, int minY, int maxY);
+	void rasterizeTriangleAVX2(const Triangle& triangle, int minY, int maxY);
+	void updateTileDepth(uint32_t firstTileRow, uint32_t lastTileRow);
+
+private:
+	uint32_t width{ 0 };
+	uint32_t height{ 0 };
+	uint32_t numTilesX{ 0 };
+	uint32_t numTilesY{ 0 };
+
+	std::vector<float> depth;		// nearest occluder depth per pixel, 1.0 is the far plane
+	std::vector<float> tileDepth;	// farthest pixel depth per tile
+
+	std::vector<Occluder> occluders;
+	std::vector<std::vector<Triangle>> threadTriangles;
+	uint32_t numTriangles{ 0 };
+
+	ThreadPool threadPool;
+};
\ No newline at end of file
@@ -0,0 +1,319 @@
+#include "PackFile.h"
+
+#include "JobSystem.h"
+#include "LZ4.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+static const uint32_t PACK_MAGIC = 0x4B434150; // "PACK"
+static const uint32_t PACK_VERSION = 1;
+static const uint64_t PACK_CHUNK_SIZE = LZ4_MAX_BLOCK_SIZE;
+static const uint64_t PACK_STORED_ALIGNMENT = 64 * 1024; // allocation granularity of file mappings on Windows
+static const uint64_t PACK_TABLE_ALIGNMENT = 16;
+
+static bool isInside(uint64_t offset, uint64_t size, uint64_t fileSize)
+{
+	return offset <= fileSize && size <= fileSize - offset;
+}
+
+bool PackFile::open(const std::string& path)
+{
+	close();
+
+	if (!file.open(path))
+	{
+		std::cerr << "PackFile::open(): can't open \"" << path << "\"" << std::endl;
+		return false;
+	}
+
+	uint64_t fileSize = file.getSize();
+
+	PackHeader header;
+	if (fileSize < sizeof(PackHeader))
+	{
+		std::cerr << "PackFile::open(): \"" << path << "\" is truncated" << std::endl;
+		close();
+		return false;
+	}
+
+	memcpy(&header, file.getData(), sizeof(PackHeader));
+
+	if (header.magic != PACK_MAGIC || header.version != PACK_VERSION)
+	{
+		std::cerr << "PackFile::open(): \"" << path << "\" isn't a pack or has an unsupported version" << std::endl;
+		close();
+		return false;
+	}
+
+	bool valid = isInside(header.entriesOffset, sizeof(PackEntry) * static_cast<uint64_t>(header.numEntries), fileSize)
+		&& isInside(header.chunksOffset, sizeof(PackChunk) * static_cast<uint64_t>(header.numChunks), fileSize)
+		&& isInside(header.namesOffset, header.namesSize, fileSize)
+		&& header.entriesOffset % PACK_TABLE_ALIGNMENT == 0 && header.chunksOffset % PACK_TABLE_ALIGNMENT == 0;
+
+	if (valid)
+	{
+		entries = reinterpret_cast<const PackEntry*>(file.getData() + header.entriesOffset);
+		chunks = reinterpret_cast<const PackChunk*>(file.getData() + header.chunksOffset);
+		names = reinterpret_cast<const char*>(file.getData() + header.namesOffset);
+	}
+
+	// Everything is checked once here, reads trust the tables afterwards
+	for (uint32_t i = 0; valid && i < header.numEntries; i++)
+	{
+		const PackEntry& entry = entries[i];
+		valid = isInside(entry.nameOffset, entry.nameLength, header.namesSize);
+
+		if (!valid)
+			break;
+
+		if (entry.flags & PACK_ENTRY_COMPRESSED)
+		{
+			uint64_t numChunks = (entry.size + PACK_CHUNK_SIZE - 1) / PACK_CHUNK_SIZE;
+			valid = entry.numChunks == numChunks && isInside(entry.firstChunk, entry.numChunks, header.numChunks);
+
+			for (uint32_t j = 0; valid && j < entry.numChunks; j++)
+			{
+				const PackChunk& chunk = chunks[entry.firstChunk + j];
+				uint64_t expectedSize = std::min(PACK_CHUNK_SIZE, entry.size - j * PACK_CHUNK_SIZE);
+				valid = chunk.size == expectedSize && chunk.compressedSize <= getLZ4Bound(chunk.size) && isInside(chunk.offset, chunk.compressedSize, fileSize);
+			}
+		}
+		else
+			valid = isInside(entry.offset, entry.size, fileSize);
+
+		// Sorted names are what find() relies on
+		if (valid && i > 0)
+			valid = getName(entries[i - 1]) < getName(entry);
+	}
+
+	if (!valid)
+	{
+		std::cerr << "PackFile::open(): \"" << path << "\" is corrupt" << std::endl;
+		close();
+		return false;
+	}
+
+	numEntries = header.numEntries;
+	return true;
+}
+
+void PackFile::close()
+{
+	file.close();
+
+	entries = nullptr;
+	chunks = nullptr;
+	names = nullptr;
+	numEntries = 0;
+}
+
+const PackEntry* PackFile::find(std::string_view name) const
+{
+	const PackEntry* end = entries + numEntries;
+	const PackEntry* it = std::lower_bound(entries, end, name, [this](const PackEntry& entry, std::string_view name) { return getName(entry) < name; });
+
+	return (it != end && getName(*it) == name) ? it : nullptr;
+}
+
+std::string_view PackFile::getName(const PackEntry& entry) const
+{
+	return std::string_view(names + entry.nameOffset, entry.nameLength);
+}
+
+const uint8_t* PackFile::getMappedData(const PackEntry& entry) const
+{
+	if (entry.flags & PACK_ENTRY_COMPRESSED)
+		return nullptr;
+
+	return file.getData() + entry.offset;
+}
+
+bool PackFile::read(const PackEntry& entry, uint8_t* destination, JobSystem* jobSystem) const
+{
+	if (!(entry.flags & PACK_ENTRY_COMPRESSED))
+	{
+		if (entry.size > 0)
+			memcpy(destination, file.getData() + entry.offset, entry.size);
+
+		return true;
+	}
+
+	if (!jobSystem)
+	{
+		for (uint32_t i = 0; i < entry.numChunks; i++)
+			if (!readChunk(entry, i, destination + i * PACK_CHUNK_SIZE))
+				return false;
+
+		return true;
+	}
+
+	std::atomic<bool> failed{ false };
+	jobSystem->parallelFor(entry.numChunks, [&](uint32_t chunk, uint32_t /*thread*/)
+	{
+		if (!readChunk(entry, chunk, destination + chunk * PACK_CHUNK_SIZE))
+			failed = true;
+	});
+
+	return !failed;
+}
+
+bool PackFile::readChunk(const PackEntry& entry, uint32_t chunk, uint8_t* destination) const
+{
+	const PackChunk& info = chunks[entry.firstChunk + chunk];
+	const uint8_t* source = file.getData() + info.offset;
+
+	if (info.compressedSize == info.size)
+	{
+		memcpy(destination, source, info.size);
+		return true;
+	}
+
+	if (!decompressLZ4(source, info.compressedSize, destination, info.size))
+	{
+		std::cerr << "PackFile::readChunk(): chunk " << chunk << " of \"" << getName(entry) << "\" is corrupt" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+std::string PackFile::normalizeName(const std::string& path)
+{
+	return std::filesystem::path(path).lexically_normal().generic_string();
+}
+
+void PackWriter::addFile(const std::string& name, const std::string& sourcePath, bool compress)
+{
+	sources.push_back({ PackFile::normalizeName(name), sourcePath, compress });
+}
+
+bool PackWriter::write(const std::string& path) const
+{
+	std::vector<const Source*> sorted;
+	for (const Source& source : sources)
+		sorted.push_back(&source);
+
+	std::sort(sorted.begin(), sorted.end(), [](const Source* a, const Source* b) { return a->name < b->name; });
+
+	for (size_t i = 1; i < sorted.size(); i++)
+		if (sorted[i - 1]->name == sorted[i]->name)
+		{
+			std::cerr << "PackWriter::write(): \"" << sorted[i]->name << "\" was added twice" << std::endl;
+			return false;
+		}
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cerr << "PackWriter::write(): can't open \"" << path << "\"" << std::endl;
+		return false;
+	}
+
+	auto pad = [&file](uint64_t alignment)
+	{
+		static const char padding[PACK_TABLE_ALIGNMENT] = {};
+
+		uint64_t position = static_cast<uint64_t>(file.tellp());
+		uint64_t size = (alignment - position % alignment) % alignment;
+
+		for (; size > 0; size -= std::min(size, PACK_TABLE_ALIGNMENT))
+			file.write(padding, static_cast<std::streamsize>(std::min(size, PACK_TABLE_ALIGNMENT)));
+
+		return static_cast<uint64_t>(file.tellp());
+	};
+
+	// The header is rewritten once the tables are known
+	PackHeader header = {};
+	file.write(reinterpret_cast<const char*>(&header), sizeof(PackHeader));
+
+	std::vector<PackEntry> entries;
+	std::vector<PackChunk> chunks;
+	std::string names;
+
+	std::vector<uint8_t> compressed(getLZ4Bound(PACK_CHUNK_SIZE));
+
+	for (const Source* source : sorted)
+	{
+		MappedFile input;
+		if (!input.open(source->path))
+		{
+			std::cerr << "PackWriter::write(): can't open \"" << source->path << "\"" << std::endl;
+			return false;
+		}
+
+		PackEntry entry = {};
+		entry.nameOffset = static_cast<uint32_t>(names.size());
+		entry.nameLength = static_cast<uint32_t>(source->name.size());
+		entry.size = input.getSize();
+		names += source->name;
+
+		if (!source->compress)
+		{
+			entry.offset = pad(PACK_STORED_ALIGNMENT);
+			file.write(reinterpret_cast<const char*>(input.getData()), static_cast<std::streamsize>(input.getSize()));
+			entries.push_back(entry);
+			continue;
+		}
+
+		entry.flags = PACK_ENTRY_COMPRESSED;
+		entry.firstChunk = static_cast<uint32_t>(chunks.size());
+
+		for (uint64_t offset = 0; offset < entry.size; offset += PACK_CHUNK_SIZE)
+		{
+			PackChunk chunk = {};
+			chunk.offset = static_cast<uint64_t>(file.tellp());
+			chunk.size = static_cast<uint32_t>(std::min(PACK_CHUNK_SIZE, entry.size - offset));
+
+			const uint8_t* data = input.getData() + offset;
+			size_t compressedSize = compressLZ4(data, chunk.size, compressed.data(), compressed.size());
+
+			// Blocks that don't shrink are stored as is
+			if (compressedSize == 0 || compressedSize >= chunk.size)
+			{
+				chunk.compressedSize = chunk.size;
+				file.write(reinterpret_cast<const char*>(data), chunk.size);
+			}
+			else
+			{
+				chunk.compressedSize = static_cast<uint32_t>(compressedSize);
+				file.write(reinterpret_cast<const char*>(compressed.data()), static_cast<std::streamsize>(compressedSize));
+			}
+
+			chunks.push_back(chunk);
+			entry.numChunks++;
+		}
+
+		entries.push_back(entry);
+	}
+
+	header.magic = PACK_MAGIC;
+	header.version = PACK_VERSION;
+	header.numEntries = static_cast<uint32_t>(entries.size());
+	header.numChunks = static_cast<uint32_t>(chunks.size());
+
+	header.entriesOffset = pad(PACK_TABLE_ALIGNMENT);
+	file.write(reinterpret_cast<const char*>(entries.data()), static_cast<std::streamsize>(sizeof(PackEntry) * entries.size()));
+
+	header.chunksOffset = pad(PACK_TABLE_ALIGNMENT);
+	file.write(reinterpret_cast<const char*>(chunks.data()), static_cast<std::streamsize>(sizeof(PackChunk) * chunks.size()));
+
+	header.namesOffset = static_cast<uint64_t>(file.tellp());
+	header.namesSize = names.size();
+	file.write(names.data(), static_cast<std::streamsize>(names.size()));
+
+	file.seekp(0);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(PackHeader));
+
+	if (!file.good())
+	{
+		std::cerr << "PackWriter::write(): can't write \"" << path << "\"" << std::endl;
+		return false;
+	}
+
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class JobSystem;
+
+// Pack layout: header, entry data, then the tables the header points to. Entries are sorted by name.
+// Compressed entries are split in LZ4 blocks of 64 KB of data each, so they decompress independently.
+// Stored entries start on a 64 KB boundary and are used straight from the mapping
+struct PackHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t numEntries;
+	uint32_t numChunks;
+	uint64_t entriesOffset;
+	uint64_t chunksOffset;
+	uint64_t namesOffset;
+	uint64_t namesSize;
+};
+
+struct PackEntry
+{
+	uint32_t nameOffset;
+	uint32_t nameLength;
+	uint64_t offset; // stored entries only
+	uint64_t size;
+	uint32_t firstChunk;
+	uint32_t numChunks;
+	uint32_t flags;
+	uint32_t padding;
+};
+
+struct PackChunk
+{
+	uint64_t offset;
+	uint32_t compressedSize; // equal to size for blocks that didn't compress and are stored as is
+	uint32_t size;
+};
+
+enum PackEntryFlags
+{
+	PACK_ENTRY_COMPRESSED = 0x1,
+};
+
+class PackFile
+{
+public:
+	bool open(const std::string& path);
+	void close();
+
+	inline bool isOpen() const { return file.isOpen(); }
+
+	// Names are relative paths with forward slashes, see normalizeName()
+	const PackEntry* find(std::string_view name) const;
+
+	inline uint32_t getNumEntries() const { return numEntries; }
+	inline const PackEntry& getEntry(uint32_t index) const { return entries[index]; }
+	std::string_view getName(const PackEntry& entry) const;
+
+	// Stored entries live in the mapping as long as the pack is open, nullptr for compressed ones
+	const uint8_t* getMappedData(const PackEntry& entry) const;
+
+	// Decompresses or copies entry.size bytes, for instance into a mapped staging buffer. Thread-safe.
+	// With a job system the chunks decompress in parallel, the calling thread helps until all of them are done
+	bool read(const PackEntry& entry, uint8_t* destination, JobSystem* jobSystem = nullptr) const;
+	bool readChunk(const PackEntry& entry, uint32_t chunk, uint8_t* destination) const;
+
+	static std::string normalizeName(const std::string& path);
+
+private:
+	MappedFile file;
+
+	const PackEntry* entries{ nullptr };
+	const PackChunk* chunks{ nullptr };
+	const char* names{ nullptr };
+	uint32_t numEntries{ 0 };
+};
+
+class PackWriter
+{
+public:
+	// Sources are read in write(). Uncompressed entries cost more space but need no decompression
+	void addFile(const std::string& name, const std::string& sourcePath, bool compress = true);
+
+	bool write(const std::string& path) const;
+
+private:
+	struct Source
+	{
+		std::string name;
+		std::string path;
+		bool compress{ true };
+	};
+
+	std::vector<Source> sources;
+};
\ No newline at end of file
@@ -1,8 +1,15 @@
 #include "RenderScene.h"
+#include "Mesh.h"
+#include "SceneAssets.h"
 #include "../RHI/Shader.h"
 
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 #include <iostream>
+#include <random>
 #include <vector>
 
 #include <cassert>
@@ -11,51 +18,235 @@ namespace RHI
 {
 	namespace config
 	{
-		static std::vector<const char*> meshes = {
-		"Assert/Model/DamagedHelmet.fbx"
+		struct ObjectDescription
+		{
+			uint32_t mesh; // index in meshes
+			glm::mat4 transform;
+			bool occluder;
 		};
 
-		static std::vector<const char*> shaders = {
-			 "Assert/Shader/Pbrshader.vert",
-			 "Assert/Shader/Pbrshader.frag",
-			 "Assert/Shader/skyBox.vert",
-			 "Assert/Shader/skyBox.frag",
-			 "Assert/Shader/commonCube.vert",
-			 "Assert/Shader/hdriToCube.frag",
-			 "Assert/Shader/diffuseIrradiance.frag",
-			 "Assert/Shader/bakeBRDF.vert",
-			 "Assert/Shader/bakeBRDF.frag"
+		static std::vector<ObjectDescription> objects = {
+		{ Meshes::Helmet, glm::mat4(1.0f), true }
 		};
+	}
 
-		static std::vector<const char*> textures = {
-			"Assert/Texture/Default_albedo.jpg",
-			"Assert/Texture/Default_normal.jpg",
-			"Assert/Texture/Default_AO.jpg",
-			"Assert/Texture/Default_metalRoughness.jpg",
-			"Assert/Texture/Default_emissive.jpg",
-		};
+	void RenderScene::init()
+	{
+		// Pipelines are built right after, the shaders compile in parallel but have to be there
+		std::vector<Task<Shader*>> shaderLoads;
+		shaders.resize(config::Shaders::NumShaders);
 
-		static std::vector<const char*> hdrTextures = {
-			"Assert/Texture/Ice_Lake/Ice_Lake_Ref.hdr",
-			"Assert/Texture/Default_environment.hdr"
-		};
+		for (const config::ShaderAsset& asset : config::shaders)
+		{
+			assert(asset.shader < shaders.size() && !shaders[asset.shader].isValid() && "Shader slot listed twice");
+
+			ResourceManager::AsyncLoad<Shader> load = resources.loadShaderAsync(asset.path, asset.defines);
+			shaders[asset.shader] = load.handle;
+			shaderLoads.push_back(std::move(load.task));
+		}
+
+		assert(std::all_of(shaders.begin(), shaders.end(), [](ShaderHandle shader) { return shader.isValid(); }) && "Shader slot without an asset");
+
+		resources.wait(whenAll(std::move(shaderLoads)));
+
+		skybox = resources.createCubeMesh(1000.0f);
+
+		// Meshes and textures stream in behind their fallbacks while the scene is already drawn
+		loading = load();
+
+		for (const config::ObjectDescription& object : config::objects)
+			addObject(meshes[object.mesh], object.transform, object.occluder);
+
+		bvh.build();
 	}
 
-	void RenderScene::init()
+	void RenderScene::update()
+	{
+		resources.update();
+	}
+
+	Task<void> RenderScene::load()
 	{
+		// Handles are taken before the first suspension, init() places the objects right after
+		std::vector<Task<Mesh*>> meshLoads;
 		for (int i = 0; i < config::meshes.size(); i++)
-			resources.loadMesh(i, config::meshes[i]);
+		{
+			ResourceManager::AsyncLoad<Mesh> load = resources.loadMeshAsync(config::meshImportOptions[i], config::meshes[i]);
+			meshes.push_back(load.handle);
+			meshLoads.push_back(std::move(load.task));
+		}
 
-		resources.createCubeMesh(config::Meshes::Skybox, 1000.0f);
+		std::vector<Task<Texture*>> textureLoads;
+		for (int i = 0; i < config::textures.size(); i++)
+		{
+			ResourceManager::AsyncLoad<Texture> load = resources.loadTextureAsync(config::textures[i], config::textureFallbacks[i]);
+			textures.push_back(load.handle);
+			textureLoads.push_back(std::move(load.task));
+		}
 
-		for (int i = 0; i < config::shaders.size(); i++)
-			resources.loadShader(i, config::shaders[i]);
+		for (const char* path : config::hdrTextures)
+		{
+			ResourceManager::AsyncLoad<Texture> load = resources.loadTextureAsync(path, glm::vec4(0.5f, 0.5f, 0.5f, 1.0f));
+			hdrTextures.push_back(load.handle);
+			textureLoads.push_back(std::move(load.task));
+		}
 
-		for (int i = 0; i < config::textures.size(); i++)
-			resources.loadTexture(i, config::textures[i]);
+		co_await whenAll(std::move(meshLoads));
+
+		// Objects were placed with the bounds of the fallback boxes, loads finish on the main thread
+		std::vector<uint32_t> sceneObjects;
+		getObjects(sceneObjects);
+
+		for (uint32_t object : sceneObjects)
+			setObjectTransform(object, objects[object].transform);
+
+		bvh.build();
+
+		co_await whenAll(std::move(textureLoads));
+	}
+
+	uint32_t RenderScene::addObject(MeshHandle mesh, const glm::mat4& transform, bool occluder)
+	{
+		SceneObject object;
+		object.mesh = mesh;
+		object.transform = transform;
+		object.occluder = occluder;
+		object.alive = true;
+
+		glm::vec3 boundsMin, boundsMax;
+		getObjectBounds(object, boundsMin, boundsMax);
+
+		uint32_t index = bvh.addObject(boundsMin, boundsMax);
+		if (index >= objects.size())
+			objects.resize(index + 1);
+
+		objects[index] = object;
+		return index;
+	}
+
+	void RenderScene::removeObject(uint32_t object)
+	{
+		assert(hasObject(object));
+		bvh.removeObject(object);
+
+		// The slot drops its mesh handle and stays dead until addObject() reuses the index
+		objects[object] = SceneObject();
+	}
+
+	void RenderScene::setObjectTransform(uint32_t object, const glm::mat4& transform)
+	{
+		assert(hasObject(object));
+		objects[object].transform = transform;
+
+		glm::vec3 boundsMin, boundsMax;
+		getObjectBounds(objects[object], boundsMin, boundsMax);
+
+		bvh.moveObject(object, boundsMin, boundsMax);
+	}
+
+	void RenderScene::setObjectAlbedoTint(uint32_t object, const glm::vec4& tint)
+	{
+		assert(hasObject(object));
+		objects[object].albedoTint = tint;
+	}
+
+	void RenderScene::spawnStressObjects(uint32_t numObjects)
+	{
+		clearStressObjects();
+
+		const Mesh* mesh = getMesh();
+		if (!mesh)
+			return;
+
+		// Rows go away from the camera, a fixed seed keeps runs comparable
+		float spacing = std::max(mesh->getSphereRadius() * 2.5f, 0.01f);
+		uint32_t numColumns = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(numObjects))));
+
+		std::mt19937 random(42);
+		std::uniform_real_distribution<float> angle(0.0f, 2.0f * glm::pi<float>());
+		std::uniform_real_distribution<float> tint(0.4f, 1.0f);
+
+		for (uint32_t i = 0; i < numObjects; i++)
+		{
+			float x = (static_cast<float>(i % numColumns) - 0.5f * (numColumns - 1)) * spacing;
+			float z = -static_cast<float>(i / numColumns + 1) * spacing;
+
+			glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(x, 0.0f, z));
+			transform = glm::rotate(transform, angle(random), glm::vec3(0.0f, 1.0f, 0.0f));
+
+			uint32_t object = addObject(meshes[config::Meshes::Helmet], transform);
+			setObjectAlbedoTint(object, glm::vec4(tint(random), tint(random), tint(random), 1.0f));
+
+			stressObjects.push_back(object);
+		}
+
+		bvh.build();
+	}
+
+	void RenderScene::clearStressObjects()
+	{
+		for (uint32_t object : stressObjects)
+			removeObject(object);
+
+		stressObjects.clear();
+	}
 
-		for (int i = 0; i < config::hdrTextures.size(); i++)
-			resources.loadTexture(config::Textures::Environment + i, config::hdrTextures[i]);
+	void RenderScene::getObjects(std::vector<uint32_t>& result) const
+	{
+		for (uint32_t object = 0; object < objects.size(); object++)
+			if (objects[object].alive)
+			{
+				assert(bvh.hasObject(object));
+				result.push_back(object);
+			}
+	}
+
+	void RenderScene::getObjectBounds(const SceneObject& object, glm::vec3& boundsMin, glm::vec3& boundsMax) const
+	{
+		boundsMin = glm::vec3(object.transform[3]);
+		boundsMax = boundsMin;
+
+		const Mesh* mesh = getMesh(object.mesh);
+		if (!mesh)
+			return;
+
+		// Arvo: each world axis takes the smaller and larger product of every matrix entry with the local extent
+		for (int column = 0; column < 3; column++)
+			for (int row = 0; row < 3; row++)
+			{
+				float a = object.transform[column][row] * mesh->getBoundsMin()[column];
+				float b = object.transform[column][row] * mesh->getBoundsMax()[column];
+
+				boundsMin[row] += std::min(a, b);
+				boundsMax[row] += std::max(a, b);
+			}
+	}
+
+	const Shader* RenderScene::getPBRVertexShader() const
+	{
+		const Mesh* mesh = getMesh();
+		if (!mesh)
+			return getShader(config::Shaders::PBRVertex);
+
+		switch (mesh->getVertexFormat())
+		{
+			case VertexFormat::Default: return getShader(config::Shaders::PBRVertex);
+			case VertexFormat::Compact: return getShader(config::Shaders::PBRCompactVertex);
+			case VertexFormat::CompactColor: return getShader(config::Shaders::PBRCompactColorVertex);
+		}
+
+		return getShader(config::Shaders::PBRVertex);
+	}
+
+	const Shader* RenderScene::getPBRFragmentShader(SpecularIBL specularIBL) const
+	{
+		switch (specularIBL)
+		{
+			case SpecularIBL::Prefiltered: return getShader(config::Shaders::PBRPrefilteredFragment);
+			case SpecularIBL::Reference: return getShader(config::Shaders::PBRReferenceFragment);
+		}
+
+		return getShader(config::Shaders::PBRFragment);
 	}
 
 	const char* RenderScene::getHDRTexturePath(int index) const
@@ -71,25 +262,55 @@ namespace RHI
 
 	void RenderScene::shutdown()
 	{
-		for (int i = 0; i < config::meshes.size(); i++)
-			resources.unloadMesh(i);
+		resources.wait(loading);
 
-		resources.unloadMesh(config::Meshes::Skybox);
+		for (MeshHandle mesh : meshes)
+			resources.unloadMesh(mesh);
 
-		for (int i = 0; i < config::shaders.size(); i++)
-			resources.unloadShader(i);
+		resources.unloadMesh(skybox);
+		meshes.clear();
 
-		for (int i = 0; i < config::textures.size(); i++)
-			resources.unloadTexture(i);
+		objects.clear();
+		stressObjects.clear();
+		bvh.clear();
+
+		for (ShaderHandle shader : shaders)
+			resources.unloadShader(shader);
 
-		for (int i = 0; i < config::hdrTextures.size(); i++)
-			resources.unloadTexture(config::Textures::Environment + i);
+		shaders.clear();
+
+		for (TextureHandle texture : textures)
+			resources.unloadTexture(texture);
+
+		for (TextureHandle texture : hdrTextures)
+			resources.unloadTexture(texture);
+
+		textures.clear();
+		hdrTextures.clear();
+	}
+
+	void RenderScene::reloadShaders(std::vector<const Shader*>& reloaded)
+	{
+		std::vector<ShaderHandle> reloadedHandles;
+		resources.reloadShaders(shaders, reloadedHandles);
+
+		for (ShaderHandle handle : reloadedHandles)
+			reloaded.push_back(resources.getShader(handle));
 	}
 
-	void RenderScene::reloadShaders()
+	void RenderScene::reloadShaders(const std::vector<std::string>& changedFiles, std::vector<const Shader*>& reloaded)
 	{
-		for (int i = 0; i < config::shaders.size(); i++)
-			resources.reloadShader(i);
+		std::vector<ShaderHandle> dependents;
+		resources.getDependentShaders(changedFiles, dependents);
+
+		if (dependents.empty())
+			return;
+
+		std::vector<ShaderHandle> reloadedHandles;
+		resources.reloadShaders(dependents, reloadedHandles);
+
+		for (ShaderHandle handle : reloadedHandles)
+			reloaded.push_back(resources.getShader(handle));
 	}
 }
 
@@ -5,6 +5,9 @@
 
 #include "../RHI/VulkanContext.h"
 #include "ResourceManager.h"
+#include "BVH.h"
+
+#include <glm/glm.hpp>
 
 namespace RHI
 {
@@ -13,7 +16,6 @@ namespace RHI
 		enum Meshes
 		{
 			Helmet = 0,
-			Skybox,
 		};
 
 		enum Shaders
@@ -27,6 +29,15 @@ namespace RHI
 			DiffuseIrradianceFragment,
 			BakedBRDFVertex,
 			BakedBRDFFragment,
+			PBRCompactVertex,
+			PBRCompactColorVertex,
+			HiZCopyCompute,
+			HiZReduceCompute,
+			IndirectCullCompute,
+			PBRPrefilteredFragment,
+			PBRReferenceFragment,
+			HiZCopySingleSampleCompute,
+			NumShaders,
 		};
 
 		enum Textures
@@ -36,49 +47,120 @@ namespace RHI
 			AO,
 			Shading,
 			Emission,
-			Environment,
 		};
 	}
 
+	// Specular image based lighting of the pbr pipeline, each one a variant of Pbrshader.frag
+	enum class SpecularIBL
+	{
+		SplitSum = 0, // prefiltered environment and the baked BRDF
+		Prefiltered, // prefiltered environment only
+		Reference, // importance sampled environment, for comparison
+	};
+
+	// Placed instance of a mesh
+	struct SceneObject
+	{
+		MeshHandle mesh;
+		glm::mat4 transform{ 1.0f };
+		bool occluder{ false }; // rasterized into the software depth buffer to hide the objects behind it
+		glm::vec4 albedoTint{ 1.0f }; // per instance material parameter
+		bool alive{ false }; // false once removed, the slot waits until the BVH hands its index out again
+	};
+
 	class RenderScene
 	{
 	public:
-		RenderScene(const VulkanContext* context)
-			: resources(context) { }
+		RenderScene(const VulkanContext* context, JobSystem* jobSystem)
+			: resources(context, jobSystem) { }
 
 		void init();
 
+		// Main thread, every frame. Moves the pending loads on
+		void update();
+
 		void shutdown();
 
-		inline const Shader* getPBRVertexShader() const { return resources.getShader(config::Shaders::PBRVertex); }
-		inline const Shader* getPBRFragmentShader() const { return resources.getShader(config::Shaders::PBRFragment); }
+		// Picks the vertex shader matching the vertex format of the scene mesh
+		const Shader* getPBRVertexShader() const;
+		const Shader* getPBRFragmentShader(SpecularIBL specularIBL = SpecularIBL::SplitSum) const;
+
+		inline const Shader* getSkyboxVertexShader() const { return getShader(config::Shaders::SkyboxVertex); }
+		inline const Shader* getSkyboxFragmentShader() const { return getShader(config::Shaders::SkyboxFragment); }
 
-		inline const Shader* getSkyboxVertexShader() const { return resources.getShader(config::Shaders::SkyboxVertex); }
-		inline const Shader* getSkyboxFragmentShader() const { return resources.getShader(config::Shaders::SkyboxFragment); }
+		inline const Shader* getCubeVertexShader() const { return getShader(config::Shaders::CubeVertex); }
+		inline const Shader* getHDRIToFragmentShader() const { return getShader(config::Shaders::HDRIToCubeFragment); }
+		inline const Shader* getDiffuseIrradianceFragmentShader() const { return getShader(config::Shaders::DiffuseIrradianceFragment); }
 
-		inline const Shader* getCubeVertexShader() const { return resources.getShader(config::Shaders::CubeVertex); }
-		inline const Shader* getHDRIToFragmentShader() const { return resources.getShader(config::Shaders::HDRIToCubeFragment); }
-		inline const Shader* getDiffuseIrradianceFragmentShader() const { return resources.getShader(config::Shaders::DiffuseIrradianceFragment); }
+		inline const Shader* getBakedBRDFVertexShader() const { return getShader(config::Shaders::BakedBRDFVertex); }
+		inline const Shader* getBakedBRDFFragmentShader() const { return getShader(config::Shaders::BakedBRDFFragment); }
 
-		inline const Shader* getBakedBRDFVertexShader() const { return resources.getShader(config::Shaders::BakedBRDFVertex); }
-		inline const Shader* getBakedBRDFFragmentShader() const { return resources.getShader(config::Shaders::BakedBRDFFragment); }
+		inline const Shader* getHiZCopyComputeShader(VkSampleCountFlagBits numSamples) const { return getShader((numSamples == VK_SAMPLE_COUNT_1_BIT) ? config::Shaders::HiZCopySingleSampleCompute : config::Shaders::HiZCopyCompute); }
+		inline const Shader* getHiZReduceComputeShader() const { return getShader(config::Shaders::HiZReduceCompute); }
+		inline const Shader* getIndirectCullComputeShader() const { return getShader(config::Shaders::IndirectCullCompute); }
 
-		inline const Texture* getAlbedoTexture() const { return resources.getTexture(config::Textures::Albedo); }
-		inline const Texture* getNormalTexture() const { return resources.getTexture(config::Textures::Normal); }
-		inline const Texture* getAOTexture() const { return resources.getTexture(config::Textures::AO); }
-		inline const Texture* getShadingTexture() const { return resources.getTexture(config::Textures::Shading); }
-		inline const Texture* getEmissionTexture() const { return resources.getTexture(config::Textures::Emission); }
-		inline const Texture* getHDRTexture(int index) const { return resources.getTexture(config::Textures::Environment + index); }
+		inline const Texture* getAlbedoTexture() const { return getTexture(config::Textures::Albedo); }
+		inline const Texture* getNormalTexture() const { return getTexture(config::Textures::Normal); }
+		inline const Texture* getAOTexture() const { return getTexture(config::Textures::AO); }
+		inline const Texture* getShadingTexture() const { return getTexture(config::Textures::Shading); }
+		inline const Texture* getEmissionTexture() const { return getTexture(config::Textures::Emission); }
+		inline const Texture* getHDRTexture(int index) const { return resources.getTexture(hdrTextures[index]); }
 
-		inline const Mesh* getMesh() const { return resources.getMesh(config::Meshes::Helmet); }
-		inline const Mesh* getSkybox() const { return resources.getMesh(config::Meshes::Skybox); }
+		inline const Mesh* getMesh() const { return resources.getMesh(meshes[config::Meshes::Helmet]); }
+		inline const Mesh* getMesh(MeshHandle mesh) const { return resources.getMesh(mesh); }
+		inline const Mesh* getSkybox() const { return resources.getMesh(skybox); }
 
 		const char* getHDRTexturePath(int index) const;
 		size_t getNumHDRTextures() const;
 
-		void reloadShaders();
+		// Appends the shaders that compiled again, the pipelines built with them have to follow.
+		// Either every shader, or only the ones whose source or includes are among the changed files
+		void reloadShaders(std::vector<const Shader*>& reloaded);
+		void reloadShaders(const std::vector<std::string>& changedFiles, std::vector<const Shader*>& reloaded);
+
+		// Meshes and textures are fallbacks until their load finished
+		inline bool isLoading() const { return !loading.isReady(); }
+		inline uint32_t getNumPendingLoads() const { return resources.getNumPendingLoads(); }
+		inline uint32_t getResourceVersion() const { return resources.getVersion(); }
+
+		// Objects share their index with the BVH, which holds their world space bounds
+		uint32_t addObject(MeshHandle mesh, const glm::mat4& transform, bool occluder = false);
+		void removeObject(uint32_t object);
+		void setObjectTransform(uint32_t object, const glm::mat4& transform);
+		void setObjectAlbedoTint(uint32_t object, const glm::vec4& tint);
+
+		// Grid of randomly turned and tinted helmets behind the scene, replaces the previous one
+		void spawnStressObjects(uint32_t numObjects);
+		void clearStressObjects();
+		inline uint32_t getNumStressObjects() const { return static_cast<uint32_t>(stressObjects.size()); }
+
+		inline const SceneObject& getObject(uint32_t object) const { return objects[object]; }
+		inline bool hasObject(uint32_t object) const { return object < objects.size() && objects[object].alive; }
+
+		// Appends every object still in the scene, removed slots are skipped
+		void getObjects(std::vector<uint32_t>& result) const;
+		inline const BVH& getBVH() const { return bvh; }
+
+	private:
+		inline const Shader* getShader(uint32_t index) const { return resources.getShader(shaders[index]); }
+		inline const Texture* getTexture(uint32_t index) const { return resources.getTexture(textures[index]); }
+
+		Task<void> load();
+		void getObjectBounds(const SceneObject& object, glm::vec3& boundsMin, glm::vec3& boundsMax) const;
 
 	private:
 		ResourceManager resources;
+		Task<void> loading;
+
+		// Indexed by the config enums
+		std::vector<MeshHandle> meshes;
+		std::vector<ShaderHandle> shaders;
+		std::vector<TextureHandle> textures;
+		std::vector<TextureHandle> hdrTextures;
+		MeshHandle skybox;
+
+		std::vector<SceneObject> objects;
+		std::vector<uint32_t> stressObjects;
+		BVH bvh;
 	};
 }
\ No newline at end of file
@@ -1,163 +1,648 @@
 #include "ResourceManager.h"
+#include "FileSystem.h"
 #include "Mesh.h"
 #include "../RHI/Shader.h"
 #include "../RHI/VulkanContext.h"
 #include "Texture.h"
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <limits>
+#include <string>
 
-ResourceManager::ResourceManager(const RHI::VulkanContext* context)
-	: context(context)
+ResourceManager::ResourceManager(const RHI::VulkanContext* context, JobSystem* jobSystem)
+	: context(context), jobSystem(jobSystem)
 {
 
 }
 
-Mesh* ResourceManager::getMesh(unsigned int id) const
+ResourceManager::~ResourceManager()
 {
-	auto it = meshes.find(id);
-	if (it != meshes.end())
-		return it->second;
+	// Pending loads still point to the manager
+	while (numPendingLoads > 0)
+		flush();
+
+	for (Mesh* mesh : meshes.getResources())
+		if (!isFallback(mesh))
+			delete mesh;
+
+	for (RHI::Shader* shader : shaders.getResources())
+		delete shader;
+
+	for (Texture* texture : textures.getResources())
+		if (!isFallback(texture))
+			delete texture;
 
-	return nullptr;
+	for (auto& it : fallbackMeshes)
+		delete it.second;
+
+	for (auto& it : fallbackTextures)
+		delete it.second;
 }
 
-Mesh* ResourceManager::createCubeMesh(unsigned int id, float size)
+// Counts a load as pending until its coroutine ends, also when an exception ends it early.
+// Created and destroyed on the main thread, the stages in between that may throw are caught on the worker
+struct PendingLoadGuard
 {
-	auto it = meshes.find(id);
-	if (it != meshes.end())
-	{
-		std::cerr << "ResourceManager::loadMesh(): " << id << " is already taken by another mesh" << std::endl;
-		return nullptr;
-	}
+	explicit PendingLoadGuard(uint32_t& numPendingLoads)
+		: numPendingLoads(numPendingLoads) { numPendingLoads++; }
+
+	~PendingLoadGuard() { numPendingLoads--; }
+
+	uint32_t& numPendingLoads;
+};
+
+// The same file imported with other options is another mesh
+static std::string makeMeshKey(const MeshImportOptions& options, const char* path)
+{
+	std::string key = AssetRegistry<Mesh>::makeKey(path) + "?" + std::to_string(static_cast<uint32_t>(options.vertexFormat));
+
+	for (bool flag : { options.optimize, options.useCache, options.flattenTransforms, options.buildMeshlets, options.generateLods, options.buildOccluder })
+		key += flag ? '1' : '0';
+
+	return key;
+}
 
+// Compiling with an explicit kind can give another module than inferring it from the source, so can defines
+static std::string makeShaderKey(const char* path, int kind, const std::vector<std::string>& defines = {})
+{
+	return AssetRegistry<RHI::Shader>::makeKey(path) + "?" + std::to_string(kind) + "?" + RHI::Shader::getVariantName(defines);
+}
+
+Mesh* ResourceManager::getMesh(MeshHandle handle) const
+{
+	return meshes.get(handle);
+}
+
+MeshHandle ResourceManager::createCubeMesh(float size)
+{
 	Mesh* mesh = new Mesh(context);
 	mesh->createSkybox(size);
 
-	meshes.insert(std::make_pair(id, mesh));
-	return mesh;
+	return meshes.add(mesh);
+}
+
+MeshHandle ResourceManager::loadMesh(const char* path)
+{
+	return loadMesh(MeshImportOptions(), path);
 }
 
-Mesh* ResourceManager::loadMesh(unsigned int id, const char* path)
+MeshHandle ResourceManager::loadMesh(const MeshImportOptions& options, const char* path)
 {
-	auto it = meshes.find(id);
-	if (it != meshes.end())
+	std::string key = makeMeshKey(options, path);
+
+	MeshHandle handle = meshRegistry.find(key);
+	if (handle.isValid())
 	{
-		std::cerr << "ResourceManager::loadMesh(): " << id << " is already taken by another mesh" << std::endl;
-		return nullptr;
+		meshes.addReference(handle);
+
+		// Callers of the synchronous load expect the mesh to be there
+		while (meshRegistry.isLoading(handle))
+			flush();
+
+		return handle;
 	}
 
 	Mesh* mesh = new Mesh(context);
-	if (!mesh->loadFromFile(path))
-		return nullptr;
+	if (!mesh->loadFromFile(path, options))
+	{
+		delete mesh;
+		return MeshHandle();
+	}
 
-	meshes.insert(std::make_pair(id, mesh));
-	return mesh;
+	handle = meshes.add(mesh);
+	meshRegistry.add(key, handle, false);
+
+	return handle;
 }
 
-void ResourceManager::unloadMesh(unsigned int id)
+void ResourceManager::unloadMesh(MeshHandle handle)
 {
-	auto it = meshes.find(id);
-	if (it == meshes.end())
+	Mesh* mesh = nullptr;
+	if (!meshes.release(handle, mesh))
 		return;
 
-	delete it->second;
-	meshes.erase(it);
+	meshRegistry.remove(handle);
+
+	if (!isFallback(mesh))
+		delete mesh;
 }
 
-RHI::Shader* ResourceManager::getShader(unsigned int id) const
+RHI::Shader* ResourceManager::getShader(ShaderHandle handle) const
 {
-	auto it = shaders.find(id);
-	if (it != shaders.end())
-		return it->second;
-
-	return nullptr;
+	return shaders.get(handle);
 }
 
-RHI::Shader* ResourceManager::loadShader(unsigned int id, const char* path)
+ShaderHandle ResourceManager::loadShader(const char* path, const std::vector<std::string>& defines)
 {
-	auto it = shaders.find(id);
-	if (it != shaders.end())
+	std::string key = makeShaderKey(path, -1, defines);
+
+	ShaderHandle handle = shaderRegistry.find(key);
+	if (handle.isValid())
 	{
-		std::cerr << "ResourceManager::loadShader(): " << id << " is already taken by another shader" << std::endl;
-		return nullptr;
+		shaders.addReference(handle);
+
+		while (shaderRegistry.isLoading(handle))
+			flush();
+
+		// The shared load may have failed, which frees the handle
+		return shaders.contains(handle) ? handle : ShaderHandle();
 	}
 
 	RHI::Shader* shader = new RHI::Shader(context);
-	if (!shader->compileFromFile(path))
-		return nullptr;
+	if (!shader->compileFromFile(path, defines))
+	{
+		delete shader;
+		return ShaderHandle();
+	}
+
+	handle = shaders.add(shader);
+	shaderRegistry.add(key, handle, false);
+	addShaderDependencies(handle);
 
-	shaders.insert(std::make_pair(id, shader));
-	return shader;
+	return handle;
 }
 
-RHI::Shader* ResourceManager::loadShader(unsigned int id, RHI::ShaderKind kind, const char* path)
+ShaderHandle ResourceManager::loadShader(RHI::ShaderKind kind, const char* path)
 {
-	auto it = shaders.find(id);
-	if (it != shaders.end())
+	std::string key = makeShaderKey(path, static_cast<int>(kind));
+
+	ShaderHandle handle = shaderRegistry.find(key);
+	if (handle.isValid())
 	{
-		std::cerr << "ResourceManager::loadShader(): " << id << " is already taken by another shader" << std::endl;
-		return nullptr;
+		shaders.addReference(handle);
+		return handle;
 	}
 
 	RHI::Shader* shader = new RHI::Shader(context);
 	if (!shader->compileFromFile(path, kind))
-		return nullptr;
+	{
+		delete shader;
+		return ShaderHandle();
+	}
 
-	shaders.insert(std::make_pair(id, shader));
-	return shader;
+	handle = shaders.add(shader);
+	shaderRegistry.add(key, handle, false);
+	addShaderDependencies(handle);
+
+	return handle;
 }
 
-bool ResourceManager::reloadShader(unsigned int id)
+bool ResourceManager::reloadShader(ShaderHandle handle)
 {
-	auto it = shaders.find(id);
-	if (it == shaders.end())
-		return false;
+	std::vector<ShaderHandle> reloaded;
+	reloadShaders({ handle }, reloaded);
 
-	return it->second->reload();
+	return !reloaded.empty();
 }
 
-void ResourceManager::unloadShader(unsigned int id)
+void ResourceManager::unloadShader(ShaderHandle handle)
 {
-	auto it = shaders.find(id);
-	if (it == shaders.end())
+	RHI::Shader* shader = nullptr;
+	if (!shaders.release(handle, shader))
 		return;
 
-	delete it->second;
-	shaders.erase(it);
+	removeShaderDependencies(handle);
+	shaderRegistry.remove(handle);
+	delete shader;
 }
 
-Texture* ResourceManager::getTexture(unsigned int id) const
+void ResourceManager::reloadShaders(const std::vector<ShaderHandle>& handles, std::vector<ShaderHandle>& reloaded)
 {
-	auto it = textures.find(id);
-	if (it != textures.end())
-		return it->second;
+	std::vector<ShaderHandle> pendingHandles;
+	std::vector<RHI::Shader*> pendingShaders;
+
+	// A shader listed twice would be compiled twice at the same time
+	std::vector<ShaderHandle> uniqueHandles = handles;
+	std::sort(uniqueHandles.begin(), uniqueHandles.end());
+	uniqueHandles.erase(std::unique(uniqueHandles.begin(), uniqueHandles.end()), uniqueHandles.end());
+
+	// Shaders still streaming in have no module to replace yet
+	for (ShaderHandle handle : uniqueHandles)
+		if (RHI::Shader* shader = shaders.get(handle))
+		{
+			pendingHandles.push_back(handle);
+			pendingShaders.push_back(shader);
+		}
+
+	std::vector<uint8_t> compiled(pendingShaders.size(), 0);
+	jobSystem->parallelFor(static_cast<uint32_t>(pendingShaders.size()), [&](uint32_t index, uint32_t /*thread*/)
+	{
+		compiled[index] = pendingShaders[index]->reload();
+	});
+
+	for (size_t i = 0; i < pendingHandles.size(); i++)
+	{
+		if (!compiled[i])
+			continue;
+
+		removeShaderDependencies(pendingHandles[i]);
+		addShaderDependencies(pendingHandles[i]);
+		reloaded.push_back(pendingHandles[i]);
+	}
+}
+
+void ResourceManager::getDependentShaders(const std::vector<std::string>& files, std::vector<ShaderHandle>& dependents) const
+{
+	size_t first = dependents.size();
+
+	for (const std::string& file : files)
+	{
+		auto it = shaderDependents.find(FileSystem::normalizePath(file));
+		if (it != shaderDependents.end())
+			dependents.insert(dependents.end(), it->second.begin(), it->second.end());
+	}
+
+	std::sort(dependents.begin() + first, dependents.end());
+	dependents.erase(std::unique(dependents.begin() + first, dependents.end()), dependents.end());
+}
+
+void ResourceManager::addShaderDependencies(ShaderHandle handle)
+{
+	const RHI::Shader* shader = shaders.get(handle);
+	if (!shader)
+		return;
+
+	shaderDependents[shader->getPath()].push_back(handle);
+
+	for (const std::string& include : shader->getIncludes())
+		shaderDependents[include].push_back(handle);
+}
+
+void ResourceManager::removeShaderDependencies(ShaderHandle handle)
+{
+	for (auto it = shaderDependents.begin(); it != shaderDependents.end(); )
+	{
+		std::vector<ShaderHandle>& dependents = it->second;
+		dependents.erase(std::remove(dependents.begin(), dependents.end(), handle), dependents.end());
+
+		if (dependents.empty())
+			it = shaderDependents.erase(it);
+		else
+			++it;
+	}
+}
 
-	return nullptr;
+Texture* ResourceManager::getTexture(TextureHandle handle) const
+{
+	return textures.get(handle);
 }
 
-Texture* ResourceManager::loadTexture(unsigned int id, const char* path)
+TextureHandle ResourceManager::loadTexture(const char* path)
 {
-	auto it = textures.find(id);
-	if (it != textures.end())
+	std::string key = AssetRegistry<Texture>::makeKey(path);
+
+	TextureHandle handle = textureRegistry.find(key);
+	if (handle.isValid())
 	{
-		std::cerr << "ResourceManager::loadTexture(): " << id << " is already taken by another texture" << std::endl;
-		return nullptr;
+		textures.addReference(handle);
+
+		while (textureRegistry.isLoading(handle))
+			flush();
+
+		return handle;
 	}
 
 	Texture* texture = new Texture(context);
 	if (!texture->loadFromFile(path))
-		return nullptr;
+	{
+		delete texture;
+		return TextureHandle();
+	}
 
-	textures.insert(std::make_pair(id, texture));
-	return texture;
+	handle = textures.add(texture);
+	textureRegistry.add(key, handle, false);
+
+	return handle;
 }
 
-void ResourceManager::unloadTexture(unsigned int id)
+void ResourceManager::unloadTexture(TextureHandle handle)
 {
-	auto it = textures.find(id);
-	if (it == textures.end())
+	Texture* texture = nullptr;
+	if (!textures.release(handle, texture))
 		return;
 
-	delete it->second;
-	textures.erase(it);
+	textureRegistry.remove(handle);
+
+	if (!isFallback(texture))
+		delete texture;
+}
+
+ResourceManager::AsyncLoad<Mesh> ResourceManager::loadMeshAsync(const MeshImportOptions& options, const char* path)
+{
+	std::string key = makeMeshKey(options, path);
+
+	MeshHandle handle = meshRegistry.find(key);
+	if (handle.isValid())
+	{
+		meshes.addReference(handle);
+		return { handle, waitForMesh(handle) };
+	}
+
+	Mesh* fallback = getFallbackMesh(options);
+	handle = meshes.add(fallback);
+	meshRegistry.add(key, handle, true);
+
+	return { handle, streamMesh(handle, fallback, options, path) };
+}
+
+ResourceManager::AsyncLoad<Texture> ResourceManager::loadTextureAsync(const char* path, const glm::vec4& fallbackColor)
+{
+	std::string key = AssetRegistry<Texture>::makeKey(path);
+
+	TextureHandle handle = textureRegistry.find(key);
+	if (handle.isValid())
+	{
+		textures.addReference(handle);
+		return { handle, waitForTexture(handle) };
+	}
+
+	Texture* fallback = getFallbackTexture(fallbackColor);
+	handle = textures.add(fallback);
+	textureRegistry.add(key, handle, true);
+
+	return { handle, streamTexture(handle, fallback, path) };
+}
+
+ResourceManager::AsyncLoad<RHI::Shader> ResourceManager::loadShaderAsync(const char* path, const std::vector<std::string>& defines)
+{
+	std::string key = makeShaderKey(path, -1, defines);
+
+	ShaderHandle handle = shaderRegistry.find(key);
+	if (handle.isValid())
+	{
+		shaders.addReference(handle);
+		return { handle, waitForShader(handle) };
+	}
+
+	// The slot stays empty until the shader is compiled
+	handle = shaders.add(nullptr);
+	shaderRegistry.add(key, handle, true);
+
+	return { handle, streamShader(handle, path, defines) };
+}
+
+Task<Mesh*> ResourceManager::streamMesh(MeshHandle handle, Mesh* fallback, MeshImportOptions options, std::string path)
+{
+	PendingLoadGuard pendingLoad(numPendingLoads);
+
+	// Read and decode
+	Mesh* mesh = new Mesh(context);
+
+	co_await resumeOnWorker();
+	bool decoded = false;
+	try
+	{
+		decoded = mesh->decodeFromFile(path, options);
+	}
+	catch (const std::exception& exception)
+	{
+		std::cerr << "ResourceManager::streamMesh(): \"" << path << "\" " << exception.what() << std::endl;
+	}
+
+	// Upload, unless the load failed or the mesh was unloaded in the meantime
+	co_await resumeOnMainThread();
+	meshRegistry.setLoaded(handle);
+
+	if (!decoded || meshes.get(handle) != fallback)
+	{
+		// The next load of the file tries again with a handle of its own, this one keeps the fallback until unloaded
+		if (!decoded)
+			meshRegistry.remove(handle);
+
+		delete mesh;
+		co_return nullptr;
+	}
+
+	mesh->uploadToGPU();
+
+	meshes.replace(handle, mesh);
+	version++;
+
+	co_return mesh;
+}
+
+Task<Texture*> ResourceManager::streamTexture(TextureHandle handle, Texture* fallback, std::string path)
+{
+	PendingLoadGuard pendingLoad(numPendingLoads);
+
+	// Read and decode
+	Texture* texture = new Texture(context);
+
+	co_await resumeOnWorker();
+	bool decoded = false;
+	try
+	{
+		decoded = texture->decodeFromFile(path);
+	}
+	catch (const std::exception& exception)
+	{
+		std::cerr << "ResourceManager::streamTexture(): \"" << path << "\" " << exception.what() << std::endl;
+	}
+
+	// Upload, unless the load failed or the texture was unloaded in the meantime
+	co_await resumeOnMainThread();
+	textureRegistry.setLoaded(handle);
+
+	if (!decoded || textures.get(handle) != fallback)
+	{
+		// The next load of the file tries again with a handle of its own, this one keeps the fallback until unloaded
+		if (!decoded)
+			textureRegistry.remove(handle);
+
+		delete texture;
+		co_return nullptr;
+	}
+
+	texture->uploadToGPU();
+
+	textures.replace(handle, texture);
+	version++;
+
+	co_return texture;
+}
+
+Task<RHI::Shader*> ResourceManager::streamShader(ShaderHandle handle, std::string path, std::vector<std::string> defines)
+{
+	PendingLoadGuard pendingLoad(numPendingLoads);
+
+	// Creating the module doesn't need the main thread, the whole compilation runs on the worker
+	RHI::Shader* shader = new RHI::Shader(context);
+
+	co_await resumeOnWorker();
+	bool compiled = false;
+	try
+	{
+		compiled = shader->compileFromFile(path.c_str(), defines);
+	}
+	catch (const std::exception& exception)
+	{
+		std::cerr << "ResourceManager::streamShader(): \"" << path << "\" " << exception.what() << std::endl;
+	}
+
+	co_await resumeOnMainThread();
+	shaderRegistry.setLoaded(handle);
+
+	if (!compiled || !shaders.contains(handle))
+	{
+		// A failed shader frees its slot like a failed synchronous load, for every user
+		if (shaders.contains(handle))
+		{
+			shaderRegistry.remove(handle);
+			shaders.remove(handle);
+		}
+
+		delete shader;
+		co_return nullptr;
+	}
+
+	shaders.replace(handle, shader);
+	addShaderDependencies(handle);
+
+	co_return shader;
+}
+
+Task<Mesh*> ResourceManager::waitForMesh(MeshHandle handle)
+{
+	// Another load of the same file is in flight, look again at every update
+	PendingLoadGuard pendingLoad(numPendingLoads);
+
+	while (meshRegistry.isLoading(handle))
+		co_await resumeOnMainThread();
+
+	Mesh* mesh = meshes.get(handle);
+	co_return isFallback(mesh) ? nullptr : mesh;
+}
+
+Task<Texture*> ResourceManager::waitForTexture(TextureHandle handle)
+{
+	PendingLoadGuard pendingLoad(numPendingLoads);
+
+	while (textureRegistry.isLoading(handle))
+		co_await resumeOnMainThread();
+
+	Texture* texture = textures.get(handle);
+	co_return isFallback(texture) ? nullptr : texture;
+}
+
+Task<RHI::Shader*> ResourceManager::waitForShader(ShaderHandle handle)
+{
+	PendingLoadGuard pendingLoad(numPendingLoads);
+
+	while (shaderRegistry.isLoading(handle))
+		co_await resumeOnMainThread();
+
+	co_return shaders.get(handle);
+}
+
+void ResourceManager::update(float budgetMilliseconds)
+{
+	// Without workers the background stages only make progress here
+	if (jobSystem->getNumThreads() == 1)
+		jobSystem->wait(workerStages);
+
+	runMainThreadStages(budgetMilliseconds);
+}
+
+void ResourceManager::flush()
+{
+	jobSystem->wait(workerStages);
+	runMainThreadStages(std::numeric_limits<float>::max());
+}
+
+void ResourceManager::runMainThreadStages(float budgetMilliseconds)
+{
+	std::vector<std::coroutine_handle<>> stages;
+	{
+		std::lock_guard<std::mutex> lock(mainThreadMutex);
+		stages.swap(mainThreadStages);
+	}
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	// At least one stage runs, so loads move on however long an upload takes
+	size_t numResumed = 0;
+	while (numResumed < stages.size())
+	{
+		stages[numResumed++].resume();
+
+		auto currentTime = std::chrono::high_resolution_clock::now();
+		if (std::chrono::duration<float, std::chrono::milliseconds::period>(currentTime - startTime).count() > budgetMilliseconds)
+			break;
+	}
+
+	// Over budget, the rest goes first next time
+	if (numResumed < stages.size())
+	{
+		std::lock_guard<std::mutex> lock(mainThreadMutex);
+		mainThreadStages.insert(mainThreadStages.begin(), stages.begin() + numResumed, stages.end());
+	}
+}
+
+void ResourceManager::WorkerAwaiter::await_suspend(std::coroutine_handle<> coroutine)
+{
+	// The coroutine may already run on the worker once runBackground() returns, the awaiter lives in its frame.
+	// Background jobs keep the decode off the main thread, which runs the frame jobs while it waits on them
+	JobSystem* jobSystem = resources->jobSystem;
+	JobCounter* counter = &resources->workerStages;
+
+	jobSystem->runBackground([coroutine]() { coroutine.resume(); }, counter);
+}
+
+void ResourceManager::MainThreadAwaiter::await_suspend(std::coroutine_handle<> coroutine)
+{
+	// Nobody resumes the coroutine before the lock is released
+	std::lock_guard<std::mutex> lock(resources->mainThreadMutex);
+	resources->mainThreadStages.push_back(coroutine);
+}
+
+Mesh* ResourceManager::getFallbackMesh(const MeshImportOptions& options)
+{
+	// Pipelines are built for the vertex format of the loaded mesh, the stand-in has to match it
+	uint32_t key = static_cast<uint32_t>(options.vertexFormat);
+
+	auto it = fallbackMeshes.find(key);
+	if (it != fallbackMeshes.end())
+		return it->second;
+
+	Mesh* mesh = new Mesh(context);
+	mesh->createBox(glm::vec3(-0.5f), glm::vec3(0.5f), options.vertexFormat);
+
+	fallbackMeshes.insert(std::make_pair(key, mesh));
+	return mesh;
+}
+
+Texture* ResourceManager::getFallbackTexture(const glm::vec4& color)
+{
+	glm::uvec4 rgba = glm::uvec4(glm::clamp(color, 0.0f, 1.0f) * 255.0f + 0.5f);
+	uint32_t key = rgba.r | (rgba.g << 8) | (rgba.b << 16) | (rgba.a << 24);
+
+	auto it = fallbackTextures.find(key);
+	if (it != fallbackTextures.end())
+		return it->second;
+
+	Texture* texture = new Texture(context);
+	texture->createSolidColor(color);
+
+	fallbackTextures.insert(std::make_pair(key, texture));
+	return texture;
+}
+
+bool ResourceManager::isFallback(const Mesh* mesh) const
+{
+	for (const auto& it : fallbackMeshes)
+		if (it.second == mesh)
+			return true;
+
+	return false;
+}
+
+bool ResourceManager::isFallback(const Texture* texture) const
+{
+	for (const auto& it : fallbackTextures)
+		if (it.second == texture)
+			return true;
+
+	return false;
 }
\ No newline at end of file
@@ -1,6 +1,17 @@
 #pragma once
 
+#include "AssetRegistry.h"
+#include "HandlePool.h"
+#include "JobSystem.h"
+#include "Task.h"
+
+#include <glm/glm.hpp>
+
+#include <coroutine>
+#include <mutex>
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace RHI
 {
@@ -11,32 +22,155 @@ namespace RHI
 
 class Mesh;
 class Texture;
+struct MeshImportOptions;
+
+typedef Handle<Mesh> MeshHandle;
+typedef Handle<RHI::Shader> ShaderHandle;
+typedef Handle<Texture> TextureHandle;
 
 class ResourceManager
 {
 public:
-	ResourceManager(const RHI::VulkanContext* context);
+	ResourceManager(const RHI::VulkanContext* context, JobSystem* jobSystem);
+	~ResourceManager();
+
+	// Loads return an invalid handle when they fail, stale handles resolve to nullptr.
+	// Loading a file that is already loaded hands out its handle again with one more reference,
+	// unloading drops one and the last one frees the resource
+	Mesh* getMesh(MeshHandle handle) const;
+	MeshHandle createCubeMesh(float size);
+	MeshHandle loadMesh(const char* path);
+	MeshHandle loadMesh(const MeshImportOptions& options, const char* path);
+	void unloadMesh(MeshHandle handle);
+
+	RHI::Shader* getShader(ShaderHandle handle) const;
+	// Each define set of a file is a variant of its own, loaded and cached once like any other shader
+	ShaderHandle loadShader(const char* path, const std::vector<std::string>& defines = {});
+	ShaderHandle loadShader(RHI::ShaderKind kind, const char* path);
+	bool reloadShader(ShaderHandle handle);
+	void unloadShader(ShaderHandle handle);
+
+	// Recompiles the shaders in parallel on the job system and appends the ones that compiled,
+	// a shader that fails to compile keeps its previous module
+	void reloadShaders(const std::vector<ShaderHandle>& handles, std::vector<ShaderHandle>& reloaded);
+
+	// Appends once each the shaders whose source or includes, nested ones too, are among the files
+	void getDependentShaders(const std::vector<std::string>& files, std::vector<ShaderHandle>& dependents) const;
+
+	Texture* getTexture(TextureHandle handle) const;
+	TextureHandle loadTexture(const char* path);
+	void unloadTexture(TextureHandle handle);
+
+	template<typename T>
+	struct AsyncLoad
+	{
+		Handle<T> handle;
+		Task<T*> task;
+	};
+
+	// Asynchronous loads: the handle is valid right away and resolves to a fallback until the real resource replaces it.
+	// The file is read and decoded on a job system worker in the background, the upload runs in update(). The task finishes on the
+	// main thread with the loaded resource, or nullptr when the load failed. A failed handle, and the ones shared with
+	// it in the meantime, resolve to the fallback until unloaded, while the path is forgotten so the next load retries
+	AsyncLoad<Mesh> loadMeshAsync(const MeshImportOptions& options, const char* path);
+	AsyncLoad<Texture> loadTextureAsync(const char* path, const glm::vec4& fallbackColor = glm::vec4(1.0f));
+
+	// Shaders have no fallback, the handle resolves to nullptr until the task finished.
+	// A failed compilation frees the handle
+	AsyncLoad<RHI::Shader> loadShaderAsync(const char* path, const std::vector<std::string>& defines = {});
+
+	// Live resources, contiguous
+	inline const std::vector<Mesh*>& getMeshes() const { return meshes.getResources(); }
+	inline const std::vector<RHI::Shader*>& getShaders() const { return shaders.getResources(); }
+	inline const std::vector<Texture*>& getTextures() const { return textures.getResources(); }
+
+	// Main thread, every frame. Runs the load stages waiting for the main thread until the budget is spent
+	void update(float budgetMilliseconds = 2.0f);
+
+	// Main thread, runs load stages until the task finished
+	template<typename T>
+	void wait(const Task<T>& task)
+	{
+		while (!task.isReady())
+			flush();
+	}
+
+	inline uint32_t getNumPendingLoads() const { return numPendingLoads; }
 
-	Mesh* getMesh(unsigned int id) const;
-	Mesh* createCubeMesh(unsigned int id, float size);
-	Mesh* loadMesh(unsigned int id, const char* path);
-	void unloadMesh(unsigned int id);
+	// Changes every time a fallback got replaced, whatever keeps resource handles around has to fetch them again
+	inline uint32_t getVersion() const { return version; }
 
-	RHI::Shader* getShader(unsigned int id) const;
-	RHI::Shader* loadShader(unsigned int id, const char* path);
-	RHI::Shader* loadShader(unsigned int id, RHI::ShaderKind kind, const char* path);
-	bool reloadShader(unsigned int id);
-	void unloadShader(unsigned int id);
+private:
+	// Moves the awaiting coroutine to a background job, run by a job system worker but never the main thread
+	struct WorkerAwaiter
+	{
+		ResourceManager* resources{ nullptr };
+
+		bool await_ready() const noexcept { return false; }
+		void await_suspend(std::coroutine_handle<> coroutine);
+		void await_resume() const noexcept { }
+	};
+
+	// Moves the awaiting coroutine to the next update() on the main thread
+	struct MainThreadAwaiter
+	{
+		ResourceManager* resources{ nullptr };
+
+		bool await_ready() const noexcept { return false; }
+		void await_suspend(std::coroutine_handle<> coroutine);
+		void await_resume() const noexcept { }
+	};
+
+	inline WorkerAwaiter resumeOnWorker() { return WorkerAwaiter{ this }; }
+	inline MainThreadAwaiter resumeOnMainThread() { return MainThreadAwaiter{ this }; }
+
+	// Arguments are taken by value, the coroutine frames outlive the caller's
+	Task<Mesh*> streamMesh(MeshHandle handle, Mesh* fallback, MeshImportOptions options, std::string path);
+	Task<Texture*> streamTexture(TextureHandle handle, Texture* fallback, std::string path);
+	Task<RHI::Shader*> streamShader(ShaderHandle handle, std::string path, std::vector<std::string> defines);
+
+	// Later loads of a file still streaming in wait for the first one
+	Task<Mesh*> waitForMesh(MeshHandle handle);
+	Task<Texture*> waitForTexture(TextureHandle handle);
+	Task<RHI::Shader*> waitForShader(ShaderHandle handle);
+
+	void runMainThreadStages(float budgetMilliseconds);
+	void flush();
 
-	Texture* getTexture(unsigned int id) const;
-	Texture* loadTexture(unsigned int id, const char* path);
-	void unloadTexture(unsigned int id);
+	Mesh* getFallbackMesh(const MeshImportOptions& options);
+	Texture* getFallbackTexture(const glm::vec4& color);
+	bool isFallback(const Mesh* mesh) const;
+	bool isFallback(const Texture* texture) const;
+
+	void addShaderDependencies(ShaderHandle handle);
+	void removeShaderDependencies(ShaderHandle handle);
 
 private:
 	const RHI::VulkanContext* context { nullptr };
-	
-	std::unordered_map<unsigned int, Mesh*> meshes;
-	std::unordered_map<unsigned int, RHI::Shader*> shaders;
-	std::unordered_map<unsigned int, Texture*> textures;
+	JobSystem* jobSystem{ nullptr };
+
+	HandlePool<Mesh> meshes;
+	HandlePool<RHI::Shader> shaders;
+	HandlePool<Texture> textures;
+
+	AssetRegistry<Mesh> meshRegistry;
+	AssetRegistry<RHI::Shader> shaderRegistry;
+	AssetRegistry<Texture> textureRegistry;
+
+	// Shared by every pending load of the same vertex format or color, they live as long as the manager
+	std::unordered_map<uint32_t, Mesh*> fallbackMeshes;
+	std::unordered_map<uint32_t, Texture*> fallbackTextures;
+
+	// Shaders to compile again when a file changes, by file system path of their sources and includes.
+	// Rebuilt for a shader every time it compiles, includes can come and go with an edit
+	std::unordered_map<std::string, std::vector<ShaderHandle>> shaderDependents;
+
+	// Worker stages in flight and stages waiting for the main thread
+	JobCounter workerStages;
+	std::mutex mainThreadMutex;
+	std::vector<std::coroutine_handle<>> mainThreadStages;
+
+	uint32_t numPendingLoads{ 0 };
+	uint32_t version{ 0 };
 };
 
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Mesh.h"
+#include "RenderScene.h"
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+// Assets of the scene, loaded by RenderScene and cooked ahead of time by the AssetCooker.
+// Indexed by the config enums of RenderScene.h, shaders name their slot instead
+namespace RHI
+{
+	namespace config
+	{
+		static std::vector<const char*> meshes = {
+		"Assert/Model/DamagedHelmet.fbx"
+		};
+
+		static std::vector<MeshImportOptions> meshImportOptions = {
+		{ VertexFormat::Compact, true, true, false }
+		};
+
+		struct ShaderAsset
+		{
+			Shaders shader; // slot in the scene, every slot is listed once
+			const char* path;
+			std::vector<std::string> defines; // keywords, a file listed twice is compiled into a variant per define set
+		};
+
+		static std::vector<ShaderAsset> shaders = {
+			{ Shaders::PBRVertex, "Assert/Shader/Pbrshader.vert" },
+			{ Shaders::PBRFragment, "Assert/Shader/Pbrshader.frag" },
+			{ Shaders::PBRPrefilteredFragment, "Assert/Shader/Pbrshader.frag", { "SPECULAR_IBL_PREFILTERED" } },
+			{ Shaders::PBRReferenceFragment, "Assert/Shader/Pbrshader.frag", { "SPECULAR_IBL_REFERENCE" } },
+			{ Shaders::SkyboxVertex, "Assert/Shader/skyBox.vert" },
+			{ Shaders::SkyboxFragment, "Assert/Shader/skyBox.frag" },
+			{ Shaders::CubeVertex, "Assert/Shader/commonCube.vert" },
+			{ Shaders::HDRIToCubeFragment, "Assert/Shader/hdriToCube.frag" },
+			{ Shaders::DiffuseIrradianceFragment, "Assert/Shader/diffuseIrradiance.frag" },
+			{ Shaders::BakedBRDFVertex, "Assert/Shader/bakeBRDF.vert" },
+			{ Shaders::BakedBRDFFragment, "Assert/Shader/bakeBRDF.frag" },
+			{ Shaders::PBRCompactVertex, "Assert/Shader/PbrshaderCompact.vert" },
+			{ Shaders::PBRCompactColorVertex, "Assert/Shader/PbrshaderCompactColor.vert" },
+			{ Shaders::HiZCopyCompute, "Assert/Shader/hiZCopy.comp" },
+			{ Shaders::HiZCopySingleSampleCompute, "Assert/Shader/hiZCopy.comp", { "SINGLE_SAMPLE" } },
+			{ Shaders::HiZReduceCompute, "Assert/Shader/hiZReduce.comp" },
+			{ Shaders::IndirectCullCompute, "Assert/Shader/indirectCull.comp" },
+		};
+
+		static std::vector<const char*> textures = {
+			"Assert/Texture/Default_albedo.jpg",
+			"Assert/Texture/Default_normal.jpg",
+			"Assert/Texture/Default_AO.jpg",
+			"Assert/Texture/Default_metalRoughness.jpg",
+			"Assert/Texture/Default_emissive.jpg",
+		};
+
+		// Shown until the texture is loaded: white albedo, flat normal, no occlusion, half rough dielectric, no emission
+		static std::vector<glm::vec4> textureFallbacks = {
+			glm::vec4(1.0f, 1.0f, 1.0f, 1.0f),
+			glm::vec4(0.5f, 0.5f, 1.0f, 1.0f),
+			glm::vec4(1.0f, 1.0f, 1.0f, 1.0f),
+			glm::vec4(0.0f, 0.5f, 0.0f, 1.0f),
+			glm::vec4(0.0f, 0.0f, 0.0f, 1.0f),
+		};
+
+		static std::vector<const char*> hdrTextures = {
+			"Assert/Texture/Ice_Lake/Ice_Lake_Ref.hdr",
+			"Assert/Texture/Default_environment.hdr"
+		};
+	}
+}
\ No newline at end of file
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// Shared by every promise type: who waits for the coroutine and who still holds its frame
+class TaskPromiseBase
+{
+public:
+	// Resumes the waiting coroutine, if any, on the thread that finished
+	struct FinalAwaiter
+	{
+		bool await_ready() const noexcept { return false; }
+		void await_resume() const noexcept { }
+
+		template<typename Promise>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> coroutine) noexcept
+		{
+			TaskPromiseBase& promise = coroutine.promise();
+			void* waiter = promise.continuation.exchange(finishedMarker(), std::memory_order_acq_rel);
+
+			// Nobody holds the task anymore, the frame goes away with the coroutine
+			if (promise.references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				coroutine.destroy();
+
+			if (waiter)
+				return std::coroutine_handle<>::from_address(waiter);
+
+			return std::noop_coroutine();
+		}
+	};
+
+	std::suspend_never initial_suspend() const noexcept { return {}; }
+	FinalAwaiter final_suspend() const noexcept { return {}; }
+	void unhandled_exception() { exception = std::current_exception(); }
+
+	inline bool isFinished() const { return continuation.load(std::memory_order_acquire) == finishedMarker(); }
+
+	// False when the coroutine finished in the meantime, the waiter goes on right away
+	bool setContinuation(std::coroutine_handle<> waiter)
+	{
+		void* expected = nullptr;
+		return continuation.compare_exchange_strong(expected, waiter.address(), std::memory_order_acq_rel);
+	}
+
+	// Drops the reference of the task object, true when the frame has to be destroyed
+	bool release() { return references.fetch_sub(1, std::memory_order_acq_rel) == 1; }
+
+protected:
+	void rethrow() const
+	{
+		if (exception)
+			std::rethrow_exception(exception);
+	}
+
+private:
+	static void* finishedMarker()
+	{
+		static char marker;
+		return &marker;
+	}
+
+private:
+	std::atomic<void*> continuation{ nullptr };
+	std::atomic<uint32_t> references{ 2 }; // the task object and the running coroutine
+	std::exception_ptr exception;
+};
+
+template<typename T>
+class TaskPromise : public TaskPromiseBase
+{
+public:
+	void return_value(T result) { value = std::move(result); }
+
+	T getResult() const
+	{
+		rethrow();
+		return *value;
+	}
+
+private:
+	std::optional<T> value;
+};
+
+template<>
+class TaskPromise<void> : public TaskPromiseBase
+{
+public:
+	void return_void() { }
+	void getResult() const { rethrow(); }
+};
+
+// Coroutine that starts right away and runs until its first suspension, then goes on wherever it gets resumed.
+// One coroutine at a time can co_await the task, other code polls isReady(). Dropping the task doesn't stop
+// the coroutine, its frame lives until both are gone
+template<typename T>
+class Task
+{
+public:
+	struct promise_type : public TaskPromise<T>
+	{
+		Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+	};
+
+	Task() = default;
+	Task(const Task&) = delete;
+	Task& operator=(const Task&) = delete;
+
+	Task(Task&& other) noexcept
+		: coroutine(std::exchange(other.coroutine, nullptr)) { }
+
+	Task& operator=(Task&& other) noexcept
+	{
+		if (this != &other)
+		{
+			reset();
+			coroutine = std::exchange(other.coroutine, nullptr);
+		}
+
+		return *this;
+	}
+
+	~Task() { reset(); }
+
+	// An empty task counts as ready
+	inline bool isReady() const { return !coroutine || coroutine.promise().isFinished(); }
+
+	// Only valid once ready, rethrows what escaped the coroutine
+	T getResult() const { return coroutine.promise().getResult(); }
+
+	bool await_ready() const noexcept { return isReady(); }
+	bool await_suspend(std::coroutine_handle<> waiter) noexcept { return coroutine.promise().setContinuation(waiter); }
+	T await_resume() const { return getResult(); }
+
+private:
+	explicit Task(std::coroutine_handle<promise_type> coroutine)
+		: coroutine(coroutine) { }
+
+	void reset()
+	{
+		if (coroutine && coroutine.promise().release())
+			coroutine.destroy();
+
+		coroutine = nullptr;
+	}
+
+private:
+	std::coroutine_handle<promise_type> coroutine;
+};
+
+// Finishes once every task finished, on the thread of the last one
+template<typename T>
+Task<void> whenAll(std::vector<Task<T>> tasks)
+{
+	for (Task<T>& task : tasks)
+		co_await task;
+}
\ No newline at end of file
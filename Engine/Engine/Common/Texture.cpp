@@ -5,12 +5,35 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
+#include "LZ4.h"
+
 #include <algorithm>
+#include <fstream>
 #include <iostream>
+#include <vector>
 #include <cassert>
 
 using namespace RHI;
 
+// Decoded pixels stored next to the source file in LZ4 blocks, bump the version whenever the layout or the decoding changes
+static const char* TEXTURE_CACHE_EXTENSION = ".texcache";
+static const uint32_t TEXTURE_CACHE_MAGIC = 0x43584554; // "TEXC"
+static const uint32_t TEXTURE_CACHE_VERSION = 1;
+
+// Followed by the compressed size of every block, then the blocks
+struct TextureCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t sourceHash;
+	uint32_t width;
+	uint32_t height;
+	uint32_t channels;
+	uint32_t pixelSize;
+	uint32_t numBlocks;
+	uint32_t padding;
+};
+
 static VkFormat deduceFormat(size_t pixelSize, int channels)
 {
 	assert(channels > 0 && channels <= 4);
@@ -70,23 +93,91 @@ Texture::~Texture()
 
 bool Texture::loadFromFile(const std::string& path)
 {
-	if (stbi_info(path.c_str(), nullptr, nullptr, nullptr) == 0)
+	if (!decodeFromFile(path))
+		return false;
+
+	// Upload CPU data to GPU
+	clearGPUData();
+	uploadToGPU();
+
+	// TODO: should we clear CPU data after uploading it to the GPU?
+
+	return true;
+}
+
+bool Texture::decodeFromFile(const std::string& path)
+{
+	uint64_t sourceHash = FNV1A_OFFSET_BASIS;
+	if (!hashFile(path, sourceHash))
+	{
+		std::cerr << "Texture::loadFromFile(): can't open \"" << path << "\"" << std::endl;
+		return false;
+	}
+
+	std::string cachePath = path + TEXTURE_CACHE_EXTENSION;
+	if (loadFromCache(cachePath, sourceHash))
+		return true;
+
+	if (!importFromFile(path))
+		return false;
+
+	saveToCache(cachePath, sourceHash);
+	return true;
+}
+
+CookResult Texture::cookFromFile(const std::string& path)
+{
+	uint64_t sourceHash = FNV1A_OFFSET_BASIS;
+	if (!hashFile(path, sourceHash))
+	{
+		std::cerr << "Texture::cookFromFile(): can't open \"" << path << "\"" << std::endl;
+		return CookResult::Failed;
+	}
+
+	std::string cachePath = path + TEXTURE_CACHE_EXTENSION;
+	if (loadFromCache(cachePath, sourceHash))
+	{
+		clearCPUData();
+		return CookResult::UpToDate;
+	}
+
+	if (!importFromFile(path))
+		return CookResult::Failed;
+
+	bool saved = saveToCache(cachePath, sourceHash);
+	clearCPUData();
+
+	return saved ? CookResult::Cooked : CookResult::Failed;
+}
+
+bool Texture::importFromFile(const std::string& path)
+{
+	FileData file;
+	if (!FileSystem::get().read(path, file))
+	{
+		std::cerr << "Texture::loadFromFile(): can't open \"" << path << "\"" << std::endl;
+		return false;
+	}
+
+	const stbi_uc* fileData = file.getData();
+	int fileSize = static_cast<int>(file.getSize());
+
+	if (stbi_info_from_memory(fileData, fileSize, nullptr, nullptr, nullptr) == 0)
 	{
 		std::cerr << "Texture::loadFromFile(): unsupported image format for \"" << path << "\" file" << std::endl;
 		return false;
 	}
 
 	void* stbPixels = nullptr;
-	size_t pixelSize = 0;
 
-	if (stbi_is_hdr(path.c_str()))
+	if (stbi_is_hdr_from_memory(fileData, fileSize))
 	{
-		stbPixels = stbi_loadf(path.c_str(), &width, &height, &channels, STBI_default);
+		stbPixels = stbi_loadf_from_memory(fileData, fileSize, &width, &height, &channels, STBI_default);
 		pixelSize = sizeof(float);
 	}
 	else
 	{
-		stbPixels = stbi_load(path.c_str(), &width, &height, &channels, STBI_default);
+		stbPixels = stbi_load_from_memory(fileData, fileSize, &width, &height, &channels, STBI_default);
 		pixelSize = sizeof(stbi_uc);
 	}
 
@@ -137,17 +228,153 @@ bool Texture::loadFromFile(const std::string& path)
 	stbi_image_free(stbPixels);
 	stbPixels = nullptr;
 
-	VkFormat format = deduceFormat(pixelSize, channels);
+	return true;
+}
 
-	// Upload CPU data to GPU
-	clearGPUData();
-	uploadToGPU(format, VK_IMAGE_TILING_OPTIMAL, imageSize);
+bool Texture::loadFromCache(const std::string& path, uint64_t sourceHash)
+{
+	FileData file;
+	if (!FileSystem::get().read(path, file) || file.getSize() < sizeof(TextureCacheHeader))
+		return false;
 
-	// TODO: should we clear CPU data after uploading it to the GPU?
+	TextureCacheHeader header;
+	memcpy(&header, file.getData(), sizeof(TextureCacheHeader));
+
+	if (header.magic != TEXTURE_CACHE_MAGIC || header.version != TEXTURE_CACHE_VERSION || header.sourceHash != sourceHash)
+		return false;
+
+	if (header.channels == 0 || header.channels > 4 || (header.pixelSize != sizeof(stbi_uc) && header.pixelSize != sizeof(float)))
+		return false;
+
+	uint64_t imageSize = static_cast<uint64_t>(header.width) * header.height * header.channels * header.pixelSize;
+	uint64_t numBlocks = (imageSize + LZ4_MAX_BLOCK_SIZE - 1) / LZ4_MAX_BLOCK_SIZE;
+
+	uint64_t offset = sizeof(TextureCacheHeader) + sizeof(uint32_t) * numBlocks;
+	if (header.numBlocks != numBlocks || offset > file.getSize())
+		return false;
+
+	const uint8_t* blockSizes = file.getData() + sizeof(TextureCacheHeader);
+
+	clearCPUData();
+	pixels = new unsigned char[imageSize];
+
+	for (uint64_t i = 0; i < numBlocks; i++)
+	{
+		uint32_t compressedSize;
+		memcpy(&compressedSize, blockSizes + sizeof(uint32_t) * i, sizeof(uint32_t));
+
+		size_t blockSize = static_cast<size_t>(std::min<uint64_t>(LZ4_MAX_BLOCK_SIZE, imageSize - i * LZ4_MAX_BLOCK_SIZE));
+		unsigned char* destination = pixels + i * LZ4_MAX_BLOCK_SIZE;
+
+		bool valid = compressedSize <= file.getSize() - offset;
+		if (valid && compressedSize == blockSize)
+			memcpy(destination, file.getData() + offset, blockSize);
+		else if (valid)
+			valid = decompressLZ4(file.getData() + offset, compressedSize, destination, blockSize);
+
+		if (!valid)
+		{
+			std::cerr << "Texture::loadFromCache(): \"" << path << "\" is corrupt" << std::endl;
+			clearCPUData();
+			return false;
+		}
+
+		offset += compressedSize;
+	}
+
+	width = static_cast<int>(header.width);
+	height = static_cast<int>(header.height);
+	channels = static_cast<int>(header.channels);
+	pixelSize = header.pixelSize;
+	layers = 1;
+	mipLevels = static_cast<int>(std::floor(std::log2(std::max(width, height))) + 1);
 
 	return true;
 }
 
+bool Texture::saveToCache(const std::string& path, uint64_t sourceHash) const
+{
+	size_t imageSize = width * height * channels * pixelSize;
+	uint32_t numBlocks = static_cast<uint32_t>((imageSize + LZ4_MAX_BLOCK_SIZE - 1) / LZ4_MAX_BLOCK_SIZE);
+
+	// Blocks are compressed independently, the ones that don't shrink are stored as is
+	std::vector<uint32_t> blockSizes(numBlocks);
+	std::vector<uint8_t> blocks;
+	std::vector<uint8_t> compressed(getLZ4Bound(LZ4_MAX_BLOCK_SIZE));
+
+	for (uint32_t i = 0; i < numBlocks; i++)
+	{
+		const uint8_t* block = pixels + i * LZ4_MAX_BLOCK_SIZE;
+		size_t blockSize = std::min(LZ4_MAX_BLOCK_SIZE, imageSize - i * LZ4_MAX_BLOCK_SIZE);
+
+		size_t compressedSize = compressLZ4(block, blockSize, compressed.data(), compressed.size());
+		if (compressedSize == 0 || compressedSize >= blockSize)
+		{
+			blockSizes[i] = static_cast<uint32_t>(blockSize);
+			blocks.insert(blocks.end(), block, block + blockSize);
+		}
+		else
+		{
+			blockSizes[i] = static_cast<uint32_t>(compressedSize);
+			blocks.insert(blocks.end(), compressed.begin(), compressed.begin() + compressedSize);
+		}
+	}
+
+	TextureCacheHeader header = {};
+	header.magic = TEXTURE_CACHE_MAGIC;
+	header.version = TEXTURE_CACHE_VERSION;
+	header.sourceHash = sourceHash;
+	header.width = static_cast<uint32_t>(width);
+	header.height = static_cast<uint32_t>(height);
+	header.channels = static_cast<uint32_t>(channels);
+	header.pixelSize = static_cast<uint32_t>(pixelSize);
+	header.numBlocks = numBlocks;
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cerr << "Texture::saveToCache(): can't open \"" << path << "\"" << std::endl;
+		return false;
+	}
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(TextureCacheHeader));
+	file.write(reinterpret_cast<const char*>(blockSizes.data()), static_cast<std::streamsize>(sizeof(uint32_t) * blockSizes.size()));
+	file.write(reinterpret_cast<const char*>(blocks.data()), static_cast<std::streamsize>(blocks.size()));
+
+	if (!file.good())
+	{
+		std::cerr << "Texture::saveToCache(): can't write \"" << path << "\"" << std::endl;
+		return false;
+	}
+
+	FileSystem::get().invalidate(path);
+	return true;
+}
+
+void Texture::createSolidColor(const glm::vec4& color)
+{
+	clearCPUData();
+	clearGPUData();
+
+	width = height = 1;
+	channels = 4;
+	pixelSize = sizeof(stbi_uc);
+	mipLevels = 1;
+	layers = 1;
+
+	pixels = new unsigned char[4];
+	for (int i = 0; i < 4; i++)
+		pixels[i] = static_cast<unsigned char>(std::clamp(color[i], 0.0f, 1.0f) * 255.0f + 0.5f);
+
+	uploadToGPU();
+}
+
+void Texture::uploadToGPU()
+{
+	size_t imageSize = width * height * channels * pixelSize;
+	uploadToGPU(deduceFormat(pixelSize, channels), VK_IMAGE_TILING_OPTIMAL, imageSize);
+}
+
 void Texture::create2D(VkFormat format, int w, int h, int mips)
 {
 	width = w;
@@ -336,6 +563,10 @@ void Texture::uploadToGPU(VkFormat format, VkImageTiling tiling, size_t imageSiz
 
 void Texture::clearGPUData()
 {
+	// Offline tools decode textures without a device
+	if (!context)
+		return;
+
 	vkDestroySampler(context->getDevice(), imageSampler, nullptr);
 	imageSampler = nullptr;
 
@@ -3,6 +3,10 @@
 #include <vulkan/vulkan.h>
 #include <string>
 
+#include <glm/glm.hpp>
+
+#include "AssetCache.h"
+
 namespace RHI
 {
 	class VulkanContext;
@@ -28,6 +32,16 @@ public:
 
 	bool loadFromFile(const std::string& path);
 
+	// CPU half of loadFromFile(), safe on any thread as long as the texture isn't on the GPU yet
+	bool decodeFromFile(const std::string& path);
+	void uploadToGPU();
+
+	// Decodes the file into its cache unless the cache is up to date, leaves no CPU data behind
+	CookResult cookFromFile(const std::string& path);
+
+	// 1x1 texture, used as a stand-in while the real one loads
+	void createSolidColor(const glm::vec4& color);
+
 	void clearGPUData();
 	void clearCPUData();;
 
@@ -35,6 +49,10 @@ public:
 	void create2D(VkFormat format, int width, int height, int numMipLevels);
 
 private:
+	bool importFromFile(const std::string& path);
+	bool loadFromCache(const std::string& path, uint64_t sourceHash);
+	bool saveToCache(const std::string& path, uint64_t sourceHash) const;
+
 	void uploadToGPU(VkFormat format, VkImageTiling tiling, size_t imageSize);
 
 private:
@@ -44,6 +62,7 @@ private:
 	int width{ 0 };
 	int height{ 0 };
 	int channels{ 0 };
+	size_t pixelSize{ 0 }; // bytes per channel
 	int mipLevels{ 0 };
 	int layers{ 0 };
 
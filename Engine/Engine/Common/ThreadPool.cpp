@@ -0,0 +1,85 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(uint32_t numThreads)
+{
+	if (numThreads == 0)
+		numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+	for (uint32_t thread = 1; thread < numThreads; thread++)
+		workers.emplace_back(&ThreadPool::workerLoop, this, thread);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wakeCondition.notify_all();
+
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+void ThreadPool::parallelFor(uint32_t count, const std::function<void(uint32_t, uint32_t)>& task)
+{
+	if (workers.empty() || count <= 1)
+	{
+		for (uint32_t i = 0; i < count; i++)
+			task(i, 0);
+
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(mutex);
+	currentTask = &task;
+	numTasks = count;
+	nextTask = 0;
+	numTasksDone = 0;
+	generation++;
+	wakeCondition.notify_all();
+
+	// The calling thread takes tasks like any worker
+	while (nextTask < numTasks)
+	{
+		uint32_t index = nextTask++;
+		lock.unlock();
+		task(index, 0);
+		lock.lock();
+		numTasksDone++;
+	}
+
+	doneCondition.wait(lock, [this]() { return numTasksDone == numTasks; });
+	currentTask = nullptr;
+}
+
+void ThreadPool::workerLoop(uint32_t thread)
+{
+	uint64_t lastGeneration = 0;
+
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		wakeCondition.wait(lock, [&]() { return stopping || generation != lastGeneration; });
+
+		if (stopping)
+			return;
+
+		lastGeneration = generation;
+
+		while (nextTask < numTasks)
+		{
+			uint32_t index = nextTask++;
+			const std::function<void(uint32_t, uint32_t)>& task = *currentTask;
+
+			lock.unlock();
+			task(index, thread);
+			lock.lock();
+
+			if (++numTasksDone == numTasks)
+				doneCondition.notify_all();
+		}
+	}
+}
\ No newline at end of file
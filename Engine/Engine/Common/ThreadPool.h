@@ -0,0 +1,37 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent worker threads sleeping between parallelFor calls, the calling thread takes tasks too.
+// One parallelFor runs at a time, thread indices are stable so callers can keep per thread state
+class ThreadPool
+{
+public:
+	// 0 threads uses every hardware thread, the calling thread counts as one
+	explicit ThreadPool(uint32_t numThreads = 0);
+	~ThreadPool();
+
+	// Runs task(index, thread) for index in [0, numTasks), thread is in [0, getNumThreads()) and 0 is the caller
+	void parallelFor(uint32_t numTasks, const std::function<void(uint32_t, uint32_t)>& task);
+
+	inline uint32_t getNumThreads() const { return static_cast<uint32_t>(workers.size()) + 1; }
+
+private:
+	void workerLoop(uint32_t thread);
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wakeCondition;
+	std::condition_variable doneCondition;
+	const std::function<void(uint32_t, uint32_t)>* currentTask{ nullptr };
+	uint32_t numTasks{ 0 };
+	uint32_t nextTask{ 0 };
+	uint32_t numTasksDone{ 0 };
+	uint64_t generation{ 0 };
+	bool stopping{ false };
+};
\ No newline at end of file
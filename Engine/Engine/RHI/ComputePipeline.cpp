@@ -0,0 +1,32 @@
+#include "ComputePipeline.h"
+#include "VulkanContext.h"
+#include <stdexcept>
+
+namespace RHI
+{
+	void ComputePipeline::setShaderStage(
+		VkShaderModule shader,
+		const VkSpecializationInfo* specialization,
+		const char* entry)
+	{
+		shaderStage = {};
+		shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shaderStage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		shaderStage.module = shader;
+		shaderStage.pName = entry;
+		shaderStage.pSpecializationInfo = specialization;
+	}
+
+	VkPipeline ComputePipeline::build()
+	{
+		VkComputePipelineCreateInfo pipelineInfo = {};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.stage = shaderStage;
+		pipelineInfo.layout = pipelineLayout;
+
+		if (vkCreateComputePipelines(context->getDevice(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS)
+			throw std::runtime_error("Can't create compute pipeline");
+
+		return pipeline;
+	}
+}
\ No newline at end of file
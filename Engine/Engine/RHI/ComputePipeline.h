@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+namespace RHI
+{
+	class VulkanContext;
+
+	// A compute pipeline runs a single compute shader stage outside of any render pass,
+	// it is recorded with vkCmdDispatch against the descriptor sets of its layout
+	class ComputePipeline
+	{
+	public:
+		ComputePipeline(const VulkanContext* context, VkPipelineLayout pipelineLayout)
+			: context(context), pipelineLayout(pipelineLayout) { }
+
+		inline VkPipeline getPipeline() const { return pipeline; }
+
+		// Shader, the specialization constants have to stay alive until build()
+		void setShaderStage(
+			VkShaderModule shader,
+			const VkSpecializationInfo* specialization = nullptr,
+			const char* entry = "main");
+
+		VkPipeline build();
+
+	private:
+		const VulkanContext* context{ nullptr };
+		VkPipelineLayout pipelineLayout{ VK_NULL_HANDLE }; // Pipeline layout
+
+		VkPipelineShaderStageCreateInfo shaderStage{}; // shader stage
+
+		VkPipeline pipeline{ VK_NULL_HANDLE };
+	};
+}
\ No newline at end of file
@@ -8,6 +8,7 @@ namespace RHI
 	void GraphicsPipeline::addShaderStage(
 		VkShaderModule shader,
 		VkShaderStageFlagBits stage,
+		const VkSpecializationInfo* specialization,
 		const char* entry)
 	{
 		VkPipelineShaderStageCreateInfo shaderStageInfo = {};
@@ -15,6 +16,7 @@ namespace RHI
 		shaderStageInfo.stage = stage;
 		shaderStageInfo.module = shader;
 		shaderStageInfo.pName = entry;
+		shaderStageInfo.pSpecializationInfo = specialization;
 
 		shaderStages.push_back(shaderStageInfo);
 	}
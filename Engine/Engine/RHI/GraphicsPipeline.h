@@ -18,10 +18,11 @@ namespace RHI
 
 		inline VkPipeline getPipeline() const { return pipeline; }
 
-		// Shader 
+		// Shader, the specialization constants have to stay alive until build()
 		void addShaderStage(
 			VkShaderModule shader,
 			VkShaderStageFlagBits stage,
+			const VkSpecializationInfo* specialization = nullptr,
 			const char* entry = "main");
 
 		// Vertex input
@@ -0,0 +1,168 @@
+#include "LayoutCache.h"
+#include "ShaderReflection.h"
+#include "VulkanContext.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace RHI
+{
+	template<typename T>
+	static void appendKey(std::string& key, const T& value)
+	{
+		key.append(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	LayoutCache::~LayoutCache()
+	{
+		clear();
+	}
+
+	std::string LayoutCache::getDescriptorSetLayoutKey(const std::vector<VkDescriptorSetLayoutBinding>& bindings)
+	{
+		// Immutable samplers aren't used, the rest of every binding is the key
+		std::string key;
+		for (const VkDescriptorSetLayoutBinding& binding : bindings)
+		{
+			appendKey(key, binding.binding);
+			appendKey(key, binding.descriptorType);
+			appendKey(key, binding.descriptorCount);
+			appendKey(key, binding.stageFlags);
+		}
+
+		return key;
+	}
+
+	std::string LayoutCache::getPipelineLayoutKey(const std::vector<VkDescriptorSetLayout>& setLayouts, const VkPushConstantRange& pushConstantRange)
+	{
+		std::string key;
+		for (VkDescriptorSetLayout setLayout : setLayouts)
+			appendKey(key, setLayout);
+
+		appendKey(key, pushConstantRange.stageFlags);
+		appendKey(key, pushConstantRange.offset);
+		appendKey(key, pushConstantRange.size);
+
+		return key;
+	}
+
+	VkDescriptorSetLayout LayoutCache::getDescriptorSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings)
+	{
+		std::string key = getDescriptorSetLayoutKey(bindings);
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto it = descriptorSetLayouts.find(key);
+		if (it != descriptorSetLayouts.end())
+			return it->second;
+
+		VkDescriptorSetLayoutCreateInfo descriptorSetLayoutInfo = {};
+		descriptorSetLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		descriptorSetLayoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+		descriptorSetLayoutInfo.pBindings = bindings.data();
+
+		VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+		if (vkCreateDescriptorSetLayout(context->getDevice(), &descriptorSetLayoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS)
+			throw std::runtime_error("Can't create descriptor set layout");
+
+		descriptorSetLayouts[key] = descriptorSetLayout;
+		return descriptorSetLayout;
+	}
+
+	VkPipelineLayout LayoutCache::getPipelineLayout(const std::vector<VkDescriptorSetLayout>& setLayouts, const VkPushConstantRange& pushConstantRange)
+	{
+		std::string key = getPipelineLayoutKey(setLayouts, pushConstantRange);
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto it = pipelineLayouts.find(key);
+		if (it != pipelineLayouts.end())
+			return it->second;
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+		pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+		pipelineLayoutInfo.pushConstantRangeCount = (pushConstantRange.size > 0) ? 1 : 0;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		if (vkCreatePipelineLayout(context->getDevice(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
+			throw std::runtime_error("Can't create pipeline layout");
+
+		pipelineLayouts[key] = pipelineLayout;
+		return pipelineLayout;
+	}
+
+	VkDescriptorSetLayout LayoutCache::getDescriptorSetLayout(const ShaderReflection& reflection, uint32_t set)
+	{
+		return getDescriptorSetLayout(reflection.getSetBindings(set));
+	}
+
+	VkPipelineLayout LayoutCache::getPipelineLayout(const ShaderReflection& reflection, const std::vector<VkDescriptorSetLayout>& externalSetLayouts)
+	{
+		uint32_t numSets = std::max(reflection.getNumSets(), static_cast<uint32_t>(externalSetLayouts.size()));
+
+		// Sets the stages skip in between get an empty layout
+		std::vector<VkDescriptorSetLayout> setLayouts(numSets);
+		for (uint32_t set = 0; set < numSets; set++)
+		{
+			bool external = set < externalSetLayouts.size() && externalSetLayouts[set] != VK_NULL_HANDLE;
+			setLayouts[set] = external ? externalSetLayouts[set] : getDescriptorSetLayout(reflection, set);
+		}
+
+		return getPipelineLayout(setLayouts, reflection.getPushConstantRange());
+	}
+
+	VkDescriptorSetLayout LayoutCache::findDescriptorSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings)
+	{
+		std::string key = getDescriptorSetLayoutKey(bindings);
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto it = descriptorSetLayouts.find(key);
+		return (it != descriptorSetLayouts.end()) ? it->second : VK_NULL_HANDLE;
+	}
+
+	VkPipelineLayout LayoutCache::findPipelineLayout(const std::vector<VkDescriptorSetLayout>& setLayouts, const VkPushConstantRange& pushConstantRange)
+	{
+		std::string key = getPipelineLayoutKey(setLayouts, pushConstantRange);
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto it = pipelineLayouts.find(key);
+		return (it != pipelineLayouts.end()) ? it->second : VK_NULL_HANDLE;
+	}
+
+	VkPipelineLayout LayoutCache::findPipelineLayout(const ShaderReflection& reflection, const std::vector<VkDescriptorSetLayout>& externalSetLayouts)
+	{
+		uint32_t numSets = std::max(reflection.getNumSets(), static_cast<uint32_t>(externalSetLayouts.size()));
+
+		std::vector<VkDescriptorSetLayout> setLayouts(numSets);
+		for (uint32_t set = 0; set < numSets; set++)
+		{
+			bool external = set < externalSetLayouts.size() && externalSetLayouts[set] != VK_NULL_HANDLE;
+			setLayouts[set] = external ? externalSetLayouts[set] : findDescriptorSetLayout(reflection.getSetBindings(set));
+
+			// A set nobody asked for yet can't be part of a cached pipeline layout
+			if (setLayouts[set] == VK_NULL_HANDLE)
+				return VK_NULL_HANDLE;
+		}
+
+		return findPipelineLayout(setLayouts, reflection.getPushConstantRange());
+	}
+
+	void LayoutCache::clear()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for (auto& it : pipelineLayouts)
+			vkDestroyPipelineLayout(context->getDevice(), it.second, nullptr);
+
+		for (auto& it : descriptorSetLayouts)
+			vkDestroyDescriptorSetLayout(context->getDevice(), it.second, nullptr);
+
+		pipelineLayouts.clear();
+		descriptorSetLayouts.clear();
+	}
+}
\ No newline at end of file
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace RHI
+{
+	class ShaderReflection;
+	class VulkanContext;
+
+	// Descriptor set and pipeline layouts shared by everything asking for the same description, so pipelines
+	// with the same interface get the same layout and descriptor sets stay bound across them. The same goes the other
+	// way: a reloaded shader kept the interface of a pipeline when its reflection finds the same pipeline layout.
+	// The cache owns the layouts until clear(), users never destroy them
+	class LayoutCache
+	{
+	public:
+		LayoutCache(const VulkanContext* context)
+			: context(context) { }
+
+		~LayoutCache();
+
+		VkDescriptorSetLayout getDescriptorSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings);
+		VkPipelineLayout getPipelineLayout(const std::vector<VkDescriptorSetLayout>& setLayouts, const VkPushConstantRange& pushConstantRange);
+
+		// Layouts of the reflected interface, merged across the stages of the pipeline beforehand.
+		// Sets given a layout in externalSetLayouts use it, they are allocated by someone else like the swap chain
+		VkDescriptorSetLayout getDescriptorSetLayout(const ShaderReflection& reflection, uint32_t set);
+		VkPipelineLayout getPipelineLayout(const ShaderReflection& reflection, const std::vector<VkDescriptorSetLayout>& externalSetLayouts = {});
+
+		// Same lookups without creating anything, VK_NULL_HANDLE when the description was never asked for
+		VkDescriptorSetLayout findDescriptorSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings);
+		VkPipelineLayout findPipelineLayout(const std::vector<VkDescriptorSetLayout>& setLayouts, const VkPushConstantRange& pushConstantRange);
+		VkPipelineLayout findPipelineLayout(const ShaderReflection& reflection, const std::vector<VkDescriptorSetLayout>& externalSetLayouts = {});
+
+		void clear();
+
+	private:
+		static std::string getDescriptorSetLayoutKey(const std::vector<VkDescriptorSetLayoutBinding>& bindings);
+		static std::string getPipelineLayoutKey(const std::vector<VkDescriptorSetLayout>& setLayouts, const VkPushConstantRange& pushConstantRange);
+
+	private:
+		const VulkanContext* context{ nullptr };
+
+		// By the bytes of their description
+		std::mutex mutex;
+		std::unordered_map<std::string, VkDescriptorSetLayout> descriptorSetLayouts;
+		std::unordered_map<std::string, VkPipelineLayout> pipelineLayouts;
+	};
+}
\ No newline at end of file
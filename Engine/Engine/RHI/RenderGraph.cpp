@@ -0,0 +1,628 @@
+#include "RenderGraph.h"
+#include "VulkanContext.h"
+#include "VulkanUtils.h"
+#include "../Common/Texture.h"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace RHI
+{
+	struct AccessInfo
+	{
+		VkImageLayout layout;
+		VkPipelineStageFlags stages;
+		VkAccessFlags access;
+		VkImageUsageFlags usage;
+	};
+
+	static AccessInfo getAccessInfo(RenderGraph::Access access)
+	{
+		switch (access)
+		{
+			case RenderGraph::Access::ColorAttachment:
+				return {
+					VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+					VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+					VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+					VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
+				};
+			case RenderGraph::Access::DepthStencilAttachment:
+				return {
+					VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+					VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+					VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+					VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT
+				};
+			case RenderGraph::Access::SampledRead:
+				return {
+					VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+					VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+					VK_ACCESS_SHADER_READ_BIT,
+					VK_IMAGE_USAGE_SAMPLED_BIT
+				};
+			case RenderGraph::Access::StorageRead:
+				return {
+					VK_IMAGE_LAYOUT_GENERAL,
+					VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+					VK_ACCESS_SHADER_READ_BIT,
+					VK_IMAGE_USAGE_STORAGE_BIT
+				};
+			case RenderGraph::Access::StorageWrite:
+				return {
+					VK_IMAGE_LAYOUT_GENERAL,
+					VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+					VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+					VK_IMAGE_USAGE_STORAGE_BIT
+				};
+			case RenderGraph::Access::TransferSrc:
+				return {
+					VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+					VK_PIPELINE_STAGE_TRANSFER_BIT,
+					VK_ACCESS_TRANSFER_READ_BIT,
+					VK_IMAGE_USAGE_TRANSFER_SRC_BIT
+				};
+			case RenderGraph::Access::TransferDst:
+				return {
+					VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+					VK_PIPELINE_STAGE_TRANSFER_BIT,
+					VK_ACCESS_TRANSFER_WRITE_BIT,
+					VK_IMAGE_USAGE_TRANSFER_DST_BIT
+				};
+		}
+
+		throw std::runtime_error("Unknown render graph access");
+	}
+
+	static bool isDepthFormat(VkFormat format)
+	{
+		return format == VK_FORMAT_D16_UNORM || format == VK_FORMAT_D32_SFLOAT || VulkanUtils::hasStencilComponent(format);
+	}
+
+	static bool hasDeviceLocalMemoryType(const VulkanContext* context, uint32_t memoryTypeBits)
+	{
+		VkPhysicalDeviceMemoryProperties memoryProperties;
+		vkGetPhysicalDeviceMemoryProperties(context->getPhysicalDevice(), &memoryProperties);
+
+		for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+			if ((memoryTypeBits & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT))
+				return true;
+
+		return false;
+	}
+
+	void RenderGraph::PassBuilder::read(ImageHandle image, Access access)
+	{
+		addUse(image, access, false);
+	}
+
+	void RenderGraph::PassBuilder::write(ImageHandle image, Access access)
+	{
+		addUse(image, access, true);
+	}
+
+	void RenderGraph::PassBuilder::addUse(ImageHandle image, Access access, bool write)
+	{
+		assert(image < graph->images.size());
+		Pass& graphPass = graph->passes[pass];
+
+		// An image has a single layout for the whole pass, its accesses are merged into one barrier
+		for (const ImageUse& use : graphPass.uses)
+			if (use.image == image && getAccessInfo(use.access).layout != getAccessInfo(access).layout)
+				throw std::runtime_error("Render graph pass \"" + graphPass.name + "\" uses \"" + graph->images[image].name + "\" in two layouts");
+
+		graphPass.uses.push_back({ image, access, write });
+	}
+
+	void RenderGraph::PassBuilder::setSideEffects()
+	{
+		graph->passes[pass].sideEffects = true;
+	}
+
+	RenderGraph::~RenderGraph()
+	{
+		clear();
+	}
+
+	RenderGraph::ImageHandle RenderGraph::importImage(const char* name, VkImage image, VkImageView imageView, VkFormat format, uint32_t mipLevels, uint32_t layers, VkImageLayout currentLayout, VkImageLayout finalLayout)
+	{
+		Image result;
+		result.name = name;
+		result.description.format = format;
+		result.description.mipLevels = mipLevels;
+		result.description.layers = layers;
+		result.imported = true;
+		result.currentLayout = currentLayout;
+		result.finalLayout = finalLayout;
+		result.image = image;
+		result.imageView = imageView;
+
+		images.push_back(result);
+		compiled = false;
+
+		return static_cast<ImageHandle>(images.size() - 1);
+	}
+
+	RenderGraph::ImageHandle RenderGraph::importTexture(const char* name, const Texture& texture, VkImageLayout layout)
+	{
+		return importImage(name, texture.getImage(), texture.getImageView(), texture.getImageFormat(), texture.getNumMipLevels(), texture.getNumLayers(), layout, layout);
+	}
+
+	RenderGraph::ImageHandle RenderGraph::createImage(const char* name, const ImageDescription& description)
+	{
+		Image result;
+		result.name = name;
+		result.description = description;
+
+		images.push_back(result);
+		compiled = false;
+
+		return static_cast<ImageHandle>(images.size() - 1);
+	}
+
+	void RenderGraph::addPass(const char* name, const SetupFunction& setup, const ExecuteFunction& execute)
+	{
+		Pass pass;
+		pass.name = name;
+		pass.execute = execute;
+		passes.push_back(pass);
+
+		PassBuilder builder(this, static_cast<uint32_t>(passes.size() - 1));
+		setup(builder);
+
+		compiled = false;
+	}
+
+	VkImage RenderGraph::getImage(ImageHandle image) const
+	{
+		assert(image < images.size());
+		return images[image].image;
+	}
+
+	VkImageView RenderGraph::getImageView(ImageHandle image) const
+	{
+		assert(image < images.size());
+		return images[image].imageView;
+	}
+
+	void RenderGraph::clear()
+	{
+		destroyTransientImages();
+
+		passes.clear();
+		images.clear();
+		finalBarriers.clear();
+		finalSrcStages = 0;
+
+		numCulledPasses = 0;
+		numBarriers = 0;
+		compiled = false;
+	}
+
+	void RenderGraph::compile()
+	{
+		destroyTransientImages();
+
+		cullPasses();
+		allocateTransientImages();
+		computeBarriers();
+
+		compiled = true;
+	}
+
+	void RenderGraph::cullPasses()
+	{
+		// Passes are referenced by the images they write, images by the passes reading them.
+		// Imported images are read after the graph, so their writers always survive
+		std::vector<uint32_t> passReferences(passes.size(), 0);
+		std::vector<uint32_t> imageReferences(images.size(), 0);
+		std::vector<std::vector<uint32_t>> writers(images.size());
+
+		for (uint32_t i = 0; i < passes.size(); i++)
+		{
+			for (const ImageUse& use : passes[i].uses)
+			{
+				if (use.write)
+				{
+					passReferences[i]++;
+					writers[use.image].push_back(i);
+				}
+				else
+					imageReferences[use.image]++;
+			}
+
+			passes[i].culled = false;
+		}
+
+		std::vector<ImageHandle> unreferenced;
+		for (ImageHandle i = 0; i < images.size(); i++)
+		{
+			if (images[i].imported)
+				imageReferences[i]++;
+
+			if (imageReferences[i] == 0)
+				unreferenced.push_back(i);
+		}
+
+		while (!unreferenced.empty())
+		{
+			ImageHandle image = unreferenced.back();
+			unreferenced.pop_back();
+
+			for (uint32_t writer : writers[image])
+			{
+				Pass& pass = passes[writer];
+
+				if (--passReferences[writer] > 0 || pass.sideEffects || pass.culled)
+					continue;
+
+				pass.culled = true;
+
+				for (const ImageUse& use : pass.uses)
+					if (!use.write && --imageReferences[use.image] == 0)
+						unreferenced.push_back(use.image);
+			}
+		}
+
+		// Passes writing nothing survive only through their side effects
+		numCulledPasses = 0;
+		for (uint32_t i = 0; i < passes.size(); i++)
+		{
+			Pass& pass = passes[i];
+
+			if (!pass.culled && !pass.sideEffects && passReferences[i] == 0)
+				pass.culled = true;
+
+			if (pass.culled)
+				numCulledPasses++;
+		}
+	}
+
+	void RenderGraph::allocateTransientImages()
+	{
+		transientMemorySize = 0;
+		requestedTransientMemorySize = 0;
+
+		// Lifetimes in pass order, images only used by culled passes are never created
+		std::vector<bool> used(images.size(), false);
+		std::vector<VkImageUsageFlags> usages(images.size(), 0);
+
+		for (uint32_t i = 0; i < passes.size(); i++)
+		{
+			if (passes[i].culled)
+				continue;
+
+			for (const ImageUse& use : passes[i].uses)
+			{
+				Image& image = images[use.image];
+
+				if (!used[use.image])
+					image.firstPass = i;
+
+				image.lastPass = i;
+				used[use.image] = true;
+				usages[use.image] |= getAccessInfo(use.access).usage;
+			}
+		}
+
+		std::vector<ImageHandle> transients;
+		std::vector<VkMemoryRequirements> requirements(images.size());
+
+		for (ImageHandle i = 0; i < images.size(); i++)
+		{
+			Image& image = images[i];
+
+			if (image.imported || !used[i])
+				continue;
+
+			const ImageDescription& description = image.description;
+
+			VkImageCreateInfo imageInfo = {};
+			imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+			imageInfo.imageType = VK_IMAGE_TYPE_2D;
+			imageInfo.extent.width = description.width;
+			imageInfo.extent.height = description.height;
+			imageInfo.extent.depth = 1;
+			imageInfo.mipLevels = description.mipLevels;
+			imageInfo.arrayLayers = description.layers;
+			imageInfo.format = description.format;
+			imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageInfo.usage = description.usage | usages[i];
+			imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			imageInfo.samples = description.samples;
+			imageInfo.flags = description.cube ? VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT : 0;
+
+			if (vkCreateImage(context->getDevice(), &imageInfo, nullptr, &image.image) != VK_SUCCESS)
+				throw std::runtime_error("Can't create render graph image");
+
+			vkGetImageMemoryRequirements(context->getDevice(), image.image, &requirements[i]);
+			requestedTransientMemorySize += requirements[i].size;
+
+			transients.push_back(i);
+		}
+
+		// Largest first, every image goes to the first block holding no image alive at the same time.
+		// Images share the start of their block, so alignment is the one of the block
+		std::sort(transients.begin(), transients.end(), [&](ImageHandle a, ImageHandle b)
+		{
+			return requirements[a].size > requirements[b].size;
+		});
+
+		for (ImageHandle handle : transients)
+		{
+			Image& image = images[handle];
+			const VkMemoryRequirements& requirement = requirements[handle];
+
+			uint32_t blockIndex = 0;
+			for (; blockIndex < memoryBlocks.size(); blockIndex++)
+			{
+				const MemoryBlock& block = memoryBlocks[blockIndex];
+
+				if (!hasDeviceLocalMemoryType(context, block.memoryTypeBits & requirement.memoryTypeBits))
+					continue;
+
+				bool overlaps = std::any_of(block.images.begin(), block.images.end(), [&](ImageHandle other)
+				{
+					return images[other].firstPass <= image.lastPass && image.firstPass <= images[other].lastPass;
+				});
+
+				if (!overlaps)
+					break;
+			}
+
+			if (blockIndex == memoryBlocks.size())
+			{
+				MemoryBlock block;
+				block.memoryTypeBits = requirement.memoryTypeBits;
+				memoryBlocks.push_back(block);
+			}
+
+			MemoryBlock& block = memoryBlocks[blockIndex];
+			block.size = std::max(block.size, requirement.size);
+			block.memoryTypeBits &= requirement.memoryTypeBits;
+			block.images.push_back(handle);
+
+			image.memoryBlock = blockIndex;
+		}
+
+		for (MemoryBlock& block : memoryBlocks)
+		{
+			VkMemoryAllocateInfo memoryAllocateInfo = {};
+			memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			memoryAllocateInfo.allocationSize = block.size;
+			memoryAllocateInfo.memoryTypeIndex = VulkanUtils::findMemoryType(context, block.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+			if (vkAllocateMemory(context->getDevice(), &memoryAllocateInfo, nullptr, &block.memory) != VK_SUCCESS)
+				throw std::runtime_error("Can't allocate render graph memory");
+
+			transientMemorySize += block.size;
+
+			// Images of a block in pass order, each one takes over the memory of the previous one
+			std::sort(block.images.begin(), block.images.end(), [&](ImageHandle a, ImageHandle b)
+			{
+				return images[a].firstPass < images[b].firstPass;
+			});
+
+			for (size_t i = 0; i < block.images.size(); i++)
+			{
+				Image& image = images[block.images[i]];
+				image.aliasedImage = (i > 0) ? block.images[i - 1] : block.images[i];
+
+				if (vkBindImageMemory(context->getDevice(), image.image, block.memory, 0) != VK_SUCCESS)
+					throw std::runtime_error("Can't bind render graph image memory");
+
+				const ImageDescription& description = image.description;
+
+				VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D;
+				if (description.cube)
+					viewType = VK_IMAGE_VIEW_TYPE_CUBE;
+				else if (description.layers > 1)
+					viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+
+				VkImageAspectFlags aspect = isDepthFormat(description.format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+
+				image.imageView = VulkanUtils::createImageView(context, image.image, description.format, aspect, viewType, 0, description.mipLevels, 0, description.layers);
+			}
+		}
+	}
+
+	void RenderGraph::computeBarriers()
+	{
+		std::vector<ImageState> states(images.size());
+		for (ImageHandle i = 0; i < images.size(); i++)
+			states[i].layout = images[i].imported ? images[i].currentLayout : VK_IMAGE_LAYOUT_UNDEFINED;
+
+		numBarriers = 0;
+
+		for (uint32_t i = 0; i < passes.size(); i++)
+		{
+			Pass& pass = passes[i];
+
+			pass.barriers.clear();
+			pass.srcStages = 0;
+			pass.dstStages = 0;
+
+			if (pass.culled)
+				continue;
+
+			for (auto it = pass.uses.begin(); it != pass.uses.end(); ++it)
+			{
+				const ImageUse& use = *it;
+				const Image& image = images[use.image];
+				ImageState& state = states[use.image];
+				AccessInfo info = getAccessInfo(use.access);
+
+				// A pass declaring an image twice gets the union of both accesses, in the layout they share
+				auto barrier = std::find_if(pass.barriers.begin(), pass.barriers.end(), [&](const VkImageMemoryBarrier& other) { return other.image == image.image; });
+				if (barrier != pass.barriers.end())
+				{
+					barrier->dstAccessMask |= info.access;
+					pass.dstStages |= info.stages;
+
+					state.stages |= info.stages;
+					state.writeAccess |= use.write ? info.access : 0;
+					continue;
+				}
+
+				bool usedInPass = std::any_of(pass.uses.begin(), it, [&](const ImageUse& other) { return other.image == use.image; });
+
+				VkPipelineStageFlags srcStages = state.stages;
+				VkAccessFlags srcAccess = state.writeAccess;
+
+				// The first use of an aliased image waits for the last use of the image before it in memory
+				bool firstUse = !image.imported && image.firstPass == i && state.stages == 0;
+				if (firstUse && image.aliasedImage != use.image)
+				{
+					const ImageState& aliased = states[image.aliasedImage];
+					srcStages = aliased.stages;
+					srcAccess = aliased.writeAccess;
+				}
+
+				// Reads after reads in the same layout need nothing, they extend the scope a later write waits for
+				bool hazard = state.layout != info.layout || state.writeAccess != 0 || use.write;
+				if (!hazard)
+				{
+					state.stages |= info.stages;
+					continue;
+				}
+
+				if (state.layout != info.layout || srcAccess != 0 || srcStages != 0)
+				{
+					VkImageMemoryBarrier barrier = {};
+					barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+					barrier.oldLayout = state.layout;
+					barrier.newLayout = info.layout;
+					barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+					barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+					barrier.srcAccessMask = srcAccess;
+					barrier.dstAccessMask = info.access;
+					barrier.image = image.image;
+					barrier.subresourceRange.aspectMask = isDepthFormat(image.description.format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+					barrier.subresourceRange.baseMipLevel = 0;
+					barrier.subresourceRange.levelCount = image.description.mipLevels;
+					barrier.subresourceRange.baseArrayLayer = 0;
+					barrier.subresourceRange.layerCount = image.description.layers;
+
+					if (VulkanUtils::hasStencilComponent(image.description.format))
+						barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+
+					pass.barriers.push_back(barrier);
+					pass.srcStages |= srcStages;
+					pass.dstStages |= info.stages;
+				}
+
+				// Later passes wait for every access of this one
+				VkPipelineStageFlags passStages = usedInPass ? state.stages : 0;
+				VkAccessFlags passWriteAccess = usedInPass ? state.writeAccess : 0;
+
+				state.layout = info.layout;
+				state.stages = passStages | info.stages;
+				state.writeAccess = passWriteAccess | (use.write ? info.access : 0);
+			}
+
+			// Nothing to wait for means the first use of images, the top of the pipe is enough
+			if (!pass.barriers.empty() && pass.srcStages == 0)
+				pass.srcStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+
+			numBarriers += static_cast<uint32_t>(pass.barriers.size());
+		}
+
+		finalBarriers.clear();
+		finalSrcStages = 0;
+
+		for (ImageHandle i = 0; i < images.size(); i++)
+		{
+			const Image& image = images[i];
+			const ImageState& state = states[i];
+
+			if (!image.imported || (state.layout == image.finalLayout && state.writeAccess == 0))
+				continue;
+
+			VkImageMemoryBarrier barrier = {};
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.oldLayout = state.layout;
+			barrier.newLayout = image.finalLayout;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.srcAccessMask = state.writeAccess;
+			barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+			barrier.image = image.image;
+			barrier.subresourceRange.aspectMask = isDepthFormat(image.description.format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+			barrier.subresourceRange.baseMipLevel = 0;
+			barrier.subresourceRange.levelCount = image.description.mipLevels;
+			barrier.subresourceRange.baseArrayLayer = 0;
+			barrier.subresourceRange.layerCount = image.description.layers;
+
+			if (VulkanUtils::hasStencilComponent(image.description.format))
+				barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+
+			finalBarriers.push_back(barrier);
+			finalSrcStages |= (state.stages != 0) ? state.stages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		}
+
+		numBarriers += static_cast<uint32_t>(finalBarriers.size());
+	}
+
+	void RenderGraph::destroyTransientImages()
+	{
+		for (Image& image : images)
+		{
+			if (image.imported)
+				continue;
+
+			vkDestroyImageView(context->getDevice(), image.imageView, nullptr);
+			image.imageView = VK_NULL_HANDLE;
+
+			vkDestroyImage(context->getDevice(), image.image, nullptr);
+			image.image = VK_NULL_HANDLE;
+		}
+
+		for (MemoryBlock& block : memoryBlocks)
+			vkFreeMemory(context->getDevice(), block.memory, nullptr);
+
+		memoryBlocks.clear();
+		transientMemorySize = 0;
+		requestedTransientMemorySize = 0;
+	}
+
+	void RenderGraph::execute(VkCommandBuffer commandBuffer) const
+	{
+		if (!compiled)
+			throw std::runtime_error("Can't execute a render graph before compiling it");
+
+		for (const Pass& pass : passes)
+		{
+			if (pass.culled)
+				continue;
+
+			if (!pass.barriers.empty())
+				vkCmdPipelineBarrier(
+					commandBuffer,
+					pass.srcStages, pass.dstStages,
+					0,
+					0, nullptr,
+					0, nullptr,
+					static_cast<uint32_t>(pass.barriers.size()), pass.barriers.data());
+
+			pass.execute(commandBuffer, *this);
+		}
+
+		if (!finalBarriers.empty())
+			vkCmdPipelineBarrier(
+				commandBuffer,
+				finalSrcStages, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+				0,
+				0, nullptr,
+				0, nullptr,
+				static_cast<uint32_t>(finalBarriers.size()), finalBarriers.data());
+	}
+
+	void RenderGraph::executeImmediate() const
+	{
+		VkCommandBuffer commandBuffer = VulkanUtils::beginSingleTimeCommands(context);
+		execute(commandBuffer);
+		VulkanUtils::endSingleTimeCommands(context, commandBuffer);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+class Texture;
+
+namespace RHI
+{
+	class VulkanContext;
+
+	// Passes declare the images they read and write, the graph works out everything in between.
+	// compile() culls passes whose results are never used, places a single batched barrier before every pass
+	// and binds transient images whose lifetimes don't overlap to the same memory.
+	// Imported images stay owned by the caller, the graph only tracks their layout and leaves them in their final one
+	class RenderGraph
+	{
+	public:
+		typedef uint32_t ImageHandle;
+
+		enum class Access
+		{
+			ColorAttachment = 0,
+			DepthStencilAttachment,
+			SampledRead,
+			StorageRead,
+			StorageWrite,
+			TransferSrc,
+			TransferDst,
+		};
+
+		struct ImageDescription
+		{
+			VkFormat format{ VK_FORMAT_UNDEFINED };
+			uint32_t width{ 0 };
+			uint32_t height{ 0 };
+			uint32_t mipLevels{ 1 };
+			uint32_t layers{ 1 };
+			VkSampleCountFlagBits samples{ VK_SAMPLE_COUNT_1_BIT };
+			VkImageUsageFlags usage{ 0 }; // on top of the usage implied by the declared accesses
+			bool cube{ false };
+		};
+
+		class PassBuilder
+		{
+		public:
+			void read(ImageHandle image, Access access);
+			void write(ImageHandle image, Access access);
+
+			// The pass does something outside the graph and is never culled
+			void setSideEffects();
+
+		private:
+			friend class RenderGraph;
+
+			// Throws when the pass already uses the image in another layout
+			void addUse(ImageHandle image, Access access, bool write);
+
+			PassBuilder(RenderGraph* graph, uint32_t pass)
+				: graph(graph), pass(pass) { }
+
+			RenderGraph* graph{ nullptr };
+			uint32_t pass{ 0 };
+		};
+
+		typedef std::function<void(PassBuilder&)> SetupFunction;
+		typedef std::function<void(VkCommandBuffer, const RenderGraph&)> ExecuteFunction;
+
+		RenderGraph(const VulkanContext* context)
+			: context(context) { }
+
+		~RenderGraph();
+
+		// The image is in currentLayout when the graph starts and is left in finalLayout
+		ImageHandle importImage(const char* name, VkImage image, VkImageView imageView, VkFormat format, uint32_t mipLevels, uint32_t layers, VkImageLayout currentLayout, VkImageLayout finalLayout);
+		ImageHandle importTexture(const char* name, const Texture& texture, VkImageLayout layout);
+
+		// Created by compile(), its content is undefined at its first use
+		ImageHandle createImage(const char* name, const ImageDescription& description);
+
+		// Passes run in the order they are added, setup is called right away
+		void addPass(const char* name, const SetupFunction& setup, const ExecuteFunction& execute);
+
+		void compile();
+
+		// A compiled graph can be executed any number of times
+		void execute(VkCommandBuffer commandBuffer) const;
+		void executeImmediate() const;
+
+		// Forgets every pass and image, transient memory is released
+		void clear();
+
+		VkImage getImage(ImageHandle image) const;
+		VkImageView getImageView(ImageHandle image) const;
+
+		inline uint32_t getNumPasses() const { return static_cast<uint32_t>(passes.size()); }
+		inline uint32_t getNumCulledPasses() const { return numCulledPasses; }
+		inline uint32_t getNumBarriers() const { return numBarriers; }
+		inline VkDeviceSize getTransientMemorySize() const { return transientMemorySize; }
+		inline VkDeviceSize getRequestedTransientMemorySize() const { return requestedTransientMemorySize; }
+
+	private:
+		struct ImageUse
+		{
+			ImageHandle image;
+			Access access;
+			bool write;
+		};
+
+		struct Pass
+		{
+			std::string name;
+			ExecuteFunction execute;
+			std::vector<ImageUse> uses;
+			bool sideEffects{ false };
+			bool culled{ false };
+
+			// Compiled
+			std::vector<VkImageMemoryBarrier> barriers;
+			VkPipelineStageFlags srcStages{ 0 };
+			VkPipelineStageFlags dstStages{ 0 };
+		};
+
+		// Synchronization scope of the accesses since the last write
+		struct ImageState
+		{
+			VkImageLayout layout{ VK_IMAGE_LAYOUT_UNDEFINED };
+			VkPipelineStageFlags stages{ 0 };
+			VkAccessFlags writeAccess{ 0 };
+		};
+
+		struct Image
+		{
+			std::string name;
+			ImageDescription description;
+			bool imported{ false };
+			VkImageLayout currentLayout{ VK_IMAGE_LAYOUT_UNDEFINED };
+			VkImageLayout finalLayout{ VK_IMAGE_LAYOUT_UNDEFINED };
+
+			VkImage image{ VK_NULL_HANDLE };
+			VkImageView imageView{ VK_NULL_HANDLE };
+
+			// Compiled, transient images only
+			uint32_t firstPass{ 0 };
+			uint32_t lastPass{ 0 };
+			uint32_t memoryBlock{ 0 };
+			ImageHandle aliasedImage{ 0 }; // previous image of the memory block, itself when none
+		};
+
+		struct MemoryBlock
+		{
+			VkDeviceMemory memory{ VK_NULL_HANDLE };
+			VkDeviceSize size{ 0 };
+			uint32_t memoryTypeBits{ 0 };
+			std::vector<ImageHandle> images;
+		};
+
+		void cullPasses();
+		void allocateTransientImages();
+		void computeBarriers();
+		void destroyTransientImages();
+
+	private:
+		const VulkanContext* context{ nullptr };
+
+		std::vector<Pass> passes;
+		std::vector<Image> images;
+		std::vector<MemoryBlock> memoryBlocks;
+
+		// Imported images back to their final layout
+		std::vector<VkImageMemoryBarrier> finalBarriers;
+		VkPipelineStageFlags finalSrcStages{ 0 };
+
+		uint32_t numCulledPasses{ 0 };
+		uint32_t numBarriers{ 0 };
+		VkDeviceSize transientMemorySize{ 0 };
+		VkDeviceSize requestedTransientMemorySize{ 0 };
+		bool compiled{ false };
+	};
+}
\ No newline at end of file
@@ -2,12 +2,34 @@
 #include "VulkanUtils.h"
 #include "VulkanContext.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <vector>
 
 namespace RHI
 {
+	// SPIR-V stored next to the source file, bump the version whenever the layout or the compile options change
+	static const char* SHADER_CACHE_EXTENSION = ".spvcache";
+	static const uint32_t SHADER_CACHE_MAGIC = 0x43565053; // "SPVC"
+	static const uint32_t SHADER_CACHE_VERSION = 1;
+
+	// Root of #include <...>, a file system path so mounts decide where it comes from
+	static const char* SHADER_INCLUDE_DIRECTORY = "Assert/Shader/";
+
+	// Followed by the include paths, then the SPIR-V
+	struct ShaderCacheHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t sourceHash;
+		uint32_t numIncludes;
+		uint32_t padding;
+		uint64_t spirvSize;
+	};
+
 	static shaderc_shader_kind vulkan_to_shaderc_kind(ShaderKind kind)
 	{
 		switch (kind)
@@ -43,7 +65,7 @@ namespace RHI
 		{
 		case shaderc_include_type_standard:
 		{
-			targetDir = "Assert/Shader/";
+			targetDir = SHADER_INCLUDE_DIRECTORY;
 		}
 		break;
 
@@ -58,22 +80,23 @@ namespace RHI
 		break;
 		}
 
-		std::string targetPath = targetDir + std::string(requestedSource);
+		std::string targetPath = FileSystem::normalizePath(targetDir + std::string(requestedSource));
 
-		std::ifstream file(targetPath, std::ios::ate | std::ios::binary);
+		// Includes are part of the cache key, see compileToSPIRV()
+		if (userData)
+			static_cast<std::vector<std::string>*>(userData)->push_back(targetPath);
 
-		if (!file.is_open())
+		// Shared includes stay in the file system cache from one shader to the next
+		FileData file;
+		if (!FileSystem::get().read(targetPath, file))
 		{
 			std::cerr << "vulkan_include_resolver(): can't load include at \"" << targetPath << "\"" << std::endl;
 			return result;
 		}
 
-		size_t fileSize = static_cast<size_t>(file.tellg());
+		size_t fileSize = file.getSize();
 		char* buffer = new char[fileSize];
-
-		file.seekg(0);
-		file.read(buffer, fileSize);
-		file.close();
+		memcpy(buffer, file.getData(), fileSize);
 
 		char* path = new char[targetPath.size() + 1];
 		memcpy(path, targetPath.c_str(), targetPath.size());
@@ -94,67 +117,61 @@ namespace RHI
 		delete result;
 	}
 
-	// -------------------- Shader --------------------
-
-	Shader::~Shader()
-	{
-		clear();
-	}
-
-	bool Shader::compileFromFile(const char* path)
+	static bool readSource(const char* path, std::vector<char>& source)
 	{
-		std::ifstream file(path, std::ios::ate | std::ios::binary);
-
-		if (!file.is_open())
+		FileData file;
+		if (!FileSystem::get().read(path, file))
 		{
 			std::cerr << "Shader::loadFromFile(): can't load shader at \"" << path << "\"" << std::endl;
 			return false;
 		}
 
-		size_t fileSize = static_cast<size_t>(file.tellg());
-		std::vector<char> buffer(fileSize);
+		const char* data = reinterpret_cast<const char*>(file.getData());
+		source.assign(data, data + file.getSize());
 
-		file.seekg(0);
-		file.read(buffer.data(), fileSize);
-		file.close();
-
-		return compileFromSourceInternal(path, buffer.data(), buffer.size(), shaderc_glsl_infer_from_source);
+		return true;
 	}
 
-	bool Shader::compileFromFile(const char* path, ShaderKind kind)
+	// Source and every include it pulled in, in the order the compiler asked for them
+	// Defines of the variant too, the variant without any hashes like before variants existed
+	static bool hashSources(const std::vector<char>& source, const std::vector<std::string>& includes, shaderc_shader_kind kind, const std::string& variant, uint64_t& hash)
 	{
-		std::ifstream file(path, std::ios::ate | std::ios::binary);
+		uint32_t key[] = { SHADER_CACHE_VERSION, static_cast<uint32_t>(kind) };
+		hash = hashFNV1a(key, sizeof(key));
+		hash = hashFNV1a(variant.data(), variant.size(), hash);
+		hash = hashFNV1a(source.data(), source.size(), hash);
 
-		if (!file.is_open())
-		{
-			std::cerr << "Shader::loadFromFile(): can't load shader at \"" << path << "\"" << std::endl;
-			return false;
-		}
-
-		size_t fileSize = static_cast<size_t>(file.tellg());
-		std::vector<char> buffer(fileSize);
+		for (const std::string& include : includes)
+			if (!hashFile(include, hash))
+				return false;
 
-		file.seekg(0);
-		file.read(buffer.data(), fileSize);
-		file.close();
-
-		return compileFromSourceInternal(path, buffer.data(), buffer.size(), vulkan_to_shaderc_kind(kind));
+		return true;
 	}
 
-	bool Shader::compileFromSourceInternal(const char* path, const char* sourceData, size_t sourceSize, shaderc_shader_kind kind)
+	static bool compileToSPIRV(const char* path, const std::vector<char>& source, shaderc_shader_kind kind, const std::vector<std::string>& defines, std::vector<uint32_t>& spirv, std::vector<std::string>& includes)
 	{
 		// convert glsl/hlsl code to SPIR-V bytecode
 		shaderc_compiler_t compiler = shaderc_compiler_initialize();
 		shaderc_compile_options_t options = shaderc_compile_options_initialize();
 
 		// set compile options
-		shaderc_compile_options_set_include_callbacks(options, vulkan_include_resolver, vulkan_include_result_releaser, nullptr);
+		shaderc_compile_options_set_include_callbacks(options, vulkan_include_resolver, vulkan_include_result_releaser, &includes);
+
+		// NAME or NAME=VALUE, like -D
+		for (const std::string& define : defines)
+		{
+			size_t separator = define.find('=');
+			size_t nameLength = (separator != std::string::npos) ? separator : define.size();
+			size_t valueOffset = (separator != std::string::npos) ? separator + 1 : define.size();
+
+			shaderc_compile_options_add_macro_definition(options, define.c_str(), nameLength, define.c_str() + valueOffset, define.size() - valueOffset);
+		}
 
 		// compiler the shaders
 		shaderc_compilation_result_t result = shaderc_compile_into_spv(
 			compiler,
-			sourceData, sourceSize,
-			shaderc_glsl_infer_from_source,
+			source.data(), source.size(),
+			kind,
 			path,
 			"main",
 			options);
@@ -173,27 +190,241 @@ namespace RHI
 
 		size_t size = shaderc_result_get_length(result);
 		const uint32_t* data = reinterpret_cast<const uint32_t*>(shaderc_result_get_bytes(result));
-
-		clear();
-		shaderModule = VulkanUtils::createShaderModule(context, data, size);
+		spirv.assign(data, data + size / sizeof(uint32_t));
 
 		shaderc_result_release(result);
 		shaderc_compile_options_release(options);
 		shaderc_compiler_release(compiler);
 
-		shaderPath = path;
+		return true;
+	}
+
+	static bool loadFromCache(const std::string& path, const std::vector<char>& source, shaderc_shader_kind kind, const std::string& variant, std::vector<uint32_t>& spirv, std::vector<std::string>& includes)
+	{
+		FileData file;
+		if (!FileSystem::get().read(path, file) || file.getSize() < sizeof(ShaderCacheHeader))
+			return false;
+
+		ShaderCacheHeader header;
+		memcpy(&header, file.getData(), sizeof(ShaderCacheHeader));
+
+		if (header.magic != SHADER_CACHE_MAGIC || header.version != SHADER_CACHE_VERSION)
+			return false;
+
+		// Include paths, each one prefixed with its length
+		includes.clear();
+		size_t offset = sizeof(ShaderCacheHeader);
+
+		for (uint32_t i = 0; i < header.numIncludes; i++)
+		{
+			uint32_t length = 0;
+			if (file.getSize() - offset < sizeof(uint32_t))
+				return false;
+
+			memcpy(&length, file.getData() + offset, sizeof(uint32_t));
+			offset += sizeof(uint32_t);
+
+			if (file.getSize() - offset < length)
+				return false;
+
+			includes.emplace_back(reinterpret_cast<const char*>(file.getData() + offset), length);
+			offset += length;
+		}
+
+		// Stale cache, the source, one of its includes or the kind changed
+		uint64_t sourceHash = 0;
+		if (!hashSources(source, includes, kind, variant, sourceHash) || sourceHash != header.sourceHash)
+			return false;
+
+		if (header.spirvSize % sizeof(uint32_t) != 0 || file.getSize() - offset < header.spirvSize)
+			return false;
+
+		spirv.resize(header.spirvSize / sizeof(uint32_t));
+		memcpy(spirv.data(), file.getData() + offset, header.spirvSize);
+
+		return true;
+	}
+
+	static bool saveToCache(const std::string& path, const std::vector<char>& source, shaderc_shader_kind kind, const std::string& variant, const std::vector<uint32_t>& spirv, const std::vector<std::string>& includes)
+	{
+		ShaderCacheHeader header = {};
+		header.magic = SHADER_CACHE_MAGIC;
+		header.version = SHADER_CACHE_VERSION;
+		header.numIncludes = static_cast<uint32_t>(includes.size());
+		header.spirvSize = sizeof(uint32_t) * spirv.size();
+
+		if (!hashSources(source, includes, kind, variant, header.sourceHash))
+			return false;
+
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+		{
+			std::cerr << "Shader::saveToCache(): can't open \"" << path << "\"" << std::endl;
+			return false;
+		}
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(ShaderCacheHeader));
+
+		for (const std::string& include : includes)
+		{
+			uint32_t length = static_cast<uint32_t>(include.size());
+			file.write(reinterpret_cast<const char*>(&length), sizeof(uint32_t));
+			file.write(include.data(), length);
+		}
+
+		file.write(reinterpret_cast<const char*>(spirv.data()), static_cast<std::streamsize>(header.spirvSize));
+
+		if (!file.good())
+		{
+			std::cerr << "Shader::saveToCache(): can't write \"" << path << "\"" << std::endl;
+			return false;
+		}
+
+		FileSystem::get().invalidate(path);
+		return true;
+	}
+
+	// Every variant of a source has its own cache next to it, the variant without defines keeps the plain name
+	static std::string getCachePath(const char* path, const std::string& variant)
+	{
+		if (variant.empty())
+			return std::string(path) + SHADER_CACHE_EXTENSION;
+
+		char name[17];
+		snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hashFNV1a(variant.data(), variant.size())));
+
+		return std::string(path) + "." + name + SHADER_CACHE_EXTENSION;
+	}
+
+	// -------------------- Shader --------------------
+
+	Shader::~Shader()
+	{
+		clear();
+	}
+
+	bool Shader::compileFromFile(const char* path)
+	{
+		return compileFromFileInternal(path, shaderc_glsl_infer_from_source, {});
+	}
+
+	bool Shader::compileFromFile(const char* path, ShaderKind kind)
+	{
+		return compileFromFileInternal(path, vulkan_to_shaderc_kind(kind), {});
+	}
+
+	bool Shader::compileFromFile(const char* path, const std::vector<std::string>& defines)
+	{
+		return compileFromFileInternal(path, shaderc_glsl_infer_from_source, sortDefines(defines));
+	}
+
+	std::vector<std::string> Shader::sortDefines(const std::vector<std::string>& defines)
+	{
+		std::vector<std::string> sorted = defines;
+		std::sort(sorted.begin(), sorted.end());
+		sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+		return sorted;
+	}
+
+	std::string Shader::getVariantName(const std::vector<std::string>& defines)
+	{
+		std::string name;
+		for (const std::string& define : sortDefines(defines))
+		{
+			if (!name.empty())
+				name += ";";
+
+			name += define;
+		}
+
+		return name;
+	}
+
+	CookResult Shader::cookFromFile(const char* path, const std::vector<std::string>& defines)
+	{
+		std::vector<char> source;
+		if (!readSource(path, source))
+			return CookResult::Failed;
+
+		std::vector<std::string> sortedDefines = sortDefines(defines);
+		std::string variant = getVariantName(sortedDefines);
+		std::string cachePath = getCachePath(path, variant);
+
+		std::vector<uint32_t> spirv;
+		std::vector<std::string> includes;
+		if (loadFromCache(cachePath, source, shaderc_glsl_infer_from_source, variant, spirv, includes))
+			return CookResult::UpToDate;
+
+		includes.clear();
+		if (!compileToSPIRV(path, source, shaderc_glsl_infer_from_source, sortedDefines, spirv, includes))
+			return CookResult::Failed;
+
+		if (!saveToCache(cachePath, source, shaderc_glsl_infer_from_source, variant, spirv, includes))
+			return CookResult::Failed;
+
+		return CookResult::Cooked;
+	}
+
+	bool Shader::compileFromFileInternal(const char* path, shaderc_shader_kind kind, const std::vector<std::string>& sortedDefines)
+	{
+		std::vector<char> source;
+		if (!readSource(path, source))
+			return false;
+
+		std::string variant = getVariantName(sortedDefines);
+		std::string cachePath = getCachePath(path, variant);
+
+		std::vector<uint32_t> spirv;
+		std::vector<std::string> sourceIncludes;
+		if (!loadFromCache(cachePath, source, kind, variant, spirv, sourceIncludes))
+		{
+			sourceIncludes.clear();
+			if (!compileToSPIRV(path, source, kind, sortedDefines, spirv, sourceIncludes))
+				return false;
+
+			saveToCache(cachePath, source, kind, variant, spirv, sourceIncludes);
+		}
+
+		// Reflected before anything is replaced, so a failed reload keeps the previous module
+		ShaderReflection spirvReflection;
+		if (!spirvReflection.reflect(spirv.data(), spirv.size()))
+		{
+			std::cerr << "Shader::compileFromFileInternal(): can't reflect \"" << path << "\"" << std::endl;
+			return false;
+		}
+
+		clear();
+		shaderModule = VulkanUtils::createShaderModule(context, spirv.data(), sizeof(uint32_t) * spirv.size());
+		reflection = std::move(spirvReflection);
+
+		shaderPath = FileSystem::normalizePath(path);
+		shaderKind = kind;
+		defines = sortedDefines;
+
+		// Files included more than once are listed once
+		std::sort(sourceIncludes.begin(), sourceIncludes.end());
+		sourceIncludes.erase(std::unique(sourceIncludes.begin(), sourceIncludes.end()), sourceIncludes.end());
+		includes = std::move(sourceIncludes);
 
 		return true;
 	}
 
 	bool Shader::reload()
 	{
-		return compileFromFile(shaderPath.c_str());
+		// The file system cache still holds the sources as they were before the edit
+		FileSystem::get().invalidate(shaderPath);
+
+		for (const std::string& include : includes)
+			FileSystem::get().invalidate(include);
+
+		return compileFromFileInternal(shaderPath.c_str(), shaderKind, defines);
 	}
 
 	void Shader::clear()
 	{
 		vkDestroyShaderModule(context->getDevice(), shaderModule, nullptr);
 		shaderModule = VK_NULL_HANDLE;
+		reflection.clear();
 	}
 }
\ No newline at end of file
@@ -2,9 +2,13 @@
 
 #include <vulkan/vulkan.h>
 #include <string>
+#include <vector>
 
 #include <shaderc/shaderc.h>
 
+#include "../Common/AssetCache.h"
+#include "ShaderReflection.h"
+
 namespace RHI
 {
 	enum class ShaderKind
@@ -29,18 +33,44 @@ namespace RHI
 
 		bool compileFromFile(const char* path);
 		bool compileFromFile(const char* path, ShaderKind kind);
+
+		// Variant of the source compiled with keyword defines, "NAME" or "NAME=VALUE". Every define set has its own
+		// SPIR-V cache, the order of the defines doesn't matter
+		bool compileFromFile(const char* path, const std::vector<std::string>& defines);
+
+		// Compiles the file into its SPIR-V cache unless the cache is up to date, includes are tracked as well
+		static CookResult cookFromFile(const char* path, const std::vector<std::string>& defines = {});
+
+		// Sorted defines without duplicates, and the key naming the variant they compile. Empty without defines
+		static std::vector<std::string> sortDefines(const std::vector<std::string>& defines);
+		static std::string getVariantName(const std::vector<std::string>& defines);
+
+		// Compiles the same file and variant again, the source and its includes are read past the file system cache
 		bool reload();
 		void clear();
 
 		inline VkShaderModule getShaderModule() const { return shaderModule; }
 
+		// File system paths of the source and of every file it includes, nested includes too.
+		// A change to any of them means the shader has to be compiled again
+		inline const std::string& getPath() const { return shaderPath; }
+		inline const std::vector<std::string>& getIncludes() const { return includes; }
+		inline const std::vector<std::string>& getDefines() const { return defines; }
+
+		// Interface of the compiled module, layouts and vertex input are checked against it
+		inline const ShaderReflection& getReflection() const { return reflection; }
+
 	private:
-		bool compileFromSourceInternal(const char* path, const char* sourceData, size_t sourceSize, shaderc_shader_kind kind);
+		bool compileFromFileInternal(const char* path, shaderc_shader_kind kind, const std::vector<std::string>& sortedDefines);
 
 	private:
 		const VulkanContext* context;
 
 		std::string shaderPath;
+		shaderc_shader_kind shaderKind{ shaderc_glsl_infer_from_source };
+		std::vector<std::string> includes;
+		std::vector<std::string> defines; // sorted, reload() compiles the same variant
+		ShaderReflection reflection;
 		VkShaderModule shaderModule{ VK_NULL_HANDLE };
 	};
 
@@ -0,0 +1,224 @@
+#include "ShaderReflection.h"
+
+#include <spirv_cross/spirv_cross.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+namespace RHI
+{
+	static VkShaderStageFlagBits getShaderStage(spv::ExecutionModel model)
+	{
+		switch (model)
+		{
+		case spv::ExecutionModelVertex: return VK_SHADER_STAGE_VERTEX_BIT;
+		case spv::ExecutionModelTessellationControl: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+		case spv::ExecutionModelTessellationEvaluation: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+		case spv::ExecutionModelGeometry: return VK_SHADER_STAGE_GEOMETRY_BIT;
+		case spv::ExecutionModelFragment: return VK_SHADER_STAGE_FRAGMENT_BIT;
+		case spv::ExecutionModelGLCompute: return VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+
+		throw std::runtime_error("Unsupported shader stage");
+	}
+
+	// 32-bit scalars and vectors, what the vertex shaders read once the attributes are unpacked
+	static VkFormat getVertexFormat(const spirv_cross::SPIRType& type)
+	{
+		static const VkFormat floatFormats[] = { VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT };
+		static const VkFormat intFormats[] = { VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT };
+		static const VkFormat uintFormats[] = { VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT };
+
+		if (type.vecsize < 1 || type.vecsize > 4)
+			return VK_FORMAT_UNDEFINED;
+
+		switch (type.basetype)
+		{
+		case spirv_cross::SPIRType::Float: return floatFormats[type.vecsize - 1];
+		case spirv_cross::SPIRType::Int: return intFormats[type.vecsize - 1];
+		case spirv_cross::SPIRType::UInt: return uintFormats[type.vecsize - 1];
+		default: return VK_FORMAT_UNDEFINED;
+		}
+	}
+
+	// Arrays of resources take one descriptor per element
+	static uint32_t getArraySize(const spirv_cross::SPIRType& type)
+	{
+		uint32_t size = 1;
+		for (uint32_t dimension : type.array)
+			size *= std::max(dimension, 1u); // runtime sized arrays take one
+
+		return size;
+	}
+
+	bool ShaderReflection::reflect(const uint32_t* spirv, size_t numWords)
+	{
+		clear();
+
+		try
+		{
+			spirv_cross::Compiler compiler(spirv, numWords);
+			spirv_cross::ShaderResources resources = compiler.get_shader_resources();
+
+			stages = getShaderStage(compiler.get_execution_model());
+
+			auto addBindings = [&](const spirv_cross::SmallVector<spirv_cross::Resource>& resources, VkDescriptorType type, VkDescriptorType bufferType)
+			{
+				for (const spirv_cross::Resource& resource : resources)
+				{
+					const spirv_cross::SPIRType& resourceType = compiler.get_type(resource.type_id);
+
+					ShaderBinding binding;
+					binding.set = compiler.get_decoration(resource.id, spv::DecorationDescriptorSet);
+					binding.binding = compiler.get_decoration(resource.id, spv::DecorationBinding);
+					binding.type = (resourceType.basetype == spirv_cross::SPIRType::Image && resourceType.image.dim == spv::DimBuffer) ? bufferType : type;
+					binding.count = getArraySize(resourceType);
+					binding.stages = stages;
+
+					bindings.push_back(binding);
+				}
+			};
+
+			addBindings(resources.uniform_buffers, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+			addBindings(resources.storage_buffers, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+			addBindings(resources.sampled_images, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER);
+			addBindings(resources.separate_images, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER);
+			addBindings(resources.separate_samplers, VK_DESCRIPTOR_TYPE_SAMPLER, VK_DESCRIPTOR_TYPE_SAMPLER);
+			addBindings(resources.storage_images, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER);
+			addBindings(resources.subpass_inputs, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT);
+
+			std::sort(bindings.begin(), bindings.end(), [](const ShaderBinding& a, const ShaderBinding& b)
+			{
+				return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+			});
+
+			// A stage has one push constant block at most
+			for (const spirv_cross::Resource& resource : resources.push_constant_buffers)
+			{
+				pushConstantRange.stageFlags = stages;
+				pushConstantRange.offset = 0;
+				pushConstantRange.size = static_cast<uint32_t>(compiler.get_declared_struct_size(compiler.get_type(resource.base_type_id)));
+			}
+
+			if (stages == VK_SHADER_STAGE_VERTEX_BIT)
+				for (const spirv_cross::Resource& resource : resources.stage_inputs)
+				{
+					ShaderVertexInput input;
+					input.location = compiler.get_decoration(resource.id, spv::DecorationLocation);
+					input.format = getVertexFormat(compiler.get_type(resource.type_id));
+
+					vertexInputs.push_back(input);
+				}
+
+			if (stages == VK_SHADER_STAGE_FRAGMENT_BIT)
+				for (const spirv_cross::Resource& resource : resources.stage_outputs)
+				{
+					uint32_t location = compiler.get_decoration(resource.id, spv::DecorationLocation);
+					numOutputs = std::max(numOutputs, location + getArraySize(compiler.get_type(resource.type_id)));
+				}
+		}
+		catch (const std::exception& exception)
+		{
+			std::cerr << "ShaderReflection::reflect(): " << exception.what() << std::endl;
+			clear();
+			return false;
+		}
+
+		return true;
+	}
+
+	void ShaderReflection::clear()
+	{
+		stages = 0;
+		bindings.clear();
+		pushConstantRange = { 0, 0, 0 };
+		vertexInputs.clear();
+		numOutputs = 0;
+	}
+
+	bool ShaderReflection::merge(const ShaderReflection& other)
+	{
+		bool merged = true;
+
+		for (const ShaderBinding& otherBinding : other.bindings)
+		{
+			auto it = std::lower_bound(bindings.begin(), bindings.end(), otherBinding, [](const ShaderBinding& a, const ShaderBinding& b)
+			{
+				return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+			});
+
+			if (it == bindings.end() || it->set != otherBinding.set || it->binding != otherBinding.binding)
+			{
+				bindings.insert(it, otherBinding);
+				continue;
+			}
+
+			if (it->type != otherBinding.type)
+			{
+				std::cerr << "ShaderReflection::merge(): set " << otherBinding.set << " binding " << otherBinding.binding << " has another type in another stage" << std::endl;
+				merged = false;
+				continue;
+			}
+
+			it->stages |= otherBinding.stages;
+			it->count = std::max(it->count, otherBinding.count);
+		}
+
+		// One range covering the blocks of every stage, they all start at offset 0
+		if (other.pushConstantRange.size > 0)
+		{
+			pushConstantRange.stageFlags |= other.pushConstantRange.stageFlags;
+			pushConstantRange.size = std::max(pushConstantRange.size, other.pushConstantRange.size);
+		}
+
+		if (vertexInputs.empty())
+			vertexInputs = other.vertexInputs;
+
+		stages |= other.stages;
+		numOutputs = std::max(numOutputs, other.numOutputs);
+
+		return merged;
+	}
+
+	bool ShaderReflection::matchesVertexInput(const std::vector<VkVertexInputAttributeDescription>& attributes) const
+	{
+		for (const ShaderVertexInput& input : vertexInputs)
+		{
+			auto it = std::find_if(attributes.begin(), attributes.end(), [&input](const VkVertexInputAttributeDescription& attribute) { return attribute.location == input.location; });
+			if (it == attributes.end())
+			{
+				std::cerr << "ShaderReflection::matchesVertexInput(): nothing feeds location " << input.location << std::endl;
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	std::vector<VkDescriptorSetLayoutBinding> ShaderReflection::getSetBindings(uint32_t set) const
+	{
+		std::vector<VkDescriptorSetLayoutBinding> setBindings;
+
+		for (const ShaderBinding& binding : bindings)
+		{
+			if (binding.set != set)
+				continue;
+
+			VkDescriptorSetLayoutBinding layoutBinding = {};
+			layoutBinding.binding = binding.binding;
+			layoutBinding.descriptorType = binding.type;
+			layoutBinding.descriptorCount = binding.count;
+			layoutBinding.stageFlags = binding.stages;
+
+			setBindings.push_back(layoutBinding);
+		}
+
+		return setBindings;
+	}
+
+	uint32_t ShaderReflection::getNumSets() const
+	{
+		return bindings.empty() ? 0 : bindings.back().set + 1;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace RHI
+{
+	struct ShaderBinding
+	{
+		uint32_t set{ 0 };
+		uint32_t binding{ 0 };
+		VkDescriptorType type{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER };
+		uint32_t count{ 1 };
+		VkShaderStageFlags stages{ 0 };
+	};
+
+	struct ShaderVertexInput
+	{
+		uint32_t location{ 0 };
+		VkFormat format{ VK_FORMAT_UNDEFINED };
+	};
+
+	// Interface of SPIR-V bytecode read back with spirv-cross: descriptor bindings, push constants, vertex inputs and color outputs.
+	// The stages of a pipeline merge into the interface its layouts are built from, see LayoutCache
+	class ShaderReflection
+	{
+	public:
+		bool reflect(const uint32_t* spirv, size_t numWords);
+		void clear();
+
+		// Bindings and push constants used by several stages get all of them, a binding has to have the same type everywhere
+		bool merge(const ShaderReflection& other);
+
+		// Every location the vertex stage reads is fed by one of the attributes
+		bool matchesVertexInput(const std::vector<VkVertexInputAttributeDescription>& attributes) const;
+
+		// Bindings of one set as the layout takes them, empty for a set the stages skip
+		std::vector<VkDescriptorSetLayoutBinding> getSetBindings(uint32_t set) const;
+		uint32_t getNumSets() const;
+
+		inline VkShaderStageFlags getStages() const { return stages; }
+		inline const std::vector<ShaderBinding>& getBindings() const { return bindings; }
+		inline const VkPushConstantRange& getPushConstantRange() const { return pushConstantRange; } // size 0 without push constants
+		inline const std::vector<ShaderVertexInput>& getVertexInputs() const { return vertexInputs; }
+		inline uint32_t getNumOutputs() const { return numOutputs; } // color attachments the fragment stage writes
+
+	private:
+		VkShaderStageFlags stages{ 0 };
+		std::vector<ShaderBinding> bindings; // by set, then binding
+		VkPushConstantRange pushConstantRange{ 0, 0, 0 };
+		std::vector<ShaderVertexInput> vertexInputs;
+		uint32_t numOutputs{ 0 };
+	};
+}
\ No newline at end of file
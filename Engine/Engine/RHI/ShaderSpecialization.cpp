@@ -0,0 +1,64 @@
+#include "ShaderSpecialization.h"
+
+#include <cstring>
+
+namespace RHI
+{
+	void ShaderSpecialization::setConstant(uint32_t id, uint32_t value)
+	{
+		setValue(id, &value, sizeof(value));
+	}
+
+	void ShaderSpecialization::setConstant(uint32_t id, int32_t value)
+	{
+		setValue(id, &value, sizeof(value));
+	}
+
+	void ShaderSpecialization::setConstant(uint32_t id, float value)
+	{
+		setValue(id, &value, sizeof(value));
+	}
+
+	void ShaderSpecialization::clear()
+	{
+		entries.clear();
+		data.clear();
+	}
+
+	const VkSpecializationInfo* ShaderSpecialization::getInfo() const
+	{
+		if (entries.empty())
+			return nullptr;
+
+		// Filled on demand, a copy of the object would otherwise point into the vectors of the original
+		info.mapEntryCount = static_cast<uint32_t>(entries.size());
+		info.pMapEntries = entries.data();
+		info.dataSize = data.size();
+		info.pData = data.data();
+
+		return &info;
+	}
+
+	void ShaderSpecialization::setValue(uint32_t id, const void* value, uint32_t size)
+	{
+		// Setting a constant again overwrites it in place, every scalar constant takes 4 bytes
+		for (const VkSpecializationMapEntry& entry : entries)
+		{
+			if (entry.constantID != id)
+				continue;
+
+			memcpy(data.data() + entry.offset, value, size);
+			return;
+		}
+
+		VkSpecializationMapEntry entry = {};
+		entry.constantID = id;
+		entry.offset = static_cast<uint32_t>(data.size());
+		entry.size = size;
+
+		data.resize(data.size() + size);
+		memcpy(data.data() + entry.offset, value, size);
+
+		entries.push_back(entry);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <vector>
+
+namespace RHI
+{
+	// Values of the specialization constants of one shader stage, by constant_id. Constants left out keep
+	// the default of their declaration. The values are baked when the pipeline is built, so the driver folds them
+	// like literals: loop counts unroll and dead branches go away without compiling another variant
+	class ShaderSpecialization
+	{
+	public:
+		void setConstant(uint32_t id, uint32_t value);
+		void setConstant(uint32_t id, int32_t value);
+		void setConstant(uint32_t id, float value);
+		void clear();
+
+		// nullptr without constants, valid until the next change
+		const VkSpecializationInfo* getInfo() const;
+
+		inline bool isEmpty() const { return entries.empty(); }
+
+	private:
+		void setValue(uint32_t id, const void* value, uint32_t size);
+
+	private:
+		std::vector<VkSpecializationMapEntry> entries;
+		std::vector<uint8_t> data;
+
+		mutable VkSpecializationInfo info{};
+	};
+}
\ No newline at end of file
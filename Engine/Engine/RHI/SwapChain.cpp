@@ -16,6 +16,7 @@ using namespace RHI;
 SwapChain::SwapChain(const VulkanContext* context, VkDeviceSize uboSize)
 	: context(context)
 	, uboSize(uboSize)
+	, attachmentGraph(context)
 {
 
 }
@@ -211,84 +212,51 @@ void SwapChain::initTransient(int width, int height)
 			VK_IMAGE_ASPECT_COLOR_BIT,
 			VK_IMAGE_VIEW_TYPE_2D);
 
-	// Create color buffer & image view
-	VulkanUtils::createImage2D(
-		context,
-		swapChainExtent.width,
-		swapChainExtent.height,
-		1,
-		context->getMaxMSAASamples(),
-		swapChainImageFormat,
-		VK_IMAGE_TILING_OPTIMAL,
-		VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		colorImage,
-		colorImageMemory);
-
-	colorImageView = VulkanUtils::createImageView(
-		context,
-		colorImage,
-		swapChainImageFormat,
-		VK_IMAGE_ASPECT_COLOR_BIT,
-		VK_IMAGE_VIEW_TYPE_2D);
+	// Create color & depth buffers, the graph allocates them and leaves them in their attachment layouts
+	depthFormat = VulkanUtils::selectOptimalDepthFormat(context);
 
-	VulkanUtils::transitionImageLayout(
-		context,
-		colorImage,
-		swapChainImageFormat,
-		VK_IMAGE_LAYOUT_UNDEFINED,
-		VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	RenderGraph::ImageDescription colorDescription;
+	colorDescription.format = swapChainImageFormat;
+	colorDescription.width = swapChainExtent.width;
+	colorDescription.height = swapChainExtent.height;
+	colorDescription.samples = context->getMaxMSAASamples();
+	colorDescription.usage = VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
 
-	// Create depth buffer & image view
-	depthFormat = VulkanUtils::selectOptimalDepthFormat(context);
+	RenderGraph::ImageDescription depthDescription = colorDescription;
+	depthDescription.format = depthFormat;
+	depthDescription.usage = VK_IMAGE_USAGE_SAMPLED_BIT; // read by the Hi-Z pyramid
 
-	VulkanUtils::createImage2D(
-		context,
-		swapChainExtent.width,
-		swapChainExtent.height,
-		1,
-		context->getMaxMSAASamples(),
-		depthFormat,
-		VK_IMAGE_TILING_OPTIMAL,
-		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		depthImage,
-		depthImageMemory);
-
-	depthImageView = VulkanUtils::createImageView(
-		context,
-		depthImage,
-		depthFormat,
-		VK_IMAGE_ASPECT_DEPTH_BIT,
-		VK_IMAGE_VIEW_TYPE_2D);
+	RenderGraph::ImageHandle color = attachmentGraph.createImage("MSAA Color", colorDescription);
+	RenderGraph::ImageHandle depth = attachmentGraph.createImage("MSAA Depth", depthDescription);
 
-	VulkanUtils::transitionImageLayout(
-		context,
-		depthImage,
-		depthFormat,
-		VK_IMAGE_LAYOUT_UNDEFINED,
-		VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+	// Frames render into both outside the graph
+	attachmentGraph.addPass("Frame Attachments",
+		[=](RenderGraph::PassBuilder& builder)
+		{
+			builder.write(color, RenderGraph::Access::ColorAttachment);
+			builder.write(depth, RenderGraph::Access::DepthStencilAttachment);
+			builder.setSideEffects();
+		},
+		[](VkCommandBuffer, const RenderGraph&) { });
+
+	attachmentGraph.compile();
+	attachmentGraph.executeImmediate();
+
+	colorImage = attachmentGraph.getImage(color);
+	colorImageView = attachmentGraph.getImageView(color);
+	depthImage = attachmentGraph.getImage(depth);
+	depthImageView = attachmentGraph.getImageView(depth);
 }
 
 void SwapChain::shutdownTransient()
 {
-	vkDestroyImageView(context->getDevice(), colorImageView, nullptr);
-	colorImageView = VK_NULL_HANDLE;
+	// Attachments belong to the graph
+	attachmentGraph.clear();
 
-	vkDestroyImage(context->getDevice(), colorImage, nullptr);
 	colorImage = VK_NULL_HANDLE;
-
-	vkFreeMemory(context->getDevice(), colorImageMemory, nullptr);
-	colorImageMemory = VK_NULL_HANDLE;
-
-	vkDestroyImageView(context->getDevice(), depthImageView, nullptr);
-	depthImageView = VK_NULL_HANDLE;
-
-	vkDestroyImage(context->getDevice(), depthImage, nullptr);
+	colorImageView = VK_NULL_HANDLE;
 	depthImage = VK_NULL_HANDLE;
-
-	vkFreeMemory(context->getDevice(), depthImageMemory, nullptr);
-	depthImageMemory = VK_NULL_HANDLE;
+	depthImageView = VK_NULL_HANDLE;
 
 	for (auto imageView : swapChainImageViews)
 		vkDestroyImageView(context->getDevice(), imageView, nullptr);
@@ -335,7 +303,7 @@ void SwapChain::initPersistent()
 	RenderPass renderPassBuilder(context);
 	renderPassBuilder.addColorAttachment(swapChainImageFormat, context->getMaxMSAASamples(), VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE);
 	renderPassBuilder.addColorResolveAttachment(swapChainImageFormat, VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_STORE);
-	renderPassBuilder.addDepthStencilAttachment(depthFormat, context->getMaxMSAASamples(), VK_ATTACHMENT_LOAD_OP_CLEAR);
+	renderPassBuilder.addDepthStencilAttachment(depthFormat, context->getMaxMSAASamples(), VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE);
 	renderPassBuilder.addSubpass(VK_PIPELINE_BIND_POINT_GRAPHICS);
 	renderPassBuilder.addColorAttachmentReference(0, 0);
 	renderPassBuilder.addColorResolveAttachmentReference(0, 1);
@@ -387,6 +355,7 @@ void SwapChain::initFrames(VkDeviceSize uboSize)
 	for (int i = 0; i < frames.size(); i++)
 	{
 		VulkanRenderFrame& frame = frames[i];
+		frame.index = static_cast<uint32_t>(i);
 
 		// Create uniform buffer object
 		VulkanUtils::createBuffer(
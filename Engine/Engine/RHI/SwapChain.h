@@ -3,12 +3,16 @@
 #include <vulkan/vulkan.h>
 #include <vector>
 
+#include "RenderGraph.h"
+
 namespace RHI
 {
 	class VulkanContext;
 
 	struct VulkanRenderFrame
 	{
+		uint32_t index{ 0 }; // swap chain image index
+
 		VkDescriptorSet descriptorSet{ VK_NULL_HANDLE };
 
 		VkFramebuffer frameBuffer{ VK_NULL_HANDLE };
@@ -37,6 +41,11 @@ namespace RHI
 		inline VkRenderPass getRenderPass() const { return renderPass; }
 		inline VkRenderPass getNoClearRenderPass() const { return noClearRenderPass; }
 
+		// Multisampled depth attachment, stored at the end of the render pass so it can be sampled afterwards
+		inline VkImage getDepthImage() const { return depthImage; }
+		inline VkImageView getDepthImageView() const { return depthImageView; }
+		inline VkFormat getDepthFormat() const { return depthFormat; }
+
 	private:
 		// Querying details of swap chain support
 		struct SupportDetails
@@ -79,13 +88,14 @@ namespace RHI
 		VkFormat swapChainImageFormat;
 		VkExtent2D swapChainExtent;
 
+		// Multisampled attachments, transient images of the graph that also moves them to their attachment layouts
+		RenderGraph attachmentGraph;
+
 		VkImage colorImage{ VK_NULL_HANDLE };
 		VkImageView colorImageView{ VK_NULL_HANDLE };
-		VkDeviceMemory colorImageMemory{ VK_NULL_HANDLE };
 
 		VkImage depthImage{ VK_NULL_HANDLE };
 		VkImageView depthImageView{ VK_NULL_HANDLE };
-		VkDeviceMemory depthImageMemory{ VK_NULL_HANDLE };
 
 		VkFormat depthFormat;
 
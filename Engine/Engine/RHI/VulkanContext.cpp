@@ -1,6 +1,7 @@
 #define VK_USE_PLATFORM_WIN32_KHR
 #include "VulkanContext.h"
 #include "VulkanUtils.h"
+#include "LayoutCache.h"
 
 #include <array>
 #include <iostream>
@@ -15,13 +16,20 @@
 
 namespace RHI
 {
-	static int maxCombinedImageSamplers = 32;
+	static int maxCombinedImageSamplers = 64; // the renderer keeps a scene set per swap chain image
 	static int maxUniformBuffers = 32;
+	static int maxStorageImages = 64;
+	static int maxStorageBuffers = 64;
 
 	static std::vector<const char*> requiredPhysicalDeviceExtensions = {
 		VK_KHR_SWAPCHAIN_EXTENSION_NAME,
 	};
 
+	// Core since Vulkan 1.2, the instance asks for 1.0 so the KHR entry point is loaded when present
+	static std::vector<const char*> optionalPhysicalDeviceExtensions = {
+		VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME,
+	};
+
 	static std::vector<const char*> requiredValidationLayers = {
 		"VK_LAYER_KHRONOS_validation",
 	};
@@ -122,17 +130,30 @@ namespace RHI
 			queuesInfo.push_back(info);
 		}
 
+		VkPhysicalDeviceFeatures supportedFeatures;
+		vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
+		multiDrawIndirect = (supportedFeatures.multiDrawIndirect == VK_TRUE);
+		drawIndirectFirstInstance = (supportedFeatures.drawIndirectFirstInstance == VK_TRUE);
+
 		VkPhysicalDeviceFeatures deviceFeatures = {};
 		deviceFeatures.samplerAnisotropy = VK_TRUE;
 		deviceFeatures.sampleRateShading = VK_TRUE;
+		deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+		deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+
+		std::vector<const char*> deviceExtensions = requiredPhysicalDeviceExtensions;
+		for (const char* extension : optionalPhysicalDeviceExtensions)
+			if (VulkanUtils::checkPhysicalDeviceExtensions(physicalDevice, { extension }))
+				deviceExtensions.push_back(extension);
 
 		VkDeviceCreateInfo deviceCreateInfo = {};
 		deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 		deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
 		deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queuesInfo.size());
 		deviceCreateInfo.pQueueCreateInfos = queuesInfo.data();
-		deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(requiredPhysicalDeviceExtensions.size());
-		deviceCreateInfo.ppEnabledExtensionNames = requiredPhysicalDeviceExtensions.data();
+		deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
+		deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
 
 		// next two parameters are ignored, but it's still good to pass layers for backward compatibility
 		deviceCreateInfo.enabledLayerCount = static_cast<uint32_t>(requiredValidationLayers.size());
@@ -142,6 +163,9 @@ namespace RHI
 		if (result != VK_SUCCESS)
 			throw std::runtime_error("Can't create logical device");
 
+		// Extension entry points, null when the extension is missing
+		cmdDrawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountKHR"));
+
 		// Get logical device queues
 		vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
 		if (graphicsQueue == VK_NULL_HANDLE)
@@ -161,22 +185,28 @@ namespace RHI
 			throw std::runtime_error("Can't create command pool");
 
 		// Create descriptor pools
-		std::array<VkDescriptorPoolSize, 2> descriptorPoolSizes = {};
+		std::array<VkDescriptorPoolSize, 4> descriptorPoolSizes = {};
 		descriptorPoolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
 		descriptorPoolSizes[0].descriptorCount = maxUniformBuffers;
 		descriptorPoolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 		descriptorPoolSizes[1].descriptorCount = maxCombinedImageSamplers;
+		descriptorPoolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		descriptorPoolSizes[2].descriptorCount = maxStorageImages;
+		descriptorPoolSizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorPoolSizes[3].descriptorCount = maxStorageBuffers;
 
 		VkDescriptorPoolCreateInfo descriptorPoolInfo = {};
 		descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 		descriptorPoolInfo.poolSizeCount = static_cast<uint32_t>(descriptorPoolSizes.size());
 		descriptorPoolInfo.pPoolSizes = descriptorPoolSizes.data();
-		descriptorPoolInfo.maxSets = maxCombinedImageSamplers + maxUniformBuffers;
+		descriptorPoolInfo.maxSets = maxCombinedImageSamplers + maxUniformBuffers + maxStorageImages + maxStorageBuffers;
 		descriptorPoolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
 
 		if (vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
 			throw std::runtime_error("Can't create descriptor pool");
 
+		layoutCache = new LayoutCache(this);
+
 		maxMSAASamples = VulkanUtils::getMaxUsableSampleCount(physicalDevice);
 
 		if (create_allocator() != VK_SUCCESS)
@@ -185,6 +215,9 @@ namespace RHI
 
 	void VulkanContext::shutdown()
 	{
+		delete layoutCache;
+		layoutCache = nullptr;
+
 		vkDestroyDescriptorPool(device, descriptorPool, nullptr);
 		descriptorPool = VK_NULL_HANDLE;
 
@@ -206,6 +239,10 @@ namespace RHI
 		maxMSAASamples = VK_SAMPLE_COUNT_1_BIT;
 		physicalDevice = VK_NULL_HANDLE;
 
+		multiDrawIndirect = false;
+		drawIndirectFirstInstance = false;
+		cmdDrawIndexedIndirectCount = nullptr;
+
 		if (m_allocator)
 			vmaDestroyAllocator(m_allocator);
 	}
@@ -10,6 +10,8 @@ struct GLFWwindow;
 
 namespace RHI
 {
+	class LayoutCache;
+
 	class VulkanContext
 	{
 	public:
@@ -30,6 +32,14 @@ namespace RHI
 		inline VkSampleCountFlagBits getMaxMSAASamples() const { return maxMSAASamples; }
 		inline VmaAllocator GetAllocatorHandle() const { return m_allocator; }
 
+		// Descriptor set and pipeline layouts shared by every renderer, they live as long as the device
+		inline LayoutCache* getLayoutCache() const { return layoutCache; }
+
+		// Optional indirect drawing features, enabled when the device has them
+		inline bool hasMultiDrawIndirect() const { return multiDrawIndirect; }
+		inline bool hasDrawIndirectFirstInstance() const { return drawIndirectFirstInstance; }
+		inline PFN_vkCmdDrawIndexedIndirectCountKHR getCmdDrawIndexedIndirectCount() const { return cmdDrawIndexedIndirectCount; }
+
 	private:
 		// Check which queue families are supported by the device and which one of these supports the commands
 		struct QueueFamilyIndices
@@ -57,6 +67,7 @@ namespace RHI
 
 		VkCommandPool commandPool{ VK_NULL_HANDLE };
 		VkDescriptorPool descriptorPool{ VK_NULL_HANDLE };
+		LayoutCache* layoutCache{ nullptr };
 
 		uint32_t graphicsQueueFamily{ 0 };
 		uint32_t presentQueueFamily{ 0 };
@@ -66,6 +77,10 @@ namespace RHI
 
 		VkSampleCountFlagBits maxMSAASamples{ VK_SAMPLE_COUNT_1_BIT };
 
+		bool multiDrawIndirect{ false };
+		bool drawIndirectFirstInstance{ false };
+		PFN_vkCmdDrawIndexedIndirectCountKHR cmdDrawIndexedIndirectCount{ nullptr };
+
 		// Vma
 		VmaAllocator m_allocator{ VK_NULL_HANDLE };
 	};
@@ -664,6 +664,31 @@ namespace RHI
 		vkUpdateDescriptorSets(context->getDevice(), 1, &descriptorWrite, 0, nullptr);
 	}
 
+	void VulkanUtils::bindStorageBuffer(
+		const VulkanContext* context,
+		VkDescriptorSet descriptorSet,
+		int binding,
+		VkBuffer buffer,
+		VkDeviceSize offset,
+		VkDeviceSize size)
+	{
+		VkDescriptorBufferInfo descriptorBufferInfo = {};
+		descriptorBufferInfo.buffer = buffer;
+		descriptorBufferInfo.offset = offset;
+		descriptorBufferInfo.range = size;
+
+		VkWriteDescriptorSet descriptorWrite = {};
+		descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite.dstSet = descriptorSet;
+		descriptorWrite.dstBinding = binding;
+		descriptorWrite.dstArrayElement = 0;
+		descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrite.descriptorCount = 1;
+		descriptorWrite.pBufferInfo = &descriptorBufferInfo;
+
+		vkUpdateDescriptorSets(context->getDevice(), 1, &descriptorWrite, 0, nullptr);
+	}
+
 	void VulkanUtils::bindCombinedImageSampler(
 		const VulkanContext* context,
 		VkDescriptorSet descriptorSet,
@@ -687,4 +712,27 @@ namespace RHI
 
 		vkUpdateDescriptorSets(context->getDevice(), 1, &descriptorWrite, 0, nullptr);
 	}
+
+	void VulkanUtils::bindStorageImage(
+		const VulkanContext* context,
+		VkDescriptorSet descriptorSet,
+		int binding,
+		VkImageView imageView)
+	{
+		VkDescriptorImageInfo descriptorImageInfo = {};
+		descriptorImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		descriptorImageInfo.imageView = imageView;
+		descriptorImageInfo.sampler = VK_NULL_HANDLE;
+
+		VkWriteDescriptorSet descriptorWrite = {};
+		descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite.dstSet = descriptorSet;
+		descriptorWrite.dstBinding = binding;
+		descriptorWrite.dstArrayElement = 0;
+		descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		descriptorWrite.descriptorCount = 1;
+		descriptorWrite.pImageInfo = &descriptorImageInfo;
+
+		vkUpdateDescriptorSets(context->getDevice(), 1, &descriptorWrite, 0, nullptr);
+	}
 }
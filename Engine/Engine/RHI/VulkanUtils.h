@@ -123,6 +123,13 @@ namespace RHI
 			VkImageView imageView,
 			VkSampler sampler);
 
+		// Storage images are read and written by compute shaders in the general layout
+		static void bindStorageImage(
+			const VulkanContext* context,
+			VkDescriptorSet descriptorSet,
+			int binding,
+			VkImageView imageView);
+
 		static void bindUniformBuffer(
 			const VulkanContext* context,
 			VkDescriptorSet descriptorSet,
@@ -131,12 +138,20 @@ namespace RHI
 			VkDeviceSize offset,
 			VkDeviceSize size);
 
+		static void bindStorageBuffer(
+			const VulkanContext* context,
+			VkDescriptorSet descriptorSet,
+			int binding,
+			VkBuffer buffer,
+			VkDeviceSize offset,
+			VkDeviceSize size);
+
 		static VkSampleCountFlagBits getMaxUsableSampleCount(VkPhysicalDevice physicalDevice);
 
 		// Helper functions recording and excuting a command buffer
 		static VkCommandBuffer beginSingleTimeCommands(const VulkanContext* context);
 		static void endSingleTimeCommands(const VulkanContext* context, VkCommandBuffer commandBuffer);
-	private:
+
 		static bool hasStencilComponent(VkFormat format);
 	};
 }
\ No newline at end of file
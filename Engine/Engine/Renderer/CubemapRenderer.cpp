@@ -1,8 +1,7 @@
 #include "CubemapRenderer.h"
 
-#include "../RHI/DescriptorSetLayout.h"
 #include "../RHI/DescriptorSet.h"
-#include "../RHI/PipelineLayout.h"
+#include "../RHI/LayoutCache.h"
 #include "../RHI/RenderPass.h"
 #include "../RHI/GraphicsPipeline.h"
 
@@ -15,6 +14,7 @@
 #include <GLM/glm.hpp>
 #include <GLM/gtc/matrix_transform.hpp>
 
+#include <iostream>
 #include <stdexcept>
 
 namespace RHI
@@ -27,7 +27,8 @@ namespace RHI
 	void CubemapRenderer::init(
 		const Shader& vertexShader,
 		const Shader& fragmentShader,
-		const Texture& targetTexture)
+		const Texture& targetTexture,
+		const ShaderSpecialization& fragmentSpecialization)
 	{
 		rendererQuad.createQuad(2.0f);
 
@@ -47,26 +48,13 @@ namespace RHI
 		targetExtent.width = targetTexture.getWidth();
 		targetExtent.height = targetTexture.getHeight();
 
-		VkViewport viewport = {};
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		viewport.width = static_cast<float>(targetExtent.width);
-		viewport.height = static_cast<float>(targetExtent.height);
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
+		// Layouts from what both stages declare, renderers sharing the interface share the layouts
+		ShaderReflection reflection = vertexShader.getReflection();
+		reflection.merge(fragmentShader.getReflection());
 
-		VkRect2D scissor = {};
-		scissor.offset = { 0, 0 };
-		scissor.extent.width = targetExtent.width;
-		scissor.extent.height = targetExtent.height;
-
-		VkShaderStageFlags stage = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-
-		// Descriptor set layout
-		DescriptorSetLayout descriptorSetLayoutBuilder(context);
-		descriptorSetLayoutBuilder.addDescriptorBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, stage);
-		descriptorSetLayoutBuilder.addDescriptorBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, stage);
-		descriptorSetLayout = descriptorSetLayoutBuilder.build();
+		LayoutCache* layoutCache = context->getLayoutCache();
+		descriptorSetLayout = layoutCache->getDescriptorSetLayout(reflection, 0);
+		pipelineLayout = layoutCache->getPipelineLayout(reflection);
 
 		// Render pass
 		RenderPass renderPassBuilder(context);
@@ -86,30 +74,7 @@ namespace RHI
 		renderPassBuilder.addColorAttachmentReference(0, 5);
 		renderPass = renderPassBuilder.build();
 
-		// Pipeline layout
-		PipelineLayout pipelineLayoutBuilder(context);
-		
-		pipelineLayoutBuilder.addDescriptorSetLayout(descriptorSetLayout);
-		pipelineLayout = pipelineLayoutBuilder.build();
-
-		// Graphic Pipeline
-		GraphicsPipeline pipelineBuilder(context, pipelineLayout, renderPass);
-		pipelineBuilder.addShaderStage(vertexShader.getShaderModule(), VK_SHADER_STAGE_VERTEX_BIT);
-		pipelineBuilder.addShaderStage(fragmentShader.getShaderModule(), VK_SHADER_STAGE_FRAGMENT_BIT);
-		pipelineBuilder.addVertexInput(Mesh::getVertexInputBindingDescription(), Mesh::getAttributeDescriptions());
-		pipelineBuilder.setInputAssemblyState(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
-		pipelineBuilder.addViewport(viewport);
-		pipelineBuilder.addScissor(scissor);
-		pipelineBuilder.setRasterizerState(false, false, VK_POLYGON_MODE_FILL, 1.0f, VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE);
-		pipelineBuilder.setMultisampleState(VK_SAMPLE_COUNT_1_BIT);
-		pipelineBuilder.setDepthStencilState(false, false, VK_COMPARE_OP_LESS);
-		pipelineBuilder.addBlendColorAttachment();
-		pipelineBuilder.addBlendColorAttachment();
-		pipelineBuilder.addBlendColorAttachment();
-		pipelineBuilder.addBlendColorAttachment();
-		pipelineBuilder.addBlendColorAttachment();
-		pipelineBuilder.addBlendColorAttachment();
-		pipeline = pipelineBuilder.build();
+		createPipeline(vertexShader, fragmentShader, fragmentSpecialization);
 
 		// Create uniform buffers
 		VkDeviceSize uboSize = sizeof(CubemapFaceOrientationData);
@@ -145,16 +110,6 @@ namespace RHI
 		if (vkCreateFramebuffer(context->getDevice(), &framebufferInfo, nullptr, &frameBuffer) != VK_SUCCESS)
 			throw std::runtime_error("Can't create framebuffer");
 
-		// Create command buffer
-		VkCommandBufferAllocateInfo allocateInfo = {};
-		allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		allocateInfo.commandPool = context->getCommandPool();
-		allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		allocateInfo.commandBufferCount = 1;
-
-		if (vkAllocateCommandBuffers(context->getDevice(), &allocateInfo, &commandBuffer) != VK_SUCCESS)
-			throw std::runtime_error("Can't create command buffers");
-
 		// Fill uniform buffer
 		CubemapFaceOrientationData* ubo = nullptr;
 		vkMapMemory(context->getDevice(), uniformBufferMemory, 0, sizeof(CubemapFaceOrientationData), 0, reinterpret_cast<void**>(&ubo));
@@ -201,14 +156,59 @@ namespace RHI
 			uniformBuffer,
 			0,
 			uboSize);
+	}
+
+	bool CubemapRenderer::reload(const Shader& vertexShader, const Shader& fragmentShader, const ShaderSpecialization& fragmentSpecialization)
+	{
+		// The descriptor set was allocated and written for the layouts of init()
+		ShaderReflection reflection = vertexShader.getReflection();
+		reflection.merge(fragmentShader.getReflection());
+
+		if (context->getLayoutCache()->findPipelineLayout(reflection) != pipelineLayout)
+		{
+			std::cerr << "CubemapRenderer::reload(): \"" << vertexShader.getPath() << "\" or \"" << fragmentShader.getPath() << "\" changed their bindings or push constants, keeping the previous pipeline" << std::endl;
+			return false;
+		}
+
+		vkDestroyPipeline(context->getDevice(), pipeline, nullptr);
+		createPipeline(vertexShader, fragmentShader, fragmentSpecialization);
 
-		// Create Fence
-		VkFenceCreateInfo fenceInfo{};
-		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-		fenceInfo.flags = 0;
+		return true;
+	}
 
-		if (vkCreateFence(context->getDevice(), &fenceInfo, nullptr, &fence) != VK_SUCCESS)
-			throw std::runtime_error("Can't create fence");
+	void CubemapRenderer::createPipeline(const Shader& vertexShader, const Shader& fragmentShader, const ShaderSpecialization& fragmentSpecialization)
+	{
+		VkViewport viewport = {};
+		viewport.x = 0.0f;
+		viewport.y = 0.0f;
+		viewport.width = static_cast<float>(targetExtent.width);
+		viewport.height = static_cast<float>(targetExtent.height);
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+
+		VkRect2D scissor = {};
+		scissor.offset = { 0, 0 };
+		scissor.extent.width = targetExtent.width;
+		scissor.extent.height = targetExtent.height;
+
+		// Graphic Pipeline
+		GraphicsPipeline pipelineBuilder(context, pipelineLayout, renderPass);
+		pipelineBuilder.addShaderStage(vertexShader.getShaderModule(), VK_SHADER_STAGE_VERTEX_BIT);
+		pipelineBuilder.addShaderStage(fragmentShader.getShaderModule(), VK_SHADER_STAGE_FRAGMENT_BIT, fragmentSpecialization.getInfo());
+		pipelineBuilder.addVertexInput(Mesh::getVertexInputBindingDescription(), Mesh::getAttributeDescriptions());
+		pipelineBuilder.setInputAssemblyState(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+		pipelineBuilder.addViewport(viewport);
+		pipelineBuilder.addScissor(scissor);
+		pipelineBuilder.setRasterizerState(false, false, VK_POLYGON_MODE_FILL, 1.0f, VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE);
+		pipelineBuilder.setMultisampleState(VK_SAMPLE_COUNT_1_BIT);
+		pipelineBuilder.setDepthStencilState(false, false, VK_COMPARE_OP_LESS);
+		pipelineBuilder.addBlendColorAttachment();
+		pipelineBuilder.addBlendColorAttachment();
+		pipelineBuilder.addBlendColorAttachment();
+		pipelineBuilder.addBlendColorAttachment();
+		pipelineBuilder.addBlendColorAttachment();
+		pipelineBuilder.addBlendColorAttachment();
+		pipeline = pipelineBuilder.build();
 	}
 
 	void CubemapRenderer::shutdown()
@@ -225,11 +225,9 @@ namespace RHI
 		vkDestroyPipeline(context->getDevice(), pipeline, nullptr);
 		pipeline = VK_NULL_HANDLE;
 
-		vkDestroyPipelineLayout(context->getDevice(), pipelineLayout, nullptr);
+		// Layouts belong to the layout cache
 		pipelineLayout = VK_NULL_HANDLE;
-
-		vkDestroyDescriptorSetLayout(context->getDevice(), descriptorSetLayout, nullptr);
-		descriptorSetLayout = nullptr;
+		descriptorSetLayout = VK_NULL_HANDLE;
 
 		vkDestroyRenderPass(context->getDevice(), renderPass, nullptr);
 		renderPass = VK_NULL_HANDLE;
@@ -240,20 +238,14 @@ namespace RHI
 			faceViews[i] = VK_NULL_HANDLE;
 		}
 
-		vkFreeCommandBuffers(context->getDevice(), context->getCommandPool(), 1, &commandBuffer);
-		commandBuffer = VK_NULL_HANDLE;
-
 		vkFreeDescriptorSets(context->getDevice(), context->getDescriptorPool(), 1, &descriptorSet);
 		descriptorSet = VK_NULL_HANDLE;
 
-		vkDestroyFence(context->getDevice(), fence, nullptr);
-		fence = VK_NULL_HANDLE;
-
 		rendererQuad.clearGPUData();
 		rendererQuad.clearCPUData();
 	}
 
-	void CubemapRenderer::render(const Texture& inputTexture)
+	void CubemapRenderer::render(VkCommandBuffer commandBuffer, const Texture& inputTexture)
 	{
 		VulkanUtils::bindCombinedImageSampler(
 			context,
@@ -262,15 +254,6 @@ namespace RHI
 			inputTexture.getImageView(),
 			inputTexture.getSampler());
 
-		// Record command buffer
-		VkCommandBufferBeginInfo beginInfo = {};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-		beginInfo.pInheritanceInfo = nullptr; // Optional
-
-		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
-			throw std::runtime_error("Can't begin recording command buffer");
-
 		VkRenderPassBeginInfo renderPassInfo = {};
 		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
 		renderPassInfo.renderPass = renderPass;
@@ -297,28 +280,11 @@ namespace RHI
 			VkBuffer indexBuffer = rendererQuad.getIndexBuffer();
 			VkDeviceSize offsets[] = { 0 };
 			vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-			vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+			vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, rendererQuad.getIndexType());
 
 			vkCmdDrawIndexed(commandBuffer, rendererQuad.getNumIndices(), 1, 0, 0, 0);
 		}
 
 		vkCmdEndRenderPass(commandBuffer);
-
-		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
-			throw std::runtime_error("Can't record command buffer");
-
-		VkSubmitInfo submitInfo = {};
-		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &commandBuffer;
-
-		if (vkResetFences(context->getDevice(), 1, &fence) != VK_SUCCESS)
-			throw std::runtime_error("Can't reset fence");
-
-		if (vkQueueSubmit(context->getGraphicsQueue(), 1, &submitInfo, fence) != VK_SUCCESS)
-			throw std::runtime_error("Can't submit command buffer");
-
-		if (vkWaitForFences(context->getDevice(), 1, &fence, VK_TRUE, UINT64_MAX) != VK_SUCCESS)
-			throw std::runtime_error("Can't wait for a fence");
 	}
 }
\ No newline at end of file
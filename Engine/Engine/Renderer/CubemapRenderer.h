@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "../RHI/Shader.h"
+#include "../RHI/ShaderSpecialization.h"
 #include "../Common/Texture.h"
 #include "../Common/Mesh.h"
 
@@ -19,11 +20,20 @@ namespace RHI
 			: context(context)
 			, rendererQuad(context)	{ }
 
-		void init(const Shader& vertexShader, const Shader& fragmentShader, const Texture& targetTexture);
+		// The fragment specialization is only read while the pipeline is built
+		void init(const Shader& vertexShader, const Shader& fragmentShader, const Texture& targetTexture, const ShaderSpecialization& fragmentSpecialization = ShaderSpecialization());
 
 		void shutdown();
 
-		void render(const Texture& inputTexture);
+		// Rebuilds the pipeline only, what was baked into the target stays until the next render.
+		// Shaders whose interface no longer matches the layouts are refused, the previous pipeline stays and false is returned
+		bool reload(const Shader& vertexShader, const Shader& fragmentShader, const ShaderSpecialization& fragmentSpecialization = ShaderSpecialization());
+
+		// Records the bake, the target is expected in the color attachment layout and left in it
+		void render(VkCommandBuffer commandBuffer, const Texture& inputTexture);
+
+	private:
+		void createPipeline(const Shader& vertexShader, const Shader& fragmentShader, const ShaderSpecialization& fragmentSpecialization);
 
 	private:
 		const VulkanContext* context{ nullptr };
@@ -39,12 +49,9 @@ namespace RHI
 		VkPipeline pipeline{ VK_NULL_HANDLE }; // Pipeline
 
 		VkFramebuffer frameBuffer{ VK_NULL_HANDLE }; // Frame Buffer
-		VkCommandBuffer commandBuffer{ VK_NULL_HANDLE }; // Command Buffer
 		VkDescriptorSet descriptorSet{ VK_NULL_HANDLE }; // Descriptor set
 
 		VkBuffer uniformBuffer{ VK_NULL_HANDLE }; // Uniform Buffer
 		VkDeviceMemory uniformBufferMemory{ VK_NULL_HANDLE }; // Uniform buffer Memory
-
-		VkFence fence{ VK_NULL_HANDLE }; // Fence
 	};
 }
\ No newline at end of file
@@ -0,0 +1,461 @@
+#include "HiZRenderer.h"
+#include "../RHI/ComputePipeline.h"
+#include "../RHI/LayoutCache.h"
+#include "../RHI/SwapChain.h"
+#include "../RHI/VulkanUtils.h"
+#include "../RHI/VulkanContext.h"
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <iostream>
+#include <stdexcept>
+
+namespace RHI
+{
+	// Matches HiZConstants in hiZCopy.comp and hiZReduce.comp
+	struct HiZConstants
+	{
+		glm::ivec2 srcSize;
+		glm::ivec2 dstSize;
+		int32_t numSamples;
+	};
+
+	// Clip space w under which a corner is treated as crossing the near plane
+	static const float MIN_CLIP_W = 1e-5f;
+
+	HiZRenderer::~HiZRenderer()
+	{
+		shutdown();
+		clearTargets();
+	}
+
+	void HiZRenderer::init(const Shader& copyShader, const Shader& reduceShader)
+	{
+		// Layouts from what the shaders declare, push constants included
+		LayoutCache* layoutCache = context->getLayoutCache();
+		copyDescriptorSetLayout = layoutCache->getDescriptorSetLayout(copyShader.getReflection(), 0);
+		reduceDescriptorSetLayout = layoutCache->getDescriptorSetLayout(reduceShader.getReflection(), 0);
+		copyPipelineLayout = layoutCache->getPipelineLayout(copyShader.getReflection());
+		reducePipelineLayout = layoutCache->getPipelineLayout(reduceShader.getReflection());
+
+		createPipelines(copyShader, reduceShader);
+
+		if (image != VK_NULL_HANDLE)
+			createDescriptorSets();
+	}
+
+	bool HiZRenderer::reload(const Shader& copyShader, const Shader& reduceShader)
+	{
+		// The descriptor sets were allocated and written for the layouts of init()
+		LayoutCache* layoutCache = context->getLayoutCache();
+		if (layoutCache->findPipelineLayout(copyShader.getReflection()) != copyPipelineLayout ||
+			layoutCache->findPipelineLayout(reduceShader.getReflection()) != reducePipelineLayout)
+		{
+			std::cerr << "HiZRenderer::reload(): \"" << copyShader.getPath() << "\" or \"" << reduceShader.getPath() << "\" changed their bindings or push constants, keeping the previous pipelines" << std::endl;
+			return false;
+		}
+
+		destroyPipelines();
+		createPipelines(copyShader, reduceShader);
+
+		return true;
+	}
+
+	void HiZRenderer::createPipelines(const Shader& copyShader, const Shader& reduceShader)
+	{
+		ComputePipeline copyPipelineBuilder(context, copyPipelineLayout);
+		copyPipelineBuilder.setShaderStage(copyShader.getShaderModule());
+		copyPipeline = copyPipelineBuilder.build();
+
+		ComputePipeline reducePipelineBuilder(context, reducePipelineLayout);
+		reducePipelineBuilder.setShaderStage(reduceShader.getShaderModule());
+		reducePipeline = reducePipelineBuilder.build();
+	}
+
+	void HiZRenderer::destroyPipelines()
+	{
+		vkDestroyPipeline(context->getDevice(), copyPipeline, nullptr);
+		copyPipeline = VK_NULL_HANDLE;
+
+		vkDestroyPipeline(context->getDevice(), reducePipeline, nullptr);
+		reducePipeline = VK_NULL_HANDLE;
+	}
+
+	void HiZRenderer::shutdown()
+	{
+		destroyDescriptorSets();
+		destroyPipelines();
+
+		// Layouts belong to the layout cache
+		copyPipelineLayout = VK_NULL_HANDLE;
+		reducePipelineLayout = VK_NULL_HANDLE;
+		copyDescriptorSetLayout = VK_NULL_HANDLE;
+		reduceDescriptorSetLayout = VK_NULL_HANDLE;
+	}
+
+	void HiZRenderer::resize(const SwapChain* swapChain)
+	{
+		clearTargets();
+
+		VkExtent2D extent = swapChain->getExtent();
+
+		depthImage = swapChain->getDepthImage();
+		depthImageView = swapChain->getDepthImageView();
+		depthFormat = swapChain->getDepthFormat();
+		numSamples = context->getMaxMSAASamples();
+		depthSampler = VulkanUtils::createSampler(context, 1);
+
+		// Full mip chain down to 1x1, every level halves and rounds down like regular mipmaps
+		levelExtents.clear();
+		levelExtents.push_back(extent);
+
+		while (levelExtents.back().width > 1 || levelExtents.back().height > 1)
+		{
+			VkExtent2D level = levelExtents.back();
+			levelExtents.push_back({ std::max(level.width / 2, 1u), std::max(level.height / 2, 1u) });
+		}
+
+		uint32_t numLevels = static_cast<uint32_t>(levelExtents.size());
+
+		VulkanUtils::createImage2D(
+			context,
+			extent.width,
+			extent.height,
+			numLevels,
+			VK_SAMPLE_COUNT_1_BIT,
+			VK_FORMAT_R32_SFLOAT,
+			VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			image,
+			imageMemory);
+
+		levelViews.resize(numLevels);
+		for (uint32_t level = 0; level < numLevels; level++)
+			levelViews[level] = VulkanUtils::createImageView(
+				context,
+				image,
+				VK_FORMAT_R32_SFLOAT,
+				VK_IMAGE_ASPECT_COLOR_BIT,
+				VK_IMAGE_VIEW_TYPE_2D,
+				level, 1);
+
+		// Readback layout, levels are packed one after the other
+		readbackLevel = 0;
+		while (readbackLevel + 1 < numLevels && std::max(levelExtents[readbackLevel].width, levelExtents[readbackLevel].height) > READBACK_SIZE)
+			readbackLevel++;
+
+		uint32_t readbackSize = 0;
+		readbackOffsets.clear();
+
+		for (uint32_t level = readbackLevel; level < numLevels; level++)
+		{
+			readbackOffsets.push_back(readbackSize);
+			readbackSize += levelExtents[level].width * levelExtents[level].height;
+		}
+
+		readbacks.resize(swapChain->getNumImages());
+		for (Readback& readback : readbacks)
+		{
+			VulkanUtils::createBuffer(
+				context,
+				readbackSize * sizeof(float),
+				VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				readback.buffer,
+				readback.memory);
+
+			void* data = nullptr;
+			vkMapMemory(context->getDevice(), readback.memory, 0, readbackSize * sizeof(float), 0, &data);
+
+			readback.data = reinterpret_cast<const float*>(data);
+			readback.valid = false;
+		}
+
+		if (copyDescriptorSetLayout != VK_NULL_HANDLE)
+			createDescriptorSets();
+	}
+
+	void HiZRenderer::clearTargets()
+	{
+		destroyDescriptorSets();
+
+		for (Readback& readback : readbacks)
+		{
+			vkUnmapMemory(context->getDevice(), readback.memory);
+			vkDestroyBuffer(context->getDevice(), readback.buffer, nullptr);
+			vkFreeMemory(context->getDevice(), readback.memory, nullptr);
+		}
+		readbacks.clear();
+		readbackOffsets.clear();
+		currentReadback = nullptr;
+
+		for (VkImageView view : levelViews)
+			vkDestroyImageView(context->getDevice(), view, nullptr);
+		levelViews.clear();
+		levelExtents.clear();
+
+		vkDestroyImage(context->getDevice(), image, nullptr);
+		image = VK_NULL_HANDLE;
+
+		vkFreeMemory(context->getDevice(), imageMemory, nullptr);
+		imageMemory = VK_NULL_HANDLE;
+
+		vkDestroySampler(context->getDevice(), depthSampler, nullptr);
+		depthSampler = VK_NULL_HANDLE;
+
+		// The depth attachment belongs to the swap chain
+		depthImage = VK_NULL_HANDLE;
+		depthImageView = VK_NULL_HANDLE;
+	}
+
+	void HiZRenderer::createDescriptorSets()
+	{
+		descriptorSets.resize(levelViews.size());
+
+		for (size_t level = 0; level < descriptorSets.size(); level++)
+		{
+			VkDescriptorSetLayout layout = (level == 0) ? copyDescriptorSetLayout : reduceDescriptorSetLayout;
+
+			VkDescriptorSetAllocateInfo descriptorSetAllocInfo = {};
+			descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+			descriptorSetAllocInfo.descriptorPool = context->getDescriptorPool();
+			descriptorSetAllocInfo.descriptorSetCount = 1;
+			descriptorSetAllocInfo.pSetLayouts = &layout;
+
+			if (vkAllocateDescriptorSets(context->getDevice(), &descriptorSetAllocInfo, &descriptorSets[level]) != VK_SUCCESS)
+				throw std::runtime_error("Can't allocate Hi-Z descriptor set");
+
+			if (level == 0)
+				VulkanUtils::bindCombinedImageSampler(context, descriptorSets[level], 0, depthImageView, depthSampler);
+			else
+				VulkanUtils::bindStorageImage(context, descriptorSets[level], 0, levelViews[level - 1]);
+
+			VulkanUtils::bindStorageImage(context, descriptorSets[level], 1, levelViews[level]);
+		}
+	}
+
+	void HiZRenderer::destroyDescriptorSets()
+	{
+		if (!descriptorSets.empty())
+			vkFreeDescriptorSets(context->getDevice(), context->getDescriptorPool(), static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data());
+
+		descriptorSets.clear();
+	}
+
+	void HiZRenderer::render(VkCommandBuffer commandBuffer, uint32_t frameIndex, const glm::mat4& viewProjection)
+	{
+		if (image == VK_NULL_HANDLE || descriptorSets.empty())
+			return;
+
+		uint32_t numLevels = static_cast<uint32_t>(levelExtents.size());
+
+		VkImageAspectFlags depthAspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+		if (VulkanUtils::hasStencilComponent(depthFormat))
+			depthAspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+
+		// Depth attachment becomes readable, the pyramid content of the previous build is discarded
+		std::array<VkImageMemoryBarrier, 2> barriers = {};
+		barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barriers[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barriers[0].oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[0].image = depthImage;
+		barriers[0].subresourceRange = { depthAspect, 0, 1, 0, 1 };
+
+		barriers[1].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barriers[1].srcAccessMask = 0;
+		barriers[1].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barriers[1].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barriers[1].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[1].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[1].image = image;
+		barriers[1].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, numLevels, 0, 1 };
+
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0,
+			0, nullptr,
+			0, nullptr,
+			static_cast<uint32_t>(barriers.size()), barriers.data());
+
+		// Level 0 resolves the samples or copies the single one, the next ones reduce the previous level
+		for (uint32_t level = 0; level < numLevels; level++)
+		{
+			VkPipeline pipeline = (level == 0) ? copyPipeline : reducePipeline;
+			VkPipelineLayout pipelineLayout = (level == 0) ? copyPipelineLayout : reducePipelineLayout;
+			VkExtent2D srcExtent = levelExtents[(level == 0) ? 0 : level - 1];
+			VkExtent2D dstExtent = levelExtents[level];
+
+			if (level > 0)
+			{
+				VkImageMemoryBarrier barrier = {};
+				barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+				barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+				barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+				barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+				barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+				barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.image = image;
+				barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 1, 0, 1 };
+
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+			}
+
+			HiZConstants constants;
+			constants.srcSize = glm::ivec2(srcExtent.width, srcExtent.height);
+			constants.dstSize = glm::ivec2(dstExtent.width, dstExtent.height);
+			constants.numSamples = static_cast<int32_t>(numSamples);
+
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[level], 0, nullptr);
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(HiZConstants), &constants);
+			vkCmdDispatch(commandBuffer, (dstExtent.width + GROUP_SIZE - 1) / GROUP_SIZE, (dstExtent.height + GROUP_SIZE - 1) / GROUP_SIZE, 1);
+		}
+
+		// Depth goes back to the attachment layout the next render pass expects, the pyramid gets copied
+		barriers[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barriers[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		barriers[0].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barriers[0].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		barriers[1].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barriers[1].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0,
+			0, nullptr,
+			0, nullptr,
+			static_cast<uint32_t>(barriers.size()), barriers.data());
+
+		// Coarse levels to the readback buffer of this frame slot
+		Readback& readback = readbacks[frameIndex];
+
+		std::vector<VkBufferImageCopy> regions(numLevels - readbackLevel);
+		for (uint32_t level = readbackLevel; level < numLevels; level++)
+		{
+			VkBufferImageCopy& region = regions[level - readbackLevel];
+			region = {};
+			region.bufferOffset = readbackOffsets[level - readbackLevel] * sizeof(float);
+			region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+			region.imageExtent = { levelExtents[level].width, levelExtents[level].height, 1 };
+		}
+
+		vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback.buffer, static_cast<uint32_t>(regions.size()), regions.data());
+
+		VkBufferMemoryBarrier bufferBarrier = {};
+		bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.buffer = readback.buffer;
+		bufferBarrier.offset = 0;
+		bufferBarrier.size = VK_WHOLE_SIZE;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+
+		readback.viewProjection = viewProjection;
+		readback.valid = true;
+	}
+
+	void HiZRenderer::selectFrame(uint32_t frameIndex)
+	{
+		currentReadback = nullptr;
+
+		if (frameIndex < readbacks.size() && readbacks[frameIndex].valid)
+			currentReadback = &readbacks[frameIndex];
+	}
+
+	bool HiZRenderer::isOccluded(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& transform) const
+	{
+		if (currentReadback == nullptr)
+			return false;
+
+		// Reproject the box into the frame the pyramid was built for
+		glm::mat4 clipFromSpace = currentReadback->viewProjection * transform;
+
+		glm::vec3 ndcMin(FLT_MAX);
+		glm::vec3 ndcMax(-FLT_MAX);
+
+		for (int i = 0; i < 8; i++)
+		{
+			glm::vec3 corner(
+				(i & 1) ? boundsMax.x : boundsMin.x,
+				(i & 2) ? boundsMax.y : boundsMin.y,
+				(i & 4) ? boundsMax.z : boundsMin.z);
+
+			glm::vec4 clip = clipFromSpace * glm::vec4(corner, 1.0f);
+
+			if (clip.w < MIN_CLIP_W)
+				return false;
+
+			glm::vec3 ndc = glm::vec3(clip) / clip.w;
+			ndcMin = glm::min(ndcMin, ndc);
+			ndcMax = glm::max(ndcMax, ndc);
+		}
+
+		// The pyramid has no depth outside of the screen it was built from
+		if (ndcMin.x < -1.0f || ndcMin.y < -1.0f || ndcMax.x > 1.0f || ndcMax.y > 1.0f || ndcMin.z < 0.0f)
+			return false;
+
+		const VkExtent2D& extent = levelExtents[0];
+
+		int x0 = static_cast<int>((ndcMin.x * 0.5f + 0.5f) * extent.width);
+		int y0 = static_cast<int>((ndcMin.y * 0.5f + 0.5f) * extent.height);
+		int x1 = static_cast<int>((ndcMax.x * 0.5f + 0.5f) * extent.width);
+		int y1 = static_cast<int>((ndcMax.y * 0.5f + 0.5f) * extent.height);
+
+		x0 = std::min(x0, static_cast<int>(extent.width) - 1);
+		y0 = std::min(y0, static_cast<int>(extent.height) - 1);
+		x1 = std::min(x1, static_cast<int>(extent.width) - 1);
+		y1 = std::min(y1, static_cast<int>(extent.height) - 1);
+
+		return ndcMin.z > getMaxDepth(x0, y0, x1, y1);
+	}
+
+	float HiZRenderer::getMaxDepth(int x0, int y0, int x1, int y1) const
+	{
+		uint32_t numLevels = static_cast<uint32_t>(levelExtents.size());
+
+		// Coarsest of the read back levels where the rectangle spans at most 2x2 texels.
+		// Level sizes round down, so the last texel of a level also covers the leftover pixels
+		for (uint32_t level = readbackLevel; level < numLevels; level++)
+		{
+			int width = static_cast<int>(levelExtents[level].width);
+			int height = static_cast<int>(levelExtents[level].height);
+
+			int tx0 = std::min(x0 >> level, width - 1);
+			int ty0 = std::min(y0 >> level, height - 1);
+			int tx1 = std::min(x1 >> level, width - 1);
+			int ty1 = std::min(y1 >> level, height - 1);
+
+			if ((tx1 - tx0 > 1 || ty1 - ty0 > 1) && level + 1 < numLevels)
+				continue;
+
+			const float* data = currentReadback->data + readbackOffsets[level - readbackLevel];
+
+			float depth = 0.0f;
+			for (int y = ty0; y <= ty1; y++)
+				for (int x = tx0; x <= tx1; x++)
+					depth = std::max(depth, data[y * width + x]);
+
+			return depth;
+		}
+
+		return 1.0f;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+#include "../RHI/Shader.h"
+
+#include <glm/glm.hpp>
+
+namespace RHI
+{
+	class VulkanContext;
+	class SwapChain;
+
+	// Hierarchical depth pyramid built in compute from the swap chain depth attachment.
+	// Every level keeps the farthest depth of the pixels it covers, so a box whose nearest
+	// depth lies behind the texels under it is hidden by what was drawn.
+	// The coarse levels are read back, geometry is tested on the CPU against the pyramid
+	// of an earlier frame reprojected with the view projection that frame was drawn with
+	class HiZRenderer
+	{
+	public:
+		HiZRenderer(const VulkanContext* context)
+			: context(context) { }
+
+		~HiZRenderer();
+
+		// Pipelines, reloaded with the shaders. The copy shader reads the depth as multisampled or not like the swap chain has it
+		void init(const Shader& copyShader, const Shader& reduceShader);
+		void shutdown();
+
+		// Rebuilds the pipelines only, layouts, descriptor sets and the pyramid are kept. Shaders whose interface
+		// no longer matches the layouts are refused, the previous pipelines stay and false is returned
+		bool reload(const Shader& copyShader, const Shader& reduceShader);
+
+		// Pyramid and readback buffers, sized after the swap chain depth attachment
+		void resize(const SwapChain* swapChain);
+		void clearTargets();
+
+		// Records the pyramid build and its readback, must follow the render pass that wrote the depth
+		void render(VkCommandBuffer commandBuffer, uint32_t frameIndex, const glm::mat4& viewProjection);
+
+		// Makes the pyramid last read back into this frame slot the one tested against,
+		// its command buffer being recorded again means the previous submission has completed
+		void selectFrame(uint32_t frameIndex);
+
+		// Conservative, boxes the pyramid knows nothing about (off screen, crossing the near plane) are visible.
+		// The transform moves the box into world space
+		bool isOccluded(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& transform) const;
+
+	private:
+		void createPipelines(const Shader& copyShader, const Shader& reduceShader);
+		void destroyPipelines();
+
+		void createDescriptorSets();
+		void destroyDescriptorSets();
+
+		// Depth of the farthest texel under the level 0 pixel rectangle
+		float getMaxDepth(int x0, int y0, int x1, int y1) const;
+
+	private:
+		enum
+		{
+			GROUP_SIZE = 8,
+			READBACK_SIZE = 128, // largest level read back to the CPU
+		};
+
+		struct Readback
+		{
+			VkBuffer buffer{ VK_NULL_HANDLE };
+			VkDeviceMemory memory{ VK_NULL_HANDLE };
+			const float* data{ nullptr };
+			glm::mat4 viewProjection{ 1.0f };
+			bool valid{ false };
+		};
+
+		const VulkanContext* context{ nullptr };
+
+		VkDescriptorSetLayout copyDescriptorSetLayout{ VK_NULL_HANDLE };
+		VkDescriptorSetLayout reduceDescriptorSetLayout{ VK_NULL_HANDLE };
+		VkPipelineLayout copyPipelineLayout{ VK_NULL_HANDLE };
+		VkPipelineLayout reducePipelineLayout{ VK_NULL_HANDLE };
+		VkPipeline copyPipeline{ VK_NULL_HANDLE };
+		VkPipeline reducePipeline{ VK_NULL_HANDLE };
+
+		// Swap chain depth attachment
+		VkImage depthImage{ VK_NULL_HANDLE };
+		VkImageView depthImageView{ VK_NULL_HANDLE };
+		VkFormat depthFormat{ VK_FORMAT_UNDEFINED };
+		VkSampler depthSampler{ VK_NULL_HANDLE };
+		VkSampleCountFlagBits numSamples{ VK_SAMPLE_COUNT_1_BIT };
+
+		// Pyramid, one view and one descriptor set per level
+		VkImage image{ VK_NULL_HANDLE };
+		VkDeviceMemory imageMemory{ VK_NULL_HANDLE };
+		std::vector<VkImageView> levelViews;
+		std::vector<VkExtent2D> levelExtents;
+		std::vector<VkDescriptorSet> descriptorSets;
+
+		// Levels from readbackLevel to the 1x1 one are copied back, one buffer per frame slot
+		uint32_t readbackLevel{ 0 };
+		std::vector<uint32_t> readbackOffsets;
+		std::vector<Readback> readbacks;
+		const Readback* currentReadback{ nullptr };
+	};
+}
\ No newline at end of file
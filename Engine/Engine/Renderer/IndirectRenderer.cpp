@@ -0,0 +1,484 @@
+#include "IndirectRenderer.h"
+#include "../Common/Mesh.h"
+#include "../Common/RenderScene.h"
+#include "../RHI/ComputePipeline.h"
+#include "../RHI/LayoutCache.h"
+#include "../RHI/VulkanUtils.h"
+#include "../RHI/VulkanContext.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+namespace RHI
+{
+	// Matches ObjectInstance in Common/Object.inc and indirectCull.comp
+	struct ObjectInstance
+	{
+		glm::mat4 world;
+		glm::vec4 positionScale;
+		glm::vec4 positionOffset;
+		glm::vec4 albedoTint;
+	};
+
+	// Matches DrawRecord in indirectCull.comp
+	struct DrawRecord
+	{
+		glm::vec4 boundsMin;
+		glm::vec4 boundsMax;
+		glm::vec4 sphere;
+		uint32_t instance;
+		uint32_t firstRange;
+		uint32_t numRanges;
+		uint32_t group;
+		uint32_t firstCommand;
+		uint32_t groupFirstCommand;
+		uint32_t materialIndex;
+		uint32_t padding;
+	};
+
+	// Matches DrawRange in indirectCull.comp
+	struct DrawRangeRecord
+	{
+		uint32_t firstIndex;
+		uint32_t numIndices;
+		int32_t baseVertex;
+		uint32_t lod;
+		float error;
+	};
+
+	// Matches CullConstants in indirectCull.comp
+	struct CullConstants
+	{
+		glm::mat4 viewProjection;
+		glm::vec4 cameraPosition;
+		float lodErrorThreshold;
+		uint32_t numDraws;
+		uint32_t compact;
+	};
+
+	IndirectRenderer::~IndirectRenderer()
+	{
+		shutdown();
+		clearTargets();
+	}
+
+	void IndirectRenderer::init(const Shader& cullShader)
+	{
+		LayoutCache* layoutCache = context->getLayoutCache();
+
+		// The instance set is bound by the scene pipelines, its layout is described here rather than reflected from one of them
+		VkDescriptorSetLayoutBinding instanceBinding = {};
+		instanceBinding.binding = 0;
+		instanceBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		instanceBinding.descriptorCount = 1;
+		instanceBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		instanceDescriptorSetLayout = layoutCache->getDescriptorSetLayout({ instanceBinding });
+
+		// Cull layouts from what the shader declares
+		cullDescriptorSetLayout = layoutCache->getDescriptorSetLayout(cullShader.getReflection(), 0);
+		cullPipelineLayout = layoutCache->getPipelineLayout(cullShader.getReflection());
+
+		// Compute pipeline
+		ComputePipeline cullPipelineBuilder(context, cullPipelineLayout);
+		cullPipelineBuilder.setShaderStage(cullShader.getShaderModule());
+		cullPipeline = cullPipelineBuilder.build();
+
+		for (Frame& frame : frames)
+		{
+			createDescriptorSets(frame);
+			writeDescriptorSets(frame);
+		}
+	}
+
+	bool IndirectRenderer::reload(const Shader& cullShader)
+	{
+		// The cull sets of every frame were written for the layout of init()
+		if (context->getLayoutCache()->findPipelineLayout(cullShader.getReflection()) != cullPipelineLayout)
+		{
+			std::cerr << "IndirectRenderer::reload(): \"" << cullShader.getPath() << "\" changed its bindings or push constants, keeping the previous pipeline" << std::endl;
+			return false;
+		}
+
+		vkDestroyPipeline(context->getDevice(), cullPipeline, nullptr);
+
+		ComputePipeline cullPipelineBuilder(context, cullPipelineLayout);
+		cullPipelineBuilder.setShaderStage(cullShader.getShaderModule());
+		cullPipeline = cullPipelineBuilder.build();
+
+		return true;
+	}
+
+	void IndirectRenderer::shutdown()
+	{
+		for (Frame& frame : frames)
+			destroyDescriptorSets(frame);
+
+		vkDestroyPipeline(context->getDevice(), cullPipeline, nullptr);
+		cullPipeline = VK_NULL_HANDLE;
+
+		// Layouts belong to the layout cache
+		cullPipelineLayout = VK_NULL_HANDLE;
+		cullDescriptorSetLayout = VK_NULL_HANDLE;
+		instanceDescriptorSetLayout = VK_NULL_HANDLE;
+	}
+
+	void IndirectRenderer::resize(uint32_t numFrames)
+	{
+		clearTargets();
+
+		frames.resize(numFrames);
+		for (Frame& frame : frames)
+		{
+			// Descriptors can't point to empty buffers, every buffer starts small
+			reserve(frame.instances, MIN_BUFFER_SIZE, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, true);
+			reserve(frame.draws, MIN_BUFFER_SIZE, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, true);
+			reserve(frame.ranges, MIN_BUFFER_SIZE, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, true);
+			reserve(frame.commands, MIN_BUFFER_SIZE, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, false);
+			reserve(frame.counts, MIN_BUFFER_SIZE, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, false);
+
+			if (instanceDescriptorSetLayout != VK_NULL_HANDLE)
+			{
+				createDescriptorSets(frame);
+				writeDescriptorSets(frame);
+			}
+		}
+	}
+
+	void IndirectRenderer::clearTargets()
+	{
+		for (Frame& frame : frames)
+		{
+			destroyDescriptorSets(frame);
+
+			destroy(frame.instances);
+			destroy(frame.draws);
+			destroy(frame.ranges);
+			destroy(frame.commands);
+			destroy(frame.counts);
+		}
+
+		frames.clear();
+	}
+
+	bool IndirectRenderer::reserve(Buffer& buffer, VkDeviceSize size, VkBufferUsageFlags usage, bool hostVisible)
+	{
+		if (buffer.buffer != VK_NULL_HANDLE && buffer.size >= size)
+			return false;
+
+		destroy(buffer);
+
+		// Grows geometrically so a slowly growing scene doesn't reallocate every frame
+		VkDeviceSize newSize = MIN_BUFFER_SIZE;
+		while (newSize < size)
+			newSize *= 2;
+
+		VkMemoryPropertyFlags memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		if (hostVisible)
+			memoryProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+		VulkanUtils::createBuffer(context, newSize, usage, memoryProperties, buffer.buffer, buffer.memory);
+		buffer.size = newSize;
+
+		if (hostVisible)
+			vkMapMemory(context->getDevice(), buffer.memory, 0, newSize, 0, &buffer.data);
+
+		return true;
+	}
+
+	void IndirectRenderer::destroy(Buffer& buffer)
+	{
+		if (buffer.data)
+			vkUnmapMemory(context->getDevice(), buffer.memory);
+
+		vkDestroyBuffer(context->getDevice(), buffer.buffer, nullptr);
+		vkFreeMemory(context->getDevice(), buffer.memory, nullptr);
+
+		buffer = Buffer();
+	}
+
+	void IndirectRenderer::createDescriptorSets(Frame& frame)
+	{
+		std::array<VkDescriptorSetLayout, 2> layouts = { instanceDescriptorSetLayout, cullDescriptorSetLayout };
+		std::array<VkDescriptorSet, 2> sets = {};
+
+		VkDescriptorSetAllocateInfo descriptorSetAllocInfo = {};
+		descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		descriptorSetAllocInfo.descriptorPool = context->getDescriptorPool();
+		descriptorSetAllocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+		descriptorSetAllocInfo.pSetLayouts = layouts.data();
+
+		if (vkAllocateDescriptorSets(context->getDevice(), &descriptorSetAllocInfo, sets.data()) != VK_SUCCESS)
+			throw std::runtime_error("Can't allocate indirect draw descriptor sets");
+
+		frame.instanceDescriptorSet = sets[0];
+		frame.cullDescriptorSet = sets[1];
+	}
+
+	void IndirectRenderer::writeDescriptorSets(const Frame& frame)
+	{
+		if (frame.instanceDescriptorSet == VK_NULL_HANDLE)
+			return;
+
+		VulkanUtils::bindStorageBuffer(context, frame.instanceDescriptorSet, 0, frame.instances.buffer, 0, VK_WHOLE_SIZE);
+
+		std::array<const Buffer*, 5> buffers = { &frame.instances, &frame.draws, &frame.ranges, &frame.commands, &frame.counts };
+		for (int binding = 0; binding < buffers.size(); binding++)
+			VulkanUtils::bindStorageBuffer(context, frame.cullDescriptorSet, binding, buffers[binding]->buffer, 0, VK_WHOLE_SIZE);
+	}
+
+	void IndirectRenderer::destroyDescriptorSets(Frame& frame)
+	{
+		std::array<VkDescriptorSet, 2> sets = { frame.instanceDescriptorSet, frame.cullDescriptorSet };
+
+		if (frame.instanceDescriptorSet != VK_NULL_HANDLE)
+			vkFreeDescriptorSets(context->getDevice(), context->getDescriptorPool(), static_cast<uint32_t>(sets.size()), sets.data());
+
+		frame.instanceDescriptorSet = VK_NULL_HANDLE;
+		frame.cullDescriptorSet = VK_NULL_HANDLE;
+	}
+
+	VkDescriptorSet IndirectRenderer::getInstanceDescriptorSet(uint32_t frameIndex) const
+	{
+		if (frameIndex >= frames.size())
+			return VK_NULL_HANDLE;
+
+		return frames[frameIndex].instanceDescriptorSet;
+	}
+
+	bool IndirectRenderer::isSupported() const
+	{
+		return context->hasDrawIndirectFirstInstance();
+	}
+
+	bool IndirectRenderer::hasDrawCount() const
+	{
+		return context->getCmdDrawIndexedIndirectCount() != nullptr;
+	}
+
+	void IndirectRenderer::uploadInstances(uint32_t frameIndex, const RenderScene* scene, const std::vector<uint32_t>& objects)
+	{
+		if (frameIndex >= frames.size())
+			return;
+
+		Frame& frame = frames[frameIndex];
+		frame.scene = scene;
+		frame.objects = objects;
+
+		if (reserve(frame.instances, sizeof(ObjectInstance) * objects.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, true))
+			writeDescriptorSets(frame);
+
+		ObjectInstance* instances = reinterpret_cast<ObjectInstance*>(frame.instances.data);
+
+		for (size_t i = 0; i < objects.size(); i++)
+		{
+			const SceneObject& object = scene->getObject(objects[i]);
+			const Mesh* mesh = scene->getMesh(object.mesh);
+
+			instances[i].world = object.transform;
+			instances[i].positionScale = glm::vec4(mesh->getPositionDecodeScale(), 0.0f);
+			instances[i].positionOffset = glm::vec4(mesh->getPositionDecodeOffset(), 0.0f);
+			instances[i].albedoTint = object.albedoTint;
+		}
+	}
+
+	void IndirectRenderer::cull(VkCommandBuffer commandBuffer, uint32_t frameIndex, const glm::mat4& viewProjection, const glm::vec3& cameraPosition, float lodScale, float lodErrorThreshold)
+	{
+		numDraws = 0;
+		numCommands = 0;
+
+		if (frameIndex >= frames.size() || cullPipeline == VK_NULL_HANDLE)
+			return;
+
+		Frame& frame = frames[frameIndex];
+		frame.groups.clear();
+		frame.numDraws = 0;
+
+		// Instances grouped by mesh, a scene holds a handful of meshes
+		std::vector<std::vector<uint32_t>> groupInstances;
+
+		for (uint32_t instance = 0; instance < frame.objects.size(); instance++)
+		{
+			const Mesh* mesh = frame.scene->getMesh(frame.scene->getObject(frame.objects[instance]).mesh);
+
+			size_t group = 0;
+			while (group < frame.groups.size() && frame.groups[group].mesh != mesh)
+				group++;
+
+			if (group == frame.groups.size())
+			{
+				Group newGroup;
+				newGroup.mesh = mesh;
+				frame.groups.push_back(newGroup);
+				groupInstances.emplace_back();
+			}
+
+			groupInstances[group].push_back(instance);
+		}
+
+		// Draw ranges of every mesh once, then one record per submesh of every instance.
+		// The fixed command slots of a mesh are contiguous, they also bound its packed region
+		std::vector<DrawRangeRecord> ranges;
+		std::vector<DrawRecord> draws;
+
+		for (uint32_t groupIndex = 0; groupIndex < frame.groups.size(); groupIndex++)
+		{
+			Group& group = frame.groups[groupIndex];
+			const Mesh* mesh = group.mesh;
+			const std::vector<Mesh::Lod>& lods = mesh->getLods();
+			const std::vector<Mesh::Submesh>& submeshes = mesh->getSubmeshes();
+
+			uint32_t firstRange = static_cast<uint32_t>(ranges.size());
+			for (const Mesh::DrawRange& range : mesh->getDrawRanges())
+			{
+				const Mesh::Submesh& submesh = submeshes[range.submesh];
+
+				DrawRangeRecord record;
+				record.firstIndex = range.firstIndex;
+				record.numIndices = range.numIndices;
+				record.baseVertex = range.baseVertex;
+				record.lod = range.lod;
+				record.error = (submesh.numLods > 0) ? lods[submesh.firstLod + range.lod].error : 0.0f;
+				ranges.push_back(record);
+			}
+
+			group.firstCommand = numCommands;
+
+			for (uint32_t instance : groupInstances[groupIndex])
+			{
+				for (const Mesh::Submesh& submesh : submeshes)
+				{
+					DrawRecord record;
+					record.boundsMin = glm::vec4(submesh.boundsMin, 0.0f);
+					record.boundsMax = glm::vec4(submesh.boundsMax, 0.0f);
+					record.sphere = glm::vec4(submesh.sphereCenter, submesh.sphereRadius);
+					record.instance = instance;
+					record.firstRange = firstRange + submesh.firstDrawRange;
+					record.numRanges = submesh.numDrawRanges;
+					record.group = groupIndex;
+					record.firstCommand = numCommands;
+					record.groupFirstCommand = group.firstCommand;
+					record.materialIndex = submesh.materialIndex;
+					record.padding = 0;
+					draws.push_back(record);
+
+					numCommands += submesh.numDrawRanges;
+				}
+			}
+
+			group.numCommands = numCommands - group.firstCommand;
+		}
+
+		frame.numDraws = static_cast<uint32_t>(draws.size());
+		numDraws = frame.numDraws;
+
+		bool recreated = false;
+		recreated |= reserve(frame.draws, sizeof(DrawRecord) * draws.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, true);
+		recreated |= reserve(frame.ranges, sizeof(DrawRangeRecord) * ranges.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, true);
+		recreated |= reserve(frame.commands, sizeof(VkDrawIndexedIndirectCommand) * numCommands, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, false);
+		recreated |= reserve(frame.counts, sizeof(uint32_t) * frame.groups.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, false);
+
+		if (recreated)
+			writeDescriptorSets(frame);
+
+		if (frame.numDraws == 0)
+			return;
+
+		memcpy(frame.draws.data, draws.data(), sizeof(DrawRecord) * draws.size());
+		memcpy(frame.ranges.data, ranges.data(), sizeof(DrawRangeRecord) * ranges.size());
+
+		bool compact = hasDrawCount();
+
+		// Packed commands are counted from zero
+		if (compact)
+		{
+			vkCmdFillBuffer(commandBuffer, frame.counts.buffer, 0, VK_WHOLE_SIZE, 0);
+
+			VkBufferMemoryBarrier barrier = {};
+			barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.buffer = frame.counts.buffer;
+			barrier.offset = 0;
+			barrier.size = VK_WHOLE_SIZE;
+
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+		}
+
+		CullConstants constants;
+		constants.viewProjection = viewProjection;
+		constants.cameraPosition = glm::vec4(cameraPosition, lodScale);
+		constants.lodErrorThreshold = lodErrorThreshold;
+		constants.numDraws = frame.numDraws;
+		constants.compact = compact ? 1 : 0;
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &frame.cullDescriptorSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullConstants), &constants);
+		vkCmdDispatch(commandBuffer, (frame.numDraws + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+
+		// Commands and counts are read by the draws of the opaque pass
+		std::array<VkBufferMemoryBarrier, 2> barriers = {};
+		for (size_t i = 0; i < barriers.size(); i++)
+		{
+			barriers[i].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			barriers[i].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			barriers[i].dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+			barriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barriers[i].offset = 0;
+			barriers[i].size = VK_WHOLE_SIZE;
+		}
+		barriers[0].buffer = frame.commands.buffer;
+		barriers[1].buffer = frame.counts.buffer;
+
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+			0,
+			0, nullptr,
+			static_cast<uint32_t>(barriers.size()), barriers.data(),
+			0, nullptr);
+	}
+
+	void IndirectRenderer::draw(VkCommandBuffer commandBuffer, uint32_t frameIndex) const
+	{
+		if (frameIndex >= frames.size())
+			return;
+
+		const Frame& frame = frames[frameIndex];
+		if (frame.numDraws == 0)
+			return;
+
+		const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+		PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount = context->getCmdDrawIndexedIndirectCount();
+
+		for (uint32_t groupIndex = 0; groupIndex < frame.groups.size(); groupIndex++)
+		{
+			const Group& group = frame.groups[groupIndex];
+			if (group.numCommands == 0)
+				continue;
+
+			VkBuffer vertexBuffers[] = { group.mesh->getVertexBuffer() };
+			VkDeviceSize offsets[] = { 0 };
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+			vkCmdBindIndexBuffer(commandBuffer, group.mesh->getIndexBuffer(), 0, group.mesh->getIndexType());
+
+			VkDeviceSize offset = group.firstCommand * stride;
+
+			// Packed commands and their count, otherwise every slot with culled ones as empty draws
+			if (drawIndexedIndirectCount)
+				drawIndexedIndirectCount(commandBuffer, frame.commands.buffer, offset, frame.counts.buffer, groupIndex * sizeof(uint32_t), group.numCommands, stride);
+			else if (context->hasMultiDrawIndirect())
+				vkCmdDrawIndexedIndirect(commandBuffer, frame.commands.buffer, offset, group.numCommands, stride);
+			else
+				for (uint32_t i = 0; i < group.numCommands; i++)
+					vkCmdDrawIndexedIndirect(commandBuffer, frame.commands.buffer, offset + i * stride, 1, stride);
+		}
+	}
+}
\ No newline at end of file
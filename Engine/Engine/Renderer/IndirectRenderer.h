@@ -0,0 +1,122 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+#include "../RHI/Shader.h"
+
+#include <glm/glm.hpp>
+
+class Mesh;
+
+namespace RHI
+{
+	class VulkanContext;
+	class RenderScene;
+
+	// Per instance data lives in storage buffers, every draw picks its instance through firstInstance.
+	// In GPU driven mode a compute pass culls every submesh of every instance, selects its level of detail
+	// and writes the indirect draw commands, the opaque pass is then recorded with one indirect draw per mesh
+	// whatever the number of objects.
+	// vkCmdDrawIndexedIndirectCount is used when the device has it, otherwise culled draws are kept as empty commands
+	class IndirectRenderer
+	{
+	public:
+		IndirectRenderer(const VulkanContext* context)
+			: context(context) { }
+
+		~IndirectRenderer();
+
+		// Layouts and the culling pipeline, reloaded with the shaders
+		void init(const Shader& cullShader);
+		void shutdown();
+
+		// Rebuilds the culling pipeline only, the instance set layout the scene pipelines were built with is kept.
+		// Refused like HiZRenderer::reload() when the shader no longer matches the cull layouts
+		bool reload(const Shader& cullShader);
+
+		// One set of buffers per frame slot, they grow with the scene
+		void resize(uint32_t numFrames);
+		void clearTargets();
+
+		// Instance i of the frame holds objects[i], buffers of a frame slot are rewritten once its last submission completed
+		void uploadInstances(uint32_t frameIndex, const RenderScene* scene, const std::vector<uint32_t>& objects);
+
+		// Culls every submesh of the uploaded instances, must be recorded outside of a render pass
+		void cull(VkCommandBuffer commandBuffer, uint32_t frameIndex, const glm::mat4& viewProjection, const glm::vec3& cameraPosition, float lodScale, float lodErrorThreshold);
+
+		// Records the culled draws, the pipeline and the descriptor sets are bound by the caller
+		void draw(VkCommandBuffer commandBuffer, uint32_t frameIndex) const;
+
+		inline VkDescriptorSetLayout getInstanceDescriptorSetLayout() const { return instanceDescriptorSetLayout; }
+		VkDescriptorSet getInstanceDescriptorSet(uint32_t frameIndex) const;
+
+		// Indirect commands can only select their instance with the drawIndirectFirstInstance feature
+		bool isSupported() const;
+		bool hasDrawCount() const;
+
+		inline uint32_t getNumDraws() const { return numDraws; }
+		inline uint32_t getNumCommands() const { return numCommands; }
+
+	private:
+		enum
+		{
+			GROUP_SIZE = 64,
+			MIN_BUFFER_SIZE = 4096,
+		};
+
+		struct Buffer
+		{
+			VkBuffer buffer{ VK_NULL_HANDLE };
+			VkDeviceMemory memory{ VK_NULL_HANDLE };
+			VkDeviceSize size{ 0 };
+			void* data{ nullptr }; // mapped when host visible
+		};
+
+		// Draws of one mesh share its vertex and index buffers and a region of the command buffer
+		struct Group
+		{
+			const Mesh* mesh{ nullptr };
+			uint32_t firstCommand{ 0 };
+			uint32_t numCommands{ 0 };
+		};
+
+		struct Frame
+		{
+			Buffer instances;
+			Buffer draws;
+			Buffer ranges;
+			Buffer commands;
+			Buffer counts;
+
+			VkDescriptorSet instanceDescriptorSet{ VK_NULL_HANDLE };
+			VkDescriptorSet cullDescriptorSet{ VK_NULL_HANDLE };
+
+			const RenderScene* scene{ nullptr };
+			std::vector<uint32_t> objects;
+			std::vector<Group> groups;
+			uint32_t numDraws{ 0 };
+		};
+
+		// Returns true when the buffer was recreated and its descriptors need to be written again
+		bool reserve(Buffer& buffer, VkDeviceSize size, VkBufferUsageFlags usage, bool hostVisible);
+		void destroy(Buffer& buffer);
+
+		void createDescriptorSets(Frame& frame);
+		void writeDescriptorSets(const Frame& frame);
+		void destroyDescriptorSets(Frame& frame);
+
+	private:
+		const VulkanContext* context{ nullptr };
+
+		VkDescriptorSetLayout instanceDescriptorSetLayout{ VK_NULL_HANDLE };
+		VkDescriptorSetLayout cullDescriptorSetLayout{ VK_NULL_HANDLE };
+		VkPipelineLayout cullPipelineLayout{ VK_NULL_HANDLE };
+		VkPipeline cullPipeline{ VK_NULL_HANDLE };
+
+		std::vector<Frame> frames;
+
+		uint32_t numDraws{ 0 };
+		uint32_t numCommands{ 0 };
+	};
+}
\ No newline at end of file
@@ -0,0 +1,99 @@
+#include "ParallelCommandRecorder.h"
+#include "../RHI/VulkanContext.h"
+
+#include <stdexcept>
+
+namespace RHI
+{
+	ParallelCommandRecorder::~ParallelCommandRecorder()
+	{
+		clear();
+	}
+
+	void ParallelCommandRecorder::resize(uint32_t numFrames, uint32_t threads)
+	{
+		clear();
+
+		numThreads = threads;
+		pools.resize(numFrames * numThreads);
+
+		for (ThreadCommands& pool : pools)
+		{
+			VkCommandPoolCreateInfo poolInfo = {};
+			poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			poolInfo.queueFamilyIndex = context->getGraphicsQueueFamily();
+			poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+			if (vkCreateCommandPool(context->getDevice(), &poolInfo, nullptr, &pool.commandPool) != VK_SUCCESS)
+				throw std::runtime_error("Can't create secondary command pool");
+		}
+	}
+
+	void ParallelCommandRecorder::clear()
+	{
+		// Destroying a pool frees its buffers
+		for (ThreadCommands& pool : pools)
+			vkDestroyCommandPool(context->getDevice(), pool.commandPool, nullptr);
+
+		pools.clear();
+		numThreads = 0;
+	}
+
+	void ParallelCommandRecorder::beginFrame(uint32_t frameIndex)
+	{
+		for (uint32_t thread = 0; thread < numThreads; thread++)
+		{
+			ThreadCommands& pool = pools[frameIndex * numThreads + thread];
+
+			if (pool.numUsed == 0)
+				continue;
+
+			vkResetCommandPool(context->getDevice(), pool.commandPool, 0);
+			pool.numUsed = 0;
+		}
+	}
+
+	VkCommandBuffer ParallelCommandRecorder::begin(uint32_t frameIndex, uint32_t thread, VkRenderPass renderPass, uint32_t subpass, VkFramebuffer frameBuffer)
+	{
+		ThreadCommands& pool = pools[frameIndex * numThreads + thread];
+
+		if (pool.numUsed == pool.commandBuffers.size())
+		{
+			VkCommandBufferAllocateInfo allocInfo = {};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.commandPool = pool.commandPool;
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+			allocInfo.commandBufferCount = 1;
+
+			VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+			if (vkAllocateCommandBuffers(context->getDevice(), &allocInfo, &commandBuffer) != VK_SUCCESS)
+				throw std::runtime_error("Can't allocate secondary command buffer");
+
+			pool.commandBuffers.push_back(commandBuffer);
+		}
+
+		VkCommandBuffer commandBuffer = pool.commandBuffers[pool.numUsed++];
+
+		VkCommandBufferInheritanceInfo inheritanceInfo = {};
+		inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritanceInfo.renderPass = renderPass;
+		inheritanceInfo.subpass = subpass;
+		inheritanceInfo.framebuffer = frameBuffer;
+
+		VkCommandBufferBeginInfo beginInfo = {};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+			throw std::runtime_error("Can't begin recording secondary command buffer");
+
+		return commandBuffer;
+	}
+
+	void ParallelCommandRecorder::end(VkCommandBuffer commandBuffer)
+	{
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+			throw std::runtime_error("Can't record secondary command buffer");
+	}
+}
\ No newline at end of file
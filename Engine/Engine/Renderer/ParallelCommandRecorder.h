@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+namespace RHI
+{
+	class VulkanContext;
+
+	// Secondary command buffers recorded by several threads inside one render pass.
+	// Every frame slot has one command pool per thread, a pool is only touched by its thread while recording
+	// and reset as a whole once the last submission of its frame slot completed
+	class ParallelCommandRecorder
+	{
+	public:
+		ParallelCommandRecorder(const VulkanContext* context)
+			: context(context) { }
+
+		~ParallelCommandRecorder();
+
+		void resize(uint32_t numFrames, uint32_t numThreads);
+		void clear();
+
+		// Recycles every secondary buffer of the frame slot, called before any thread records into it
+		void beginFrame(uint32_t frameIndex);
+
+		// Returns a secondary buffer of the thread, begun to continue the subpass of the render pass
+		VkCommandBuffer begin(uint32_t frameIndex, uint32_t thread, VkRenderPass renderPass, uint32_t subpass, VkFramebuffer frameBuffer);
+		void end(VkCommandBuffer commandBuffer);
+
+		inline uint32_t getNumThreads() const { return numThreads; }
+
+	private:
+		struct ThreadCommands
+		{
+			VkCommandPool commandPool{ VK_NULL_HANDLE };
+			std::vector<VkCommandBuffer> commandBuffers;
+			uint32_t numUsed{ 0 };
+		};
+
+	private:
+		const VulkanContext* context{ nullptr };
+
+		std::vector<ThreadCommands> pools; // frame major
+		uint32_t numThreads{ 0 };
+	};
+}
\ No newline at end of file
@@ -1,10 +1,14 @@
 #include "Renderer.h"	
 #include "../Common/Mesh.h"
+#include "../Common/Frustum.h"
+#include "../Common/FrustumCuller.h"
+#include "../Common/JobSystem.h"
 #include "../RHI/GraphicsPipeline.h"
-#include "../RHI/PipelineLayout.h"
-#include "../RHI/DescriptorSetLayout.h"
+#include "../RHI/LayoutCache.h"
 #include "../RHI/DescriptorSet.h"
 #include "../RHI/RenderPass.h"
+#include "../RHI/RenderGraph.h"
+#include "../RHI/ShaderSpecialization.h"
 #include "../RHI/VulkanUtils.h"
 #include "../RHI/VulkanContext.h"
 #include "../Application.h"
@@ -19,26 +23,131 @@
 #include <GLM/glm.hpp>
 #include <GLM/gtc/matrix_transform.hpp>
 
+#include <algorithm>
 #include <chrono>	
+#include <iostream>
 #include <stdexcept>
 
 using namespace RHI;
 
+// Every triangle of the meshlet faces away from the camera
+static bool isMeshletBackfacing(const Mesh::Meshlet& meshlet, const glm::vec3& cameraPosition)
+{
+	glm::vec3 direction = meshlet.coneApex - cameraPosition;
+	float length = glm::length(direction);
+
+	return length > 0.0f && glm::dot(direction / length, meshlet.coneAxis) > meshlet.coneCutoff;
+}
+
+// Coarsest level of detail whose error stays under the threshold, lodScale turns mesh units seen at distance 1 into pixels
+static uint32_t selectLod(const Mesh* mesh, const Mesh::Submesh& submesh, const glm::vec3& cameraPosition, float lodScale, float threshold)
+{
+	const std::vector<Mesh::Lod>& lods = mesh->getLods();
+
+	// Distance to the closest point of the bounding sphere
+	float distance = glm::length(submesh.sphereCenter - cameraPosition) - submesh.sphereRadius;
+
+	if (distance <= 0.0f)
+		return 0;
+
+	uint32_t result = 0;
+	for (uint32_t lod = 1; lod < submesh.numLods; lod++)
+	{
+		if (lods[submesh.firstLod + lod].error * lodScale / distance > threshold)
+			break;
+
+		result = lod;
+	}
+
+	return result;
+}
+
+// Draw lists are never shorter than this, smaller ones cost more to execute than to record
+static const uint32_t minDrawListSize = 64;
+
+// Specialization constants of the image based lighting shaders, constant_id 0 in each of them
+static ShaderSpecialization getPBRSpecialization(const ShadingQuality& quality)
+{
+	ShaderSpecialization specialization;
+	specialization.setConstant(0, quality.specularSamples); // SAMPLE_COUNT
+	return specialization;
+}
+
+static ShaderSpecialization getBRDFSpecialization(const ShadingQuality& quality)
+{
+	ShaderSpecialization specialization;
+	specialization.setConstant(0, quality.brdfSamples); // SAMPLE_COUNT
+	return specialization;
+}
+
+static ShaderSpecialization getIrradianceSpecialization(const ShadingQuality& quality)
+{
+	ShaderSpecialization specialization;
+	specialization.setConstant(0, quality.irradianceAngleStep); // ANGLE_STEP
+	return specialization;
+}
+
+ShadingQuality ShadingQuality::fromTier(ShadingQualityTier tier)
+{
+	ShadingQuality quality;
+
+	switch (tier)
+	{
+		case ShadingQualityTier::Low:
+			quality.specularSamples = 32;
+			quality.brdfSamples = 256;
+			quality.irradianceAngleStep = 0.1f;
+			break;
+
+		case ShadingQualityTier::Medium:
+			quality.specularSamples = 64;
+			quality.brdfSamples = 512;
+			quality.irradianceAngleStep = 0.05f;
+			break;
+
+		case ShadingQualityTier::High:
+			break;
+	}
+
+	return quality;
+}
+
+ShadingQualityTier ShadingQuality::getDeviceTier(VkPhysicalDevice physicalDevice)
+{
+	VkPhysicalDeviceProperties physicalDeviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
+
+	switch (physicalDeviceProperties.deviceType)
+	{
+		case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return ShadingQualityTier::High;
+		case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return ShadingQualityTier::Medium;
+		default: break;
+	}
+
+	return ShadingQualityTier::Low;
+}
+
 Renderer::Renderer(const VulkanContext* context,
+	JobSystem* jobSystem,
 	VkExtent2D extent,
 	VkDescriptorSetLayout descriptorSetLayout,
 	VkRenderPass renderPass)
 	: context(context)
+	, jobSystem(jobSystem)
 	, extent(extent)
 	, renderPass(renderPass)
 	, descriptorSetLayout(descriptorSetLayout)
 	, hdriToCubeRenderer(context)
 	, diffuseIrradianceRenderer(context)
+	, hiZRenderer(context)
+	, indirectRenderer(context)
+	, commandRecorder(context)
 	, environmentCubemap(context)
 	, diffuseIrradianceCubemap(context)
 	, bakedBRDFRenderer(context)
 	, bakedBRDFTexture(context)
 {
+	drawContexts.resize(jobSystem->getNumThreads());
 }
 
 Renderer::~Renderer()
@@ -49,36 +158,104 @@ Renderer::~Renderer()
 
 void Renderer::init(const RenderScene* scene)
 {
+	for (DrawContext& drawContext : drawContexts)
+		drawContext.submeshCullerMesh = nullptr;
+
+	// Instance buffers and GPU culling, the pbr pipeline layout takes the instance set
+	indirectRenderer.init(*scene->getIndirectCullComputeShader());
+
+	// Layouts from the interface the scene shaders declare, pbr and skybox share them so the sets stay bound between the two.
+	// The split sum variant reads every scene texture, the other specular variants fit the same layouts
+	ShaderReflection reflection = getSceneReflection(scene);
+
+	// Set 0 is allocated by the swap chain and set 2 by the indirect renderer, they bring their own layouts
+	LayoutCache* layoutCache = context->getLayoutCache();
+	sceneDescriptorSetLayout = layoutCache->getDescriptorSetLayout(reflection, 1);
+	pipelineLayout = layoutCache->getPipelineLayout(reflection, { descriptorSetLayout, VK_NULL_HANDLE, indirectRenderer.getInstanceDescriptorSetLayout() });
+	
+	createScenePipelines(scene);
+	
+	// Cubemap Initialization
+	environmentCubemap.createCube(VK_FORMAT_R32G32B32A32_SFLOAT, 256, 256, 1);
+	diffuseIrradianceCubemap.createCube(VK_FORMAT_R32G32B32A32_SFLOAT, 256, 256, 1);
+	bakedBRDFTexture.create2D(VK_FORMAT_R16G16_SFLOAT, 256, 256, 1);
+
+	// bake BRDF
+	bakedBRDFRenderer.init(
+		*scene->getBakedBRDFVertexShader(),
+		*scene->getBakedBRDFFragmentShader(), 
+		bakedBRDFTexture,
+		getBRDFSpecialization(shadingQuality));
+
+	bakeBRDF();
+
+	// Cube Render
+	hdriToCubeRenderer.init(
+		*scene->getCubeVertexShader(),
+		*scene->getHDRIToFragmentShader(),
+		environmentCubemap);
+
+	// Irradiance Renderer
+	diffuseIrradianceRenderer.init(
+		*scene->getCubeVertexShader(),
+		*scene->getDiffuseIrradianceFragmentShader(),
+		diffuseIrradianceCubemap,
+		getIrradianceSpecialization(shadingQuality));
+
+	// Depth pyramid
+	hiZRenderer.init(
+		*scene->getHiZCopyComputeShader(context->getMaxMSAASamples()),
+		*scene->getHiZReduceComputeShader());
+
+	// Scene descriptor sets are allocated by resize() once the number of swap chain images is known
+}
+
+ShaderReflection Renderer::getSceneReflection(const RenderScene* scene) const
+{
+	ShaderReflection reflection = scene->getPBRVertexShader()->getReflection();
+	reflection.merge(scene->getPBRFragmentShader()->getReflection());
+	reflection.merge(scene->getPBRFragmentShader(shadingQuality.specularIBL)->getReflection());
+	reflection.merge(scene->getSkyboxVertexShader()->getReflection());
+	reflection.merge(scene->getSkyboxFragmentShader()->getReflection());
+
+	return reflection;
+}
+
+bool Renderer::matchesScenePipelineLayout(const RenderScene* scene) const
+{
+	// The scene sets were allocated for the layouts of init(), the cache finds the same layout for the same interface.
+	// Looking up rather than creating, so refused edits don't leave layouts behind until shutdown
+	VkPipelineLayout layout = context->getLayoutCache()->findPipelineLayout(getSceneReflection(scene), { descriptorSetLayout, VK_NULL_HANDLE, indirectRenderer.getInstanceDescriptorSetLayout() });
+	if (layout == pipelineLayout)
+		return true;
+
+	std::cerr << "Renderer::matchesScenePipelineLayout(): the scene shaders changed their bindings or push constants, keeping the previous scene pipelines" << std::endl;
+	return false;
+}
+
+void Renderer::createScenePipelines(const RenderScene* scene)
+{
+	const Mesh* mesh = scene->getMesh();
+
 	const Shader* pbrVertexShader = scene->getPBRVertexShader();
-	const Shader* pbrFragmentShader = scene->getPBRFragmentShader();
+	const Shader* pbrFragmentShader = scene->getPBRFragmentShader(shadingQuality.specularIBL);
 	const Shader* skyboxVertexShader = scene->getSkyboxVertexShader();
 	const Shader* skyboxFragmentShader = scene->getSkyboxFragmentShader();
 
-	VkShaderStageFlags stage = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-
-	// Descriptor set Layout
-	DescriptorSetLayout sceneDescriptorSetLayoutBuilder(context);
-	sceneDescriptorSetLayoutBuilder.addDescriptorBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, stage);
-	sceneDescriptorSetLayoutBuilder.addDescriptorBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, stage);
-	sceneDescriptorSetLayoutBuilder.addDescriptorBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, stage);
-	sceneDescriptorSetLayoutBuilder.addDescriptorBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, stage);
-	sceneDescriptorSetLayoutBuilder.addDescriptorBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, stage);
-	sceneDescriptorSetLayoutBuilder.addDescriptorBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, stage);
-	sceneDescriptorSetLayoutBuilder.addDescriptorBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, stage);
-	sceneDescriptorSetLayoutBuilder.addDescriptorBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, stage);
-	sceneDescriptorSetLayout = sceneDescriptorSetLayoutBuilder.build();
-
-	// Pipeline Layout
-	PipelineLayout pipelineLayoutBuilder(context);
-	pipelineLayoutBuilder.addDescriptorSetLayout(descriptorSetLayout);
-	pipelineLayoutBuilder.addDescriptorSetLayout(sceneDescriptorSetLayout);
-	pipelineLayout = pipelineLayoutBuilder.build();
-	
+	// Every location the vertex shaders read has to come from the mesh, a mismatch reads garbage
+	if (!pbrVertexShader->getReflection().matchesVertexInput(Mesh::getAttributeDescriptions(mesh->getVertexFormat())))
+		std::cerr << "Renderer::createScenePipelines(): \"" << pbrVertexShader->getPath() << "\" doesn't match the mesh vertex format" << std::endl;
+
+	if (!skyboxVertexShader->getReflection().matchesVertexInput(Mesh::getAttributeDescriptions()))
+		std::cerr << "Renderer::createScenePipelines(): \"" << skyboxVertexShader->getPath() << "\" doesn't match the skybox vertex format" << std::endl;
+
 	// Graphic Pipeline
+	ShaderSpecialization pbrSpecialization = getPBRSpecialization(shadingQuality);
+
 	GraphicsPipeline pbrPipelineBuilder(context, pipelineLayout, renderPass);
 	pbrPipelineBuilder.addShaderStage(pbrVertexShader->getShaderModule(), VK_SHADER_STAGE_VERTEX_BIT);
-	pbrPipelineBuilder.addShaderStage(pbrFragmentShader->getShaderModule(), VK_SHADER_STAGE_FRAGMENT_BIT);
-	pbrPipelineBuilder.addVertexInput(Mesh::getVertexInputBindingDescription(), Mesh::getAttributeDescriptions());
+	pbrPipelineBuilder.addShaderStage(pbrFragmentShader->getShaderModule(), VK_SHADER_STAGE_FRAGMENT_BIT, pbrSpecialization.getInfo());
+	pbrPipelineBuilder.addVertexInput(Mesh::getVertexInputBindingDescription(mesh->getVertexFormat()), Mesh::getAttributeDescriptions(mesh->getVertexFormat()));
 	pbrPipelineBuilder.setInputAssemblyState(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
 	pbrPipelineBuilder.addDynamicState(VK_DYNAMIC_STATE_SCISSOR);
 	pbrPipelineBuilder.addDynamicState(VK_DYNAMIC_STATE_VIEWPORT);
@@ -106,63 +283,56 @@ void Renderer::init(const RenderScene* scene)
 	skyboxPipelineBuilder.addBlendColorAttachment();
 
 	skyboxPipeline = skyboxPipelineBuilder.build();
-	
-	// Create scene descriptor set
-	VkDescriptorSetAllocateInfo sceneDescriptorSetAllocInfo = {};
-	sceneDescriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	sceneDescriptorSetAllocInfo.descriptorPool = context->getDescriptorPool();
-	sceneDescriptorSetAllocInfo.descriptorSetCount = 1;
-	sceneDescriptorSetAllocInfo.pSetLayouts = &sceneDescriptorSetLayout;
+}
 
-	if (vkAllocateDescriptorSets(context->getDevice(), &sceneDescriptorSetAllocInfo, &sceneDescriptorSet) != VK_SUCCESS)
-		throw std::runtime_error("Can't allocate scene descriptor set");
+void Renderer::destroyScenePipelines()
+{
+	vkDestroyPipeline(context->getDevice(), pbrPipeline, nullptr);
+	pbrPipeline = VK_NULL_HANDLE;
 
-	
-	// Cubemap Initialization
-	environmentCubemap.createCube(VK_FORMAT_R32G32B32A32_SFLOAT, 256, 256, 1);
-	diffuseIrradianceCubemap.createCube(VK_FORMAT_R32G32B32A32_SFLOAT, 256, 256, 1);
-	bakedBRDFTexture.create2D(VK_FORMAT_R16G16_SFLOAT, 256, 256, 1);
+	vkDestroyPipeline(context->getDevice(), skyboxPipeline, nullptr);
+	skyboxPipeline = VK_NULL_HANDLE;
+}
 
-	// bake BRDF
-	bakedBRDFRenderer.init(
-		*scene->getBakedBRDFVertexShader(),
-		*scene->getBakedBRDFFragmentShader(), 
-		bakedBRDFTexture);
+void Renderer::bakeBRDF()
+{
+	RenderGraph graph(context);
+	RenderGraph::ImageHandle brdf = graph.importTexture("Baked BRDF", bakedBRDFTexture, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
-	{
-		VulkanUtils::transitionImageLayout(
-			context,
-			bakedBRDFTexture.getImage(),
-			bakedBRDFTexture.getImageFormat(),
-			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-			0, bakedBRDFTexture.getNumMipLevels(),
-			0, bakedBRDFTexture.getNumLayers());
+	graph.addPass("Bake BRDF",
+		[=](RenderGraph::PassBuilder& builder) { builder.write(brdf, RenderGraph::Access::ColorAttachment); },
+		[this](VkCommandBuffer commandBuffer, const RenderGraph&) { bakedBRDFRenderer.render(commandBuffer); });
 
-		bakedBRDFRenderer.render();
+	graph.compile();
+	graph.executeImmediate();
+}
 
-		VulkanUtils::transitionImageLayout(
-			context,
-			bakedBRDFTexture.getImage(),
-			bakedBRDFTexture.getImageFormat(),
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-			0, bakedBRDFTexture.getNumMipLevels(),
-			0, bakedBRDFTexture.getNumLayers());
-	}
+void Renderer::resizeSceneDescriptorSets(uint32_t numFrames)
+{
+	// The swap chain is idle while it changes
+	if (!sceneDescriptorSets.empty())
+		vkFreeDescriptorSets(context->getDevice(), context->getDescriptorPool(), static_cast<uint32_t>(sceneDescriptorSets.size()), sceneDescriptorSets.data());
 
-	// Cube Render
-	hdriToCubeRenderer.init(
-		*scene->getCubeVertexShader(),
-		*scene->getHDRIToFragmentShader(),
-		environmentCubemap);
+	sceneDescriptorSets.assign(numFrames, VK_NULL_HANDLE);
+	sceneResourceVersions.assign(numFrames, ~0u); // written when their frame is recorded
 
-	// Irradiance Renderer
-	diffuseIrradianceRenderer.init(
-		*scene->getCubeVertexShader(),
-		*scene->getDiffuseIrradianceFragmentShader(),
-		diffuseIrradianceCubemap);
+	if (numFrames == 0)
+		return;
+
+	std::vector<VkDescriptorSetLayout> setLayouts(numFrames, sceneDescriptorSetLayout);
+
+	VkDescriptorSetAllocateInfo sceneDescriptorSetAllocInfo = {};
+	sceneDescriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	sceneDescriptorSetAllocInfo.descriptorPool = context->getDescriptorPool();
+	sceneDescriptorSetAllocInfo.descriptorSetCount = numFrames;
+	sceneDescriptorSetAllocInfo.pSetLayouts = setLayouts.data();
+
+	if (vkAllocateDescriptorSets(context->getDevice(), &sceneDescriptorSetAllocInfo, sceneDescriptorSets.data()) != VK_SUCCESS)
+		throw std::runtime_error("Can't allocate scene descriptor set");
+}
 
+void Renderer::bindSceneTextures(const RenderScene* scene, uint32_t frameIndex)
+{
 	std::array<const Texture*, 8> textures =
 	{
 		scene->getAlbedoTexture(),
@@ -178,110 +348,533 @@ void Renderer::init(const RenderScene* scene)
 	for (int k = 0; k < textures.size(); k++)
 		VulkanUtils::bindCombinedImageSampler(
 			context,
-			sceneDescriptorSet,
+			sceneDescriptorSets[frameIndex],
 			k,
 			textures[k]->getImageView(),
 			textures[k]->getSampler());
+
+	sceneResourceVersions[frameIndex] = scene->getResourceVersion();
 }
 
 void Renderer::setEnvironment(const Texture* texture)
 {
+	environmentTexture = texture;
+
+	// Irradiance is convolved from the environment cubemap, the graph orders both bakes and their transitions
+	RenderGraph graph(context);
+	RenderGraph::ImageHandle hdri = graph.importTexture("HDRI", *texture, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	RenderGraph::ImageHandle environment = graph.importTexture("Environment", environmentCubemap, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	RenderGraph::ImageHandle irradiance = graph.importTexture("Diffuse Irradiance", diffuseIrradianceCubemap, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+	graph.addPass("HDRI To Cube",
+		[=](RenderGraph::PassBuilder& builder)
+		{
+			builder.read(hdri, RenderGraph::Access::SampledRead);
+			builder.write(environment, RenderGraph::Access::ColorAttachment);
+		},
+		[this, texture](VkCommandBuffer commandBuffer, const RenderGraph&) { hdriToCubeRenderer.render(commandBuffer, *texture); });
+
+	graph.addPass("Diffuse Irradiance",
+		[=](RenderGraph::PassBuilder& builder)
+		{
+			builder.read(environment, RenderGraph::Access::SampledRead);
+			builder.write(irradiance, RenderGraph::Access::ColorAttachment);
+		},
+		[this](VkCommandBuffer commandBuffer, const RenderGraph&) { diffuseIrradianceRenderer.render(commandBuffer, environmentCubemap); });
+
+	graph.compile();
+	graph.executeImmediate();
+
+	// The cubemaps are baked in place, their views in the scene sets stay valid
+}
+
+void Renderer::reloadShaders(const RenderScene* scene, const std::vector<const Shader*>& shaders)
+{
+	auto usesAny = [&shaders](std::initializer_list<const Shader*> pipelineShaders)
 	{
-		VulkanUtils::transitionImageLayout(
-			context,
-			environmentCubemap.getImage(),
-			environmentCubemap.getImageFormat(),
-			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-			0, environmentCubemap.getNumMipLevels(),
-			0, environmentCubemap.getNumLayers());
+		for (const Shader* shader : pipelineShaders)
+			if (std::find(shaders.begin(), shaders.end(), shader) != shaders.end())
+				return true;
 
-		hdriToCubeRenderer.render(*texture);
+		return false;
+	};
 
-		VulkanUtils::transitionImageLayout(
-			context,
-			environmentCubemap.getImage(),
-			environmentCubemap.getImageFormat(),
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-			0, environmentCubemap.getNumMipLevels(),
-			0, environmentCubemap.getNumLayers());
-	}
+	bool scenePipelines = usesAny({ scene->getPBRVertexShader(), scene->getPBRFragmentShader(shadingQuality.specularIBL), scene->getSkyboxVertexShader(), scene->getSkyboxFragmentShader() });
+	bool brdf = usesAny({ scene->getBakedBRDFVertexShader(), scene->getBakedBRDFFragmentShader() });
+	bool hdriToCube = usesAny({ scene->getCubeVertexShader(), scene->getHDRIToFragmentShader() });
+	bool diffuseIrradiance = usesAny({ scene->getCubeVertexShader(), scene->getDiffuseIrradianceFragmentShader() });
+	bool hiZ = usesAny({ scene->getHiZCopyComputeShader(context->getMaxMSAASamples()), scene->getHiZReduceComputeShader() });
+	bool cull = usesAny({ scene->getIndirectCullComputeShader() });
 
-	{
-		VulkanUtils::transitionImageLayout(
-			context,
-			diffuseIrradianceCubemap.getImage(),
-			diffuseIrradianceCubemap.getImageFormat(),
-			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-			0, diffuseIrradianceCubemap.getNumMipLevels(),
-			0, diffuseIrradianceCubemap.getNumLayers());
+	if (!scenePipelines && !brdf && !hdriToCube && !diffuseIrradiance && !hiZ && !cull)
+		return;
 
-		diffuseIrradianceRenderer.render(environmentCubemap);
+	// Frames in flight may still use the pipelines about to be destroyed
+	vkDeviceWaitIdle(context->getDevice());
 
-		VulkanUtils::transitionImageLayout(
-			context,
-			diffuseIrradianceCubemap.getImage(),
-			diffuseIrradianceCubemap.getImageFormat(),
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-			0, diffuseIrradianceCubemap.getNumMipLevels(),
-			0, diffuseIrradianceCubemap.getNumLayers());
+	if (scenePipelines && matchesScenePipelineLayout(scene))
+	{
+		destroyScenePipelines();
+		createScenePipelines(scene);
 	}
 
-	std::array<const Texture*, 2> textures =
-	{
-		&environmentCubemap,
-		&diffuseIrradianceCubemap,
-	};
+	if (cull)
+		indirectRenderer.reload(*scene->getIndirectCullComputeShader());
 
-	for (int k = 0; k < textures.size(); k++)
-		VulkanUtils::bindCombinedImageSampler(
-			context,
-			sceneDescriptorSet,
-			k + 5,
-			textures[k]->getImageView(),
-			textures[k]->getSampler());
+	if (hiZ)
+		hiZRenderer.reload(*scene->getHiZCopyComputeShader(context->getMaxMSAASamples()), *scene->getHiZReduceComputeShader());
+
+	// Refused reloads keep what was baked with the previous shaders
+	if (brdf && bakedBRDFRenderer.reload(*scene->getBakedBRDFVertexShader(), *scene->getBakedBRDFFragmentShader(), getBRDFSpecialization(shadingQuality)))
+		bakeBRDF();
+
+	if (hdriToCube)
+		hdriToCube = hdriToCubeRenderer.reload(*scene->getCubeVertexShader(), *scene->getHDRIToFragmentShader());
+
+	if (diffuseIrradiance)
+		diffuseIrradiance = diffuseIrradianceRenderer.reload(*scene->getCubeVertexShader(), *scene->getDiffuseIrradianceFragmentShader(), getIrradianceSpecialization(shadingQuality));
+
+	// Irradiance is convolved from the environment cubemap, both are baked again when either bake changed
+	if ((hdriToCube || diffuseIrradiance) && environmentTexture)
+		setEnvironment(environmentTexture);
 }
-void Renderer::reload(const RenderScene* scene)
+
+void Renderer::setShadingQuality(const RenderScene* scene, const ShadingQuality& quality)
 {
-	shutdown();
-	init(scene);
+	bool scenePipelines = quality.specularIBL != shadingQuality.specularIBL || quality.specularSamples != shadingQuality.specularSamples;
+	bool brdf = quality.brdfSamples != shadingQuality.brdfSamples;
+	bool diffuseIrradiance = quality.irradianceAngleStep != shadingQuality.irradianceAngleStep;
+
+	ShadingQuality previousQuality = shadingQuality;
+	shadingQuality = quality;
+
+	// Nothing built yet, init() picks the quality up
+	if (pbrPipeline == VK_NULL_HANDLE)
+		return;
+
+	if (!scenePipelines && !brdf && !diffuseIrradiance)
+		return;
+
+	// Frames in flight may still use the pipelines about to be destroyed
+	vkDeviceWaitIdle(context->getDevice());
+
+	// A variant declaring other bindings than the layouts of init() keeps the previous pipelines, and their settings
+	if (scenePipelines && matchesScenePipelineLayout(scene))
+	{
+		destroyScenePipelines();
+		createScenePipelines(scene);
+	}
+	else if (scenePipelines)
+	{
+		shadingQuality.specularIBL = previousQuality.specularIBL;
+		shadingQuality.specularSamples = previousQuality.specularSamples;
+	}
+
+	if (brdf && bakedBRDFRenderer.reload(*scene->getBakedBRDFVertexShader(), *scene->getBakedBRDFFragmentShader(), getBRDFSpecialization(shadingQuality)))
+		bakeBRDF();
+
+	if (diffuseIrradiance && diffuseIrradianceRenderer.reload(*scene->getCubeVertexShader(), *scene->getDiffuseIrradianceFragmentShader(), getIrradianceSpecialization(shadingQuality)))
+	{
+		if (environmentTexture)
+			setEnvironment(environmentTexture);
+	}
 }
 
 void Renderer::shutdown()
 {
-	vkDestroyPipeline(context->getDevice(), pbrPipeline, nullptr);
-	pbrPipeline = VK_NULL_HANDLE;
+	destroyScenePipelines();
 
-	vkDestroyPipeline(context->getDevice(), skyboxPipeline, nullptr);
-	skyboxPipeline = VK_NULL_HANDLE;
-
-	vkDestroyPipelineLayout(context->getDevice(), pipelineLayout, nullptr);
+	// Layouts belong to the layout cache
 	pipelineLayout = VK_NULL_HANDLE;
+	sceneDescriptorSetLayout = VK_NULL_HANDLE;
 
-	vkDestroyDescriptorSetLayout(context->getDevice(), sceneDescriptorSetLayout, nullptr);
-	sceneDescriptorSetLayout = nullptr;
-
-	vkFreeDescriptorSets(context->getDevice(), context->getDescriptorPool(), 1, &sceneDescriptorSet);
-	sceneDescriptorSet = VK_NULL_HANDLE;
+	resizeSceneDescriptorSets(0);
 
 	hdriToCubeRenderer.shutdown();
 	diffuseIrradianceRenderer.shutdown();
 	bakedBRDFRenderer.shutdown();
+	hiZRenderer.shutdown();
+	indirectRenderer.shutdown();
 
 	bakedBRDFTexture.clearGPUData();
 	environmentCubemap.clearGPUData();
 	diffuseIrradianceCubemap.clearGPUData();
+	environmentTexture = nullptr;
+}
+
+void Renderer::drawMesh(VkCommandBuffer commandBuffer, DrawContext& drawContext, const Mesh* mesh, uint32_t instance, const glm::mat4& transform, const Frustum& frustum, const glm::vec3& cameraPosition, float lodScale)
+{
+	const std::vector<Mesh::Submesh>& submeshes = mesh->getSubmeshes();
+	const std::vector<Mesh::Meshlet>& meshlets = mesh->getMeshlets();
+	const std::vector<Mesh::DrawRange>& drawRanges = mesh->getDrawRanges();
+
+	// Whole submeshes first, the visible list comes out compact and in submesh order
+	if (mesh != drawContext.submeshCullerMesh)
+	{
+		drawContext.submeshCuller.clear();
+		for (const Mesh::Submesh& submesh : submeshes)
+			drawContext.submeshCuller.addObject(submesh.boundsMin, submesh.boundsMax);
+
+		drawContext.submeshCullerMesh = mesh;
+	}
+
+	drawContext.submeshCuller.cull(frustum, drawContext.visibleSubmeshes);
+
+	for (uint32_t submeshIndex : drawContext.visibleSubmeshes)
+	{
+		const Mesh::Submesh& submesh = submeshes[submeshIndex];
+
+		if (occlusionCulling && hiZRenderer.isOccluded(submesh.boundsMin, submesh.boundsMax, transform))
+			continue;
+
+		uint32_t lod = selectLod(mesh, submesh, cameraPosition, lodScale, lodErrorThreshold);
+
+		for (uint32_t rangeIndex = submesh.firstDrawRange; rangeIndex < submesh.firstDrawRange + submesh.numDrawRanges; rangeIndex++)
+		{
+			const Mesh::DrawRange& range = drawRanges[rangeIndex];
+
+			if (range.lod != lod)
+				continue;
+
+			// Meshlets only cover the full detail level
+			if (!clusterCulling || submesh.numMeshlets == 0 || range.lod != 0)
+			{
+				vkCmdDrawIndexed(commandBuffer, range.numIndices, 1, range.firstIndex, range.baseVertex, instance);
+				drawContext.numTriangles += range.numIndices / 3;
+				drawContext.numDrawCalls++;
+				continue;
+			}
+
+			// Visible meshlets are contiguous in the index buffer, neighbours are merged into a single draw
+			uint32_t batchFirstIndex = 0;
+			uint32_t batchNumIndices = 0;
+
+			for (uint32_t i = submesh.firstMeshlet; i < submesh.firstMeshlet + submesh.numMeshlets; i++)
+			{
+				const Mesh::Meshlet& meshlet = meshlets[i];
+
+				// 16-bit draw ranges can split a meshlet, only the part inside this range is drawn here
+				uint32_t begin = std::max(meshlet.firstIndex, range.firstIndex);
+				uint32_t end = std::min(meshlet.firstIndex + meshlet.numIndices, range.firstIndex + range.numIndices);
+
+				if (begin >= end)
+					continue;
+
+				if (begin == meshlet.firstIndex)
+					drawContext.numMeshlets++;
+
+				if (!frustum.intersectsSphere(meshlet.center, meshlet.radius) || isMeshletBackfacing(meshlet, cameraPosition))
+					continue;
+
+				glm::vec3 extent(meshlet.radius);
+				if (occlusionCulling && hiZRenderer.isOccluded(meshlet.center - extent, meshlet.center + extent, transform))
+					continue;
+
+				if (begin == meshlet.firstIndex)
+					drawContext.numVisibleMeshlets++;
+
+				if (batchNumIndices > 0 && batchFirstIndex + batchNumIndices == begin)
+				{
+					batchNumIndices += end - begin;
+					continue;
+				}
+
+				if (batchNumIndices > 0)
+				{
+					vkCmdDrawIndexed(commandBuffer, batchNumIndices, 1, batchFirstIndex, range.baseVertex, instance);
+					drawContext.numTriangles += batchNumIndices / 3;
+					drawContext.numDrawCalls++;
+				}
+
+				batchFirstIndex = begin;
+				batchNumIndices = end - begin;
+			}
+
+			if (batchNumIndices > 0)
+			{
+				vkCmdDrawIndexed(commandBuffer, batchNumIndices, 1, batchFirstIndex, range.baseVertex, instance);
+				drawContext.numTriangles += batchNumIndices / 3;
+				drawContext.numDrawCalls++;
+			}
+		}
+	}
+}
+
+void Renderer::buildInstanceBatches(const RenderScene* scene, const glm::mat4& viewProjection, const glm::vec3& cameraPosition, float lodScale)
+{
+	instanceBatches.clear();
+	instanceObjects.clear();
+
+	// Objects of a mesh become neighbours, the visible order is kept inside a mesh
+	std::stable_sort(visibleObjects.begin(), visibleObjects.end(), [scene](uint32_t a, uint32_t b)
+	{
+		return scene->getObject(a).mesh < scene->getObject(b).mesh;
+	});
+
+	// Model space view of every object, submesh bounds are in model space
+	struct ObjectView
+	{
+		uint32_t object;
+		Frustum frustum;
+		glm::vec3 cameraPosition;
+	};
+
+	std::vector<ObjectView> views;
+	std::vector<std::vector<uint32_t>> lodObjects;
+
+	for (size_t begin = 0; begin < visibleObjects.size();)
+	{
+		MeshHandle meshHandle = scene->getObject(visibleObjects[begin]).mesh;
+		const Mesh* mesh = scene->getMesh(meshHandle);
+
+		size_t end = begin;
+		while (end < visibleObjects.size() && scene->getObject(visibleObjects[end]).mesh == meshHandle)
+			end++;
+
+		views.clear();
+		for (size_t i = begin; i < end; i++)
+		{
+			const SceneObject& object = scene->getObject(visibleObjects[i]);
+
+			ObjectView view;
+			view.object = visibleObjects[i];
+			view.frustum = Frustum(viewProjection * object.transform);
+			view.cameraPosition = glm::vec3(glm::inverse(object.transform) * glm::vec4(cameraPosition, 1.0f));
+			views.push_back(view);
+		}
+
+		const std::vector<Mesh::Submesh>& submeshes = mesh->getSubmeshes();
+
+		for (uint32_t submeshIndex = 0; submeshIndex < submeshes.size(); submeshIndex++)
+		{
+			const Mesh::Submesh& submesh = submeshes[submeshIndex];
+
+			lodObjects.resize(std::max(submesh.numLods, 1u));
+			for (std::vector<uint32_t>& objects : lodObjects)
+				objects.clear();
+
+			for (const ObjectView& view : views)
+			{
+				const glm::mat4& transform = scene->getObject(view.object).transform;
+
+				if (!view.frustum.intersectsBox(submesh.boundsMin, submesh.boundsMax))
+					continue;
+
+				if (occlusionCulling && hiZRenderer.isOccluded(submesh.boundsMin, submesh.boundsMax, transform))
+					continue;
+
+				uint32_t lod = selectLod(mesh, submesh, view.cameraPosition, lodScale, lodErrorThreshold);
+				lodObjects[lod].push_back(view.object);
+			}
+
+			for (uint32_t lod = 0; lod < lodObjects.size(); lod++)
+			{
+				if (lodObjects[lod].empty())
+					continue;
+
+				InstanceBatch batch;
+				batch.mesh = mesh;
+				batch.submesh = submeshIndex;
+				batch.lod = lod;
+				batch.firstInstance = static_cast<uint32_t>(instanceObjects.size());
+				batch.numInstances = static_cast<uint32_t>(lodObjects[lod].size());
+				instanceBatches.push_back(batch);
+
+				instanceObjects.insert(instanceObjects.end(), lodObjects[lod].begin(), lodObjects[lod].end());
+			}
+		}
+
+		begin = end;
+	}
+}
+
+void Renderer::drawInstanceBatches(VkCommandBuffer commandBuffer, DrawContext& drawContext, uint32_t firstBatch, uint32_t lastBatch)
+{
+	const Mesh* boundMesh = nullptr;
+
+	for (uint32_t batchIndex = firstBatch; batchIndex < lastBatch; batchIndex++)
+	{
+		const InstanceBatch& batch = instanceBatches[batchIndex];
+		const Mesh* mesh = batch.mesh;
+
+		if (mesh != boundMesh)
+		{
+			VkBuffer vertexBuffers[] = { mesh->getVertexBuffer() };
+			VkDeviceSize offsets[] = { 0 };
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+			vkCmdBindIndexBuffer(commandBuffer, mesh->getIndexBuffer(), 0, mesh->getIndexType());
+
+			boundMesh = mesh;
+		}
+
+		const Mesh::Submesh& submesh = mesh->getSubmeshes()[batch.submesh];
+		const std::vector<Mesh::DrawRange>& drawRanges = mesh->getDrawRanges();
+
+		for (uint32_t rangeIndex = submesh.firstDrawRange; rangeIndex < submesh.firstDrawRange + submesh.numDrawRanges; rangeIndex++)
+		{
+			const Mesh::DrawRange& range = drawRanges[rangeIndex];
+
+			if (range.lod != batch.lod)
+				continue;
+
+			vkCmdDrawIndexed(commandBuffer, range.numIndices, batch.numInstances, range.firstIndex, range.baseVertex, batch.firstInstance);
+			drawContext.numTriangles += range.numIndices / 3 * batch.numInstances;
+			drawContext.numDrawCalls++;
+		}
+	}
+}
+
+void Renderer::drawObjects(VkCommandBuffer commandBuffer, DrawContext& drawContext, const RenderScene* scene, uint32_t first, uint32_t last, const glm::mat4& viewProjection, const glm::vec3& cameraPosition, float lodScale)
+{
+	// Every object shares the pbr pipeline, so their meshes must share its vertex format
+	const Mesh* boundMesh = nullptr;
+
+	for (uint32_t instance = first; instance < last; instance++)
+	{
+		const SceneObject& object = scene->getObject(visibleObjects[instance]);
+		const Mesh* mesh = scene->getMesh(object.mesh);
+
+		if (mesh != boundMesh)
+		{
+			VkBuffer vertexBuffers[] = { mesh->getVertexBuffer() };
+			VkBuffer indexBuffer = mesh->getIndexBuffer();
+			VkDeviceSize offsets[] = { 0 };
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+			vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, mesh->getIndexType());
+
+			boundMesh = mesh;
+		}
+
+		// Submesh and meshlet bounds are in model space, so are the planes and the camera
+		Frustum frustum(viewProjection * object.transform);
+		glm::vec3 objectCameraPosition = glm::vec3(glm::inverse(object.transform) * glm::vec4(cameraPosition, 1.0f));
+
+		drawMesh(commandBuffer, drawContext, mesh, instance, object.transform, frustum, objectCameraPosition, lodScale);
+	}
+}
+
+void Renderer::drawSkybox(VkCommandBuffer commandBuffer, const RenderScene* scene)
+{
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, skyboxPipeline);
+
+	const Mesh* skybox = scene->getSkybox();
+
+	VkBuffer vertexBuffers[] = { skybox->getVertexBuffer() };
+	VkBuffer indexBuffer = skybox->getIndexBuffer();
+	VkDeviceSize offsets[] = { 0 };
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+	vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, skybox->getIndexType());
+
+	for (const Mesh::DrawRange& range : skybox->getDrawRanges())
+		vkCmdDrawIndexed(commandBuffer, range.numIndices, 1, range.firstIndex, range.baseVertex, 0);
 }
 
-void Renderer::render(const RenderScene* scene, const VulkanRenderFrame& frame)
+void Renderer::render(const RenderScene* scene, const VulkanRenderFrame& frame, const UniformBufferObject& ubo)
 {
 	VkCommandBuffer commandBuffer = frame.commandBuffer;
 	VkFramebuffer frameBuffer = frame.frameBuffer;
 	VkDescriptorSet descriptorSet = frame.descriptorSet;
 
+	glm::mat4 viewProjection = ubo.proj * ubo.view;
+
+	// Pixels covered by one mesh unit at distance 1, the projection is flipped on y
+	float lodScale = fabs(ubo.proj[1][1]) * extent.height * 0.5f;
+
+	for (DrawContext& drawContext : drawContexts)
+	{
+		drawContext.numMeshlets = 0;
+		drawContext.numVisibleMeshlets = 0;
+		drawContext.numTriangles = 0;
+		drawContext.numDrawCalls = 0;
+	}
+
+	numOccludedObjects = 0;
+	numSoftwareOccludedObjects = 0;
+
+	// A loaded texture replaced its fallback. Only the set of this frame is written, the GPU is done with it
+	// once its image was acquired, frames in flight keep reading their own set until they come around again
+	if (sceneResourceVersions[frame.index] != scene->getResourceVersion())
+		bindSceneTextures(scene, frame.index);
+
+	bool indirect = gpuDriven && indirectRenderer.isSupported();
+
+	visibleObjects.clear();
+
+	if (indirect)
+	{
+		// Every object goes to the GPU, which culls and selects levels of detail before the render pass
+		scene->getObjects(visibleObjects);
+
+		indirectRenderer.uploadInstances(frame.index, scene, visibleObjects);
+		indirectRenderer.cull(commandBuffer, frame.index, viewProjection, ubo.cameraPosWS, lodScale, lodErrorThreshold);
+	}
+	else
+	{
+		// Objects are culled in world space by the scene BVH
+		scene->getBVH().queryFrustum(Frustum(viewProjection), visibleObjects);
+
+		// Then against the occluders of this frame, rasterized on the CPU
+		if (softwareOcclusionCulling)
+		{
+			occlusionRasterizer.clear();
+
+			for (uint32_t objectIndex : visibleObjects)
+			{
+				const SceneObject& object = scene->getObject(objectIndex);
+				const Mesh* mesh = scene->getMesh(object.mesh);
+
+				if (object.occluder && !mesh->getOccluderIndices().empty())
+				{
+					const std::vector<glm::vec3>& positions = mesh->getOccluderPositions();
+					const std::vector<uint32_t>& indices = mesh->getOccluderIndices();
+
+					occlusionRasterizer.addOccluder(viewProjection * object.transform, positions.data(), indices.data(), static_cast<uint32_t>(indices.size()));
+				}
+			}
+
+			occlusionRasterizer.rasterize();
+
+			auto occluded = [&](uint32_t objectIndex)
+			{
+				const SceneObject& object = scene->getObject(objectIndex);
+				const Mesh* mesh = scene->getMesh(object.mesh);
+
+				return occlusionRasterizer.isOccluded(viewProjection * object.transform, mesh->getBoundsMin(), mesh->getBoundsMax());
+			};
+
+			size_t numVisible = visibleObjects.size();
+			visibleObjects.erase(std::remove_if(visibleObjects.begin(), visibleObjects.end(), occluded), visibleObjects.end());
+			numSoftwareOccludedObjects = static_cast<uint32_t>(numVisible - visibleObjects.size());
+		}
+
+		// Then against the depth pyramid of the last frame drawn into this frame slot
+		hiZRenderer.selectFrame(frame.index);
+
+		if (occlusionCulling)
+		{
+			auto occluded = [&](uint32_t objectIndex)
+			{
+				const SceneObject& object = scene->getObject(objectIndex);
+				const Mesh* mesh = scene->getMesh(object.mesh);
+
+				return hiZRenderer.isOccluded(mesh->getBoundsMin(), mesh->getBoundsMax(), object.transform);
+			};
+
+			size_t numVisible = visibleObjects.size();
+			visibleObjects.erase(std::remove_if(visibleObjects.begin(), visibleObjects.end(), occluded), visibleObjects.end());
+			numOccludedObjects = static_cast<uint32_t>(numVisible - visibleObjects.size());
+		}
+
+		// Instance i is the visible object i, or the object of slot i of a batch
+		if (instancing)
+		{
+			buildInstanceBatches(scene, viewProjection, ubo.cameraPosWS, lodScale);
+			indirectRenderer.uploadInstances(frame.index, scene, instanceObjects);
+		}
+		else
+			indirectRenderer.uploadInstances(frame.index, scene, visibleObjects);
+	}
+
 	VkRenderPassBeginInfo renderPassInfo = {};
 	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
 	renderPassInfo.renderPass = renderPass;
@@ -296,7 +889,7 @@ void Renderer::render(const RenderScene* scene, const VulkanRenderFrame& frame)
 	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
 	renderPassInfo.pClearValues = clearValues.data();
 
-	std::array<VkDescriptorSet, 2> sets = { descriptorSet, sceneDescriptorSet };
+	std::array<VkDescriptorSet, 3> sets = { descriptorSet, sceneDescriptorSets[frame.index], indirectRenderer.getInstanceDescriptorSet(frame.index) };
 
 	VkViewport viewport = {};
 	viewport.x = 0.0f;
@@ -310,43 +903,106 @@ void Renderer::render(const RenderScene* scene, const VulkanRenderFrame& frame)
 	scissor.offset = { 0, 0 };
 	scissor.extent = extent;
 
-	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+	// List 0 is the skybox and the indirect draws, the others split the batches or the visible objects
+	uint32_t numItems = 0;
+	if (!indirect)
+		numItems = static_cast<uint32_t>(instancing ? instanceBatches.size() : visibleObjects.size());
 
-	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-	
-	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, static_cast<uint32_t>(sets.size()), sets.data(), 0, nullptr);
+	// A few lists per thread even out lists of uneven cost
+	uint32_t numLists = parallelRecording ? jobSystem->getNumThreads() * 4 : 1;
+	uint32_t drawListSize = std::max(minDrawListSize, (numItems + numLists - 1) / numLists);
+	numDrawLists = 1 + (numItems + drawListSize - 1) / drawListSize;
 
-	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, skyboxPipeline);
+	auto recordDrawList = [&](VkCommandBuffer drawCommandBuffer, DrawContext& drawContext, uint32_t list)
 	{
-		const Mesh* skybox = scene->getSkybox();
+		if (list == 0)
+		{
+			drawSkybox(drawCommandBuffer, scene);
+
+			if (indirect)
+			{
+				// A few commands whatever the number of objects
+				vkCmdBindPipeline(drawCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pbrPipeline);
+				indirectRenderer.draw(drawCommandBuffer, frame.index);
+			}
+
+			return;
+		}
+
+		uint32_t first = (list - 1) * drawListSize;
+		uint32_t last = std::min(first + drawListSize, numItems);
+
+		vkCmdBindPipeline(drawCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pbrPipeline);
+		if (instancing)
+			drawInstanceBatches(drawCommandBuffer, drawContext, first, last);
+		else
+			drawObjects(drawCommandBuffer, drawContext, scene, first, last, viewProjection, ubo.cameraPosWS, lodScale);
+	};
 
-		VkBuffer vertexBuffers[] = { skybox->getVertexBuffer() };
-		VkBuffer indexBuffer = skybox->getIndexBuffer();
-		VkDeviceSize offsets[] = { 0 };
-		vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-		vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+	if (parallelRecording)
+	{
+		// Viewport, scissor and bindings are not inherited, every secondary buffer sets its own
+		commandRecorder.beginFrame(frame.index);
+		secondaryCommandBuffers.resize(numDrawLists);
 
-		vkCmdDrawIndexed(commandBuffer, skybox->getNumIndices(), 1, 0, 0, 0);
-	}
+		jobSystem->parallelFor(numDrawLists, [&](uint32_t list, uint32_t thread)
+		{
+			VkCommandBuffer secondaryCommandBuffer = commandRecorder.begin(frame.index, thread, renderPass, 0, frameBuffer);
 
-	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pbrPipeline);
+			vkCmdSetViewport(secondaryCommandBuffer, 0, 1, &viewport);
+			vkCmdSetScissor(secondaryCommandBuffer, 0, 1, &scissor);
+			vkCmdBindDescriptorSets(secondaryCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, static_cast<uint32_t>(sets.size()), sets.data(), 0, nullptr);
+
+			recordDrawList(secondaryCommandBuffer, drawContexts[thread], list);
+
+			commandRecorder.end(secondaryCommandBuffer);
+			secondaryCommandBuffers[list] = secondaryCommandBuffer;
+		});
+
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		vkCmdExecuteCommands(commandBuffer, numDrawLists, secondaryCommandBuffers.data());
+	}
+	else
 	{
-		const Mesh* mesh = scene->getMesh();
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-		VkBuffer vertexBuffers[] = { mesh->getVertexBuffer() };
-		VkBuffer indexBuffer = mesh->getIndexBuffer();
-		VkDeviceSize offsets[] = { 0 };
-		vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-		vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, static_cast<uint32_t>(sets.size()), sets.data(), 0, nullptr);
 
-		vkCmdDrawIndexed(commandBuffer, mesh->getNumIndices(), 1, 0, 0, 0);
+		for (uint32_t list = 0; list < numDrawLists; list++)
+			recordDrawList(commandBuffer, drawContexts[0], list);
+	}
+
+	numMeshlets = 0;
+	numVisibleMeshlets = 0;
+	numTriangles = 0;
+	numDrawCalls = 0;
+
+	for (const DrawContext& drawContext : drawContexts)
+	{
+		numMeshlets += drawContext.numMeshlets;
+		numVisibleMeshlets += drawContext.numVisibleMeshlets;
+		numTriangles += drawContext.numTriangles;
+		numDrawCalls += drawContext.numDrawCalls;
 	}
 
 	vkCmdEndRenderPass(commandBuffer);
+
+	// Built every frame, so turning occlusion culling back on never tests against a stale pyramid
+	hiZRenderer.render(commandBuffer, frame.index, viewProjection);
+}
+
+uint32_t Renderer::getNumRecordingThreads() const
+{
+	return jobSystem->getNumThreads();
 }
 
 void Renderer::resize(const SwapChain* swapChain)
 {
 	extent = swapChain->getExtent();
+	hiZRenderer.resize(swapChain);
+	indirectRenderer.resize(swapChain->getNumImages());
+	resizeSceneDescriptorSets(swapChain->getNumImages());
+	commandRecorder.resize(swapChain->getNumImages(), jobSystem->getNumThreads());
 }
\ No newline at end of file
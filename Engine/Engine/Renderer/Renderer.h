@@ -6,33 +6,162 @@
 
 #include "CubemapRenderer.h"
 #include "Texture2DRenderer.h"
+#include "HiZRenderer.h"
+#include "IndirectRenderer.h"
+#include "ParallelCommandRecorder.h"
 #include "../Common/Texture.h"
 #include "../RHI/Shader.h"
+#include "../Common/RenderScene.h"
+#include "../Common/FrustumCuller.h"
+#include "../Common/OcclusionRasterizer.h"
+
+#include <glm/glm.hpp>
+
+class JobSystem;
+class Mesh;
 
 namespace RHI
 {
 	class RenderScene;
+	struct UniformBufferObject;
 	struct VulkanRenderFrame;
 	class SwapChain;
 	class VulkanContext;
 
+	enum class ShadingQualityTier
+	{
+		Low = 0,
+		Medium,
+		High,
+	};
+
+	// Image based lighting cost, picked per device or quality tier without editing the shaders. Sample counts are
+	// specialization constants of the pipelines, the specular term is a variant of Pbrshader.frag
+	struct ShadingQuality
+	{
+		SpecularIBL specularIBL{ SpecularIBL::SplitSum };
+		uint32_t specularSamples{ 124 }; // SAMPLE_COUNT of Pbrshader.frag
+		uint32_t brdfSamples{ 1024 }; // SAMPLE_COUNT of bakeBRDF.frag
+		float irradianceAngleStep{ 0.025f }; // ANGLE_STEP of diffuseIrradiance.frag, in radians
+
+		static ShadingQuality fromTier(ShadingQualityTier tier);
+
+		// High on discrete GPUs, medium on integrated ones and low on anything else
+		static ShadingQualityTier getDeviceTier(VkPhysicalDevice physicalDevice);
+	};
+
 	class Renderer
 	{
 	public:
-		Renderer(const VulkanContext* context, VkExtent2D extent, VkDescriptorSetLayout descriptorSetLayout, VkRenderPass renderPass);
+		Renderer(const VulkanContext* context, JobSystem* jobSystem, VkExtent2D extent, VkDescriptorSetLayout descriptorSetLayout, VkRenderPass renderPass);
 
 		virtual ~Renderer();
 
 		void init(const RenderScene* scene);
 		void resize(const SwapChain* swapChain);
-		void render(const RenderScene* scene, const VulkanRenderFrame& frame);
+		void render(const RenderScene* scene, const VulkanRenderFrame& frame, const UniformBufferObject& ubo);
 		void shutdown();
 
-		void reload(const RenderScene* scene);
+		// Rebuilds only the pipelines built with one of the shaders that compiled again. Baked textures are kept,
+		// except the ones baked by a reloaded shader which are baked again. Shaders that changed the bindings or
+		// push constants of a pipeline are refused with an error, the pipeline keeps its previous shaders
+		void reloadShaders(const RenderScene* scene, const std::vector<const Shader*>& shaders);
 		void setEnvironment(const Texture* texture);
 
+		// Rebuilds the pipelines whose constants or variant changed and bakes again what they bake.
+		// Set before init() it only picks what init() builds
+		void setShadingQuality(const RenderScene* scene, const ShadingQuality& quality);
+		inline const ShadingQuality& getShadingQuality() const { return shadingQuality; }
+
+		// Per meshlet frustum and backface cone culling on the CPU
+		inline void setClusterCulling(bool enabled) { clusterCulling = enabled; }
+		inline bool getClusterCulling() const { return clusterCulling; }
+		inline uint32_t getNumMeshlets() const { return numMeshlets; }
+		inline uint32_t getNumVisibleMeshlets() const { return numVisibleMeshlets; }
+
+		// The coarsest level of detail whose error projects below this many pixels is drawn
+		inline void setLodErrorThreshold(float pixels) { lodErrorThreshold = pixels; }
+		inline float getLodErrorThreshold() const { return lodErrorThreshold; }
+		inline uint32_t getNumTriangles() const { return numTriangles; }
+		inline uint32_t getNumDrawCalls() const { return numDrawCalls; }
+
+		// Objects sharing a mesh draw each submesh level of detail once with one instance per object.
+		// Meshlet culling is per object, so it is skipped for instanced batches
+		inline void setInstancing(bool enabled) { instancing = enabled; }
+		inline bool getInstancing() const { return instancing; }
+		inline uint32_t getNumInstanceBatches() const { return static_cast<uint32_t>(instanceBatches.size()); }
+		inline uint32_t getNumVisibleObjects() const { return static_cast<uint32_t>(visibleObjects.size()); }
+
+		// Objects, submeshes and meshlets hidden behind the depth pyramid of an earlier frame are skipped
+		inline void setOcclusionCulling(bool enabled) { occlusionCulling = enabled; }
+		inline bool getOcclusionCulling() const { return occlusionCulling; }
+		inline uint32_t getNumOccludedObjects() const { return numOccludedObjects; }
+
+		// Objects hidden behind the occluder objects of this frame, rasterized on the CPU before recording
+		inline void setSoftwareOcclusionCulling(bool enabled) { softwareOcclusionCulling = enabled; }
+		inline bool getSoftwareOcclusionCulling() const { return softwareOcclusionCulling; }
+		inline uint32_t getNumSoftwareOccludedObjects() const { return numSoftwareOccludedObjects; }
+		inline const OcclusionRasterizer& getOcclusionRasterizer() const { return occlusionRasterizer; }
+
+		// Culling and level of detail selection in compute, the opaque pass is drawn indirectly.
+		// The CPU only path is used when the device can't draw indirect instances
+		inline void setGPUDriven(bool enabled) { gpuDriven = enabled; }
+		inline bool getGPUDriven() const { return gpuDriven; }
+		inline bool isGPUDrivenSupported() const { return indirectRenderer.isSupported(); }
+		inline const IndirectRenderer& getIndirectRenderer() const { return indirectRenderer; }
+
+		// The opaque pass is split in draw lists recorded by worker threads into secondary command buffers,
+		// executed in list order so the frame is the same whatever thread recorded what
+		inline void setParallelRecording(bool enabled) { parallelRecording = enabled; }
+		inline bool getParallelRecording() const { return parallelRecording; }
+		uint32_t getNumRecordingThreads() const;
+		inline uint32_t getNumDrawLists() const { return numDrawLists; }
+
+	private:
+		// Instances of one submesh level of detail, contiguous in the instance buffer
+		struct InstanceBatch
+		{
+			const Mesh* mesh{ nullptr };
+			uint32_t submesh{ 0 };
+			uint32_t lod{ 0 };
+			uint32_t firstInstance{ 0 };
+			uint32_t numInstances{ 0 };
+		};
+
+		// Scratch state and statistics of one recording thread
+		struct DrawContext
+		{
+			FrustumCuller submeshCuller;
+			const Mesh* submeshCullerMesh{ nullptr };
+			std::vector<uint32_t> visibleSubmeshes;
+
+			uint32_t numMeshlets{ 0 };
+			uint32_t numVisibleMeshlets{ 0 };
+			uint32_t numTriangles{ 0 };
+			uint32_t numDrawCalls{ 0 };
+		};
+
+		void buildInstanceBatches(const RenderScene* scene, const glm::mat4& viewProjection, const glm::vec3& cameraPosition, float lodScale);
+		void drawInstanceBatches(VkCommandBuffer commandBuffer, DrawContext& drawContext, uint32_t firstBatch, uint32_t lastBatch);
+
+		// Draws visibleObjects[first, last), instance i is visible object i
+		void drawObjects(VkCommandBuffer commandBuffer, DrawContext& drawContext, const RenderScene* scene, uint32_t first, uint32_t last, const glm::mat4& viewProjection, const glm::vec3& cameraPosition, float lodScale);
+		void drawMesh(VkCommandBuffer commandBuffer, DrawContext& drawContext, const Mesh* mesh, uint32_t instance, const glm::mat4& transform, const Frustum& frustum, const glm::vec3& cameraPosition, float lodScale);
+		void drawSkybox(VkCommandBuffer commandBuffer, const RenderScene* scene);
+
+		// PBR and skybox pipelines, they share the pipeline layout. The interface is merged from every shader
+		// they may be built with, the selected specular variant on top of the split sum one init() starts with
+		ShaderReflection getSceneReflection(const RenderScene* scene) const;
+		bool matchesScenePipelineLayout(const RenderScene* scene) const;
+		void createScenePipelines(const RenderScene* scene);
+		void destroyScenePipelines();
+		void bakeBRDF();
+		void resizeSceneDescriptorSets(uint32_t numFrames);
+		void bindSceneTextures(const RenderScene* scene, uint32_t frameIndex);
+
 	private:
 		const VulkanContext* context{nullptr};
+		JobSystem* jobSystem{ nullptr };
 		VkExtent2D extent;
 		VkRenderPass renderPass{ VK_NULL_HANDLE };
 		VkPipelineLayout pipelineLayout{ VK_NULL_HANDLE };
@@ -40,6 +169,8 @@ namespace RHI
 		Texture2DRenderer bakedBRDFRenderer;
 		CubemapRenderer hdriToCubeRenderer;
 		CubemapRenderer diffuseIrradianceRenderer;
+		HiZRenderer hiZRenderer;
+		IndirectRenderer indirectRenderer;
 
 		Texture bakedBRDFTexture;
 		Texture environmentCubemap;
@@ -50,8 +181,43 @@ namespace RHI
 
 		VkDescriptorSetLayout descriptorSetLayout{ VK_NULL_HANDLE };
 		VkDescriptorSetLayout sceneDescriptorSetLayout{ VK_NULL_HANDLE };
-		VkDescriptorSet sceneDescriptorSet{ VK_NULL_HANDLE };
+		// One scene set per swap chain image, rewritten when its image is recorded again after a load replaced
+		// a fallback. The sets of the frames still in flight are left alone
+		std::vector<VkDescriptorSet> sceneDescriptorSets;
+		std::vector<uint32_t> sceneResourceVersions; // resources each set was written with
+
+		ShadingQuality shadingQuality;
 
 		uint32_t currentEnvironment{ 0 };
+		const Texture* environmentTexture{ nullptr }; // baked into the environment cubemaps
+
+		bool clusterCulling{ true };
+		uint32_t numMeshlets{ 0 };
+		uint32_t numVisibleMeshlets{ 0 };
+
+		float lodErrorThreshold{ 1.0f };
+		uint32_t numTriangles{ 0 };
+		uint32_t numDrawCalls{ 0 };
+
+		bool instancing{ true };
+		std::vector<InstanceBatch> instanceBatches;
+		std::vector<uint32_t> instanceObjects;
+
+		std::vector<uint32_t> visibleObjects;
+
+		bool occlusionCulling{ true };
+		uint32_t numOccludedObjects{ 0 };
+
+		OcclusionRasterizer occlusionRasterizer;
+		bool softwareOcclusionCulling{ true };
+		uint32_t numSoftwareOccludedObjects{ 0 };
+
+		bool gpuDriven{ false };
+
+		ParallelCommandRecorder commandRecorder;
+		std::vector<DrawContext> drawContexts; // one per recording thread
+		std::vector<VkCommandBuffer> secondaryCommandBuffers; // one per draw list
+		bool parallelRecording{ true };
+		uint32_t numDrawLists{ 0 };
 	};
 }
\ No newline at end of file
@@ -1,8 +1,7 @@
 #include "Texture2DRenderer.h"
 #include "../RHI/VulkanContext.h"
 #include "../RHI/GraphicsPipeline.h"
-#include "../RHI/PipelineLayout.h"
-#include "../RHI/DescriptorSetLayout.h"
+#include "../RHI/LayoutCache.h"
 #include "../RHI/DescriptorSet.h"
 #include "../RHI/RenderPass.h"
 #include "../RHI/VulkanUtils.h"
@@ -12,30 +11,18 @@
 #include <GLM/glm.hpp>
 #include <GLM/gtc/matrix_transform.hpp>
 
+#include <iostream>
 #include <stdexcept>
 
 namespace RHI
 {
-	void Texture2DRenderer::init(const Shader& vertexShader, const Shader& fragmentShader, const Texture& targetTexture)
+	void Texture2DRenderer::init(const Shader& vertexShader, const Shader& fragmentShader, const Texture& targetTexture, const ShaderSpecialization& fragmentSpecialization)
 	{
 		rendererQuad.createQuad(2.0f);
 
 		targetExtent.width = targetTexture.getWidth();
 		targetExtent.height = targetTexture.getHeight();
 
-		VkViewport viewport = {};
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		viewport.width = static_cast<float>(targetExtent.width);
-		viewport.height = static_cast<float>(targetExtent.height);
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
-
-		VkRect2D scissor = {};
-		scissor.offset = { 0, 0 };
-		scissor.extent.width = targetExtent.width;
-		scissor.extent.height = targetExtent.height;
-
 		VkShaderStageFlags stage = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
 
 		// Render pass 
@@ -45,23 +32,12 @@ namespace RHI
 		renderPassBuilder.addColorAttachmentReference(0, 0);
 		renderPass = renderPassBuilder.build();
 
-		// Pipeline layout
-		PipelineLayout pipelineLayoutBuilder(context);
-		pipelineLayout = pipelineLayoutBuilder.build();
+		// Pipeline layout from what both stages declare
+		ShaderReflection reflection = vertexShader.getReflection();
+		reflection.merge(fragmentShader.getReflection());
+		pipelineLayout = context->getLayoutCache()->getPipelineLayout(reflection);
 
-		// Graphic Pipeline
-		GraphicsPipeline pipelineBuilder(context, pipelineLayout, renderPass);
-		pipelineBuilder.addShaderStage(vertexShader.getShaderModule(), VK_SHADER_STAGE_VERTEX_BIT);
-		pipelineBuilder.addShaderStage(fragmentShader.getShaderModule(), VK_SHADER_STAGE_FRAGMENT_BIT);
-		pipelineBuilder.addVertexInput(Mesh::getVertexInputBindingDescription(), Mesh::getAttributeDescriptions());
-		pipelineBuilder.setInputAssemblyState(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
-		pipelineBuilder.addViewport(viewport);
-		pipelineBuilder.addScissor(scissor);
-		pipelineBuilder.setRasterizerState(false, false, VK_POLYGON_MODE_FILL, 1.0f, VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE);
-		pipelineBuilder.setMultisampleState(VK_SAMPLE_COUNT_1_BIT);
-		pipelineBuilder.setDepthStencilState(false, false, VK_COMPARE_OP_LESS);
-		pipelineBuilder.addBlendColorAttachment();
-		pipeline = pipelineBuilder.build();
+		createPipeline(vertexShader, fragmentShader, fragmentSpecialization);
 
 		// Create framebuffer
 		std::array<VkImageView, 1> views = { targetTexture.getImageView() };
@@ -77,37 +53,57 @@ namespace RHI
 
 		if (vkCreateFramebuffer(context->getDevice(), &framebufferInfo, nullptr, &frameBuffer) != VK_SUCCESS)
 			throw std::runtime_error("Can't create framebuffer");
+	}
 
-		// Create command buffer
-		VkCommandBufferAllocateInfo allocateInfo = {};
-		allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		allocateInfo.commandPool = context->getCommandPool();
-		allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		allocateInfo.commandBufferCount = 1;
+	bool Texture2DRenderer::reload(const Shader& vertexShader, const Shader& fragmentShader, const ShaderSpecialization& fragmentSpecialization)
+	{
+		ShaderReflection reflection = vertexShader.getReflection();
+		reflection.merge(fragmentShader.getReflection());
 
-		if (vkAllocateCommandBuffers(context->getDevice(), &allocateInfo, &commandBuffer) != VK_SUCCESS)
-			throw std::runtime_error("Can't create command buffers");
+		if (context->getLayoutCache()->findPipelineLayout(reflection) != pipelineLayout)
+		{
+			std::cerr << "Texture2DRenderer::reload(): \"" << vertexShader.getPath() << "\" or \"" << fragmentShader.getPath() << "\" changed their bindings or push constants, keeping the previous pipeline" << std::endl;
+			return false;
+		}
 
-		// Create fence
-		VkFenceCreateInfo fenceInfo{};
-		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-		fenceInfo.flags = 0;
+		vkDestroyPipeline(context->getDevice(), pipeline, nullptr);
+		createPipeline(vertexShader, fragmentShader, fragmentSpecialization);
 
-		if (vkCreateFence(context->getDevice(), &fenceInfo, nullptr, &fence) != VK_SUCCESS)
-			throw std::runtime_error("Can't create fence");
+		return true;
 	}
 
-	void Texture2DRenderer::render()
+	void Texture2DRenderer::createPipeline(const Shader& vertexShader, const Shader& fragmentShader, const ShaderSpecialization& fragmentSpecialization)
 	{
-		// Record command buffer
-		VkCommandBufferBeginInfo beginInfo = {};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-		beginInfo.pInheritanceInfo = nullptr; // Optional
+		VkViewport viewport = {};
+		viewport.x = 0.0f;
+		viewport.y = 0.0f;
+		viewport.width = static_cast<float>(targetExtent.width);
+		viewport.height = static_cast<float>(targetExtent.height);
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
 
-		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
-			throw std::runtime_error("Can't begin recording command buffer");
+		VkRect2D scissor = {};
+		scissor.offset = { 0, 0 };
+		scissor.extent.width = targetExtent.width;
+		scissor.extent.height = targetExtent.height;
 
+		// Graphic Pipeline
+		GraphicsPipeline pipelineBuilder(context, pipelineLayout, renderPass);
+		pipelineBuilder.addShaderStage(vertexShader.getShaderModule(), VK_SHADER_STAGE_VERTEX_BIT);
+		pipelineBuilder.addShaderStage(fragmentShader.getShaderModule(), VK_SHADER_STAGE_FRAGMENT_BIT, fragmentSpecialization.getInfo());
+		pipelineBuilder.addVertexInput(Mesh::getVertexInputBindingDescription(), Mesh::getAttributeDescriptions());
+		pipelineBuilder.setInputAssemblyState(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+		pipelineBuilder.addViewport(viewport);
+		pipelineBuilder.addScissor(scissor);
+		pipelineBuilder.setRasterizerState(false, false, VK_POLYGON_MODE_FILL, 1.0f, VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE);
+		pipelineBuilder.setMultisampleState(VK_SAMPLE_COUNT_1_BIT);
+		pipelineBuilder.setDepthStencilState(false, false, VK_COMPARE_OP_LESS);
+		pipelineBuilder.addBlendColorAttachment();
+		pipeline = pipelineBuilder.build();
+	}
+
+	void Texture2DRenderer::render(VkCommandBuffer commandBuffer)
+	{
 		VkRenderPassBeginInfo renderPassInfo = {};
 		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
 		renderPassInfo.renderPass = renderPass;
@@ -130,29 +126,12 @@ namespace RHI
 			VkBuffer indexBuffer = rendererQuad.getIndexBuffer();
 			VkDeviceSize offsets[] = { 0 };
 			vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-			vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+			vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, rendererQuad.getIndexType());
 
 			vkCmdDrawIndexed(commandBuffer, rendererQuad.getNumIndices(), 1, 0, 0, 0);
 		}
 
 		vkCmdEndRenderPass(commandBuffer);
-
-		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
-			throw std::runtime_error("Can't record command buffer");
-
-		VkSubmitInfo submitInfo = {};
-		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &commandBuffer;
-
-		if (vkResetFences(context->getDevice(), 1, &fence) != VK_SUCCESS)
-			throw std::runtime_error("Can't reset fence");
-
-		if (vkQueueSubmit(context->getGraphicsQueue(), 1, &submitInfo, fence) != VK_SUCCESS)
-			throw std::runtime_error("Can't submit command buffer");
-
-		if (vkWaitForFences(context->getDevice(), 1, &fence, VK_TRUE, UINT64_MAX) != VK_SUCCESS)
-			throw std::runtime_error("Can't wait for a fence");
 	}
 
 	void Texture2DRenderer::shutdown()
@@ -163,18 +142,12 @@ namespace RHI
 		vkDestroyPipeline(context->getDevice(), pipeline, nullptr);
 		pipeline = VK_NULL_HANDLE;
 
-		vkDestroyPipelineLayout(context->getDevice(), pipelineLayout, nullptr);
+		// The layout belongs to the layout cache
 		pipelineLayout = VK_NULL_HANDLE;
 
 		vkDestroyRenderPass(context->getDevice(), renderPass, nullptr);
 		renderPass = VK_NULL_HANDLE;
 
-		vkFreeCommandBuffers(context->getDevice(), context->getCommandPool(), 1, &commandBuffer);
-		commandBuffer = VK_NULL_HANDLE;
-
-		vkDestroyFence(context->getDevice(), fence, nullptr);
-		fence = VK_NULL_HANDLE;
-
 		rendererQuad.clearGPUData();
 		rendererQuad.clearCPUData();
 	}
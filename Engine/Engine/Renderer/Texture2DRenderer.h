@@ -7,6 +7,7 @@
 #include "../Common/Mesh.h"
 #include "../Common/Texture.h"
 #include "../RHI/Shader.h"
+#include "../RHI/ShaderSpecialization.h"
 
 namespace RHI
 {
@@ -19,9 +20,19 @@ namespace RHI
 			: context(context), rendererQuad(context)
 		{}
 
-		void init(const Shader& vertexShader, const Shader& fragmentShader, const Texture& targetTexture);
+		// The fragment specialization is only read while the pipeline is built
+		void init(const Shader& vertexShader, const Shader& fragmentShader, const Texture& targetTexture, const ShaderSpecialization& fragmentSpecialization = ShaderSpecialization());
 		void shutdown();
-		void render();
+
+		// Rebuilds the pipeline only, what was baked into the target stays until the next render.
+		// Refused like CubemapRenderer::reload() when the shaders no longer match the pipeline layout
+		bool reload(const Shader& vertexShader, const Shader& fragmentShader, const ShaderSpecialization& fragmentSpecialization = ShaderSpecialization());
+
+		// Records the bake, the target is expected in the color attachment layout and left in it
+		void render(VkCommandBuffer commandBuffer);
+
+	private:
+		void createPipeline(const Shader& vertexShader, const Shader& fragmentShader, const ShaderSpecialization& fragmentSpecialization);
 
 	private:
 		const VulkanContext* context = nullptr;
@@ -33,7 +44,5 @@ namespace RHI
 		VkPipeline pipeline{ VK_NULL_HANDLE };
 
 		VkFramebuffer frameBuffer{ VK_NULL_HANDLE };
-		VkCommandBuffer commandBuffer{ VK_NULL_HANDLE };
-		VkFence fence{ VK_NULL_HANDLE };
 	};
 }
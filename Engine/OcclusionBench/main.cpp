@@ -0,0 +1,157 @@
+#include "../Engine/Common/OcclusionRasterizer.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Checks the software occlusion rasterizer against a few known scenes, then benchmarks it. Needs no GPU:
+//
+//     OcclusionBench [occluders] [objects] [iterations]
+
+static const uint32_t WIDTH = 320;
+static const uint32_t HEIGHT = 192;
+
+// Two triangles, occluders are two sided so the winding doesn't matter
+static const uint32_t quadIndices[] = { 0, 1, 2, 0, 2, 3 };
+
+static glm::mat4 getClipFromWorld()
+{
+	// The camera sits at the origin looking down -z, like in OcclusionRasterizer::runBenchmark()
+	return glm::perspectiveRH_ZO(glm::radians(60.0f), static_cast<float>(WIDTH) / HEIGHT, 0.1f, 100.0f);
+}
+
+static bool check(bool condition, const char* name)
+{
+	std::cout << (condition ? "passed " : "FAILED ") << name << std::endl;
+	return condition;
+}
+
+static bool isBoxOccluded(const OcclusionRasterizer& rasterizer, const glm::vec3& center, float extent)
+{
+	return rasterizer.isOccluded(getClipFromWorld(), center - glm::vec3(extent), center + glm::vec3(extent));
+}
+
+static uint32_t checkFullScreenOccluder(OcclusionRasterizer::Path path)
+{
+	// Wall at z = -5 much larger than the view
+	const glm::vec3 wall[] = { { -100.0f, -100.0f, -5.0f }, { 100.0f, -100.0f, -5.0f }, { 100.0f, 100.0f, -5.0f }, { -100.0f, 100.0f, -5.0f } };
+
+	OcclusionRasterizer rasterizer(WIDTH, HEIGHT);
+	rasterizer.addOccluder(getClipFromWorld(), wall, quadIndices, 6);
+	rasterizer.rasterize(path);
+
+	uint32_t numFailed = 0;
+	numFailed += !check(isBoxOccluded(rasterizer, glm::vec3(0.0f, 0.0f, -20.0f), 1.0f), "box behind a full screen occluder is occluded");
+	numFailed += !check(!isBoxOccluded(rasterizer, glm::vec3(0.0f, 0.0f, -2.0f), 0.2f), "box in front of a full screen occluder is visible");
+	numFailed += !check(!isBoxOccluded(rasterizer, glm::vec3(0.0f, 0.0f, -5.0f), 0.5f), "box crossing the occluder is visible");
+	numFailed += !check(!isBoxOccluded(rasterizer, glm::vec3(0.0f, 0.0f, 0.0f), 1.0f), "box around the camera is visible");
+
+	return numFailed;
+}
+
+static uint32_t checkNearPlaneCrossing(OcclusionRasterizer::Path path)
+{
+	// Slanted wall going from behind the camera at the bottom to z = -15 at the top, z = -5 - 0.2 * y.
+	// Its lower vertices are clipped against the near plane
+	const glm::vec3 wall[] = { { -100.0f, -50.0f, 5.0f }, { 100.0f, -50.0f, 5.0f }, { 100.0f, 50.0f, -15.0f }, { -100.0f, 50.0f, -15.0f } };
+
+	OcclusionRasterizer rasterizer(WIDTH, HEIGHT);
+	rasterizer.addOccluder(getClipFromWorld(), wall, quadIndices, 6);
+	rasterizer.rasterize(path);
+
+	uint32_t numFailed = 0;
+	numFailed += !check(rasterizer.getNumTriangles() > 0, "near plane crossing occluder keeps its visible part");
+	numFailed += !check(isBoxOccluded(rasterizer, glm::vec3(0.0f, 0.0f, -40.0f), 1.0f), "box behind a near plane crossing occluder is occluded");
+	numFailed += !check(!isBoxOccluded(rasterizer, glm::vec3(0.0f, 0.0f, -2.0f), 0.2f), "box in front of a near plane crossing occluder is visible");
+
+	return numFailed;
+}
+
+static uint32_t checkPathsMatch()
+{
+	if (!OcclusionRasterizer::isAVX2Supported())
+	{
+		std::cout << "skipped scalar and AVX2 comparison, AVX2 is not supported" << std::endl;
+		return 0;
+	}
+
+	// Random quads in front of the camera, some of them crossing the near plane
+	std::mt19937 generator(5678);
+	std::uniform_real_distribution<float> spread(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> distance(-1.0f, 30.0f);
+
+	const uint32_t numQuads = 200;
+	std::vector<glm::vec3> positions(numQuads * 4);
+
+	for (glm::vec3& position : positions)
+	{
+		float z = distance(generator);
+		position = glm::vec3(spread(generator) * (z + 2.0f), spread(generator) * (z + 2.0f), -z);
+	}
+
+	OcclusionRasterizer scalar(WIDTH, HEIGHT, 1);
+	OcclusionRasterizer avx2(WIDTH, HEIGHT);
+
+	for (uint32_t i = 0; i < numQuads; i++)
+	{
+		scalar.addOccluder(getClipFromWorld(), positions.data() + i * 4, quadIndices, 6);
+		avx2.addOccluder(getClipFromWorld(), positions.data() + i * 4, quadIndices, 6);
+	}
+
+	scalar.rasterize(OcclusionRasterizer::Path::Scalar);
+	avx2.rasterize(OcclusionRasterizer::Path::AVX2);
+
+	// FMA rounds differently from separate multiplies and adds
+	float maxDifference = 0.0f;
+	for (size_t i = 0; i < scalar.getDepth().size(); i++)
+		maxDifference = std::max(maxDifference, std::fabs(scalar.getDepth()[i] - avx2.getDepth()[i]));
+
+	uint32_t numFailed = 0;
+	numFailed += !check(scalar.getNumTriangles() == avx2.getNumTriangles(), "scalar and AVX2 set up the same triangles");
+	numFailed += !check(maxDifference < 1e-5f, "scalar and AVX2 depths match");
+
+	return numFailed;
+}
+
+static uint32_t getArgument(int argc, char** argv, int index, uint32_t defaultValue)
+{
+	return (argc > index) ? static_cast<uint32_t>(std::stoul(argv[index])) : defaultValue;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t numFailed = 0;
+
+	numFailed += checkFullScreenOccluder(OcclusionRasterizer::Path::Scalar);
+	numFailed += checkNearPlaneCrossing(OcclusionRasterizer::Path::Scalar);
+
+	if (OcclusionRasterizer::isAVX2Supported())
+	{
+		numFailed += checkFullScreenOccluder(OcclusionRasterizer::Path::AVX2);
+		numFailed += checkNearPlaneCrossing(OcclusionRasterizer::Path::AVX2);
+	}
+
+	numFailed += checkPathsMatch();
+
+	uint32_t numOccluders = getArgument(argc, argv, 1, 256);
+	uint32_t numObjects = getArgument(argc, argv, 2, 10000);
+	uint32_t numIterations = getArgument(argc, argv, 3, 20);
+
+	OcclusionRasterizer::BenchmarkResult result = OcclusionRasterizer::runBenchmark(numOccluders, numObjects, numIterations);
+
+	std::cout << result.numTriangles << " occluder triangles, " << result.numOccluded << " of " << result.numObjects << " objects occluded" << std::endl;
+	std::cout << "scalar " << result.scalarMs << " ms" << std::endl;
+
+	if (OcclusionRasterizer::isAVX2Supported())
+		std::cout << "AVX2 " << result.avx2Ms << " ms, AVX2 threaded " << result.avx2ThreadedMs << " ms" << std::endl;
+
+	std::cout << "testing " << result.testMs << " ms" << std::endl;
+
+	return (numFailed > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
\ No newline at end of file